@@ -7,6 +7,7 @@
 #include "common_utils.h" // For logInfo, logError (assuming it's a .cpp file or has inline functions)
 #include "client_common.h"
 #include "client_utils.h"
+#include "client_session.h"
 
 // Include feature headers (which now contain function implementations)
 #include "chat_mode.h"
@@ -17,6 +18,8 @@
 // Define global variables declared in client_common.h
 volatile bool running = true;
 std::atomic<bool> voiceActive{false};
+ClientOptions clientOptions;
+ClientSession clientSession;
 
 // Define the global signal handler declared in client_common.h
 void handleSigint(int signal) {
@@ -29,11 +32,45 @@ void handleSigint(int signal) {
 // ---------- Main Loop ----------
 int main(int argc, char* argv[]) {
     try {
-        if (argc != 2) {
-            std::cout << "Usage: " << argv[0] << " <server_ip>" << std::endl;
+        bool validArgs = argc >= 2;
+        for (int i = 2; i < argc && validArgs; i++) {
+            validArgs = parseClientOption(argv[i], clientOptions); // From client_utils.h
+        }
+        if (!validArgs) {
+            std::cout << "Usage: " << argv[0] << " <server_ip> [options]" << std::endl;
+            std::cout << "Options:" << std::endl;
+            std::cout << "  --video-udp       Stream video over UDP with FEC instead of TCP" << std::endl;
+            std::cout << "  --video-loss=N    Drop N% of outgoing UDP video datagrams (testing)" << std::endl;
+            std::cout << "  --video-source=S  Video source: camera[:N] (default), file:PATH or pattern[:WxH]" << std::endl;
+            std::cout << "  --video-max-speed Capture and send video as fast as possible (throughput testing)" << std::endl;
+            std::cout << "  --voice-codec=C   Voice codec to offer: opus (default when built with Opus) or pcm" << std::endl;
+            std::cout << "  --voice-bitrate=KBPS Opus voice bitrate to ask for (default 24)" << std::endl;
+            std::cout << "  --voice-vad=on|off Suppress silent voice frames (default on)" << std::endl;
+            std::cout << "  --voice-red=N     Copies of earlier voice frames sent in each packet, 0-2 (default 1)" << std::endl;
+            std::cout << "  --voice-loss=N[:B] Drop N% of outgoing voice packets, in bursts of B on average (testing)" << std::endl;
+            std::cout << "  --audio-latency=MS Microphone and speaker latency to ask of the audio devices (default: lowest the host API recommends)" << std::endl;
+            std::cout << "  --audio-input=S   Microphone: portaudio[:N] (default), wav:PATH (plays the file once), tone[:HZ] or null" << std::endl;
+            std::cout << "  --audio-output=S  Speaker: portaudio[:N] (default), wav:PATH (records what is played) or null" << std::endl;
+            std::cout << "  --transport=T     Session transport: tcp (default), or for a server on this host unix[:PATH] or shm[:PATH]" << std::endl;
+            std::cout << "  --thread-role=ROLE:SPEC CPUs and scheduling of network, codec, mix, audio or bulk threads," << std::endl;
+            std::cout << "                    SPEC: cpus=N[-M][+N...], fifo=PRIO, nice=N, comma separated (repeatable)" << std::endl;
             std::cout << "Example: " << argv[0] << " 127.0.0.1" << std::endl;
             return EXIT_FAILURE;
         }
+        for (const std::string& spec : clientOptions.threadRoles) threadRoles().configure(spec); // From thread_roles.h
+        
+        if (!createCaptureSource(clientOptions.videoSource)) { // From capture_source.h
+            logError("Invalid video source: " + clientOptions.videoSource);
+            return EXIT_FAILURE;
+        }
+        if (!createAudioDevice(clientOptions.audioInput, AudioDevice::INPUT, VOICE_SAMPLE_RATE)) { // From audio_device.h
+            logError("Invalid audio input: " + clientOptions.audioInput);
+            return EXIT_FAILURE;
+        }
+        if (!createAudioDevice(clientOptions.audioOutput, AudioDevice::OUTPUT, VOICE_SAMPLE_RATE)) {
+            logError("Invalid audio output: " + clientOptions.audioOutput);
+            return EXIT_FAILURE;
+        }
         
         const char* server_ip = argv[1];
         
@@ -105,6 +142,8 @@ int main(int argc, char* argv[]) {
             }
         }
         
+        clientSession.close(); // Also stops an upload still running
+        threadRoles().report();
         logInfo("Mini Zoom Client terminated normally.");
         return 0;
         
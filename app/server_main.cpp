@@ -6,6 +6,8 @@
 #include <queue>
 #include <condition_variable>
 #include <atomic>
+#include <csignal> // For sigwait
+#include <pthread.h> // For pthread_sigmask
 
 // Include common utilities
 #include "common_utils.h" // For logInfo, logError (assuming it's a .cpp file or has inline functions)
@@ -16,59 +18,108 @@
 #include "chat_handler.h"
 #include "file_handler.h"
 #include "video_handler.h"
+#include "video_udp_handler.h"
 #include "voice_server.h"
 #include "tcp_server.h"
+#ifndef MINI_ZOOM_HEADLESS
 #include "video_display.h"
+#endif
 
 // Define global variables declared in server_common.h
-volatile bool running = true;
+Executor serverExecutor;
+TimerWheel serverTimers(TIMER_TICK_MS);
+CaptureWriter serverCapture;
 std::atomic<bool> videoStreaming{false};
 std::atomic<bool> videoClientConnected{false};
 std::atomic<bool> shouldCloseWindow{false};
 std::atomic<bool> videoSessionActive{false};
+ServerOptions serverOptions;
 
 std::vector<int> chatClients;
+std::vector<SessionMux*> chatSessions;
 std::mutex chatMutex;
 
-std::queue<cv::Mat> videoFrameQueue;
+std::queue<DisplayFrame> videoFrameQueue;
 std::mutex videoQueueMutex;
 std::condition_variable videoCond;
 
-std::thread videoClientThread; // Defined here, managed by tcpServer
 std::mutex videoClientMutex;
+std::condition_variable videoClientDone;
+bool videoClientBusy = false;
+CancelToken videoClientTask;
 
 std::condition_variable mainThreadCond;
 std::mutex mainThreadMutex;
 
-int main() {
-    logInfo("Starting Mini Zoom Server...");
-
-    std::thread udpThread(voiceUDPServer); // From voice_server.h
-    std::thread tcpThread(tcpServer);     // From tcp_server.h
-
-    // Run video display loop in main thread (required for macOS GUI)
-    videoDisplayLoop(); // From video_display.h
-
-    logInfo("Shutting down server...");
-
-    // Cleanup
-    running = false;
-
-    // Wake up any waiting threads
-    mainThreadCond.notify_all();
-    videoCond.notify_all();
+int main(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (!parseServerOption(argv[i], serverOptions)) { // From server_utils.h
+            std::cout << "Usage: " << argv[0] << " [options]" << std::endl;
+            std::cout << "Options:" << std::endl;
+            std::cout << "  --headless        Run without the video window (for servers and containers)" << std::endl;
+            std::cout << "  --record[=DIR]    Record incoming video sessions (default DIR: recordings)" << std::endl;
+            std::cout << "  --metrics         Log frame rate and bitrate of incoming video" << std::endl;
+            std::cout << "  --relay=IP[:PORT] Forward incoming video to another server" << std::endl;
+            std::cout << "  --latency-csv[=DIR] Write per-frame video timestamps to a CSV file per session (default DIR: latency)" << std::endl;
+            std::cout << "  --voice-max-bitrate=KBPS Highest Opus bitrate granted to voice clients (default 64)" << std::endl;
+            std::cout << "  --audio-latency=MS Speaker latency to ask of the audio device (default: lowest the host API recommends)" << std::endl;
+            std::cout << "  --audio-output=S  Voice output: portaudio[:N] (default), wav:PATH or null" << std::endl;
+            std::cout << "  --unix-socket=PATH|off Unix socket for clients on this host (default " UNIX_SOCKET_PATH ")" << std::endl;
+            std::cout << "  --capture=FILE    Record everything clients send, for session_replay" << std::endl;
+            std::cout << "  --thread-role=ROLE:SPEC CPUs and scheduling of network, codec, mix, audio or bulk threads," << std::endl;
+            std::cout << "                    SPEC: cpus=N[-M][+N...], fifo=PRIO, nice=N, comma separated (repeatable)" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if (!createAudioDevice(serverOptions.audioOutput, AudioDevice::OUTPUT, VOICE_SAMPLE_RATE)) { // From audio_device.h
+        logError("Invalid audio output: " + serverOptions.audioOutput);
+        return EXIT_FAILURE;
+    }
+    for (const std::string& spec : serverOptions.threadRoles) threadRoles().configure(spec); // From thread_roles.h
+    if (!serverOptions.capturePath.empty() && !serverCapture.open(serverOptions.capturePath)) {
+        logError("Failed to create capture file " + serverOptions.capturePath);
+        return EXIT_FAILURE;
+    }
 
-    // Wait for video client thread to finish
+    logInfo("Starting Mini Zoom Server" + std::string(serverOptions.headless ? " (headless)..." : "..."));
+
+    // Ctrl+C / SIGTERM are only ever delivered to sigwait() below, never to a worker thread
+    sigset_t stopSignals;
+    sigemptyset(&stopSignals);
+    sigaddset(&stopSignals, SIGINT);
+    sigaddset(&stopSignals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stopSignals, nullptr);
+
+    serverExecutor.spawnBlocking(timerService, PRIORITY_HIGH);   // From server_utils.h
+    serverExecutor.spawnBlocking(voiceUDPServer, PRIORITY_HIGH); // From voice_server.h
+    serverExecutor.spawnBlocking(tcpServer, PRIORITY_HIGH);      // From tcp_server.h
+    if (!serverOptions.unixSocket.empty()) serverExecutor.spawnBlocking(unixServer, PRIORITY_HIGH);
+
+    auto waitForStopSignal = [&stopSignals] {
+        int signal = 0;
+        sigwait(&stopSignals, &signal);
+        logInfo(std::string(signal == SIGINT ? "SIGINT" : "SIGTERM") + " received, shutting down...");
+        requestShutdown(); // From server_utils.h
+    };
+
+#ifndef MINI_ZOOM_HEADLESS
+    if (!serverOptions.headless) {
+        // Run video display loop in main thread (required for macOS GUI); it returns once the server is cancelled
+        std::thread signalThread(waitForStopSignal);
+        videoDisplayLoop(); // From video_display.h
+        signalThread.join();
+    } else
+#endif
     {
-        std::lock_guard<std::mutex> lock(videoClientMutex);
-        if (videoClientThread.joinable()) {
-            videoClientConnected = false; // Ensure old thread exits
-            videoClientThread.join();
-        }
+        // Nothing to poll: the main thread just sleeps until asked to stop
+        waitForStopSignal();
     }
 
-    if (tcpThread.joinable()) tcpThread.join();
-    if (udpThread.joinable()) udpThread.join();
+    logInfo("Shutting down server...");
+
+    serverExecutor.shutdown(); // Every handler was cancelled; waits for them to return
+    serverCapture.close();     // After the handlers, which record their connections' ends
+    threadRoles().report();
 
     logInfo("Server shutdown complete.");
     return 0;
@@ -0,0 +1,244 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <thread>
+#include <algorithm> // For std::nth_element, std::min
+#include <cstring>   // For strerror
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/tcp.h> // For TCP_NODELAY
+
+#include "common_utils.h"    // For sendAll, logInfo, logError
+#include "client_common.h"   // For TCP_PORT, UDP_VOICE_PORT, MODE_*
+#include "session_capture.h" // For CaptureReader, CAPTURE_*
+#include "video_protocol.h"  // For VideoUdpAnnounce
+#include "wire_schema.h"     // For recvWire
+
+// Replays a capture made by `server_app --capture=FILE` to a server: every connection is
+// opened again in its recorded mode and sent the same bytes and datagrams, at the recorded
+// times or as fast as possible. The same load can so be run against any build of the server.
+// Bytes go out unchanged, timestamps inside video and voice packets included, so the
+// server's latency figures are meaningless during a replay; its throughput and CPU are not.
+
+#define REPLAY_DRAIN_BYTES 65536
+#define REPLAY_CLOSE_WAIT_MS 2000 // After the last event, for the server to close what it was sent
+
+struct ReplayConnection {
+    uint8_t mode = 0;
+    int fd = -1;      // TCP socket, or the UDP socket of a voice source
+    int udpFd = -1;   // UDP video: where the connection's datagrams go
+    bool closing = false; // Sent everything; waiting for the server to close
+};
+
+static sockaddr_in serverAddress(const std::string& server_ip, uint16_t port) {
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, server_ip.c_str(), &addr.sin_addr);
+    return addr;
+}
+
+static int connectedSocket(int type, const sockaddr_in& addr) {
+    int sockfd = socket(AF_INET, type, 0);
+    if (sockfd < 0) return -1;
+    if (connect(sockfd, (const sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(sockfd);
+        return -1;
+    }
+    return sockfd;
+}
+
+// Opens the connection a CONNECT record stands for; false if the server cannot be reached
+static bool openConnection(const std::string& server_ip, uint8_t mode, ReplayConnection& c) {
+    c.mode = mode;
+    if (mode == CAPTURE_MODE_VOICE) {
+        c.fd = connectedSocket(SOCK_DGRAM, serverAddress(server_ip, UDP_VOICE_PORT));
+        return c.fd >= 0;
+    }
+    c.fd = connectedSocket(SOCK_STREAM, serverAddress(server_ip, TCP_PORT));
+    if (c.fd < 0) return false;
+    int one = 1;
+    setsockopt(c.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // Keep the recorded write boundaries
+    if (!sendAll(c.fd, (const char*)&mode, sizeof(mode))) return false;
+    if (mode == MODE_VIDEO_UDP) {
+        VideoUdpAnnounce announce{0};
+        if (!recvWire(c.fd, announce)) return false;
+        c.udpFd = connectedSocket(SOCK_DGRAM, serverAddress(server_ip, announce.port));
+        if (c.udpFd < 0) return false;
+    }
+    return true;
+}
+
+static void closeConnection(ReplayConnection& c) {
+    if (c.fd >= 0) close(c.fd);
+    if (c.udpFd >= 0) close(c.udpFd);
+    c.fd = c.udpFd = -1;
+}
+
+// Reads and discards whatever the server sent (chat relays, feedback, forwarded voice), so it
+// never blocks on us; waits up to timeoutMs for the first of it. A closing connection the server
+// has closed is closed here too.
+static void drainReplies(std::map<uint32_t, ReplayConnection>& connections, int timeoutMs) {
+    static std::vector<pollfd> fds;
+    static std::vector<ReplayConnection*> owners;
+    static std::vector<uint8_t> discard(REPLAY_DRAIN_BYTES);
+    fds.clear();
+    owners.clear();
+    for (auto& entry : connections) {
+        if (entry.second.fd < 0) continue;
+        fds.push_back(pollfd{entry.second.fd, POLLIN, 0});
+        owners.push_back(&entry.second);
+    }
+    if (fds.empty()) {
+        if (timeoutMs > 0) usleep(timeoutMs * 1000);
+        return;
+    }
+    if (poll(fds.data(), fds.size(), timeoutMs) <= 0) return;
+    for (size_t i = 0; i < fds.size(); i++) {
+        if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+        ssize_t bytes;
+        while ((bytes = recv(fds[i].fd, discard.data(), discard.size(), MSG_DONTWAIT)) > 0) {}
+        bool gone = bytes == 0 || (bytes < 0 && errno != EAGAIN && errno != EWOULDBLOCK);
+        if (gone && owners[i]->mode != CAPTURE_MODE_VOICE) closeConnection(*owners[i]);
+    }
+}
+
+static int64_t percentile(std::vector<int64_t>& values, double p) {
+    if (values.empty()) return 0;
+    size_t i = std::min(values.size() - 1, (size_t)(p * values.size()));
+    std::nth_element(values.begin(), values.begin() + i, values.end());
+    return values[i];
+}
+
+int main(int argc, char* argv[]) {
+    std::string path;
+    bool maxSpeed = false;
+    std::string server_ip = "127.0.0.1";
+    bool validArgs = argc >= 2;
+    for (int i = 1; i < argc && validArgs; i++) {
+        std::string arg = argv[i];
+        if (arg == "--max-speed") {
+            maxSpeed = true;
+        } else if (arg.rfind("--server=", 0) == 0) {
+            server_ip = arg.substr(9);
+        } else if (path.empty() && arg.rfind("--", 0) != 0) {
+            path = arg;
+        } else {
+            validArgs = false;
+        }
+    }
+    in_addr probe;
+    if (!validArgs || path.empty() || inet_pton(AF_INET, server_ip.c_str(), &probe) != 1) {
+        std::cout << "Usage: " << argv[0] << " <capture_file> [options]" << std::endl;
+        std::cout << "Options:" << std::endl;
+        std::cout << "  --max-speed       Send everything as fast as possible instead of at the recorded timing" << std::endl;
+        std::cout << "  --server=IP       Server to replay to (default 127.0.0.1)" << std::endl;
+        std::cout << "Example: " << argv[0] << " capture.mzc --max-speed" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    CaptureReader capture;
+    if (!capture.open(path)) {
+        logError("Not a capture file: " + path);
+        return EXIT_FAILURE;
+    }
+    const std::vector<CaptureEvent>& events = capture.events();
+    if (events.empty()) {
+        logError("Capture " + path + " is empty");
+        return EXIT_FAILURE;
+    }
+    logInfo("Replaying " + std::to_string(events.size()) + " records of " + path + " to " + server_ip +
+            (maxSpeed ? " at maximum speed" : ""));
+
+    std::map<uint32_t, ReplayConnection> connections;
+    std::vector<uint8_t> payload;
+    std::vector<int64_t> lateUs; // How far behind the recorded timing each record went out
+    uint64_t bytesSent = 0, datagramsSent = 0, connectionsOpened = 0, failures = 0;
+    auto replayStart = std::chrono::steady_clock::now();
+    uint64_t firstUs = events.front().timeUs;
+
+    for (const CaptureEvent& e : events) {
+        auto due = replayStart + std::chrono::microseconds(e.timeUs - firstUs);
+        if (maxSpeed) {
+            drainReplies(connections, 0);
+        } else {
+            for (auto now = std::chrono::steady_clock::now(); now < due; now = std::chrono::steady_clock::now()) {
+                int64_t waitUs = std::chrono::duration_cast<std::chrono::microseconds>(due - now).count();
+                if (waitUs >= 1000) {
+                    drainReplies(connections, (int)(waitUs / 1000));
+                } else {
+                    drainReplies(connections, 0);
+                    std::this_thread::sleep_until(due); // poll() only waits whole milliseconds
+                }
+            }
+            lateUs.push_back(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - due).count());
+        }
+
+        if (!capture.payload(e, payload)) {
+            logError("Capture file is truncated, stopping replay.");
+            break;
+        }
+        if (e.kind == CAPTURE_CONNECT) {
+            ReplayConnection& c = connections[e.connection];
+            if (payload.size() != 1 || !openConnection(server_ip, payload[0], c)) {
+                logError("Failed to open connection " + std::to_string(e.connection) + ": " + std::string(strerror(errno)));
+                closeConnection(c);
+                failures++;
+            } else {
+                connectionsOpened++;
+            }
+            continue;
+        }
+        auto it = connections.find(e.connection);
+        if (it == connections.end() || it->second.fd < 0) continue; // Failed, or closed by the server
+        ReplayConnection& c = it->second;
+        if (e.kind == CAPTURE_DATA) {
+            if (sendAll(c.fd, (const char*)payload.data(), payload.size())) {
+                bytesSent += payload.size();
+            } else {
+                logError("Server closed connection " + std::to_string(e.connection) + " early");
+                closeConnection(c);
+                failures++;
+            }
+        } else if (e.kind == CAPTURE_DATAGRAM) {
+            int fd = c.mode == CAPTURE_MODE_VOICE ? c.fd : c.udpFd;
+            if (fd >= 0 && send(fd, payload.data(), payload.size(), 0) >= 0) {
+                bytesSent += payload.size();
+                datagramsSent++;
+            }
+        } else if (e.kind == CAPTURE_CLOSE) {
+            if (c.mode == CAPTURE_MODE_VOICE) {
+                closeConnection(c);
+            } else {
+                shutdown(c.fd, SHUT_WR); // The server finishes reading, then closes its end
+                c.closing = true;
+            }
+        }
+    }
+
+    // Let the server read what it was sent before the sockets go
+    auto closeDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(REPLAY_CLOSE_WAIT_MS);
+    auto stillClosing = [&connections] {
+        for (auto& entry : connections) {
+            if (entry.second.closing && entry.second.fd >= 0) return true;
+        }
+        return false;
+    };
+    while (stillClosing() && std::chrono::steady_clock::now() < closeDeadline) drainReplies(connections, 10);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - replayStart).count();
+    for (auto& entry : connections) closeConnection(entry.second);
+
+    logInfo("Replay finished: " + std::to_string(connectionsOpened) + " connections, " + std::to_string(bytesSent) +
+            " bytes (" + std::to_string(datagramsSent) + " datagrams) in " + std::to_string(seconds) + " s");
+    if (!lateUs.empty()) {
+        logInfo("Timing: records late by " + std::to_string(percentile(lateUs, 0.5)) + " us median, " +
+                std::to_string(percentile(lateUs, 0.99)) + " us p99, " +
+                std::to_string(*std::max_element(lateUs.begin(), lateUs.end())) + " us max");
+    }
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,164 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <algorithm> // For std::upper_bound
+#include <cstring>   // For strerror
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "common_utils.h"     // For sendAll, logInfo, logError
+#include "client_common.h"    // For TCP_PORT, MODE_VIDEO
+#include "video_recording.h"  // For VideoIndexReader, videoSegmentPath
+#include "video_protocol.h"   // For parseVideoFrame, shiftVideoFrameTimes
+
+// Replays a session recorded by `server_app --record` to a server, as if it came from a camera.
+// Frames are sent as they were received; only their timestamps are moved to the present,
+// so the server decodes them unchanged and its latency statistics stay meaningful.
+
+struct ReplaySegment {
+    VideoIndexReader index;
+    int dataFd = -1;
+};
+
+static bool openSegments(const std::string& prefix, std::vector<ReplaySegment>& segments) {
+    for (int i = 0;; i++) {
+        ReplaySegment segment;
+        if (!segment.index.open(videoSegmentPath(prefix, i, ".idx"))) break;
+        segment.dataFd = open(videoSegmentPath(prefix, i, ".mzv").c_str(), O_RDONLY);
+        if (segment.dataFd < 0) break;
+        if (segment.index.count() == 0) {
+            close(segment.dataFd);
+            continue;
+        }
+        segments.push_back(std::move(segment));
+    }
+    return !segments.empty();
+}
+
+// Segment and frame to start from: binary search over segment start times, then within the segment
+static void seekSegments(const std::vector<ReplaySegment>& segments, int64_t timestampUs,
+                         size_t& segment, size_t& frame) {
+    auto it = std::upper_bound(segments.begin(), segments.end(), timestampUs,
+        [](int64_t ts, const ReplaySegment& s) { return ts < s.index.entry(0).timestampUs; });
+    segment = it == segments.begin() ? 0 : (size_t)(it - segments.begin()) - 1;
+    frame = segments[segment].index.seek(timestampUs);
+}
+
+static int connectToServer(const char* server_ip) {
+    int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (sockfd < 0) return -1;
+
+    sockaddr_in servaddr{};
+    servaddr.sin_family = AF_INET;
+    servaddr.sin_port = htons(TCP_PORT);
+    if (inet_pton(AF_INET, server_ip, &servaddr.sin_addr) <= 0 ||
+        connect(sockfd, (sockaddr*)&servaddr, sizeof(servaddr)) < 0) {
+        close(sockfd);
+        return -1;
+    }
+
+    uint8_t mode = MODE_VIDEO;
+    if (!sendAll(sockfd, (char*)&mode, sizeof(mode))) {
+        close(sockfd);
+        return -1;
+    }
+    return sockfd;
+}
+
+int main(int argc, char* argv[]) {
+    std::string prefix;
+    double seekSeconds = 0;
+    bool maxSpeed = false;
+    std::string server_ip = "127.0.0.1";
+    bool validArgs = argc >= 2;
+    for (int i = 1; i < argc && validArgs; i++) {
+        std::string arg = argv[i];
+        if (arg.rfind("--seek=", 0) == 0) {
+            try {
+                seekSeconds = std::stod(arg.substr(7));
+            } catch (const std::exception&) {
+                validArgs = false;
+            }
+        } else if (arg == "--max-speed") {
+            maxSpeed = true;
+        } else if (arg.rfind("--server=", 0) == 0) {
+            server_ip = arg.substr(9);
+        } else if (prefix.empty() && arg.rfind("--", 0) != 0) {
+            prefix = arg;
+        } else {
+            validArgs = false;
+        }
+    }
+    if (!validArgs || prefix.empty()) {
+        std::cout << "Usage: " << argv[0] << " <recording_prefix> [options]" << std::endl;
+        std::cout << "Options:" << std::endl;
+        std::cout << "  --seek=SECONDS    Start at the keyframe at or before this offset into the session" << std::endl;
+        std::cout << "  --max-speed       Send frames as fast as possible instead of at the recorded timing" << std::endl;
+        std::cout << "  --server=IP       Server to replay to (default 127.0.0.1)" << std::endl;
+        std::cout << "Example: " << argv[0] << " recordings/video_20250101_120000_127.0.0.1-54321" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<ReplaySegment> segments;
+    if (!openSegments(prefix, segments)) {
+        logError("No recording found at " + prefix + "_*.idx");
+        return EXIT_FAILURE;
+    }
+
+    size_t segment = 0;
+    size_t frame = 0;
+    seekSegments(segments, (int64_t)(seekSeconds * 1e6), segment, frame);
+
+    int sockfd = connectToServer(server_ip.c_str());
+    if (sockfd < 0) {
+        logError("Failed to connect to " + server_ip + ": " + std::string(strerror(errno)));
+        return EXIT_FAILURE;
+    }
+    logInfo("Replaying " + prefix + " from " +
+            std::to_string(segments[segment].index.entry(frame).timestampUs / 1000) + " ms");
+
+    // Recorded timestamps are mapped onto the wall clock from the first frame sent
+    auto replayStart = std::chrono::steady_clock::now();
+    int64_t firstTimestampUs = segments[segment].index.entry(frame).timestampUs;
+    std::vector<uint8_t> buffer;
+    uint64_t framesSent = 0;
+    bool ok = true;
+    for (; segment < segments.size() && ok; segment++, frame = 0) {
+        const ReplaySegment& s = segments[segment];
+        for (; frame < s.index.count() && ok; frame++) {
+            const VideoIndexEntry& e = s.index.entry(frame);
+            buffer.resize(e.size);
+            if (pread(s.dataFd, buffer.data(), e.size, (off_t)e.offset) != (ssize_t)e.size) {
+                logError("Recording data is truncated, stopping replay.");
+                ok = false;
+                break;
+            }
+
+            if (!maxSpeed) {
+                std::this_thread::sleep_until(replayStart + std::chrono::microseconds(e.timestampUs - firstTimestampUs));
+            }
+            // Present the frame as if it had been captured just now, keeping its stage durations
+            VideoFrameInfo info;
+            if (parseVideoFrame(buffer.data(), buffer.size(), info)) {
+                shiftVideoFrameTimes(buffer, videoClockUs() - info.sendUs);
+            }
+
+            ok = sendWire(sockfd, VideoStreamHeader{e.size}, buffer.data(), buffer.size()); // From wire_schema.h
+            if (ok) framesSent++;
+        }
+    }
+    if (!ok) logError("Replay stopped early.");
+
+    sendWire(sockfd, VideoStreamHeader{0}); // End of stream
+    close(sockfd);
+    for (ReplaySegment& s : segments) close(s.dataFd);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - replayStart).count();
+    logInfo("Replay finished: " + std::to_string(framesSent) + " frames in " + std::to_string(seconds) + " s");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
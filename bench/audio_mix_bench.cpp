@@ -0,0 +1,130 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm> // For std::min, std::max
+
+#include "audio_mix.h"      // For mixAdd*
+#include "voice_protocol.h" // For VOICE_FRAME_SAMPLES
+
+// Microbenchmark for the saturating audio mixing kernels (utils/audio_mix.h).
+// 1. Every kernel built for this machine must give exactly the scalar result, for lengths
+//    around every vector width, unaligned starts, and sums that clip at both ends.
+// 2. Time of one VOICE_FRAME_SAMPLES add (one speaker into a mix), per kernel.
+// 3. A full mix of BENCH_SPEAKERS speakers into one 20 ms frame, as the voice mixer does
+//    when everybody talks at once, and the share of the frame's time it takes.
+// Passes if (1) holds and the dispatched kernel is at least BENCH_MIN_SPEEDUP times as
+// fast as the scalar one.
+
+#define BENCH_SPEAKERS 64
+#define BENCH_ROUNDS 200000
+#define BENCH_MIX_ROUNDS 5000
+#define BENCH_MIN_SPEEDUP 1.0
+
+typedef void (*MixKernel)(int16_t*, const int16_t*, size_t);
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static bool checkKernel(const char* name, MixKernel kernel) {
+    std::mt19937 rng(1);
+    std::vector<int16_t> acc(VOICE_FRAME_SAMPLES + 64), src(acc.size());
+    for (size_t i = 0; i < acc.size(); i++) {
+        acc[i] = (int16_t)rng();
+        src[i] = (int16_t)rng();
+    }
+    // Saturation at both ends, and the largest sums that still fit
+    const int16_t edges[][2] = {{INT16_MAX, 1}, {INT16_MAX, INT16_MAX}, {INT16_MIN, -1}, {INT16_MIN, INT16_MIN},
+                                {INT16_MAX, INT16_MIN}, {INT16_MAX - 1, 1}, {INT16_MIN + 1, -1}, {-1, 1}};
+    for (size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); i++) {
+        acc[i * 3] = edges[i][0];
+        src[i * 3] = edges[i][1];
+    }
+    for (size_t n = 0; n <= VOICE_FRAME_SAMPLES; n = n < 40 ? n + 1 : n * 2 + 1) {
+        for (size_t offset = 0; offset < 3; offset++) { // Unaligned starts
+            std::vector<int16_t> expected(acc), got(acc);
+            mixAddScalar(expected.data() + offset, src.data() + offset, n);
+            kernel(got.data() + offset, src.data() + offset, n);
+            if (got != expected) {
+                printf("FAIL: %s differs from scalar at length %zu, offset %zu\n", name, n, offset);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Seconds per VOICE_FRAME_SAMPLES add
+static double addTime(MixKernel kernel, const std::vector<int16_t>& src) {
+    std::vector<int16_t> acc(VOICE_FRAME_SAMPLES, 0);
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        kernel(acc.data(), src.data(), VOICE_FRAME_SAMPLES);
+        asm volatile("" : : "r"(acc.data()) : "memory"); // Keep every add
+    }
+    return secondsSince(start) / BENCH_ROUNDS;
+}
+
+// Seconds per full mix of BENCH_SPEAKERS frames
+static double mixTime(MixKernel kernel, const std::vector<std::vector<int16_t>>& speakers) {
+    std::vector<int16_t> mix(VOICE_FRAME_SAMPLES);
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < BENCH_MIX_ROUNDS; round++) {
+        memset(mix.data(), 0, mix.size() * sizeof(int16_t));
+        for (auto& speaker : speakers) kernel(mix.data(), speaker.data(), VOICE_FRAME_SAMPLES);
+        asm volatile("" : : "r"(mix.data()) : "memory");
+    }
+    return secondsSince(start) / BENCH_MIX_ROUNDS;
+}
+
+int main() {
+    struct { const char* name; MixKernel kernel; } kernels[] = {
+        {"scalar", mixAddScalar},
+#if defined(AUDIO_MIX_X86)
+        {"sse2", mixAddSse2},
+        {"avx2", __builtin_cpu_supports("avx2") ? mixAddAvx2 : nullptr},
+#elif defined(AUDIO_MIX_NEON)
+        {"neon", mixAddNeon},
+#endif
+        {"dispatched", mixAdd},
+    };
+
+    bool ok = true;
+    for (auto& k : kernels) {
+        if (k.kernel) ok = checkKernel(k.name, k.kernel) && ok;
+    }
+
+    // Loud speech-like speakers, so the mix clips as it would with everybody talking
+    std::mt19937 rng(2);
+    std::normal_distribution<double> sample(0.0, 6000.0);
+    std::vector<std::vector<int16_t>> speakers(BENCH_SPEAKERS, std::vector<int16_t>(VOICE_FRAME_SAMPLES));
+    for (auto& speaker : speakers) {
+        for (auto& s : speaker) s = (int16_t)std::max(-32768.0, std::min(32767.0, sample(rng)));
+    }
+
+    double scalarTime = 0, dispatchedTime = 0;
+    for (auto& k : kernels) {
+        if (!k.kernel) {
+            printf("%-10s  not supported by this CPU\n", k.name);
+            continue;
+        }
+        double add = addTime(k.kernel, speakers[0]);
+        double mix = mixTime(k.kernel, speakers);
+        if (k.kernel == mixAddScalar) scalarTime = add;
+        if (k.kernel == mixAdd) dispatchedTime = add;
+        printf("%-10s  %6.3f us per %d-sample add  %7.2f us per %d-speaker mix (%.3f%% of a 20 ms frame)\n",
+               k.name, add * 1e6, VOICE_FRAME_SAMPLES, mix * 1e6, BENCH_SPEAKERS, mix / 0.020 * 100);
+    }
+    double speedup = scalarTime / dispatchedTime;
+    printf("dispatched kernel: %.1fx scalar\n", speedup);
+    if (speedup < BENCH_MIN_SPEEDUP) {
+        printf("FAIL: dispatched kernel slower than scalar\n");
+        ok = false;
+    }
+
+    printf(ok ? "PASS\n" : "FAIL\n");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,133 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <algorithm> // For std::min, std::max
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "common_utils.h" // For sendAll, recvAll
+#include "executor.h"     // For Executor
+
+// Benchmark of the server's connection handling: a task per connection on the work-stealing
+// executor (utils/executor.h) against a thread per connection, as the server did before.
+// BENCH_CONNECTIONS short-lived connections arrive in waves of BENCH_WAVE. Each is a Unix
+// socket pair; its handler blocks in recv for the client's request, as a real handler waits
+// for its mode byte, answers it and closes. The client side sends every request of the wave,
+// then reads every answer. Each way of handling is run BENCH_RUNS times.
+// Passes if every connection gets the right answer, the executor takes at most
+// 1 / BENCH_MIN_RATIO of the threads' median time, and it creates no more threads than one
+// wave plus a worker per core.
+
+#define BENCH_CONNECTIONS 3000
+#define BENCH_WAVE 64
+#define BENCH_RUNS 5
+#define BENCH_MIN_RATIO 1.0
+
+enum Mode { MODE_THREADS, MODE_EXECUTOR };
+
+struct RunResult {
+    double ms = 0;
+    size_t threads = 0;
+    uint32_t wrong = 0;
+};
+
+// A connection handler: waits for the request and answers it with the request plus one
+static void handle(int fd) {
+    uint64_t request;
+    if (recvAll(fd, (char*)&request, sizeof(request))) {
+        uint64_t answer = request + 1;
+        sendAll(fd, (const char*)&answer, sizeof(answer));
+    }
+    close(fd);
+}
+
+static RunResult run(Mode mode) {
+    RunResult r;
+    Executor executor;
+    std::vector<std::thread> threads;
+    std::vector<int> clients;
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t first = 0; first < BENCH_CONNECTIONS; first += BENCH_WAVE) {
+        uint64_t count = std::min<uint64_t>(BENCH_WAVE, BENCH_CONNECTIONS - first);
+        clients.clear();
+        for (uint64_t i = 0; i < count; i++) {
+            int sv[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+                r.wrong++;
+                continue;
+            }
+            clients.push_back(sv[0]);
+            int server = sv[1];
+            if (mode == MODE_THREADS) threads.emplace_back(handle, server);
+            else executor.spawnBlocking([server](const CancelToken&) { handle(server); });
+        }
+        for (size_t i = 0; i < clients.size(); i++) {
+            uint64_t request = first + i;
+            if (!sendAll(clients[i], (const char*)&request, sizeof(request))) r.wrong++;
+        }
+        for (size_t i = 0; i < clients.size(); i++) {
+            uint64_t answer = 0;
+            if (!recvAll(clients[i], (char*)&answer, sizeof(answer)) || answer != first + i + 1) r.wrong++;
+            close(clients[i]);
+        }
+    }
+    for (auto& t : threads) t.join(); // Each has answered, so these are returning already
+    r.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    r.threads = mode == MODE_THREADS ? threads.size() : executor.threads();
+    return r;
+}
+
+struct Summary {
+    double minMs = 1e30, medianMs = 0, maxMs = 0;
+    size_t threads = 0;
+    uint32_t wrong = 0;
+};
+
+static Summary runAll(Mode mode) {
+    Summary s;
+    std::vector<double> times;
+    for (int i = 0; i < BENCH_RUNS; i++) {
+        RunResult r = run(mode);
+        times.push_back(r.ms);
+        s.minMs = std::min(s.minMs, r.ms);
+        s.maxMs = std::max(s.maxMs, r.ms);
+        s.threads = std::max(s.threads, r.threads);
+        s.wrong += r.wrong;
+    }
+    std::sort(times.begin(), times.end());
+    s.medianMs = times[times.size() / 2];
+    return s;
+}
+
+static bool report(const char* name, const Summary& s) {
+    printf("%-22s %4.0f-%4.0f ms (median %4.0f), %4zu threads created, %u wrong answers%s\n", name, s.minMs, s.maxMs,
+           s.medianMs, s.threads, s.wrong, s.wrong ? "  FAIL" : "");
+    return s.wrong == 0;
+}
+
+int main() {
+    Summary threads = runAll(MODE_THREADS);
+    Summary executor = runAll(MODE_EXECUTOR);
+    printf("%d connections in waves of %d, %d runs each\n", BENCH_CONNECTIONS, BENCH_WAVE, BENCH_RUNS);
+    bool ok = report("thread per connection", threads);
+    ok = report("executor", executor) && ok;
+
+    double ratio = threads.medianMs / executor.medianMs;
+    printf("executor: %.2fx the threads' rate\n", ratio);
+    if (ratio < BENCH_MIN_RATIO) {
+        printf("FAIL: the executor is slower than a thread per connection\n");
+        ok = false;
+    }
+    size_t cores = std::max(1u, std::thread::hardware_concurrency());
+    if (executor.threads > BENCH_WAVE + cores) {
+        printf("FAIL: the executor created %zu threads for waves of %d\n", executor.threads, BENCH_WAVE);
+        ok = false;
+    }
+
+    printf(ok ? "PASS\n" : "FAIL\n");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
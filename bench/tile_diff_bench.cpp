@@ -0,0 +1,130 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm> // For std::min
+
+#include "tile_diff.h" // For sadRow*, blockChanged
+
+// Microbenchmark for the tile-diff SAD kernels (utils/tile_diff.h).
+// 1. Every kernel built for this machine must give exactly the scalar sum, for lengths
+//    around every vector width and with all byte values.
+// 2. Throughput of each kernel over one 1280x720 BGR frame, row by row, as the encoder
+//    calls them (3840-byte rows).
+// 3. Change detection of a talking-head frame: 64x64 tiles, a static background and a
+//    moving 320x320 face, with the encoder's threshold.
+// Passes if (1) holds and the dispatched kernel is at least BENCH_MIN_SPEEDUP times as
+// fast as the scalar one on full frames.
+
+#define BENCH_WIDTH 1280
+#define BENCH_HEIGHT 720
+#define BENCH_TILE 64
+#define BENCH_THRESHOLD 6 // VIDEO_TILE_DIFF_THRESHOLD
+#define BENCH_ROUNDS 200
+#define BENCH_MIN_SPEEDUP 1.0
+
+typedef uint64_t (*SadKernel)(const uint8_t*, const uint8_t*, size_t);
+
+static double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Bytes per second of one kernel over whole frames
+static double frameThroughput(SadKernel kernel, const std::vector<uint8_t>& a, const std::vector<uint8_t>& b) {
+    size_t row = BENCH_WIDTH * 3;
+    volatile uint64_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        uint64_t sum = 0;
+        for (int y = 0; y < BENCH_HEIGHT; y++) sum += kernel(a.data() + y * row, b.data() + y * row, row);
+        sink = sink + sum;
+    }
+    return (double)a.size() * BENCH_ROUNDS / secondsSince(start);
+}
+
+static bool checkKernel(const char* name, SadKernel kernel) {
+    std::mt19937 rng(1);
+    std::vector<uint8_t> a(4096 + 64), b(4096 + 64);
+    for (size_t i = 0; i < a.size(); i++) {
+        a[i] = (uint8_t)rng();
+        b[i] = (uint8_t)rng();
+    }
+    a[0] = 0; b[0] = 255; // Largest difference, both ways
+    a[1] = 255; b[1] = 0;
+    for (size_t n = 0; n <= 4096; n = n < 130 ? n + 1 : n * 2 + 1) {
+        for (size_t offset = 0; offset < 3; offset++) { // Unaligned starts
+            if (kernel(a.data() + offset, b.data() + offset, n) != sadRowScalar(a.data() + offset, b.data() + offset, n)) {
+                printf("FAIL: %s differs from scalar at length %zu, offset %zu\n", name, n, offset);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main() {
+    struct { const char* name; SadKernel kernel; } kernels[] = {
+        {"scalar", sadRowScalar},
+#if defined(TILE_DIFF_X86)
+        {"sse2", sadRowSse2},
+        {"avx2", __builtin_cpu_supports("avx2") ? sadRowAvx2 : nullptr},
+#elif defined(TILE_DIFF_NEON)
+        {"neon", sadRowNeon},
+#endif
+        {"dispatched", sadRow},
+    };
+
+    bool ok = true;
+    for (auto& k : kernels) {
+        if (k.kernel) ok = checkKernel(k.name, k.kernel) && ok;
+    }
+
+    std::mt19937 rng(2);
+    std::vector<uint8_t> a(BENCH_WIDTH * BENCH_HEIGHT * 3), b(a.size());
+    for (size_t i = 0; i < a.size(); i++) {
+        a[i] = (uint8_t)rng();
+        b[i] = (uint8_t)(a[i] + rng() % 8);
+    }
+    double scalarRate = 0, dispatchedRate = 0;
+    for (auto& k : kernels) {
+        if (!k.kernel) {
+            printf("%-10s  not supported by this CPU\n", k.name);
+            continue;
+        }
+        double rate = frameThroughput(k.kernel, a, b);
+        if (k.kernel == sadRowScalar) scalarRate = rate;
+        if (k.kernel == sadRow) dispatchedRate = rate;
+        printf("%-10s  %6.2f GB/s  %7.1f us per 720p frame\n", k.name, rate / 1e9, a.size() / rate * 1e6);
+    }
+    double speedup = dispatchedRate / scalarRate;
+    printf("dispatched kernel: %.1fx scalar\n", speedup);
+    if (speedup < BENCH_MIN_SPEEDUP) {
+        printf("FAIL: dispatched kernel slower than scalar\n");
+        ok = false;
+    }
+
+    // Talking head: the previous frame, then the face region shifted by a few pixels
+    std::vector<uint8_t> next = a;
+    size_t row = BENCH_WIDTH * 3;
+    for (int y = 200; y < 520; y++) memcpy(next.data() + y * row + 480 * 3, a.data() + (y + 3) * row + 484 * 3, 320 * 3);
+    int changed = 0, tiles = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        changed = tiles = 0;
+        for (int ty = 0; ty < BENCH_HEIGHT; ty += BENCH_TILE) {
+            for (int tx = 0; tx < BENCH_WIDTH; tx += BENCH_TILE) {
+                int h = std::min(BENCH_TILE, BENCH_HEIGHT - ty);
+                size_t offset = ty * row + tx * 3;
+                changed += blockChanged(a.data() + offset, row, next.data() + offset, row, BENCH_TILE * 3, h, BENCH_THRESHOLD);
+                tiles++;
+            }
+        }
+    }
+    printf("talking head: %d of %d tiles changed, detected in %.1f us per frame\n", changed, tiles,
+           secondsSince(start) / BENCH_ROUNDS * 1e6);
+
+    printf(ok ? "PASS\n" : "FAIL\n");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
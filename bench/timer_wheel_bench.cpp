@@ -0,0 +1,232 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <mutex>
+#include <random>
+#include <chrono>
+#include <functional>
+#include <algorithm> // For std::max
+
+#include "timer_wheel.h" // For TimerWheel
+
+// Benchmark of the hierarchical timer wheel (utils/timer_wheel.h) against the obvious
+// alternative: a std::multimap ordered by expiry, with a map from timer id to its entry for
+// moves and cancels, behind a mutex like the wheel.
+// 1. Correctness on a simulated clock: BENCH_CHECK_TIMERS timers, some moved and some
+//    cancelled half way. Every timer left must fire exactly once, in the tick the multimap
+//    fires it, no earlier than its delay and less than a tick after; cancelled ones never.
+// 2. With BENCH_TIMERS pending timers: time of a schedule, a move (reschedule) and a cancel,
+//    with random delays up to BENCH_MAX_DELAY_MS.
+// 3. Time of a tick (advance() by one tick) when no timer is due.
+// Passes if (1) holds and the wheel's schedule, move and cancel are each at least
+// BENCH_MIN_RATIO as fast as the multimap's.
+
+#define BENCH_TIMERS 100000
+#define BENCH_CHECK_TIMERS 20000
+#define BENCH_TICK_MS 100           // TIMER_TICK_MS on the server
+#define BENCH_MAX_DELAY_MS 60000
+#define BENCH_IDLE_TICKS 100000
+#define BENCH_MIN_RATIO 1.0
+
+using TimerId = TimerWheel::TimerId;
+
+// The reference: the same interface as TimerWheel, and the same expiry rounding
+class MultimapTimers {
+public:
+    MultimapTimers(uint32_t tickMs, uint64_t nowMs) : tickMs_(tickMs), startMs_(nowMs) {}
+
+    TimerId schedule(uint32_t delayMs, std::function<void()> fn) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        TimerId id = ++lastId_;
+        index_[id] = timers_.emplace(expiryFor(delayMs), Entry{id, std::move(fn)});
+        return id;
+    }
+
+    bool reschedule(TimerId timer, uint32_t delayMs) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = index_.find(timer);
+        if (found == index_.end()) return false;
+        auto node = timers_.extract(found->second); // Keeps the entry's allocation
+        node.key() = expiryFor(delayMs);
+        found->second = timers_.insert(std::move(node));
+        return true;
+    }
+
+    bool cancel(TimerId timer) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = index_.find(timer);
+        if (found == index_.end()) return false;
+        timers_.erase(found->second);
+        index_.erase(found);
+        return true;
+    }
+
+    size_t advance(uint64_t nowMs) {
+        std::vector<std::function<void()>> due;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tick_ = nowMs > startMs_ ? (nowMs - startMs_) / tickMs_ : 0;
+            while (!timers_.empty() && timers_.begin()->first <= tick_) {
+                index_.erase(timers_.begin()->second.id);
+                due.push_back(std::move(timers_.begin()->second.fn));
+                timers_.erase(timers_.begin());
+            }
+        }
+        for (auto& fn : due) fn();
+        return due.size();
+    }
+
+private:
+    struct Entry {
+        TimerId id;
+        std::function<void()> fn;
+    };
+
+    uint64_t expiryFor(uint32_t delayMs) const {
+        return tick_ + std::max<uint64_t>(1, (delayMs + tickMs_ - 1) / tickMs_);
+    }
+
+    std::mutex mutex_;
+    std::multimap<uint64_t, Entry> timers_;
+    std::unordered_map<TimerId, std::multimap<uint64_t, Entry>::iterator> index_;
+    uint32_t tickMs_;
+    uint64_t startMs_, tick_ = 0;
+    TimerId lastId_ = 0;
+};
+
+struct Fired {
+    uint32_t count = 0;
+    uint64_t atMs = 0;
+};
+
+struct CheckRun {
+    std::vector<Fired> fired;
+    std::vector<uint64_t> dueMs;
+    std::vector<bool> moved, cancelled;
+};
+
+struct Timings {
+    double scheduleNs = 0, moveNs = 0, cancelNs = 0, tickNs = 0;
+};
+
+// Step 1 on one implementation: when each timer fired, and when it was due
+template <typename Timers>
+static CheckRun runCheck() {
+    CheckRun run;
+    std::vector<Fired>& fired = run.fired;
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<uint32_t> delay(1, BENCH_MAX_DELAY_MS);
+    uint64_t nowMs = 0;
+    Timers timers(BENCH_TICK_MS, nowMs);
+    std::vector<TimerId> ids(BENCH_CHECK_TIMERS);
+    fired.assign(BENCH_CHECK_TIMERS, Fired{});
+    run.dueMs.assign(BENCH_CHECK_TIMERS, 0);
+    run.moved.assign(BENCH_CHECK_TIMERS, false);
+    run.cancelled.assign(BENCH_CHECK_TIMERS, false);
+    for (size_t i = 0; i < ids.size(); i++) {
+        run.dueMs[i] = delay(rng);
+        ids[i] = timers.schedule((uint32_t)run.dueMs[i], [&fired, &nowMs, i] { fired[i].count++; fired[i].atMs = nowMs; });
+    }
+    const uint64_t midMs = BENCH_MAX_DELAY_MS / 2;
+    for (; nowMs < midMs; nowMs += BENCH_TICK_MS) timers.advance(nowMs);
+    timers.advance(nowMs);
+    for (size_t i = 0; i < ids.size(); i++) {
+        if (i % 3 == 0) {
+            uint32_t d = delay(rng);
+            run.moved[i] = timers.reschedule(ids[i], d);
+            if (run.moved[i]) run.dueMs[i] = nowMs + d;
+        } else if (i % 5 == 0) {
+            run.cancelled[i] = timers.cancel(ids[i]);
+        }
+    }
+    for (; nowMs <= midMs + BENCH_MAX_DELAY_MS + 2 * BENCH_TICK_MS; nowMs += BENCH_TICK_MS) timers.advance(nowMs);
+    return run;
+}
+
+static bool check() {
+    CheckRun wheel = runCheck<TimerWheel>(), reference = runCheck<MultimapTimers>();
+    uint32_t wrong = 0, early = 0, late = 0, differ = 0, moved = 0, cancelled = 0;
+    for (size_t i = 0; i < BENCH_CHECK_TIMERS; i++) {
+        const Fired& f = wheel.fired[i];
+        moved += wheel.moved[i];
+        cancelled += wheel.cancelled[i];
+        if (f.count != (wheel.cancelled[i] ? 0u : 1u)) wrong++;
+        if (wheel.moved[i] != reference.moved[i] || wheel.cancelled[i] != reference.cancelled[i] ||
+            f.count != reference.fired[i].count || f.atMs != reference.fired[i].atMs) {
+            differ++;
+        }
+        if (f.count == 1 && f.atMs < wheel.dueMs[i]) early++;
+        if (f.count == 1 && f.atMs >= wheel.dueMs[i] + BENCH_TICK_MS) late++;
+    }
+    printf("%d timers, %u moved, %u cancelled: %u fired the wrong number of times, %u early, %u late, "
+           "%u unlike the multimap\n", BENCH_CHECK_TIMERS, moved, cancelled, wrong, early, late, differ);
+    if (wrong || early || late || differ) {
+        printf("FAIL: the wheel fired timers wrongly\n");
+        return false;
+    }
+    return true;
+}
+
+template <typename Timers>
+static Timings measure() {
+    using Clock = std::chrono::steady_clock;
+    auto nsEach = [](Clock::time_point start, size_t count) {
+        return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / count;
+    };
+    std::mt19937 rng(2);
+    std::uniform_int_distribution<uint32_t> delay(1, BENCH_MAX_DELAY_MS);
+    std::vector<uint32_t> delays(2 * BENCH_TIMERS);
+    for (auto& d : delays) d = delay(rng);
+    uint64_t fired = 0;
+    Timings t;
+    {
+        Timers timers(BENCH_TICK_MS, 0);
+        std::vector<TimerId> ids(BENCH_TIMERS);
+        auto start = Clock::now();
+        for (size_t i = 0; i < ids.size(); i++) ids[i] = timers.schedule(delays[i], [&fired] { fired++; });
+        t.scheduleNs = nsEach(start, ids.size());
+        start = Clock::now();
+        for (size_t i = 0; i < ids.size(); i++) timers.reschedule(ids[i], delays[BENCH_TIMERS + i]);
+        t.moveNs = nsEach(start, ids.size());
+        start = Clock::now();
+        for (size_t i = 0; i < ids.size(); i++) timers.cancel(ids[i]);
+        t.cancelNs = nsEach(start, ids.size());
+    }
+    {
+        // Pending timers all due after the last tick, so none fires
+        uint64_t idleMs = (uint64_t)BENCH_IDLE_TICKS * BENCH_TICK_MS;
+        Timers timers(BENCH_TICK_MS, 0);
+        for (size_t i = 0; i < BENCH_TIMERS; i++) timers.schedule((uint32_t)(idleMs + delays[i]), [&fired] { fired++; });
+        auto start = Clock::now();
+        for (uint64_t tick = 1; tick <= BENCH_IDLE_TICKS; tick++) fired += timers.advance(tick * BENCH_TICK_MS);
+        t.tickNs = nsEach(start, BENCH_IDLE_TICKS);
+    }
+    if (fired) printf("FAIL: %llu timers fired while being timed\n", (unsigned long long)fired);
+    return t;
+}
+
+static bool compare(const char* operation, double wheelNs, double multimapNs) {
+    double ratio = multimapNs / wheelNs;
+    printf("%s: %.1fx the multimap\n", operation, ratio);
+    if (ratio >= BENCH_MIN_RATIO) return true;
+    printf("FAIL: %s slower on the wheel than on the multimap\n", operation);
+    return false;
+}
+
+int main() {
+    bool ok = check();
+    Timings wheel = measure<TimerWheel>();
+    Timings multimap = measure<MultimapTimers>();
+    printf("%d timers         schedule    move  cancel  idle tick\n", BENCH_TIMERS);
+    printf("timer wheel     %7.0f ns %4.0f ns %4.0f ns %6.0f ns\n", wheel.scheduleNs, wheel.moveNs, wheel.cancelNs, wheel.tickNs);
+    printf("std::multimap   %7.0f ns %4.0f ns %4.0f ns %6.0f ns\n", multimap.scheduleNs, multimap.moveNs, multimap.cancelNs,
+           multimap.tickNs);
+    ok = compare("schedule", wheel.scheduleNs, multimap.scheduleNs) && ok;
+    ok = compare("move", wheel.moveNs, multimap.moveNs) && ok;
+    ok = compare("cancel", wheel.cancelNs, multimap.cancelNs) && ok;
+
+    printf(ok ? "PASS\n" : "FAIL\n");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
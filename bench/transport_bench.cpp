@@ -0,0 +1,184 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <algorithm> // For std::sort, std::min
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "transport.h" // For SocketTransport, createShmTransport, attachShmTransport
+
+// Benchmark of the session transports (utils/transport.h) between two processes: TCP over
+// loopback, a Unix domain socket, and the shared-memory rings.
+// 1. Round trip: BENCH_ROUND_TRIPS messages of BENCH_MESSAGE_BYTES, each echoed back by the
+//    child before the next goes out; median and 99th percentile.
+// 2. Throughput: BENCH_STREAM_MB streamed in BENCH_CHUNK_BYTES writes, the session's largest
+//    frame, until the child acknowledges the last byte.
+// The parent checks every echo, and the child checks every chunk's sequence number and
+// contents and reports how many were wrong.
+// Passes if every transport delivers everything intact, and the Unix socket and shared memory
+// each reach at least BENCH_MIN_RATIO of TCP's round-trip rate and throughput (the two processes
+// compete for the CPU, so the ratio allows for noise).
+
+#define BENCH_ROUND_TRIPS 20000
+#define BENCH_MESSAGE_BYTES 64
+#define BENCH_STREAM_MB 2048
+#define BENCH_CHUNK_BYTES 16384
+#define BENCH_MIN_RATIO 0.9
+
+enum Kind { TRANSPORT_TCP, TRANSPORT_UNIX, TRANSPORT_SHM };
+
+struct RunResult {
+    double rttP50Us = 0, rttP99Us = 0, mbPerS = 0;
+    uint32_t badEchoes = 0, badChunks = 0;
+    bool completed = false;
+};
+
+static const size_t BENCH_CHUNKS = (size_t)BENCH_STREAM_MB * 1024 * 1024 / BENCH_CHUNK_BYTES;
+
+static void fillChunk(uint8_t* chunk, uint64_t seq) {
+    memcpy(chunk, &seq, sizeof(seq));
+    memset(chunk + sizeof(seq), (int)(seq & 0xff), BENCH_CHUNK_BYTES - sizeof(seq));
+}
+
+static bool chunkIntact(const uint8_t* chunk, uint64_t expectedSeq) {
+    uint64_t seq;
+    memcpy(&seq, chunk, sizeof(seq));
+    if (seq != expectedSeq) return false;
+    // The two ends and the middle: a full compare would time memcmp rather than the transport
+    uint8_t fill = (uint8_t)(seq & 0xff);
+    return chunk[sizeof(seq)] == fill && chunk[BENCH_CHUNK_BYTES / 2] == fill && chunk[BENCH_CHUNK_BYTES - 1] == fill;
+}
+
+// Child: echoes the round trips, then takes the stream and answers with the bad chunk count
+static int serve(Transport& t) {
+    uint8_t message[BENCH_MESSAGE_BYTES];
+    for (int i = 0; i < BENCH_ROUND_TRIPS; i++) {
+        if (!t.recvAll(message, sizeof(message)) || !t.sendAll(message, sizeof(message))) return EXIT_FAILURE;
+    }
+    std::vector<uint8_t> chunk(BENCH_CHUNK_BYTES);
+    uint32_t bad = 0;
+    for (size_t seq = 0; seq < BENCH_CHUNKS; seq++) {
+        if (!t.recvAll(chunk.data(), chunk.size())) return EXIT_FAILURE;
+        if (!chunkIntact(chunk.data(), seq)) bad++;
+    }
+    return t.sendAll(&bad, sizeof(bad)) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Parent: drives both phases
+static void drive(Transport& t, RunResult& r) {
+    using Clock = std::chrono::steady_clock;
+    uint8_t message[BENCH_MESSAGE_BYTES], echo[BENCH_MESSAGE_BYTES];
+    std::vector<double> rtts;
+    rtts.reserve(BENCH_ROUND_TRIPS);
+    for (int i = 0; i < BENCH_ROUND_TRIPS; i++) {
+        memset(message, i & 0xff, sizeof(message));
+        auto start = Clock::now();
+        if (!t.sendAll(message, sizeof(message)) || !t.recvAll(echo, sizeof(echo))) return;
+        rtts.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+        if (memcmp(message, echo, sizeof(message)) != 0) r.badEchoes++;
+    }
+    std::sort(rtts.begin(), rtts.end());
+    r.rttP50Us = rtts[rtts.size() / 2];
+    r.rttP99Us = rtts[std::min(rtts.size() - 1, rtts.size() * 99 / 100)];
+
+    std::vector<uint8_t> chunk(BENCH_CHUNK_BYTES);
+    auto start = Clock::now();
+    for (size_t seq = 0; seq < BENCH_CHUNKS; seq++) {
+        fillChunk(chunk.data(), seq);
+        if (!t.sendAll(chunk.data(), chunk.size())) return;
+    }
+    if (!t.recvAll(&r.badChunks, sizeof(r.badChunks))) return;
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    r.mbPerS = BENCH_STREAM_MB * 1024.0 * 1024.0 / 1e6 / seconds;
+    r.completed = true;
+}
+
+static RunResult run(Kind kind) {
+    RunResult r;
+    int parentFd = -1, childFd = -1;
+    if (kind == TRANSPORT_TCP) {
+        int listener = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t addr_len = sizeof(addr);
+        bind(listener, (sockaddr*)&addr, sizeof(addr));
+        listen(listener, 1);
+        getsockname(listener, (sockaddr*)&addr, &addr_len);
+        parentFd = socket(AF_INET, SOCK_STREAM, 0);
+        connect(parentFd, (sockaddr*)&addr, sizeof(addr));
+        childFd = accept(listener, nullptr, nullptr);
+        close(listener);
+        int one = 1; // As SessionMux sets it
+        setsockopt(parentFd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        setsockopt(childFd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    } else {
+        int sv[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) return r;
+        parentFd = sv[0];
+        childFd = sv[1];
+    }
+
+    pid_t child = fork();
+    if (child == 0) {
+        close(parentFd);
+        std::unique_ptr<Transport> t;
+        if (kind == TRANSPORT_SHM) {
+            uint8_t mode;
+            int fds[SHM_TRANSPORT_FDS];
+            int count = 0;
+            if (recvWithFds(childFd, &mode, sizeof(mode), fds, count) != 1 || count != SHM_TRANSPORT_FDS) _exit(EXIT_FAILURE);
+            t = attachShmTransport(childFd, fds);
+        } else {
+            t.reset(new SocketTransport(childFd));
+        }
+        _exit(t ? serve(*t) : EXIT_FAILURE);
+    }
+    close(childFd);
+    std::unique_ptr<Transport> t;
+    if (kind == TRANSPORT_SHM) t = createShmTransport(parentFd, 0);
+    else t.reset(new SocketTransport(parentFd));
+    if (t) drive(*t, r);
+    t.reset();
+    int status = 0;
+    waitpid(child, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) r.completed = false;
+    return r;
+}
+
+static bool report(const char* name, const RunResult& r) {
+    bool intact = r.completed && r.badEchoes == 0 && r.badChunks == 0;
+    printf("%-14s round trip %5.1f us median, %5.1f us p99;  %6.0f MB/s;  %u bad echoes, %u bad chunks%s\n", name,
+           r.rttP50Us, r.rttP99Us, r.mbPerS, r.badEchoes, r.badChunks, intact ? "" : "  FAIL");
+    return intact;
+}
+
+static bool compare(const char* name, const RunResult& r, const RunResult& tcp) {
+    double rttRatio = tcp.rttP50Us / r.rttP50Us, rateRatio = r.mbPerS / tcp.mbPerS;
+    printf("%s: %.2fx TCP's round-trip rate, %.2fx its throughput\n", name, rttRatio, rateRatio);
+    if (rttRatio >= BENCH_MIN_RATIO && rateRatio >= BENCH_MIN_RATIO) return true;
+    printf("FAIL: %s slower than TCP\n", name);
+    return false;
+}
+
+int main() {
+    RunResult tcp = run(TRANSPORT_TCP);
+    RunResult unixSocket = run(TRANSPORT_UNIX);
+    RunResult shm = run(TRANSPORT_SHM);
+    bool ok = report("TCP loopback", tcp);
+    ok = report("Unix socket", unixSocket) && ok;
+    ok = report("shared memory", shm) && ok;
+    if (ok) {
+        ok = compare("Unix socket", unixSocket, tcp) && ok;
+        ok = compare("shared memory", shm, tcp) && ok;
+    }
+    printf(ok ? "PASS\n" : "FAIL\n");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
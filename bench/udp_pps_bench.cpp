@@ -0,0 +1,168 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "udp_batch.h" // For UdpReceiveBatch, UdpSendBatch
+
+// Packet-rate benchmark for the batched UDP paths (utils/udp_batch.h) over loopback, with
+// voice-sized datagrams to a single destination.
+// 1. Send side: one sendto() per datagram, UdpSendBatch (sendmmsg), and UdpSendBatch with
+//    GSO, each into a recvmmsg receiver.
+// 2. Receive side: one recvfrom() per datagram and UdpReceiveBatch (recvmmsg), each fed by
+//    the GSO sender.
+// The sender keeps at most BENCH_WINDOW datagrams in flight so the socket buffer never
+// overflows, and the receiver checks every datagram's sequence number and contents.
+// Passes if every datagram arrives intact and in order in every run, and each batched path
+// reaches at least BENCH_MIN_RATIO of the packet rate of its one-syscall-per-datagram
+// counterpart (sender and receiver compete for the CPU, so the ratio allows for noise).
+
+#define BENCH_PACKETS 200000
+#define BENCH_PACKET_BYTES 140 // A 24 kbit/s Opus frame with one RED copy
+#define BENCH_SLOT_BYTES 4096  // The voice server's receive buffer
+#define BENCH_WINDOW 1024
+#define BENCH_TIMEOUT_MS 1000
+#define BENCH_MIN_RATIO 0.9
+
+enum SendMode { SEND_SENDTO, SEND_MMSG, SEND_GSO };
+enum ReceiveMode { RECEIVE_RECVFROM, RECEIVE_MMSG };
+
+struct RunResult {
+    double pps = 0;
+    uint32_t received = 0, corrupt = 0;
+};
+
+static void fillPacket(uint8_t* packet, uint32_t seq) {
+    memcpy(packet, &seq, sizeof(seq));
+    for (size_t i = sizeof(seq); i < BENCH_PACKET_BYTES; i++) packet[i] = (uint8_t)(seq * 7 + i);
+}
+
+static bool packetIntact(const uint8_t* packet, size_t size, uint32_t expectedSeq) {
+    if (size != BENCH_PACKET_BYTES) return false;
+    uint8_t expected[BENCH_PACKET_BYTES];
+    fillPacket(expected, expectedSeq);
+    return memcmp(packet, expected, size) == 0;
+}
+
+static RunResult run(SendMode sendMode, ReceiveMode receiveMode) {
+    int rx = socket(AF_INET, SOCK_DGRAM, 0);
+    int tx = socket(AF_INET, SOCK_DGRAM, 0);
+    int rcvbuf = 4 * 1024 * 1024;
+    setsockopt(rx, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    timeval timeout = {BENCH_TIMEOUT_MS / 1000, (BENCH_TIMEOUT_MS % 1000) * 1000};
+    setsockopt(rx, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)); // Ends the run on loss
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    bind(rx, (sockaddr*)&addr, sizeof(addr));
+    getsockname(rx, (sockaddr*)&addr, &addr_len);
+
+    std::atomic<uint32_t> received{0};
+    std::atomic<bool> receiverDone{false};
+    auto start = std::chrono::steady_clock::now();
+
+    std::thread sender([&] {
+        UdpSendBatch batch;
+        batch.enableGso(sendMode == SEND_GSO);
+        std::vector<uint8_t> packets(UDP_BATCH_SIZE * BENCH_PACKET_BYTES);
+        uint32_t seq = 0;
+        while (seq < BENCH_PACKETS && !receiverDone) {
+            if (seq - received.load() + UDP_BATCH_SIZE > BENCH_WINDOW) {
+                std::this_thread::yield(); // Let the receiver catch up
+                continue;
+            }
+            if (sendMode == SEND_SENDTO) {
+                for (int i = 0; i < UDP_BATCH_SIZE && seq < BENCH_PACKETS; i++, seq++) {
+                    fillPacket(packets.data(), seq);
+                    sendto(tx, packets.data(), BENCH_PACKET_BYTES, 0, (sockaddr*)&addr, sizeof(addr));
+                }
+            } else {
+                for (int i = 0; i < UDP_BATCH_SIZE && seq < BENCH_PACKETS; i++, seq++) {
+                    uint8_t* packet = packets.data() + i * BENCH_PACKET_BYTES;
+                    fillPacket(packet, seq);
+                    batch.add(addr, packet, BENCH_PACKET_BYTES);
+                }
+                batch.flush(tx);
+            }
+        }
+    });
+
+    RunResult r;
+    uint32_t expected = 0;
+    if (receiveMode == RECEIVE_MMSG) {
+        UdpReceiveBatch batch(BENCH_SLOT_BYTES);
+        while (expected < BENCH_PACKETS) {
+            if (batch.receive(rx) <= 0) break; // Timed out: something was lost
+            for (size_t i = 0; i < batch.count(); i++) {
+                if (!packetIntact(batch.packet(i).data, batch.packet(i).size, expected)) r.corrupt++;
+                expected++;
+            }
+            received.store(expected);
+        }
+    } else {
+        std::vector<uint8_t> buffer(BENCH_SLOT_BYTES);
+        while (expected < BENCH_PACKETS) {
+            sockaddr_in from{};
+            socklen_t from_len = sizeof(from);
+            ssize_t bytes = recvfrom(rx, buffer.data(), buffer.size(), 0, (sockaddr*)&from, &from_len);
+            if (bytes < 0 && errno == EINTR) continue;
+            if (bytes <= 0) break;
+            if (!packetIntact(buffer.data(), (size_t)bytes, expected)) r.corrupt++;
+            expected++;
+            received.store(expected);
+        }
+    }
+    r.pps = expected / std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    receiverDone = true;
+    sender.join();
+    close(tx);
+    close(rx);
+    r.received = expected;
+    return r;
+}
+
+static bool report(const char* name, const RunResult& r) {
+    bool intact = r.received == BENCH_PACKETS && r.corrupt == 0;
+    printf("%-26s %7.0f kpps  %u/%d datagrams, %u corrupt%s\n", name, r.pps / 1000, r.received, BENCH_PACKETS,
+           r.corrupt, intact ? "" : "  FAIL");
+    return intact;
+}
+
+static bool compare(const char* batched, const RunResult& b, const char* single, const RunResult& s) {
+    double ratio = b.pps / s.pps;
+    printf("%s: %.2fx %s\n", batched, ratio, single);
+    if (ratio >= BENCH_MIN_RATIO) return true;
+    printf("FAIL: %s slower than %s\n", batched, single);
+    return false;
+}
+
+int main() {
+    bool ok = true;
+    RunResult sendtoRun = run(SEND_SENDTO, RECEIVE_MMSG);
+    RunResult sendmmsgRun = run(SEND_MMSG, RECEIVE_MMSG);
+    RunResult gsoRun = run(SEND_GSO, RECEIVE_MMSG);
+    ok = report("send: sendto", sendtoRun) && ok;
+    ok = report("send: sendmmsg", sendmmsgRun) && ok;
+    ok = report("send: sendmmsg + GSO", gsoRun) && ok;
+
+    RunResult recvfromRun = run(SEND_GSO, RECEIVE_RECVFROM);
+    RunResult recvmmsgRun = run(SEND_GSO, RECEIVE_MMSG);
+    ok = report("receive: recvfrom", recvfromRun) && ok;
+    ok = report("receive: recvmmsg", recvmmsgRun) && ok;
+
+    ok = compare("sendmmsg", sendmmsgRun, "sendto", sendtoRun) && ok;
+    ok = compare("sendmmsg + GSO", gsoRun, "sendto", sendtoRun) && ok;
+    ok = compare("recvmmsg", recvmmsgRun, "recvfrom", recvfromRun) && ok;
+
+    printf(ok ? "PASS\n" : "FAIL\n");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
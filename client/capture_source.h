@@ -0,0 +1,181 @@
+#ifndef CAPTURE_SOURCE_H
+#define CAPTURE_SOURCE_H
+
+#include <string>
+#include <memory>
+#include <algorithm> // For std::min, std::max
+#include <cstdio>    // For sscanf
+#include <opencv2/opencv.hpp>
+
+#include "common_utils.h"
+#include "client_common.h" // For VIDEO_TARGET_FPS
+
+#define VIDEO_PATTERN_WIDTH 1280
+#define VIDEO_PATTERN_HEIGHT 720
+
+// Where the video client gets its frames from. read() returns a new Mat for each frame,
+// so frames already queued downstream are never overwritten.
+class CaptureSource {
+public:
+    virtual ~CaptureSource() = default;
+    virtual bool open() = 0;
+    virtual bool read(cv::Mat& frame) = 0;
+    virtual std::string describe() const = 0;
+};
+
+// A camera through OpenCV (V4L2 on Linux, AVFoundation on macOS)
+class CameraCaptureSource : public CaptureSource {
+public:
+    explicit CameraCaptureSource(int index) : index_(index) {}
+    ~CameraCaptureSource() override { cap_.release(); }
+
+    bool open() override {
+        try {
+            cap_.open(index_);
+            if (!cap_.isOpened()) {
+                logError("Could not open camera. Make sure your camera is not being used by another application.");
+                return false;
+            }
+        } catch (const cv::Exception& e) {
+            logError("OpenCV camera open error: " + std::string(e.what()));
+            return false;
+        }
+
+        // Capture at the top of the resolution ladder; the rate controller scales down from there
+        try {
+            cap_.set(cv::CAP_PROP_FRAME_WIDTH, 1920);
+            cap_.set(cv::CAP_PROP_FRAME_HEIGHT, 1080);
+            cap_.set(cv::CAP_PROP_FPS, VIDEO_TARGET_FPS);
+            logInfo("Camera properties set to " + std::to_string((int)cap_.get(cv::CAP_PROP_FRAME_WIDTH)) + "x" +
+                    std::to_string((int)cap_.get(cv::CAP_PROP_FRAME_HEIGHT)) + " @ " + std::to_string(VIDEO_TARGET_FPS) + " FPS.");
+        } catch (...) {
+            logInfo("Could not set camera properties, using defaults.");
+        }
+        return true;
+    }
+
+    bool read(cv::Mat& frame) override { return cap_.read(frame) && !frame.empty(); }
+
+    std::string describe() const override { return "camera " + std::to_string(index_); }
+
+private:
+    int index_;
+    cv::VideoCapture cap_;
+};
+
+// A video file, or an image sequence given as a printf-style pattern (e.g. frames/img_%04d.png).
+// Loops back to the start at the end so it can feed long runs.
+class FileCaptureSource : public CaptureSource {
+public:
+    explicit FileCaptureSource(const std::string& path) : path_(path) {}
+    ~FileCaptureSource() override { cap_.release(); }
+
+    bool open() override {
+        try {
+            cap_.open(path_);
+        } catch (const cv::Exception& e) {
+            logError("OpenCV file open error: " + std::string(e.what()));
+            return false;
+        }
+        if (!cap_.isOpened()) {
+            logError("Could not open video file or image sequence " + path_);
+            return false;
+        }
+        return true;
+    }
+
+    bool read(cv::Mat& frame) override {
+        if (cap_.read(frame) && !frame.empty()) return true;
+        // End of file: reopening works for every backend, seeking does not
+        cap_.release();
+        return open() && cap_.read(frame) && !frame.empty();
+    }
+
+    std::string describe() const override { return "file " + path_; }
+
+private:
+    std::string path_;
+    cv::VideoCapture cap_;
+};
+
+// Generated frames: static colour bars with a moving box and a frame counter, so that
+// keyframes carry real detail and delta frames change only a few tiles, like a webcam would.
+class TestPatternCaptureSource : public CaptureSource {
+public:
+    TestPatternCaptureSource(int width, int height) : width_(width), height_(height) {}
+
+    bool open() override {
+        background_.create(height_, width_, CV_8UC3);
+        static const cv::Scalar bars[] = {
+            {255, 255, 255}, {0, 255, 255}, {255, 255, 0}, {0, 255, 0},
+            {255, 0, 255}, {0, 0, 255}, {255, 0, 0}, {0, 0, 0},
+        };
+        int barWidth = (width_ + 7) / 8;
+        for (int i = 0; i < 8; i++) {
+            int x = i * barWidth;
+            if (x >= width_) break;
+            cv::rectangle(background_, cv::Rect(x, 0, std::min(barWidth, width_ - x), height_), bars[i], cv::FILLED);
+        }
+        return true;
+    }
+
+    bool read(cv::Mat& frame) override {
+        frame = background_.clone();
+        int box = std::max(16, height_ / 6);
+        int travelX = std::max(1, width_ - box);
+        int travelY = std::max(1, height_ - box);
+        // Bounce diagonally at a few pixels per frame
+        int x = (int)((counter_ * 7) % (2 * travelX));
+        int y = (int)((counter_ * 5) % (2 * travelY));
+        if (x >= travelX) x = 2 * travelX - x;
+        if (y >= travelY) y = 2 * travelY - y;
+        cv::rectangle(frame, cv::Rect(x, y, box, box), cv::Scalar(40, 40, 40), cv::FILLED);
+        cv::putText(frame, std::to_string(counter_), cv::Point(16, height_ - 16),
+                    cv::FONT_HERSHEY_SIMPLEX, height_ / 360.0, cv::Scalar(0, 0, 0), 2);
+        counter_++;
+        return true;
+    }
+
+    std::string describe() const override {
+        return "test pattern " + std::to_string(width_) + "x" + std::to_string(height_);
+    }
+
+private:
+    int width_;
+    int height_;
+    cv::Mat background_;
+    uint64_t counter_ = 0;
+};
+
+// Parses a --video-source spec: "camera[:INDEX]", "file:PATH" or "pattern[:WIDTHxHEIGHT]".
+// Returns nullptr if the spec is invalid.
+inline std::unique_ptr<CaptureSource> createCaptureSource(const std::string& spec) {
+    std::string kind = spec;
+    std::string arg;
+    size_t colon = spec.find(':');
+    if (colon != std::string::npos) {
+        kind = spec.substr(0, colon);
+        arg = spec.substr(colon + 1);
+    }
+
+    if (kind == "camera") {
+        int index = 0;
+        if (!arg.empty() && sscanf(arg.c_str(), "%d", &index) != 1) return nullptr;
+        return std::make_unique<CameraCaptureSource>(index);
+    }
+    if (kind == "file" && !arg.empty()) {
+        return std::make_unique<FileCaptureSource>(arg);
+    }
+    if (kind == "pattern") {
+        int width = VIDEO_PATTERN_WIDTH;
+        int height = VIDEO_PATTERN_HEIGHT;
+        if (!arg.empty() && (sscanf(arg.c_str(), "%dx%d", &width, &height) != 2 ||
+                             width < 16 || height < 16 || width > 7680 || height > 4320)) {
+            return nullptr;
+        }
+        return std::make_unique<TestPatternCaptureSource>(width & ~1, height & ~1);
+    }
+    return nullptr;
+}
+
+#endif // CAPTURE_SOURCE_H
@@ -2,20 +2,61 @@
 #define CLIENT_COMMON_H
 
 #include <atomic>
+#include <string>
+#include <vector>
 #include <csignal> // For std::signal
 
 // Global constants
 #define TCP_PORT 5000
 #define UDP_VOICE_PORT 7000
+#define UNIX_SOCKET_PATH "/tmp/mini_zoom.sock"
 #define BUFFER_SIZE 4096
 
 #define MODE_CHAT  1
 #define MODE_FILE  2
 #define MODE_VIDEO 3
+#define MODE_VIDEO_UDP 4
+#define MODE_SESSION 5
+#define MODE_SESSION_SHM 6
+
+// Video pipeline
+#define VIDEO_TARGET_FPS 30
+#define VIDEO_QUEUE_DEPTH 2
+#define VIDEO_LATENCY_TARGET_MS 150
+#define VIDEO_KEYFRAME_INTERVAL 60    // Frames between forced keyframes
+#define VIDEO_TILE_SIZE 64            // Tile edge in pixels for change detection
+#define VIDEO_TILE_DIFF_THRESHOLD 6   // Mean absolute difference per byte that marks a tile as changed
+
+// Command-line options (defined in client_main.cpp)
+struct ClientOptions {
+    bool videoUdp = false;    // --video-udp: send video frames as UDP fragments with FEC
+    int videoLossPercent = 0; // --video-loss=N: drop N% of outgoing video datagrams (loss testing)
+    std::string videoSource = "camera"; // --video-source=SPEC: camera[:N], file:PATH or pattern[:WxH]
+    bool videoMaxSpeed = false;         // --video-max-speed: no frame pacing, measures pipeline throughput
+#ifdef MINI_ZOOM_OPUS
+    std::string voiceCodec = "opus";    // --voice-codec=opus|pcm: codec offered to the server
+#else
+    std::string voiceCodec = "pcm";
+#endif
+    int voiceBitrateKbps = 24;          // --voice-bitrate=KBPS: Opus bitrate asked of the server
+    bool voiceVad = true;               // --voice-vad=on|off: send nothing but comfort noise markers while silent
+    int voiceRedundancy = 1;            // --voice-red=N: copies of earlier frames carried in each voice packet (0-2)
+    int voiceLossPercent = 0;           // --voice-loss=N[:B]: drop N% of outgoing voice packets (loss testing)...
+    int voiceLossBurst = 1;             // ...in bursts of B packets on average
+    int audioLatencyMs = 0;             // --audio-latency=MS: microphone and speaker latency (0: host API low-latency default)
+    std::string audioInput;             // --audio-input=SPEC: portaudio[:N], wav:PATH, tone[:HZ] or null (empty: the default)
+    std::string audioOutput;            // --audio-output=SPEC: portaudio[:N], wav:PATH or null (empty: the default)
+    std::string transport = "tcp";      // --transport=tcp|unix[:PATH]|shm[:PATH]: how the session reaches the server
+    std::string transportPath = UNIX_SOCKET_PATH; // The server's Unix socket, for unix and shm
+    std::vector<std::string> threadRoles; // --thread-role=ROLE:SPEC, repeatable: CPUs and scheduling of a thread role
+};
 
 // Global flags (declared extern, defined in client_main.cpp)
+class ClientSession;
 extern volatile bool running;
 extern std::atomic<bool> voiceActive;
+extern ClientOptions clientOptions;
+extern ClientSession clientSession; // The connection chat, file and TCP video share (client_session.h)
 
 // Global signal handler declaration
 extern void handleSigint(int signal);
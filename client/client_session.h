@@ -0,0 +1,219 @@
+#ifndef CLIENT_SESSION_H
+#define CLIENT_SESSION_H
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <cstring> // For strerror, memcpy
+#include <cerrno>
+#include <cstdio>  // For snprintf
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include "common_utils.h"
+#include "client_common.h"  // For TCP_PORT, MODE_SESSION, clientOptions
+#include "session_mux.h"    // For SessionMux
+#include "transport.h"      // For SocketTransport, connectUnixSocket, createShmTransport
+#include "video_protocol.h" // For VideoFeedback
+#include "thread_roles.h"   // For ThreadRoleScope
+
+// The client's one connection to the server. Chat, file uploads and TCP video share it as
+// channels of a SessionMux, so they can run at the same time: chat from other clients is
+// shown whatever mode is active, and an upload carries on in the background.
+// Connected on first use and again after the server went away, over TCP or, to a server on
+// the same host, a Unix socket or shared memory (--transport).
+class ClientSession {
+public:
+    ~ClientSession() { close(); }
+
+    // Returns true once connected (at once if already)
+    bool connect(const char* server_ip) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (mux_ && mux_->open()) return true;
+        disconnect();
+
+        std::unique_ptr<Transport> transport = openTransport(server_ip);
+        if (!transport) return false;
+        mux_ = std::make_shared<SessionMux>(std::move(transport));
+        reader_ = std::thread([this, mux = mux_] {
+            ThreadRoleScope role(ROLE_NETWORK);
+            mux->run([this](uint8_t channel, uint8_t type, std::vector<uint8_t>& payload) {
+                onMessage(channel, type, payload);
+            });
+            if (running) logInfo("Session with server closed.");
+        });
+        logInfo("Connected to server over " + mux_->describe() + ".");
+        return true;
+    }
+
+    // Queues a message on the session; false if not connected. Without wait, also false if
+    // the channel's queue is full (SessionMux::send).
+    bool send(uint8_t channel, uint8_t type, const void* data, size_t len, bool wait = true) {
+        std::shared_ptr<SessionMux> mux = current();
+        return mux && mux->send(channel, type, data, len, wait);
+    }
+
+    // True while connected and neither side has closed the session
+    bool connected() {
+        std::shared_ptr<SessionMux> mux = current();
+        return mux && mux->open();
+    }
+
+    // Bytes of a channel not yet handled by the server (SessionMux::backlog); 0 if not connected
+    size_t backlog(uint8_t channel) {
+        std::shared_ptr<SessionMux> mux = current();
+        return mux ? mux->backlog(channel) : 0;
+    }
+
+    // Where VideoFeedback reports from the server go while video is streaming (empty: dropped)
+    void setVideoFeedback(std::function<void(const VideoFeedback&)> handler) {
+        std::lock_guard<std::mutex> lock(feedbackMutex_);
+        videoFeedback_ = std::move(handler);
+    }
+
+    bool uploading() const { return uploading_; }
+
+    // Sends a file in the background, one upload at a time. Returns false if it cannot start.
+    bool startUpload(const std::string& path) {
+        if (uploading_) {
+            logError("A file upload is already running.");
+            return false;
+        }
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file.is_open()) {
+            logError("Error opening file: " + path);
+            return false;
+        }
+        if (upload_.joinable()) upload_.join();
+        uploading_ = true;
+        upload_ = std::thread(&ClientSession::uploadFile, this, path, std::move(file));
+        return true;
+    }
+
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            disconnect();
+        }
+        if (upload_.joinable()) upload_.join(); // Its sends fail now
+    }
+
+private:
+    // Connects the transport clientOptions.transport names and sends the session's mode byte
+    std::unique_ptr<Transport> openTransport(const char* server_ip) {
+        if (clientOptions.transport == "shm") {
+            int sockfd = connectUnixSocket(clientOptions.transportPath); // From transport.h
+            return sockfd < 0 ? nullptr : createShmTransport(sockfd, MODE_SESSION_SHM); // Sends the mode with the rings
+        }
+        int sockfd;
+        if (clientOptions.transport == "unix") {
+            sockfd = connectUnixSocket(clientOptions.transportPath);
+            if (sockfd < 0) return nullptr;
+        } else {
+            sockfd = socket(AF_INET, SOCK_STREAM, 0);
+            if (sockfd < 0) {
+                logError("Failed to create socket for the session.");
+                return nullptr;
+            }
+            sockaddr_in servaddr{};
+            servaddr.sin_family = AF_INET;
+            servaddr.sin_port = htons(TCP_PORT);
+            if (inet_pton(AF_INET, server_ip, &servaddr.sin_addr) <= 0) {
+                logError("Invalid server IP address.");
+                ::close(sockfd);
+                return nullptr;
+            }
+            if (::connect(sockfd, (sockaddr*)&servaddr, sizeof(servaddr)) < 0) {
+                logError("Failed to connect to server: " + std::string(strerror(errno)));
+                ::close(sockfd);
+                return nullptr;
+            }
+        }
+        uint8_t mode = MODE_SESSION;
+        if (!sendAll(sockfd, (char*)&mode, sizeof(mode))) {
+            logError("Failed to send mode to server.");
+            ::close(sockfd);
+            return nullptr;
+        }
+        return std::unique_ptr<Transport>(new SocketTransport(sockfd));
+    }
+
+    std::shared_ptr<SessionMux> current() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return mux_;
+    }
+
+    // With mutex_ held
+    void disconnect() {
+        if (mux_) mux_->close(); // Ends the reader and any upload waiting on the session
+        if (reader_.joinable()) reader_.join();
+        mux_.reset();
+    }
+
+    // Runs on the session's reader thread
+    void onMessage(uint8_t channel, uint8_t type, std::vector<uint8_t>& payload) {
+        if (channel == SESSION_CHANNEL_CHAT && type == SESSION_DATA) {
+            logInfo("[Chat] " + std::string(payload.begin(), payload.end()));
+        } else if (channel == SESSION_CHANNEL_VIDEO && type == SESSION_DATA && payload.size() == wireSize<VideoFeedback>()) {
+            VideoFeedback fb;
+            decodeWire(payload.data(), fb);
+            std::lock_guard<std::mutex> lock(feedbackMutex_);
+            if (videoFeedback_) videoFeedback_(fb);
+        } else if (channel == SESSION_CHANNEL_FILE && type == SESSION_CLOSE && !payload.empty()) {
+            if (payload[0]) logInfo("File saved by the server.");
+            else logError("The server could not save the file.");
+        }
+    }
+
+    void uploadFile(std::string path, std::ifstream file) {
+        ThreadRoleScope role(ROLE_BULK);
+        std::string filename = path.substr(path.find_last_of("/\\") + 1);
+        uint64_t file_size = file.tellg();
+        file.seekg(0);
+        std::vector<uint8_t> open(wireSize<SessionFileOpen>() + filename.size());
+        encodeWire(SessionFileOpen{file_size}, open.data()); // From session_protocol.h
+        memcpy(open.data() + wireSize<SessionFileOpen>(), filename.data(), filename.size());
+        logInfo("Sending file: " + filename + " (" + std::to_string(file_size) + " bytes)");
+
+        auto start = std::chrono::steady_clock::now();
+        bool ok = send(SESSION_CHANNEL_FILE, SESSION_OPEN, open.data(), open.size());
+        std::vector<char> buffer(SESSION_MAX_FRAME);
+        uint64_t sent = 0;
+        while (ok && file && sent < file_size) {
+            file.read(buffer.data(), buffer.size());
+            std::streamsize bytes = file.gcount();
+            if (bytes <= 0) break;
+            ok = send(SESSION_CHANNEL_FILE, SESSION_DATA, buffer.data(), bytes); // Waits for flow control credit
+            if (ok) sent += bytes;
+        }
+        ok = ok && sent == file_size && send(SESSION_CHANNEL_FILE, SESSION_CLOSE, nullptr, 0);
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (ok) {
+            char rate[64];
+            snprintf(rate, sizeof(rate), " in %.1f s (%.1f MB/s)", seconds, seconds > 0 ? sent / seconds / 1e6 : 0.0);
+            logInfo("File sent: " + filename + rate);
+        } else {
+            logError("File transfer incomplete: " + filename + " (" + std::to_string(sent) + "/" +
+                     std::to_string(file_size) + " bytes)");
+        }
+        uploading_ = false;
+    }
+
+    std::mutex mutex_;
+    std::shared_ptr<SessionMux> mux_;
+    std::thread reader_;
+    std::thread upload_;
+    std::atomic<bool> uploading_{false};
+    std::mutex feedbackMutex_;
+    std::function<void(const VideoFeedback&)> videoFeedback_;
+};
+
+#endif // CLIENT_SESSION_H
@@ -0,0 +1,113 @@
+#ifndef VIDEO_ENCODER_H
+#define VIDEO_ENCODER_H
+
+#include <vector>
+#include <atomic>
+#include <algorithm> // For std::min
+#include <opencv2/opencv.hpp>
+
+#include "client_common.h"  // For VIDEO_KEYFRAME_INTERVAL, VIDEO_TILE_SIZE, VIDEO_TILE_DIFF_THRESHOLD
+#include "video_protocol.h" // For beginVideoFrame, appendVideoPatch
+#include "tile_diff.h"      // For blockChanged
+#include "thread_pool.h"
+
+// Builds wire frames from captured pictures. Keyframes carry the whole picture
+// as horizontal strips; in between, only tiles that differ from what the receiver
+// already has are encoded. All patches of a frame are JPEG-encoded in parallel.
+class VideoFrameEncoder {
+public:
+    // Forces the next frame to be a keyframe (e.g. after a delta frame was dropped).
+    // Safe to call from any thread.
+    void requestKeyframe() { forceKey_ = true; }
+
+    // seq and captureUs identify the captured picture in the frame header
+    bool encode(const cv::Mat& frame, uint32_t seq, int64_t captureUs, int quality, std::vector<uchar>& out) {
+        bool key = forceKey_ || reference_.size() != frame.size() || framesSinceKey_ >= VIDEO_KEYFRAME_INTERVAL;
+
+        rects_.clear();
+        if (key) {
+            collectStrips(frame);
+        } else {
+            collectChangedTiles(frame);
+        }
+
+        if (!encodePatches(frame, quality)) return false;
+
+        beginVideoFrame(out, key ? VIDEO_FRAME_KEY : VIDEO_FRAME_DELTA, (uint16_t)frame.cols, (uint16_t)frame.rows,
+                        seq, captureUs);
+        for (size_t i = 0; i < rects_.size(); i++) {
+            const cv::Rect& r = rects_[i];
+            appendVideoPatch(out, (uint16_t)r.x, (uint16_t)r.y, (uint16_t)r.width, (uint16_t)r.height, jpegs_[i]);
+        }
+        setVideoPatchCount(out, (uint16_t)rects_.size());
+        setVideoEncodeTime(out, videoClockUs());
+
+        if (key) {
+            frame.copyTo(reference_);
+            forceKey_ = false;
+            framesSinceKey_ = 0;
+        } else {
+            for (const cv::Rect& r : rects_) frame(r).copyTo(reference_(r));
+            framesSinceKey_++;
+        }
+        return true;
+    }
+
+private:
+    // One strip per worker, heights aligned to the 16-line JPEG MCU
+    void collectStrips(const cv::Mat& frame) {
+        int strips = (int)std::max<size_t>(1, pool_.size());
+        int stripHeight = ((frame.rows + strips - 1) / strips + 15) & ~15;
+        for (int y = 0; y < frame.rows; y += stripHeight) {
+            rects_.emplace_back(0, y, frame.cols, std::min(stripHeight, frame.rows - y));
+        }
+    }
+
+    // Each horizontal run of changed tiles becomes one patch to save JPEG headers
+    void collectChangedTiles(const cv::Mat& frame) {
+        const size_t pixelBytes = frame.elemSize();
+        for (int y = 0; y < frame.rows; y += VIDEO_TILE_SIZE) {
+            int h = std::min(VIDEO_TILE_SIZE, frame.rows - y);
+            int x = 0;
+            while (x < frame.cols) {
+                int runStart = x;
+                while (x < frame.cols && tileChanged(frame, x, y, h, pixelBytes)) x += VIDEO_TILE_SIZE;
+                if (x > runStart) {
+                    rects_.emplace_back(runStart, y, std::min(x, frame.cols) - runStart, h);
+                } else {
+                    x += VIDEO_TILE_SIZE;
+                }
+            }
+        }
+    }
+
+    bool encodePatches(const cv::Mat& frame, int quality) {
+        if (jpegs_.size() < rects_.size()) jpegs_.resize(rects_.size());
+        std::vector<int> params = {cv::IMWRITE_JPEG_QUALITY, quality};
+        std::atomic<bool> ok{true};
+        pool_.parallelFor(rects_.size(), [&](size_t i) {
+            try {
+                if (!cv::imencode(".jpg", frame(rects_[i]), jpegs_[i], params)) ok = false;
+            } catch (const cv::Exception&) {
+                ok = false;
+            }
+        });
+        return ok;
+    }
+
+    bool tileChanged(const cv::Mat& frame, int x, int y, int h, size_t pixelBytes) const {
+        int w = std::min(VIDEO_TILE_SIZE, frame.cols - x);
+        return blockChanged(frame.ptr(y) + x * pixelBytes, frame.step,
+                            reference_.ptr(y) + x * pixelBytes, reference_.step,
+                            w * pixelBytes, h, VIDEO_TILE_DIFF_THRESHOLD);
+    }
+
+    ThreadPool pool_;
+    cv::Mat reference_;                   // What the receiver currently shows (source pixels)
+    std::vector<cv::Rect> rects_;         // Patches of the frame being built
+    std::vector<std::vector<uchar>> jpegs_; // Encoded patch buffers, reused across frames
+    int framesSinceKey_ = 0;
+    std::atomic<bool> forceKey_{true};
+};
+
+#endif // VIDEO_ENCODER_H
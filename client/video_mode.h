@@ -9,166 +9,371 @@
 #include <opencv2/opencv.hpp>
 #include <limits>
 #include <iomanip> // For std::fixed and std::setprecision
+#include <sstream>
 #include <chrono>  // For std::chrono
+#include <atomic>
+#include <cstring> // For strerror
+#include <cerrno>
+#include <random>  // For simulated loss
+#include <memory>
 
 #include "common_utils.h"
 #include "client_common.h" // For TCP_PORT, MODE_VIDEO, running
 #include "client_utils.h" // For getch_nonblocking
+#include "bounded_queue.h"
+#include "frame_clock.h"
+#include "video_protocol.h"
+#include "video_rate_control.h"
+#include "video_encoder.h"
+#include "video_fec.h"
+#include "capture_source.h"
+#include "client_session.h" // For ClientSession
+#include "thread_roles.h"   // For ThreadRoleScope
 
-// Main function for video streaming mode
-inline void runVideoMode(const char* server_ip) {
-    try {
-        logInfo("Starting video streaming mode...");
-        
-        int sockfd = socket(AF_INET, SOCK_STREAM, 0);
-        if (sockfd < 0) {
-            logError("Failed to create socket for video streaming");
-            return;
+// A picture on its way from the capture stage to the encoder
+struct CapturedFrame {
+    cv::Mat image;
+    uint32_t seq = 0;      // Counts every captured picture, so the server sees drops as gaps
+    int64_t captureUs = 0; // videoClockUs() when the picture was read
+};
+
+// Capture stage: reads frames paced by a frame clock and hands them to the encoder.
+// At max speed there is no pacing and no dropping: the slowest stage sets the frame rate.
+inline void videoCaptureStage(CaptureSource& source, BoundedQueue<CapturedFrame>& out, std::atomic<bool>& streaming,
+                              VideoRateController& rate) {
+    FrameClock clock(rate.fps());
+    uint32_t seq = 0;
+    while (streaming && running) {
+        CapturedFrame frame; // Fresh Mat each time so queued frames are never overwritten
+        if (!source.read(frame.image)) {
+            logError("Failed to capture frame from video source or stream ended.");
+            break;
+        }
+        frame.seq = seq++;
+        frame.captureUs = videoClockUs();
+        if (clientOptions.videoMaxSpeed) {
+            if (!out.pushWait(std::move(frame))) break;
+            continue;
+        }
+        out.push(std::move(frame));
+        clock.setRate(rate.fps());
+        clock.wait();
+    }
+}
+
+// Encode stage: scales the newest captured frame and encodes it as a key or delta frame
+inline void videoEncodeStage(BoundedQueue<CapturedFrame>& in, BoundedQueue<std::vector<uchar>>& out, std::atomic<bool>& streaming,
+                             VideoRateController& rate, VideoFrameEncoder& encoder) {
+    CapturedFrame captured;
+    cv::Mat scaled;
+    while (streaming && in.pop(captured)) {
+        cv::Mat frame = captured.image;
+        // Only ever scale down; keep the source aspect ratio and even dimensions
+        int height = rate.height();
+        if (frame.rows > height) {
+            int width = (frame.cols * height / frame.rows) & ~1;
+            cv::resize(frame, scaled, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+            frame = scaled;
         }
         
-        sockaddr_in servaddr{};
-        servaddr.sin_family = AF_INET;
-        servaddr.sin_port = htons(TCP_PORT);
-        
-        if (inet_pton(AF_INET, server_ip, &servaddr.sin_addr) <= 0) {
-            logError("Invalid server IP address");
-            close(sockfd);
-            return;
+        std::vector<uchar> encoded;
+        if (!encoder.encode(frame, captured.seq, captured.captureUs, rate.quality(), encoded)) {
+            logError("Failed to encode frame.");
+            break;
+        }
+        // Longer than the session carries (session_protocol.h): skipped, and a keyframe follows
+        if (encoded.size() > SESSION_MAX_VIDEO_MESSAGE) {
+            rate.onOversized();
+            encoder.requestKeyframe();
+            continue;
+        }
+        if (clientOptions.videoMaxSpeed) {
+            if (!out.pushWait(std::move(encoded))) break;
+            continue;
+        }
+        // A dropped delta frame leaves the server's reference stale: resync with a keyframe
+        if (!out.push(std::move(encoded))) encoder.requestKeyframe();
+    }
+}
+
+// Network stage: sends each encoded frame as one message on the session's video channel.
+// It never waits for flow control credit, so stopping the stream cannot hang on a stalled
+// server: when the channel's queue is full the frame is dropped, like one pushed out of the
+// send queue, and a keyframe follows. At max speed it retries instead until there is room.
+inline void videoNetworkStage(BoundedQueue<std::vector<uchar>>& in, std::atomic<bool>& streaming,
+                              std::atomic<int>& framesSent, std::atomic<int>& framesDropped,
+                              VideoRateController& rate, VideoFrameEncoder& encoder) {
+    std::vector<uchar> encoded;
+    auto trySend = [&]() {
+        setVideoSendTime(encoded, videoClockUs());
+        return clientSession.send(SESSION_CHANNEL_VIDEO, SESSION_DATA, encoded.data(), encoded.size(), false);
+    };
+    while (streaming && in.pop(encoded)) {
+        bool sent = trySend();
+        while (!sent && clientOptions.videoMaxSpeed && streaming && clientSession.connected()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            sent = trySend();
+        }
+        if (!sent && !clientSession.connected()) {
+            logInfo("Server disconnected or connection lost during frame send.");
+            break;
         }
         
-        if (connect(sockfd, (sockaddr*)&servaddr, sizeof(servaddr)) < 0) {
-            logError("Failed to connect for Video: " + std::string(strerror(errno)));
-            close(sockfd);
-            return;
+        if (sent) {
+            framesSent++;
+            rate.onSent(SESSION_HEADER_SIZE + encoded.size());
+        } else {
+            framesDropped++;
+            encoder.requestKeyframe(); // The server's reference is stale without this frame
         }
-        logInfo("Connected for Video streaming.");
+        rate.update(clientSession.backlog(SESSION_CHANNEL_VIDEO)); // Video's own queue, not the shared socket's
+    }
+}
 
-        uint8_t mode = MODE_VIDEO;
-        if (!sendAll(sockfd, (char*)&mode, sizeof(mode))) {
-            logError("Failed to send mode to server.");
-            close(sockfd);
-            return;
+// UDP network stage: sends each encoded frame as sequence-numbered fragments with XOR parity
+inline void videoUdpNetworkStage(int udpfd, BoundedQueue<std::vector<uchar>>& in, std::atomic<bool>& streaming,
+                                 std::atomic<int>& framesSent, VideoRateController& rate) {
+    std::vector<uchar> encoded;
+    std::vector<std::vector<uint8_t>> datagrams;
+    uint32_t seq = 0;
+    std::mt19937 rng(std::random_device{}());
+    std::uniform_int_distribution<int> percent(0, 99);
+    
+    while (streaming && in.pop(encoded)) {
+        setVideoSendTime(encoded, videoClockUs());
+        fragmentVideoFrame(seq++, encoded.data(), encoded.size(), datagrams);
+        size_t bytes = 0;
+        for (const std::vector<uint8_t>& dgram : datagrams) {
+            bytes += dgram.size();
+            if (percent(rng) < clientOptions.videoLossPercent) continue; // Simulated network loss
+            // A full socket buffer or a transient ICMP error just loses this datagram
+            if (send(udpfd, dgram.data(), dgram.size(), 0) < 0 && errno != ENOBUFS && errno != EAGAIN && errno != ECONNREFUSED) {
+                logInfo("Failed to send video datagram: " + std::string(strerror(errno)));
+                return;
+            }
         }
         
-        cv::VideoCapture cap;
-        logInfo("Attempting to open camera...");
-        try {
-            cap.open(0); // Use cap.open(0) for general compatibility
-            if (!cap.isOpened()) {
-                logError("Could not open camera. Make sure your camera is not being used by another application.");
+        framesSent++;
+        rate.onSent(bytes);
+        rate.update(udpfd);
+    }
+}
+
+// Feedback stage: reads receiver reports sent back by the server
+inline void videoFeedbackStage(int sockfd, VideoRateController& rate, VideoFrameEncoder& encoder) {
+    ThreadRoleScope role(ROLE_NETWORK);
+    VideoFeedback fb;
+    while (recvWire(sockfd, fb)) { // From wire_schema.h
+        rate.onFeedback(fb);
+        if (fb.flags & VIDEO_FEEDBACK_KEYFRAME) encoder.requestKeyframe();
+    }
+}
+
+// Main function for video streaming mode
+inline void runVideoMode(const char* server_ip) {
+    try {
+        logInfo("Starting video streaming mode...");
+        
+        // Over TCP, frames share the session with chat and uploads. The UDP transport keeps a
+        // connection of its own as control channel, and frames go to the port the server announces.
+        int sockfd = -1;
+        int udpfd = -1;
+        if (!clientOptions.videoUdp) {
+            if (!clientSession.connect(server_ip) || !clientSession.send(SESSION_CHANNEL_VIDEO, SESSION_OPEN, nullptr, 0)) {
+                logError("Failed to start video on the session.");
+                return;
+            }
+        } else {
+            sockfd = socket(AF_INET, SOCK_STREAM, 0);
+            if (sockfd < 0) {
+                logError("Failed to create socket for video streaming");
+                return;
+            }
+            
+            sockaddr_in servaddr{};
+            servaddr.sin_family = AF_INET;
+            servaddr.sin_port = htons(TCP_PORT);
+            
+            if (inet_pton(AF_INET, server_ip, &servaddr.sin_addr) <= 0) {
+                logError("Invalid server IP address");
                 close(sockfd);
                 return;
             }
-        } catch (const cv::Exception& e) {
-            logError("OpenCV camera open error: " + std::string(e.what()));
-            close(sockfd);
-            return;
+            
+            if (connect(sockfd, (sockaddr*)&servaddr, sizeof(servaddr)) < 0) {
+                logError("Failed to connect for Video: " + std::string(strerror(errno)));
+                close(sockfd);
+                return;
+            }
+            logInfo("Connected for Video streaming.");
+
+            uint8_t mode = MODE_VIDEO_UDP;
+            if (!sendAll(sockfd, (char*)&mode, sizeof(mode))) {
+                logError("Failed to send mode to server.");
+                close(sockfd);
+                return;
+            }
+            
+            VideoUdpAnnounce announce{0};
+            sockaddr_in udpaddr = servaddr;
+            if (recvWire(sockfd, announce)) { // From wire_schema.h
+                udpaddr.sin_port = htons(announce.port);
+                udpfd = socket(AF_INET, SOCK_DGRAM, 0);
+            }
+            if (udpfd < 0 || connect(udpfd, (sockaddr*)&udpaddr, sizeof(udpaddr)) < 0) {
+                logError("Failed to set up UDP video transport.");
+                if (udpfd >= 0) close(udpfd);
+                close(sockfd);
+                return;
+            }
+            int sndbuf = 1024 * 1024;
+            setsockopt(udpfd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+            logInfo("Using UDP video transport to port " + std::to_string(announce.port) +
+                    (clientOptions.videoLossPercent ? " with " + std::to_string(clientOptions.videoLossPercent) + "% simulated loss" : std::string()) + ".");
         }
-        logInfo("Camera opened successfully.");
         
-        // Set camera properties for better performance
-        try {
-            cap.set(cv::CAP_PROP_FRAME_WIDTH, 640);
-            cap.set(cv::CAP_PROP_FRAME_HEIGHT, 480);
-            cap.set(cv::CAP_PROP_FPS, 30);
-            logInfo("Camera properties set to 640x480 @ 30 FPS.");
-        } catch (...) {
-            logInfo("Could not set camera properties, using defaults.");
+        std::unique_ptr<CaptureSource> source = createCaptureSource(clientOptions.videoSource); // From capture_source.h
+        logInfo("Opening video source: " + (source ? source->describe() : clientOptions.videoSource));
+        if (!source || !source->open()) {
+            logError("Could not open video source.");
+            if (udpfd >= 0) close(udpfd);
+            if (sockfd >= 0) close(sockfd);
+            else clientSession.send(SESSION_CHANNEL_VIDEO, SESSION_CLOSE, nullptr, 0);
+            return;
         }
+        logInfo("Video source opened successfully" + std::string(clientOptions.videoMaxSpeed ? " (max speed, no pacing)." : "."));
         
         logInfo("Video streaming started. Press ESC to stop and return to main menu.");
         
-        cv::Mat frame;
-        std::vector<uchar> encoded;
-        std::vector<int> params = {cv::IMWRITE_JPEG_QUALITY, 40};
+        // Capture -> encode -> network, connected by small drop-oldest queues
+        BoundedQueue<CapturedFrame> captureQueue(VIDEO_QUEUE_DEPTH);
+        BoundedQueue<std::vector<uchar>> sendQueue(VIDEO_QUEUE_DEPTH);
+        std::atomic<bool> streaming{true};
+        std::atomic<int> framesSent{0};
+        std::atomic<int> framesDropped{0}; // By the session's video queue, when the server falls behind
+        VideoRateController rate;
+        VideoFrameEncoder encoder;
         
-        bool streaming = true;
-        int frameCount = 0;
-        auto startTime = std::chrono::steady_clock::now();
+        auto stopPipeline = [&]() {
+            streaming = false;
+            captureQueue.close();
+            sendQueue.close();
+        };
         
-        while (streaming && running) {
+        std::thread captureThread([&]() {
+            ThreadRoleScope role(ROLE_CODEC);
             try {
-                bool frameRead = cap.read(frame);
-                if (!frameRead || frame.empty()) {
-                    logError("Failed to capture frame from camera or stream ended.");
-                    break;
-                }
-                
-                // Encode frame
-                encoded.clear();
-                if (!cv::imencode(".jpg", frame, encoded, params)) {
-                    logError("Failed to encode frame.");
-                    break;
-                }
-                
-                // Send frame size
-                uint32_t frame_size_net = htonl((uint32_t)encoded.size());
-                if (!sendAll(sockfd, (char*)&frame_size_net, sizeof(frame_size_net))) {
-                    logInfo("Server disconnected or connection lost during frame size send.");
-                    break;
-                }
-                
-                // Send frame data
-                if (!sendAll(sockfd, (char*)encoded.data(), encoded.size())) {
-                    logInfo("Server disconnected or connection lost during frame data send.");
-                    break;
-                }
-                
-                frameCount++;
-                
-                // Show frame rate every 30 frames
-                if (frameCount % 30 == 0) {
-                    auto currentTime = std::chrono::steady_clock::now();
-                    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - startTime);
-                    if (duration.count() > 0) {
-                        double fps = (30.0 * 1000.0) / duration.count();
-                        std::cout << "\rStreaming... FPS: " << std::fixed << std::setprecision(1) << fps 
-                                 << " | Press ESC to stop" << std::flush;
-                    }
-                    startTime = currentTime;
-                }
-                
-                // Check for ESC key using non-blocking input
-                int key = getch_nonblocking();
-                if (key == 27) { // ESC key ASCII value
-                    logInfo("\nESC pressed - stopping video stream.");
-                    streaming = false;
-                }
-                
-                // Small delay to prevent overwhelming the server
-                std::this_thread::sleep_for(std::chrono::milliseconds(33)); // ~30 FPS
-                
+                videoCaptureStage(*source, captureQueue, streaming, rate);
             } catch (const cv::Exception& e) {
-                logError("OpenCV error during streaming loop: " + std::string(e.what()));
-                break;
-            } catch (const std::exception& e) {
-                logError("Standard exception during streaming loop: " + std::string(e.what()));
-                break;
+                logError("OpenCV error in capture stage: " + std::string(e.what()));
             } catch (...) {
-                logError("Unknown exception during streaming loop.");
+                logError("Unknown exception in capture stage.");
+            }
+            stopPipeline();
+        });
+        
+        std::thread encodeThread([&]() {
+            ThreadRoleScope role(ROLE_CODEC);
+            try {
+                videoEncodeStage(captureQueue, sendQueue, streaming, rate, encoder);
+            } catch (const cv::Exception& e) {
+                logError("OpenCV error in encode stage: " + std::string(e.what()));
+            } catch (...) {
+                logError("Unknown exception in encode stage.");
+            }
+            stopPipeline();
+        });
+        
+        std::thread networkThread([&]() {
+            ThreadRoleScope role(ROLE_NETWORK);
+            try {
+                if (udpfd >= 0) {
+                    videoUdpNetworkStage(udpfd, sendQueue, streaming, framesSent, rate);
+                } else {
+                    videoNetworkStage(sendQueue, streaming, framesSent, framesDropped, rate, encoder);
+                }
+            } catch (...) {
+                logError("Unknown exception in network stage.");
+            }
+            stopPipeline();
+        });
+        
+        std::thread feedbackThread;
+        if (sockfd >= 0) {
+            feedbackThread = std::thread(videoFeedbackStage, sockfd, std::ref(rate), std::ref(encoder));
+        } else {
+            clientSession.setVideoFeedback([&rate, &encoder](const VideoFeedback& fb) {
+                rate.onFeedback(fb);
+                if (fb.flags & VIDEO_FEEDBACK_KEYFRAME) encoder.requestKeyframe();
+            });
+        }
+        
+        // Main thread only handles the ESC key and the FPS readout
+        int lastFrames = 0;
+        auto startTime = std::chrono::steady_clock::now();
+        auto sessionStart = startTime;
+        while (streaming && running) {
+            int key = getch_nonblocking();
+            if (key == 27) { // ESC key ASCII value
+                logInfo("\nESC pressed - stopping video stream.");
                 break;
             }
+            
+            auto currentTime = std::chrono::steady_clock::now();
+            auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(currentTime - startTime);
+            if (duration.count() >= 1000) {
+                int frames = framesSent;
+                double fps = ((frames - lastFrames) * 1000.0) / duration.count();
+                std::cout << "\rStreaming... FPS: " << std::fixed << std::setprecision(1) << fps
+                          << "/" << rate.fps()
+                          << " | " << rate.height() << "p Q" << rate.quality()
+                          << " | Latency: " << std::setprecision(0) << rate.latencyMs() << " ms"
+                          << " | Dropped: " << (captureQueue.dropped() + sendQueue.dropped() + framesDropped)
+                          << " | Press ESC to stop" << std::flush;
+                lastFrames = frames;
+                startTime = currentTime;
+            }
+            
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
         }
         
+        stopPipeline();
+        if (captureThread.joinable()) captureThread.join();
+        if (encodeThread.joinable()) encodeThread.join();
+        if (networkThread.joinable()) networkThread.join();
+        
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - sessionStart).count();
+        std::ostringstream summary;
+        summary << "\nSent " << framesSent << " frames in " << std::fixed << std::setprecision(1) << seconds
+                << " s (average " << (seconds > 0 ? framesSent / seconds : 0.0) << " FPS).";
+        logInfo(summary.str());
+        
         // Send end signal to server
-        try {
-            uint32_t end_signal = htonl(0);
-            sendAll(sockfd, (char*)&end_signal, sizeof(end_signal));
+        if (sockfd < 0) {
+            clientSession.setVideoFeedback(nullptr);
+            clientSession.send(SESSION_CHANNEL_VIDEO, SESSION_CLOSE, nullptr, 0);
+            logInfo("End signal sent to server.");
+        } else {
+            sendWire(sockfd, VideoStreamHeader{0});
             logInfo("End signal sent to server.");
-        } catch (...) {
-            logError("Error sending end signal to server (ignored).");
         }
         
         // Cleanup
         try {
-            cap.release();
-            logInfo("Camera released.");
+            source.reset();
+            logInfo("Video source released.");
         } catch (...) {
-            logError("Error releasing camera (ignored).");
+            logError("Error releasing video source (ignored).");
         }
         
-        close(sockfd);
-        logInfo("Socket closed.");
+        // Unblocks the feedback reader before closing
+        if (sockfd >= 0) {
+            shutdown(sockfd, SHUT_RDWR);
+            if (feedbackThread.joinable()) feedbackThread.join();
+            close(udpfd);
+            close(sockfd);
+            logInfo("Socket closed.");
+        }
         
         // Ensure all OpenCV windows are destroyed, even if not explicitly created by this mode
         try {
@@ -0,0 +1,190 @@
+#ifndef VIDEO_RATE_CONTROL_H
+#define VIDEO_RATE_CONTROL_H
+
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <algorithm> // For std::min, std::max
+#include <cstddef>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h> // For TCP_INFO
+#ifdef __linux__
+  #include <linux/sockios.h> // For SIOCOUTQ
+#endif
+
+#include "client_common.h" // For VIDEO_TARGET_FPS, VIDEO_LATENCY_TARGET_MS
+#include "video_protocol.h" // For VideoFeedback
+
+// Resolution ladder (frame heights); width follows the source aspect ratio
+static const int VIDEO_HEIGHT_LADDER[] = {240, 360, 480, 720, 1080};
+static const int VIDEO_HEIGHT_LEVELS = sizeof(VIDEO_HEIGHT_LADDER) / sizeof(VIDEO_HEIGHT_LADDER[0]);
+
+#define VIDEO_QUALITY_MIN 20
+#define VIDEO_QUALITY_MAX 85
+#define VIDEO_FPS_MIN 10
+#define VIDEO_RATE_TICK_MS 250
+
+// Bytes written to the socket that have not been acknowledged by the peer yet
+inline int socketUnsentBytes(int sockfd) {
+    int pending = 0;
+#if defined(__linux__)
+    if (ioctl(sockfd, SIOCOUTQ, &pending) == 0) return pending;
+#elif defined(__APPLE__)
+    socklen_t len = sizeof(pending);
+    if (getsockopt(sockfd, SOL_SOCKET, SO_NWRITE, &pending, &len) == 0) return pending;
+#endif
+    return 0;
+}
+
+// Smoothed round-trip time reported by the kernel, 0 if unavailable
+inline double socketRttMs(int sockfd) {
+#if defined(__linux__)
+    tcp_info info{};
+    socklen_t len = sizeof(info);
+    if (getsockopt(sockfd, IPPROTO_TCP, TCP_INFO, &info, &len) == 0) return info.tcpi_rtt / 1000.0;
+#else
+    (void)sockfd;
+#endif
+    return 0.0;
+}
+
+// Congestion controller for the video sender.
+// Estimates queueing latency from send-buffer occupancy and drain rate, and
+// trades JPEG quality, resolution and frame rate to keep it under the target.
+// The occupancy is the socket's own (UDP) or the session video channel's backlog,
+// which chat and uploads sharing the connection do not count towards.
+class VideoRateController {
+public:
+    VideoRateController()
+        : quality_(40), level_(2), fps_(VIDEO_TARGET_FPS),
+          lastTick_(std::chrono::steady_clock::now()) {}
+
+    int quality() const { return quality_; }
+    int height() const { return VIDEO_HEIGHT_LADDER[level_]; }
+    int fps() const { return fps_; }
+    double latencyMs() const { return latencyMs_; }
+
+    // Called by the network stage after each frame is handed to the kernel
+    void onSent(size_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        bytesSent_ += bytes;
+    }
+
+    // Receiver reports from the server
+    void onFeedback(const VideoFeedback& fb) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        receiverDrops_ += fb.framesDropped;
+    }
+
+    // A frame too large to send at all: shrinks the frames like a receiver drop does
+    void onOversized() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        receiverDrops_++;
+    }
+
+    // Re-evaluates the settings from a socket the video has to itself
+    void update(int sockfd) {
+        if (tickDue()) update((size_t)socketUnsentBytes(sockfd), socketRttMs(sockfd));
+    }
+
+    // Re-evaluates the settings at most once per VIDEO_RATE_TICK_MS from the bytes sent but
+    // not yet delivered (and, if known, the path's round trip)
+    void update(size_t backlog, double rttMs = 0.0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto now = std::chrono::steady_clock::now();
+        double dt = std::chrono::duration<double>(now - lastTick_).count();
+        if (dt * 1000.0 < VIDEO_RATE_TICK_MS) return;
+        lastTick_ = now;
+
+        // Bytes the network actually drained = bytes written - growth of the queue
+        int unsent = (int)backlog;
+        double drained = (double)bytesSent_ - (double)(unsent - lastUnsent_);
+        bool growing = unsent > lastUnsent_;
+        bytesSent_ = 0;
+        lastUnsent_ = unsent;
+        if (drained > 0) {
+            double rate = drained / dt;
+            drainRate_ = drainRate_ > 0 ? 0.7 * drainRate_ + 0.3 * rate : rate;
+        }
+
+        double queueMs = 0.0;
+        if (unsent > 0) queueMs = drainRate_ > 0 ? (unsent / drainRate_) * 1000.0 : 10.0 * VIDEO_LATENCY_TARGET_MS;
+        latencyMs_ = queueMs + rttMs / 2.0;
+
+        bool receiverOverloaded = receiverDrops_ > 0;
+        receiverDrops_ = 0;
+
+        if (latencyMs_ > VIDEO_LATENCY_TARGET_MS) {
+            // Once the queue shrinks, the settings already fit the link and it only has to
+            // drain; stepping down further would undershoot
+            if (growing) decrease(latencyMs_ > 2.0 * VIDEO_LATENCY_TARGET_MS);
+            calmTicks_ = 0;
+        } else if (receiverOverloaded) {
+            // The server cannot decode/display fast enough: shrink the frames
+            if (level_ > 0) level_--;
+            calmTicks_ = 0;
+        } else if (latencyMs_ < 0.5 * VIDEO_LATENCY_TARGET_MS) {
+            // Probe upwards only after a second of headroom
+            if (++calmTicks_ >= 1000 / VIDEO_RATE_TICK_MS) {
+                increase();
+                calmTicks_ = 0;
+            }
+        } else {
+            calmTicks_ = 0;
+        }
+    }
+
+private:
+    // Saves the socket queries between ticks
+    bool tickDue() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return std::chrono::steady_clock::now() - lastTick_ >= std::chrono::milliseconds(VIDEO_RATE_TICK_MS);
+    }
+
+    // Quality goes first, then resolution, then frame rate
+    void decrease(bool severe) {
+        if (quality_ > VIDEO_QUALITY_MIN) {
+            quality_ = std::max(VIDEO_QUALITY_MIN, (int)(quality_ * (severe ? 0.5 : 0.75)));
+            if (!severe) return;
+        }
+        if (level_ > 0) {
+            level_--;
+            return;
+        }
+        fps_ = std::max(VIDEO_FPS_MIN, fps_ - 5);
+    }
+
+    // Restores frame rate first, then quality, then resolution
+    void increase() {
+        if (fps_ < VIDEO_TARGET_FPS) {
+            fps_ = std::min(VIDEO_TARGET_FPS, fps_ + 5);
+        } else if (quality_ < 70) {
+            quality_ = std::min(VIDEO_QUALITY_MAX, quality_ + 5);
+        } else if (level_ < VIDEO_HEIGHT_LEVELS - 1) {
+            // Larger frames at the quality learned so far would multiply the bitrate by the
+            // pixel ratio: scale the quality down by it, and let the steps of 5 adjust it
+            double ratio = (double)VIDEO_HEIGHT_LADDER[level_] / VIDEO_HEIGHT_LADDER[level_ + 1];
+            level_++;
+            quality_ = std::max(VIDEO_QUALITY_MIN, (int)(quality_ * ratio * ratio));
+        } else if (quality_ < VIDEO_QUALITY_MAX) {
+            quality_ = std::min(VIDEO_QUALITY_MAX, quality_ + 5);
+        }
+    }
+
+    std::atomic<int> quality_;
+    std::atomic<int> level_;
+    std::atomic<int> fps_;
+    std::atomic<double> latencyMs_{0.0};
+
+    std::mutex mutex_;
+    std::chrono::steady_clock::time_point lastTick_;
+    size_t bytesSent_ = 0;
+    int lastUnsent_ = 0;
+    double drainRate_ = 0.0; // Bytes per second
+    uint32_t receiverDrops_ = 0;
+    int calmTicks_ = 0;
+};
+
+#endif // VIDEO_RATE_CONTROL_H
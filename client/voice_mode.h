@@ -6,13 +6,125 @@
 #include <vector>
 #include <arpa/inet.h>
 #include <unistd.h>
-#include <portaudio.h>
 #include <csignal> // For std::signal
 #include <atomic>  // For std::atomic
-#include <cstring> // For strlen
+#include <cstring> // For strlen, strerror
+#include <random>  // For std::random_device
+#include <chrono>
+#include <cstdio>  // For snprintf
+#include <sys/time.h> // For timeval (SO_RCVTIMEO)
+#include <sys/socket.h> // For shutdown
+#include <cerrno>
+#include <ctime>  // For clock_gettime
+#include <memory> // For std::unique_ptr
+#include <functional> // For std::ref, std::cref
 
 #include "common_utils.h"
 #include "client_common.h" // For UDP_VOICE_PORT, voiceActive, handleSigint
+#include "voice_protocol.h" // For VoicePacketHeader, VOICE_SAMPLE_RATE
+#include "voice_codec.h"    // For VoiceEncoder
+#include "audio_device.h"   // For createAudioDevice
+#include "voice_activity.h" // For VoiceActivityDetector
+#include "voice_mixer.h"    // For VoiceMixer
+#include "udp_batch.h"      // For UdpReceiveBatch
+#include "voice_red.h"      // For VoiceRedSender, VOICE_MAX_PACKET
+#include "thread_roles.h"   // For ThreadRoleScope
+
+#define VOICE_NEGOTIATION_TRIES 3
+#define VOICE_NEGOTIATION_TIMEOUT_MS 300
+#define VOICE_CN_REFRESH_FRAMES 25 // Comfort noise refresh during silence (every 500 ms), keeps the server's source alive
+
+// Two-state loss model for --voice-loss: losses average `percent` of packets and come in
+// bursts of `burst` packets on average (1: independent losses)
+class VoiceLossSimulator {
+public:
+    VoiceLossSimulator(int percent, int burst) : rng_(std::random_device{}()), burst_(burst) {
+        double p = percent / 100.0;
+        stayBad_ = 1.0 - 1.0 / burst;
+        enterBad_ = p * (1.0 - stayBad_) / (1.0 - p); // Keeps the long-run loss at p
+        independent_ = p;
+    }
+
+    bool drop() {
+        if (burst_ <= 1) return chance_(rng_) < independent_;
+        bad_ = chance_(rng_) < (bad_ ? stayBad_ : enterBad_);
+        return bad_;
+    }
+
+private:
+    std::mt19937 rng_;
+    std::uniform_real_distribution<double> chance_{0.0, 1.0};
+    int burst_;
+    double independent_;
+    double enterBad_;
+    double stayBad_;
+    bool bad_ = false;
+};
+
+// Offers the codecs this build can send and the redundancy wanted, and waits briefly for
+// the server's choice. Servers that do not answer (or builds without Opus) get plain PCM.
+inline void negotiateVoiceCodec(int sockfd, const sockaddr_in& servaddr, uint32_t sourceId,
+                                uint8_t& codec, uint32_t& bitrate, uint8_t& redundancy) {
+    codec = VOICE_PAYLOAD_PCM16;
+    bitrate = VOICE_SAMPLE_RATE * 16;
+    redundancy = 0;
+    uint8_t codecs = voiceSupportedCodecs();
+    if (clientOptions.voiceCodec == "pcm") codecs = VOICE_CODEC_BIT(VOICE_PAYLOAD_PCM16);
+    if (codecs == VOICE_CODEC_BIT(VOICE_PAYLOAD_PCM16) && clientOptions.voiceRedundancy == 0) return;
+
+    timeval timeout{0, VOICE_NEGOTIATION_TIMEOUT_MS * 1000};
+    setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    uint8_t offer[VOICE_NEGOTIATION_SIZE];
+    writeVoiceNegotiation(offer, VOICE_PAYLOAD_OFFER, sourceId, codecs,
+                          clampVoiceBitrate((uint32_t)clientOptions.voiceBitrateKbps * 1000),
+                          (uint8_t)clientOptions.voiceRedundancy);
+    for (int i = 0; i < VOICE_NEGOTIATION_TRIES; i++) {
+        sendto(sockfd, offer, sizeof(offer), 0, (const sockaddr*)&servaddr, sizeof(servaddr));
+        uint8_t answer[64];
+        ssize_t bytes = recv(sockfd, answer, sizeof(answer), 0);
+        VoicePacketHeader h;
+        uint8_t chosen = 0;
+        uint32_t chosenBitrate = 0;
+        uint8_t granted = 0;
+        if (bytes > 0 && parseVoiceHeader(answer, bytes, h) && h.payloadType == VOICE_PAYLOAD_ANSWER &&
+            h.sourceId == sourceId && parseVoiceNegotiation(answer, bytes, chosen, chosenBitrate, granted) &&
+            (VOICE_CODEC_BIT(chosen) & codecs)) {
+            codec = chosen;
+            bitrate = chosenBitrate;
+            redundancy = std::min<uint8_t>(granted, (uint8_t)clientOptions.voiceRedundancy);
+            break;
+        }
+    }
+    timeout = timeval{0, 0};
+    setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+}
+
+// Feeds the voice the server forwards from the other participants into the mixer, until
+// the socket is shut down. Each speaker keeps its own source ID, so each gets its own
+// jitter buffer and decoder.
+inline void receiveForwardedVoice(int sockfd, const sockaddr_in& servaddr, VoiceMixer& mixer) {
+    ThreadRoleScope role(ROLE_NETWORK);
+    UdpReceiveBatch batch(VOICE_MAX_PACKET);
+    while (voiceActive) {
+        int received = batch.receive(sockfd);
+        if (received <= 0) {
+            if (received < 0 && errno == EINTR) continue;
+            if (received < 0 && voiceActive) logError("Error receiving forwarded voice: " + std::string(strerror(errno)));
+            break; // 0: shutdown() at the end of the session
+        }
+        for (size_t i = 0; i < batch.count(); i++) {
+            const UdpPacket& packet = batch.packet(i);
+            VoicePacketHeader header;
+            if (packet.from.sin_addr.s_addr != servaddr.sin_addr.s_addr || packet.from.sin_port != servaddr.sin_port ||
+                !parseVoiceHeader(packet.data, packet.size, header)) {
+                continue;
+            }
+            if (isVoiceMedia(header.payloadType)) {
+                mixer.onPacket(packet.from, header, packet.data + VOICE_HEADER_SIZE, packet.size - VOICE_HEADER_SIZE);
+            }
+        }
+    }
+}
 
 // Main function for voice streaming mode
 inline void runVoiceMode(const char* server_ip) {
@@ -22,34 +134,27 @@ inline void runVoiceMode(const char* server_ip) {
     voiceActive = true; // Set the global atomic flag to true for this session
     logInfo("Starting voice streaming mode...");
 
-    if (Pa_Initialize() != paNoError) {
-        logError("Failed to initialize PortAudio.");
+    // Captured by the device (sound card callback or timer thread) into a ring; this thread
+    // only encodes and sends
+    std::unique_ptr<AudioDevice> input = createAudioDevice(clientOptions.audioInput, AudioDevice::INPUT, VOICE_SAMPLE_RATE);
+    if (!input || !input->open(clientOptions.audioLatencyMs)) {
+        logError("Failed to open audio input.");
         std::signal(SIGINT, old_sigint_handler); // Restore handler on error
         return;
     }
     
-    PaStream* stream;
-    if (Pa_OpenDefaultStream(&stream, 1, 0, paInt16, 44100, 512, nullptr, nullptr) != paNoError) {
-        logError("Failed to open audio input stream.");
-        Pa_Terminate();
-        std::signal(SIGINT, old_sigint_handler); // Restore handler on error
-        return;
-    }
-    
-    if (Pa_StartStream(stream) != paNoError) {
-        logError("Failed to start audio stream.");
-        Pa_CloseStream(stream);
-        Pa_Terminate();
+    if (!input->start()) {
+        logError("Failed to start audio input.");
+        input->close();
         std::signal(SIGINT, old_sigint_handler); // Restore handler on error
         return;
     }
+    logInfo("Voice input: " + input->describe());
     
     int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
     if (sockfd < 0) {
         logError("Failed to create UDP socket.");
-        Pa_StopStream(stream);
-        Pa_CloseStream(stream);
-        Pa_Terminate();
+        input->close();
         std::signal(SIGINT, old_sigint_handler); // Restore handler on error
         return;
     }
@@ -59,37 +164,154 @@ inline void runVoiceMode(const char* server_ip) {
     servaddr.sin_port = htons(UDP_VOICE_PORT);
     inet_pton(AF_INET, server_ip, &servaddr.sin_addr);
     
-    char buffer[512 * 2];
+    VoicePacketHeader header{};
+    header.version = VOICE_VERSION;
+    header.sourceId = std::random_device{}();
+    uint32_t bitrate = 0;
+    uint8_t redundancy = 0;
+    negotiateVoiceCodec(sockfd, servaddr, header.sourceId, header.payloadType, bitrate, redundancy);
+    VoiceEncoder encoder;
+    if (!encoder.open(header.payloadType, bitrate)) {
+        header.payloadType = VOICE_PAYLOAD_PCM16;
+        encoder.open(VOICE_PAYLOAD_PCM16, bitrate);
+    }
+    VoiceRedSender red(redundancy);
+    VoiceLossSimulator loss(clientOptions.voiceLossPercent, clientOptions.voiceLossBurst);
+    logInfo("Voice codec: " + voiceCodecName(header.payloadType) +
+            (header.payloadType == VOICE_PAYLOAD_OPUS ? " at " + std::to_string(bitrate / 1000) + " kbit/s" : "") +
+            ", " + std::to_string(red.redundancy()) + " redundant frames per packet");
+
+    // Playback of the other participants, who reach us through the server on this socket
+    std::unique_ptr<AudioDevice> output = createAudioDevice(clientOptions.audioOutput, AudioDevice::OUTPUT, VOICE_SAMPLE_RATE);
+    VoiceMixer mixer;
+    std::thread receiveThread;
+    std::thread playbackThread;
+    bool playback = output && output->open(clientOptions.audioLatencyMs) && output->start();
+    if (playback) {
+        logInfo("Voice output: " + output->describe());
+        receiveThread = std::thread(receiveForwardedVoice, sockfd, std::cref(servaddr), std::ref(mixer));
+        playbackThread = std::thread([&mixer, &output] {
+            ThreadRoleScope role(ROLE_MIX);
+            mixer.run(*output, [] { return voiceActive.load(); });
+        });
+    } else {
+        logError("No audio output: other participants will not be heard.");
+    }
+
+    int16_t samples[VOICE_FRAME_SAMPLES];
+    uint8_t payload[VOICE_MAX_PAYLOAD];
+    uint8_t copy[VOICE_MAX_PAYLOAD];
+    uint8_t buffer[VOICE_MAX_PACKET];
+    VoiceActivityDetector vad;
+    uint64_t framesCaptured = 0;
+    uint64_t packetsSent = 0;
+    uint64_t packetsDropped = 0;
+    uint64_t comfortNoiseSent = 0;
+    uint64_t framesEncoded = 0;
+    uint64_t bytesSent = 0;
+    uint64_t encodeUs = 0;
+    int silentFrames = 0;
+    timespec cpuStart{};
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpuStart);
     logInfo("Voice streaming started. Press Ctrl+C to stop and return to main menu.");
     
+    ThreadRoleScope role(ROLE_CODEC); // Encoding and sending, on the menu thread until voice mode ends
     try {
         while (voiceActive) { // Loop controlled by the global atomic flag
-            PaError err = Pa_ReadStream(stream, buffer, 512);
-            if (err != paNoError) {
-                logError("Error reading from audio stream.");
+            if (!input->read(samples, VOICE_FRAME_SAMPLES, [] { return voiceActive.load(); })) {
+                if (voiceActive) logInfo("Audio input ended.");
                 break;
             }
-            
-            ssize_t sent = sendto(sockfd, buffer, sizeof(buffer), 0, 
+            framesCaptured++;
+
+            VoicePacketHeader frame = header;
+            int payloadBytes = 0;
+            if (!clientOptions.voiceVad || vad.process(samples, VOICE_FRAME_SAMPLES)) {
+                auto encodeStart = std::chrono::steady_clock::now();
+                payloadBytes = encoder.encode(samples, payload);
+                encodeUs += std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - encodeStart).count();
+                if (payloadBytes < 0) {
+                    logError("Failed to encode audio.");
+                    break;
+                }
+                framesEncoded++;
+                silentFrames = 0;
+            } else if (silentFrames++ % VOICE_CN_REFRESH_FRAMES == 0) {
+                // Silence: only a comfort noise marker when it starts, then a refresh now and then
+                frame.payloadType = VOICE_PAYLOAD_CN;
+                payload[0] = vad.noiseLevel();
+                payloadBytes = 1;
+                comfortNoiseSent++;
+            }
+            header.timestamp += VOICE_FRAME_SAMPLES; // Media time runs on through silence
+            if (payloadBytes == 0) continue;
+            header.seq++;
+
+            // Copies of the previous frames ride along, then this one is kept for the next packets
+            size_t packetBytes = red.write(frame, payload, payloadBytes, buffer);
+            if (red.redundancy() > 0 && frame.payloadType == VOICE_PAYLOAD_CN) {
+                red.remember(frame, VOICE_PAYLOAD_CN, payload, payloadBytes);
+            } else if (red.redundancy() > 0) {
+                uint8_t copyType = 0;
+                int copyBytes = encoder.encodeRedundant(samples, payload, payloadBytes, copy, copyType);
+                red.remember(frame, copyType, copy, copyBytes);
+            }
+
+            if (loss.drop()) { // Simulated network loss
+                packetsDropped++;
+                continue;
+            }
+            ssize_t sent = sendto(sockfd, buffer, packetBytes, 0, 
                                 (sockaddr*)&servaddr, sizeof(servaddr));
             if (sent < 0) {
                 logError("Failed to send audio data.");
                 break;
             }
+            packetsSent++;
+            bytesSent += sent;
         }
     } catch (...) {
         logInfo("Voice streaming interrupted.");
     }
+
+    // Bandwidth including the 28 bytes of IPv4 and UDP headers per packet, encoder CPU time,
+    // and the whole process's CPU (capture, encoding, receiving, decoding and playback)
+    if (framesCaptured) {
+        double seconds = (double)framesCaptured * VOICE_FRAME_SAMPLES / VOICE_SAMPLE_RATE;
+        timespec cpuEnd{};
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpuEnd);
+        double cpuSeconds = (cpuEnd.tv_sec - cpuStart.tv_sec) + (cpuEnd.tv_nsec - cpuStart.tv_nsec) / 1e9;
+        char line[448];
+        snprintf(line, sizeof(line),
+                 "Voice session: %llu frames captured, %llu packets sent (%.1f/s, %llu comfort noise, %.1f%% fewer than frames), "
+                 "%llu dropped for loss testing, %.1f kbit/s on the wire, %.1f us encoding per %d ms frame, %.1f%% CPU",
+                 (unsigned long long)framesCaptured, (unsigned long long)packetsSent, packetsSent / seconds,
+                 (unsigned long long)comfortNoiseSent,
+                 100.0 * (framesCaptured - packetsSent - packetsDropped) / framesCaptured, (unsigned long long)packetsDropped,
+                 (bytesSent + packetsSent * 28) * 8 / seconds / 1000.0,
+                 framesEncoded ? (double)encodeUs / framesEncoded : 0.0, VOICE_FRAME_SAMPLES * 1000 / VOICE_SAMPLE_RATE,
+                 100.0 * cpuSeconds / seconds);
+        logInfo(line);
+    }
     
     // Send a stop signal to the server
     const char* stop_msg = "STOP_AUDIO";
     sendto(sockfd, stop_msg, strlen(stop_msg), 0, (sockaddr*)&servaddr, sizeof(servaddr));
     logInfo("Sent STOP_AUDIO signal to server.");
 
+    voiceActive = false;          // Also ends playback when sending failed
+    shutdown(sockfd, SHUT_RDWR);  // Wakes the receive thread
+    if (receiveThread.joinable()) receiveThread.join();
+    if (playbackThread.joinable()) playbackThread.join();
     close(sockfd);
-    Pa_StopStream(stream);
-    Pa_CloseStream(stream);
-    Pa_Terminate();
+    input->close();
+    if (output) output->close();
+    logInfo("Voice input: " + std::to_string(input->overruns()) + " overruns");
+    if (playback) {
+        logInfo("Voice output: " + std::to_string(output->underruns()) + " underruns, " +
+                std::to_string(output->overruns()) + " overruns");
+    }
     
     // Restore the original SIGINT handler before exiting the function
     std::signal(SIGINT, old_sigint_handler);
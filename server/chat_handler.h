@@ -10,37 +10,48 @@
 
 #include "server_utils.h"
 #include "common_utils.h"
-#include "server_common.h" // For running, chatMutex, chatClients
+#include "server_common.h" // For chatMutex, chatClients, chatSessions
+#include "session_mux.h"   // For SessionMux
 
-inline void handleChatClient(int sockfd) {
+// Logs a chat message and relays it to every other chat participant, on either transport.
+// A session whose chat queue is full misses the message rather than stalling everyone.
+inline void broadcastChat(const std::string& clientInfo, const char* text, size_t len, int fromFd,
+                          const SessionMux* fromSession) {
+    logInfo("[Chat][" + clientInfo + "] " + std::string(text, len));
+    std::lock_guard<std::mutex> lock(chatMutex);
+    for (int client : chatClients) {
+        if (client != fromFd) sendAll(client, text, len);
+    }
+    for (SessionMux* session : chatSessions) {
+        if (session != fromSession) session->send(SESSION_CHANNEL_CHAT, SESSION_DATA, text, len, false);
+    }
+}
+
+inline void handleChatClient(int sockfd, const CancelToken& cancel) {
     std::string client_info = getClientInfo(sockfd); // getClientInfo from server_utils.h
     char buffer[1024];
     logInfo("Chat client connected: " + client_info);
+    ShutdownOnCancel wake(cancel, sockfd); // Wakes recv() on shutdown or when idle (from server_utils.h)
+    // The legacy protocol has no room for pings: the kernel's keepalive finds a vanished peer,
+    // the idle timeout a client that stays connected without saying anything
+    enableKeepalive(sockfd);
+    CancelOnIdle idle(cancel, CHAT_IDLE_TIMEOUT_MS, "Chat client " + client_info + " idle");
+
+    while (!cancel.cancelled()) {
+        ssize_t bytes = recvFromClient(sockfd, buffer, sizeof(buffer) - 1); // From server_utils.h
+        if (bytes <= 0) break;
+        idle.touch();
+        broadcastChat(client_info, buffer, bytes, sockfd, nullptr);
+    }
 
-    while (running) {
-        ssize_t bytes = recv(sockfd, buffer, sizeof(buffer) - 1, 0);
-        if (bytes <= 0) {
-            logInfo("Chat client disconnected: " + client_info);
-            close(sockfd);
-            {
-                std::lock_guard<std::mutex> lock(chatMutex);
-                chatClients.erase(std::remove(chatClients.begin(), chatClients.end(), sockfd), chatClients.end());
-                logInfo("Chat clients connected: " + std::to_string(chatClients.size()));
-            }
-            break;
-        }
-        
-        buffer[bytes] = '\0';
-        std::string msg = "[Chat][" + client_info + "] " + std::string(buffer);
-        logInfo(msg);
-        
-        std::lock_guard<std::mutex> lock(chatMutex);
-        for (int client : chatClients) {
-            if (client != sockfd) {
-                sendAll(client, buffer, bytes);
-            }
-        }
+    logInfo("Chat client disconnected: " + client_info);
+    {
+        std::lock_guard<std::mutex> lock(chatMutex); // Off the list first, so no broadcast writes to a reused descriptor
+        chatClients.erase(std::remove(chatClients.begin(), chatClients.end(), sockfd), chatClients.end());
+        logInfo("Chat clients connected: " + std::to_string(chatClients.size()));
     }
+    wake.reset();
+    close(sockfd);
 }
 
 #endif // CHAT_HANDLER_H
\ No newline at end of file
@@ -12,46 +12,61 @@
 #include "common_utils.h"
 #include "server_utils.h"
 #include "server_common.h" // For BUFFER_SIZE
+#include "wire_schema.h"   // For WireSchema
 
-inline void handleFileClient(int sockfd) {
-    std::string client_info = getClientInfo(sockfd); // getClientInfo from server_utils.h
-    uint32_t name_len_net;
-    if (!recvAll(sockfd, reinterpret_cast<char*>(&name_len_net), sizeof(name_len_net))) {
+// Legacy MODE_FILE upload: FileNameHeader, the name, FileSizeHeader, the data
+struct FileNameHeader {
+    uint32_t nameLength;
+};
+
+template <>
+struct WireSchema<FileNameHeader> {
+    static constexpr auto fields = std::make_tuple(&FileNameHeader::nameLength);
+};
+
+struct FileSizeHeader {
+    uint64_t fileSize;
+};
+
+template <>
+struct WireSchema<FileSizeHeader> {
+    static constexpr auto fields = std::make_tuple(&FileSizeHeader::fileSize);
+};
+
+// Reads one legacy MODE_FILE upload and writes it to disk; touches progress for every part received
+inline void receiveFile(int sockfd, const std::string& client_info, IdleTimer& progress) {
+    FileNameHeader name_header;
+    if (!recvWireFromClient(sockfd, name_header)) { // From server_utils.h
         logError("Failed to read filename length from " + client_info);
-        close(sockfd);
         return;
     }
     
-    uint32_t name_len = ntohl(name_len_net);
+    uint32_t name_len = name_header.nameLength;
     if (name_len == 0 || name_len >= 256) {
         logError("Invalid filename length from " + client_info);
-        close(sockfd);
         return;
     }
     
     char filename[256] = {0};
-    if (!recvAll(sockfd, filename, name_len)) {
+    if (!recvAllFromClient(sockfd, filename, name_len)) {
         logError("Failed to read filename from " + client_info);
-        close(sockfd);
         return;
     }
     filename[name_len] = '\0';
     
-    uint64_t file_size_net;
-    if (!recvAll(sockfd, reinterpret_cast<char*>(&file_size_net), sizeof(file_size_net))) {
+    FileSizeHeader size_header;
+    if (!recvWireFromClient(sockfd, size_header)) {
         logError("Failed to read file size from " + client_info);
-        close(sockfd);
         return;
     }
     
-    uint64_t file_size = ntohll(file_size_net);
+    uint64_t file_size = size_header.fileSize;
     logInfo("File transfer started from " + client_info + ": " + std::string(filename) +
             " (" + std::to_string(file_size) + " bytes)");
     
     std::ofstream outFile(filename, std::ios::binary);
     if (!outFile.is_open()) {
         logError("Failed to create file: " + std::string(filename));
-        close(sockfd);
         return;
     }
     
@@ -59,17 +74,28 @@ inline void handleFileClient(int sockfd) {
     uint64_t received = 0;
     while (received < file_size) {
         size_t to_read = std::min(static_cast<uint64_t>(BUFFER_SIZE), file_size - received);
-        ssize_t bytes = recv(sockfd, buffer, to_read, 0);
+        ssize_t bytes = recvFromClient(sockfd, buffer, to_read);
         if (bytes <= 0) break;
+        progress.touch();
         outFile.write(buffer, bytes);
         received += bytes;
     }
     
     outFile.close();
-    close(sockfd);
-    
     if (received == file_size) logInfo("File received successfully from " + client_info);
     else logError("File transfer incomplete from " + client_info);
 }
 
+inline void handleFileClient(int sockfd, const CancelToken& cancel) {
+    ThreadRoleScope role(ROLE_BULK); // Uploads may wait for the network and voice threads (thread_roles.h)
+    std::string client_info = getClientInfo(sockfd); // getClientInfo from server_utils.h
+    ShutdownOnCancel wake(cancel, sockfd); // Wakes recv() on shutdown or a stall (from server_utils.h)
+    {
+        CancelOnIdle stall(cancel, FILE_STALL_TIMEOUT_MS, "File transfer from " + client_info + " stalled");
+        receiveFile(sockfd, client_info, stall);
+    }
+    wake.reset();
+    close(sockfd);
+}
+
 #endif // FILE_HANDLER_H
\ No newline at end of file
@@ -8,37 +8,100 @@
 #include <condition_variable>
 #include <atomic>
 #include <thread> // For std::thread declaration
+#include <string>
+#include <memory>
+
+#include "executor.h" // For Executor, CancelToken
+#include "timer_wheel.h" // For TimerWheel
+#include "session_capture.h" // For CaptureWriter
 
 // Global constants
 #define TCP_PORT 5000
 #define UDP_VOICE_PORT 7000
+#define UNIX_SOCKET_PATH "/tmp/mini_zoom.sock" // Where same-host clients connect without TCP
 #define BUFFER_SIZE 4096
 #define MAX_CHAT_CLIENTS 50
 
+// Connection timeouts, run on serverTimers
+#define TIMER_TICK_MS 100                         // Resolution of every timeout below
+#define HANDSHAKE_TIMEOUT_MS 5000                 // For the mode byte after accept
+#define CHAT_IDLE_TIMEOUT_MS (30 * 60 * 1000)     // Legacy chat socket with nothing said
+#define CHAT_KEEPALIVE_IDLE_S 60                  // TCP keepalive on legacy chat sockets: probes after this much silence,
+#define CHAT_KEEPALIVE_INTERVAL_S 10              // one per interval, and the connection is dropped
+#define CHAT_KEEPALIVE_PROBES 3                   // after this many unanswered
+#define FILE_STALL_TIMEOUT_MS 30000               // Upload with no data arriving
+#define VIDEO_IDLE_TIMEOUT_MS 10000               // Video stream with no frames, frees the video slot
+#define SESSION_KEEPALIVE_MS 15000                // Session silent this long gets a PING
+#define SESSION_IDLE_TIMEOUT_MS 45000             // and is dropped if still silent after this
+
 // Mode IDs
 #define MODE_CHAT  1
 #define MODE_FILE  2
 #define MODE_VIDEO 3
+#define MODE_VIDEO_UDP 4
+#define MODE_SESSION 5 // One connection multiplexing chat, file and video (session_protocol.h)
+#define MODE_SESSION_SHM 6 // A session over shared-memory rings; Unix socket only, sent with the rings' descriptors (transport.h)
+
+// Command-line options (defined in server_main.cpp)
+struct ServerOptions {
+#ifdef MINI_ZOOM_HEADLESS
+    bool headless = true;                  // Built without the display window
+#else
+    bool headless = false;                 // --headless: no display window, frames only go to the sinks below
+#endif
+    bool recordVideo = false;              // --record[=DIR]: keep incoming video sessions on disk
+    std::string recordDir = "recordings";
+    bool videoMetrics = false;             // --metrics: log frame rate and bitrate of incoming video
+    std::string relayTarget;               // --relay=IP[:PORT]: forward incoming video to another server
+    std::string latencyDir;                // --latency-csv[=DIR]: dump per-frame timestamps of each session
+    uint32_t voiceMaxBitrate = 64000;      // --voice-max-bitrate=KBPS: cap on the Opus bitrate clients may ask for
+    int audioLatencyMs = 0;                // --audio-latency=MS: output device latency (0: host API low-latency default)
+    std::string audioOutput;               // --audio-output=SPEC: portaudio[:N], wav:PATH or null (empty: the default)
+    std::string unixSocket = UNIX_SOCKET_PATH; // --unix-socket=PATH|off: listener for same-host clients
+    std::string capturePath;               // --capture=FILE: record what clients send, for session_replay
+    std::vector<std::string> threadRoles;  // --thread-role=ROLE:SPEC, repeatable: CPUs and scheduling of a thread role
+};
+
+// Runs every server task: listeners, voice and connection handlers. Cancelling it stops the server.
+extern Executor serverExecutor;
+
+// Timers of every connection (server_utils.h: CancelOnIdle, CancelAfter), advanced by timerService
+extern TimerWheel serverTimers;
+
+// Capture of client traffic (--capture), inactive unless opened
+extern CaptureWriter serverCapture;
 
 // Global flags (declared extern, defined in server_main.cpp)
-extern volatile bool running;
 extern std::atomic<bool> videoStreaming;
 extern std::atomic<bool> videoClientConnected;
 extern std::atomic<bool> shouldCloseWindow;
 extern std::atomic<bool> videoSessionActive;
+extern ServerOptions serverOptions;
 
-// Global chat client list and mutex
+// Global chat client lists and mutex: legacy MODE_CHAT sockets and multiplexed sessions
+class SessionMux;
 extern std::vector<int> chatClients;
+extern std::vector<SessionMux*> chatSessions;
 extern std::mutex chatMutex;
 
+// A decoded picture waiting for the display loop
+class VideoLatencyTracker;
+struct DisplayFrame {
+    cv::Mat picture;
+    uint32_t seq = 0;
+    std::shared_ptr<VideoLatencyTracker> latency; // Told when the picture is shown
+};
+
 // Thread-safe queue for video frames
-extern std::queue<cv::Mat> videoFrameQueue;
+extern std::queue<DisplayFrame> videoFrameQueue;
 extern std::mutex videoQueueMutex;
 extern std::condition_variable videoCond;
 
-// Video client thread tracking
-extern std::thread videoClientThread;
+// The one video session being shown (beginVideoSession in video_handler.h)
 extern std::mutex videoClientMutex;
+extern std::condition_variable videoClientDone; // Signalled when the session ends
+extern bool videoClientBusy;
+extern CancelToken videoClientTask;             // Token of the task running it, cancelled by its replacement
 
 // Main thread video control
 extern std::condition_variable mainThreadCond;
@@ -0,0 +1,225 @@
+#ifndef SESSION_HANDLER_H
+#define SESSION_HANDLER_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <atomic>
+#include <algorithm> // For std::remove
+
+#include "common_utils.h"
+#include "server_utils.h"   // For getClientInfo, ShutdownOnCancel, CancelOnIdle
+#include "server_common.h"  // For serverExecutor, serverTimers, chatMutex, chatSessions
+#include "session_mux.h"    // For SessionMux
+#include "transport.h"      // For Transport
+#include "bounded_queue.h"
+#include "chat_handler.h"   // For broadcastChat
+#include "video_handler.h"  // For VideoReceiver, beginVideoSession, endVideoSession
+
+#define SESSION_VIDEO_QUEUE 4   // Frames between a session's reader and its video task
+#define SESSION_UPLOAD_QUEUE 64 // Chunks between a session's reader and its upload task; flow control keeps it under a window
+
+// One upload's data on its way from the session's reader to the task writing it to disk
+struct SessionUpload {
+    SessionUpload(const std::string& name, uint64_t size) : chunks(SESSION_UPLOAD_QUEUE), name(name), size(size) {}
+
+    BoundedQueue<std::vector<uint8_t>> chunks; // Closed at the end of the upload, however it ends
+    const std::string name;
+    const uint64_t size;
+    std::atomic<bool> complete{false}; // The client sent CLOSE: everything has been queued
+};
+
+// Writes one session upload to disk in a task of its own, so a slow disk never holds up the
+// session's reader (and the chat and video behind it). Each chunk's credit goes back to the
+// client once it is written. Reports the outcome with FILE CLOSE, unless the upload was
+// abandoned (a new OPEN, or the session ended).
+inline void handleSessionUpload(std::shared_ptr<SessionUpload> upload, std::shared_ptr<SessionMux> mux,
+                                std::string client_info, const CancelToken& cancel) {
+    ThreadRoleScope role(ROLE_BULK); // From thread_roles.h
+    std::atomic<bool> stalled{false};
+    CancelRegistration wake(cancel, [upload] { upload->chunks.close(); }); // Shutdown
+    std::ofstream file(upload->name, std::ios::binary);
+    if (!file.is_open()) logError("Failed to create file: " + upload->name);
+    uint64_t received = 0;
+    {
+        // An upload that stops arriving while the session lives on is failed, so the client can
+        // start over; its data, if any comes after all, is ignored until the next OPEN
+        IdleTimer progress(serverTimers, FILE_STALL_TIMEOUT_MS, [&] {
+            if (!stalled.exchange(true)) upload->chunks.close();
+        });
+        std::vector<uint8_t> chunk;
+        while (upload->chunks.pop(chunk)) {
+            progress.touch();
+            if (file.is_open() && !stalled && !cancel.cancelled()) file.write(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+            received += chunk.size();
+            mux->returnCredit(SESSION_CHANNEL_FILE, chunk.size());
+        }
+    }
+    upload->chunks.close(); // Any further data of this upload is ignored
+    wake.reset();
+    if (file.is_open()) file.close();
+    bool saved = upload->complete && !stalled && !cancel.cancelled() && file.good() && received == upload->size;
+    if (saved) {
+        logInfo("File received successfully from " + client_info + ": " + upload->name);
+    } else if (stalled) {
+        logError("File transfer from " + client_info + " stalled: " + upload->name);
+    } else {
+        logError("File transfer incomplete from " + client_info + ": " + upload->name);
+    }
+    if (upload->complete || stalled) {
+        uint8_t status = saved ? 1 : 0;
+        mux->send(SESSION_CHANNEL_FILE, SESSION_CLOSE, &status, sizeof(status), false);
+    }
+}
+
+// Decodes a session's video stream in a task of its own, so the session's reader never
+// waits for a decoder and keeps serving chat. Frames the decoder cannot keep up with are
+// dropped from the queue and reported as lost.
+inline void handleSessionVideo(std::shared_ptr<BoundedQueue<std::vector<uint8_t>>> frames,
+                               std::shared_ptr<SessionMux> mux, std::string client_info, const CancelToken& cancel) {
+    if (!beginVideoSession(cancel)) {
+        frames->close();
+        return;
+    }
+    logInfo("Video streaming (session) started from " + client_info);
+    VideoReceiver receiver(client_info);
+    CancelOnIdle idle(cancel, VIDEO_IDLE_TIMEOUT_MS, "No video from " + client_info); // Frees the video slot
+    std::vector<uint8_t> frame;
+    size_t dropped = 0;
+    while (!cancel.cancelled() && videoClientConnected) {
+        if (!frames->popFor(frame, std::chrono::milliseconds(100))) {
+            if (frames->closed()) break;
+            continue;
+        }
+        idle.touch();
+        if (frames->dropped() != dropped) {
+            receiver.onFramesLost((uint32_t)(frames->dropped() - dropped));
+            dropped = frames->dropped();
+        }
+        receiver.onFrame(frame);
+        VideoFeedback fb;
+        if (receiver.takeFeedback(fb)) {
+            WireBuffer<VideoFeedback> wire = encodeWire(fb);
+            mux->send(SESSION_CHANNEL_VIDEO, SESSION_DATA, wire.data(), wire.size(), false);
+        }
+    }
+    frames->close();
+    endVideoSession();
+    logInfo("Video streaming (session) ended from " + client_info);
+}
+
+// One client's multiplexed session (MODE_SESSION, MODE_SESSION_SHM): chat, file uploads and
+// TCP video over a single connection, for as long as the client runs
+inline void handleSessionClient(std::unique_ptr<Transport> transport, const CancelToken& cancel) {
+    int sockfd = transport->fd();
+    std::string client_info = getClientInfo(sockfd); // getClientInfo from server_utils.h
+    ShutdownOnCancel wake(cancel, sockfd); // Wakes the reader on shutdown (from server_utils.h)
+    if (CaptureStream::current()) transport.reset(new CaptureTransport(std::move(transport))); // From session_capture.h
+    std::shared_ptr<SessionMux> mux = std::make_shared<SessionMux>(std::move(transport));
+    logInfo("Session started with " + client_info + " over " + mux->describe());
+
+    bool chatting = false;
+    {
+        std::lock_guard<std::mutex> lock(chatMutex);
+        if (chatClients.size() + chatSessions.size() < MAX_CHAT_CLIENTS) {
+            chatSessions.push_back(mux.get());
+            chatting = true;
+        } else {
+            logError("Max chat clients reached, chat disabled for " + client_info);
+        }
+    }
+
+    std::shared_ptr<SessionUpload> upload;
+    std::shared_ptr<BoundedQueue<std::vector<uint8_t>>> videoFrames;
+
+    // A silent session is pinged every SESSION_KEEPALIVE_MS; one that answers nothing for
+    // SESSION_IDLE_TIMEOUT_MS is gone (half-open) and dropped
+    IdleTimer keepalive(serverTimers, SESSION_KEEPALIVE_MS, [&] {
+        if (keepalive.idleMs() + TIMER_TICK_MS >= SESSION_IDLE_TIMEOUT_MS) { // Timers may fire up to a tick early
+            if (!cancel.cancelled()) logError("Session with " + client_info + " not responding, closing it.");
+            cancel.cancel(); // Wakes the reader (wake above)
+        } else {
+            mux->send(SESSION_CHANNEL_CONTROL, SESSION_PING, nullptr, 0, false);
+        }
+    });
+
+    mux->run([&](uint8_t channel, uint8_t type, std::vector<uint8_t>& payload) {
+        if (channel == SESSION_CHANNEL_CHAT && type == SESSION_DATA && chatting) {
+            broadcastChat(client_info, reinterpret_cast<const char*>(payload.data()), payload.size(), -1, mux.get());
+        } else if (channel == SESSION_CHANNEL_FILE && type == SESSION_OPEN && payload.size() > wireSize<SessionFileOpen>()) {
+            SessionFileOpen open;
+            decodeWire(payload.data(), open);
+            std::string name(payload.begin() + wireSize<SessionFileOpen>(), payload.end());
+            name = name.substr(name.find_last_of("/\\") + 1); // Never write outside the working directory
+            if (name.empty() || name == "." || name == ".." || name.size() >= 256) {
+                logError("Invalid file name from " + client_info);
+                return;
+            }
+            if (upload) upload->chunks.close(); // A new upload abandons the previous one
+            upload.reset();
+            if (!serverExecutor.hasRoomForBlocking()) {
+                logError("Server busy. Refusing file transfer from " + client_info + ": " + name);
+                uint8_t status = 0;
+                mux->send(SESSION_CHANNEL_FILE, SESSION_CLOSE, &status, sizeof(status), false);
+                return;
+            }
+            upload = std::make_shared<SessionUpload>(name, open.size);
+            logInfo("File transfer started from " + client_info + ": " + name + " (" + std::to_string(open.size) + " bytes)");
+            serverExecutor.spawnBlocking([upload, mux, client_info](const CancelToken& uploadCancel) {
+                handleSessionUpload(upload, mux, client_info, uploadCancel);
+            });
+        } else if (channel == SESSION_CHANNEL_FILE && type == SESSION_DATA && upload) {
+            // Its credit returns once the upload task wrote it. A full queue (a client sending
+            // tiny chunks) holds up only this session; a finished upload's queue takes nothing.
+            size_t bytes = payload.size();
+            mux->keepCredit();
+            if (!upload->chunks.pushWait(std::move(payload))) mux->returnCredit(SESSION_CHANNEL_FILE, bytes);
+        } else if (channel == SESSION_CHANNEL_FILE && type == SESSION_CLOSE) {
+            if (upload) {
+                upload->complete = true; // The task reports the outcome
+                upload->chunks.close();
+                upload.reset();
+            } else {
+                uint8_t status = 0; // Nothing open, e.g. the OPEN was refused
+                mux->send(SESSION_CHANNEL_FILE, SESSION_CLOSE, &status, sizeof(status), false);
+            }
+        } else if (channel == SESSION_CHANNEL_VIDEO && type == SESSION_OPEN) {
+            // Like a MODE_VIDEO connection, a new stream replaces whichever one is showing
+            // (beginVideoSession); nothing here waits for the old one
+            if (videoFrames) videoFrames->close();
+            videoFrames.reset();
+            if (!serverExecutor.hasRoomForBlocking()) { // Its frames are dropped, as after a CLOSE
+                logError("Server busy. Refusing video stream from " + client_info);
+                return;
+            }
+            auto frames = std::make_shared<BoundedQueue<std::vector<uint8_t>>>(SESSION_VIDEO_QUEUE);
+            videoFrames = frames;
+            serverExecutor.spawnBlocking([frames, mux, client_info](const CancelToken& videoCancel) {
+                ThreadRoleScope role(ROLE_CODEC);
+                handleSessionVideo(frames, mux, client_info, videoCancel);
+            }, PRIORITY_HIGH);
+        } else if (channel == SESSION_CHANNEL_VIDEO && type == SESSION_DATA && videoFrames) {
+            videoFrames->push(std::move(payload));
+        } else if (channel == SESSION_CHANNEL_VIDEO && type == SESSION_CLOSE && videoFrames) {
+            videoFrames->close();
+            videoFrames.reset();
+        }
+    }, &keepalive);
+
+    if (videoFrames) videoFrames->close(); // The video and upload tasks finish on their own
+    if (upload) upload->chunks.close();
+    if (chatting) {
+        std::lock_guard<std::mutex> lock(chatMutex);
+        chatSessions.erase(std::remove(chatSessions.begin(), chatSessions.end(), mux.get()), chatSessions.end());
+    }
+    wake.reset(); // The video task may keep the session, and so the socket, a little longer
+    mux->close();
+    logInfo("Session ended with " + client_info + " (" + std::to_string(mux->framesReceived()) + " frames received, " +
+            std::to_string(mux->framesSent()) + " sent)");
+}
+
+#endif // SESSION_HANDLER_H
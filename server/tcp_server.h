@@ -8,16 +8,71 @@
 #include <unistd.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
-#include <cstring> // For strerror
+#include <sys/un.h> // For sockaddr_un
+#include <memory>
+#include <cerrno>
+#include <cstring> // For strerror, memcpy
 
 #include "common_utils.h"
 #include "server_common.h"
-#include "server_utils.h"  // For getClientInfo
+#include "server_utils.h"  // For getClientInfo, ShutdownOnCancel, CancelAfter
 #include "chat_handler.h"  // For handleChatClient
 #include "file_handler.h"  // For handleFileClient
 #include "video_handler.h" // For handleVideoClient
+#include "video_udp_handler.h" // For handleVideoUdpClient
+#include "session_handler.h"   // For handleSessionClient
+#include "transport.h"         // For SocketTransport, recvWithFds, attachShmTransport
 
-inline void tcpServer() {
+// Runs the handler for a connection's mode byte, in the connection's own task; takes
+// ownership of the socket
+inline void serveClient(int client_fd, uint8_t mode, const std::string& peer, const CancelToken& cancel) {
+    if (mode == MODE_SESSION) {
+        handleSessionClient(std::unique_ptr<Transport>(new SocketTransport(client_fd)), cancel);
+    } else if (mode == MODE_CHAT) {
+        {
+            std::lock_guard<std::mutex> lock(chatMutex);
+            if (chatClients.size() + chatSessions.size() >= MAX_CHAT_CLIENTS) {
+                logError("Max chat clients reached. Rejecting connection from " + peer);
+                close(client_fd);
+                return;
+            }
+            chatClients.push_back(client_fd);
+            logInfo("Chat clients connected: " + std::to_string(chatClients.size()) +
+                   "/" + std::to_string(MAX_CHAT_CLIENTS));
+        }
+        handleChatClient(client_fd, cancel);
+    } else if (mode == MODE_FILE) {
+        handleFileClient(client_fd, cancel);
+    } else if (mode == MODE_VIDEO) {
+        handleVideoClient(client_fd, cancel); // Replaces the stream showing, if any
+    } else if (mode == MODE_VIDEO_UDP) {
+        handleVideoUdpClient(client_fd, cancel);
+    } else {
+        logError("Unknown mode from " + peer);
+        close(client_fd);
+    }
+}
+
+// Task for one accepted TCP connection: reads its mode byte, then serves it
+inline void serveTcpClient(int client_fd, const std::string& peer, const CancelToken& cancel) {
+    ThreadRoleScope role(ROLE_NETWORK); // From thread_roles.h
+    uint8_t mode;
+    ShutdownOnCancel wake(cancel, client_fd); // Wakes recv() on shutdown or when the deadline passes
+    CancelAfter deadline(cancel, HANDSHAKE_TIMEOUT_MS, "No mode from " + peer); // From server_utils.h
+    bool ok = recvAll(client_fd, (char*)&mode, sizeof(mode));
+    ok = deadline.disarm() && ok;
+    wake.reset();
+    if (!ok) {
+        close(client_fd);
+        return;
+    }
+    CaptureStream capture(serverCapture, mode); // Records what the handler reads, with --capture
+    serveClient(client_fd, mode, peer, cancel);
+}
+
+// Accepts connections and hands each to a task of its own; never waits for a client
+inline void tcpServer(const CancelToken& cancel) {
+    ThreadRoleScope role(ROLE_NETWORK);
     int server_fd = socket(AF_INET, SOCK_STREAM, 0);
     int opt = 1;
     setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
@@ -29,10 +84,11 @@ inline void tcpServer() {
 
     bind(server_fd, (sockaddr*)&address, sizeof(address));
     listen(server_fd, 10);
+    ShutdownOnCancel wake(cancel, server_fd); // Wakes accept() on shutdown
 
     logInfo("TCP server started on port " + std::to_string(TCP_PORT));
 
-    while (running) {
+    while (!cancel.cancelled()) {
         sockaddr_in client_addr{};
         socklen_t addrlen = sizeof(client_addr);
         int client_fd = accept(server_fd, (sockaddr*)&client_addr, &addrlen);
@@ -40,46 +96,90 @@ inline void tcpServer() {
         
         char client_ip[INET_ADDRSTRLEN];
         inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, sizeof(client_ip));
-        int client_port = ntohs(client_addr.sin_port);
-        logInfo("New connection from " + std::string(client_ip) + ":" + std::to_string(client_port));
-        
-        uint8_t mode;
-        if (!recvAll(client_fd, (char*)&mode, sizeof(mode))) {
+        std::string peer = std::string(client_ip) + ":" + std::to_string(ntohs(client_addr.sin_port));
+        logInfo("New connection from " + peer);
+        if (!serverExecutor.hasRoomForBlocking()) { // Queued, it would wait with no handshake deadline running
+            logError("Server busy. Rejecting connection from " + peer);
             close(client_fd);
             continue;
         }
-        
-        if (mode == MODE_CHAT) {
-            std::lock_guard<std::mutex> lock(chatMutex);
-            if (chatClients.size() >= MAX_CHAT_CLIENTS) {
-                logError("Max chat clients reached. Rejecting connection from " +
-                        std::string(client_ip) + ":" + std::to_string(client_port));
-                close(client_fd);
-                continue;
-            }
-            chatClients.push_back(client_fd);
-            logInfo("Chat clients connected: " + std::to_string(chatClients.size()) +
-                   "/" + std::to_string(MAX_CHAT_CLIENTS));
-            std::thread(handleChatClient, client_fd).detach();
-        } else if (mode == MODE_FILE) {
-            std::thread(handleFileClient, client_fd).detach();
-        } else if (mode == MODE_VIDEO) {
-            // Wait for any existing video client to finish
-            {
-                std::lock_guard<std::mutex> lock(videoClientMutex);
-                if (videoClientThread.joinable()) {
-                    videoClientConnected = false; // Signal old thread to exit
-                    videoClientThread.join();
-                }
-                videoClientThread = std::thread(handleVideoClient, client_fd);
-            }
-        } else {
-            logError("Unknown mode from " + std::string(client_ip) + ":" + std::to_string(client_port));
+        serverExecutor.spawnBlocking([client_fd, peer](const CancelToken& task) { serveTcpClient(client_fd, peer, task); });
+    }
+
+    wake.reset();
+    close(server_fd);
+}
+
+// Task for one accepted local connection. Reads the mode byte with any descriptors sent along:
+// MODE_SESSION_SHM brings the shared-memory rings its session then runs over.
+inline void serveLocalClient(int client_fd, const std::string& peer, const CancelToken& cancel) {
+    ThreadRoleScope role(ROLE_NETWORK);
+    uint8_t mode;
+    int fds[SHM_TRANSPORT_FDS];
+    int count = 0;
+    ShutdownOnCancel wake(cancel, client_fd);
+    CancelAfter deadline(cancel, HANDSHAKE_TIMEOUT_MS, "No mode from " + peer);
+    bool ok = recvWithFds(client_fd, &mode, sizeof(mode), fds, count) == sizeof(mode); // From transport.h
+    ok = deadline.disarm() && ok;
+    wake.reset();
+    if (ok && mode == MODE_SESSION_SHM && count == SHM_TRANSPORT_FDS) {
+        std::unique_ptr<Transport> transport = attachShmTransport(client_fd, fds);
+        CaptureStream capture(serverCapture, MODE_SESSION); // Same bytes as over a socket, so replayed over TCP
+        if (transport) handleSessionClient(std::move(transport), cancel);
+        return;
+    }
+    for (int i = 0; i < count; i++) close(fds[i]);
+    if (ok && (mode == MODE_SESSION_SHM || mode == MODE_VIDEO_UDP)) { // UDP video needs the client's IP address
+        logError("Mode " + std::to_string(mode) + " not supported here, from " + peer);
+        ok = false;
+    }
+    if (!ok) {
+        close(client_fd);
+        return;
+    }
+    CaptureStream capture(serverCapture, mode);
+    serveClient(client_fd, mode, peer, cancel);
+}
+
+// Listener for clients on the same host (serverOptions.unixSocket). They skip the TCP/IP
+// stack, and with MODE_SESSION_SHM their session runs over shared memory instead of the socket.
+inline void unixServer(const CancelToken& cancel) {
+    ThreadRoleScope role(ROLE_NETWORK);
+    const std::string& path = serverOptions.unixSocket;
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path)) {
+        logError("Unix socket path too long: " + path);
+        return;
+    }
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    int server_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path.c_str()); // Left behind by a server that did not shut down cleanly
+    if (server_fd < 0 || bind(server_fd, (sockaddr*)&address, sizeof(address)) < 0 || listen(server_fd, 10) < 0) {
+        logError("Failed to listen on " + path + ": " + strerror(errno));
+        if (server_fd >= 0) close(server_fd);
+        return;
+    }
+    ShutdownOnCancel wake(cancel, server_fd);
+
+    logInfo("Unix socket server started on " + path);
+
+    while (!cancel.cancelled()) {
+        int client_fd = accept(server_fd, nullptr, nullptr);
+        if (client_fd < 0) continue;
+        std::string peer = getClientInfo(client_fd);
+        logInfo("New local connection from " + peer);
+        if (!serverExecutor.hasRoomForBlocking()) {
+            logError("Server busy. Rejecting connection from " + peer);
             close(client_fd);
+            continue;
         }
+        serverExecutor.spawnBlocking([client_fd, peer](const CancelToken& task) { serveLocalClient(client_fd, peer, task); });
     }
 
+    wake.reset();
     close(server_fd);
+    unlink(path.c_str());
 }
 
-#endif // TCP_SERVER_H
\ No newline at end of file
+#endif // TCP_SERVER_H
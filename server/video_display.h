@@ -12,24 +12,25 @@
 
 #include "common_utils.h"
 #include "server_common.h"
+#include "video_latency.h" // For VideoLatencyTracker, videoClockUs
 
 inline void videoDisplayLoop() {
     bool windowCreated = false;
 
-    while (running) {
+    while (!serverExecutor.cancelled()) {
         // Wait for video session to start
         {
             std::unique_lock<std::mutex> lock(mainThreadMutex);
-            mainThreadCond.wait(lock, [] { return videoSessionActive || !running; });
+            mainThreadCond.wait(lock, [] { return videoSessionActive || serverExecutor.cancelled(); });
         }
         
-        if (!running) break;
+        if (serverExecutor.cancelled()) break;
         
         if (videoSessionActive) {
             logInfo("Video display loop started");
             windowCreated = false;
             
-            while (videoSessionActive && running) {
+            while (videoSessionActive && !serverExecutor.cancelled()) {
                 std::unique_lock<std::mutex> lock(videoQueueMutex);
                 
                 // Wait for frames or shutdown signal
@@ -41,13 +42,14 @@ inline void videoDisplayLoop() {
                     break;
                 }
                 
+                DisplayFrame shown;
                 if (!videoFrameQueue.empty()) {
-                    cv::Mat frame = videoFrameQueue.front();
+                    shown = std::move(videoFrameQueue.front());
                     videoFrameQueue.pop();
                     lock.unlock();
                     
                     try {
-                        cv::imshow("Live Video Feed", frame);
+                        cv::imshow("Live Video Feed", shown.picture);
                         windowCreated = true;
                     } catch (const cv::Exception& e) {
                         logError("OpenCV error: " + std::string(e.what()));
@@ -59,6 +61,8 @@ inline void videoDisplayLoop() {
                 
                 // Process OpenCV events and check for ESC key
                 int key = cv::waitKey(1) & 0xFF;
+                // The window is painted inside waitKey, so this is when the picture became visible
+                if (shown.latency) shown.latency->onDisplayed(shown.seq, videoClockUs());
                 if (key == 27) { // ESC key
                     logInfo("ESC pressed - closing video window");
                     videoStreaming = false;
@@ -7,65 +7,282 @@
 #include <mutex>
 #include <condition_variable>
 #include <atomic>
+#include <chrono>
+#include <memory>
+#include <ctime>
+#include <algorithm> // For std::replace
 #include <unistd.h> // For close
+#include <sys/stat.h> // For mkdir
+#include <sys/socket.h> // For send
+#include <poll.h>
+#include <cerrno>
 #include <opencv2/opencv.hpp>
 
 #include "server_utils.h"
 #include "common_utils.h"
-#include "server_common.h" // For running, videoClientConnected, videoStreaming, videoSessionActive, shouldCloseWindow, videoQueueMutex, videoFrameQueue, videoCond, mainThreadCond
+#include "video_protocol.h" // For VideoFeedback, parseVideoFrame
+#include "thread_pool.h"
+#include "video_sink.h"     // For VideoSink, DisplayVideoSink, MetricsVideoSink, RelayVideoSink
+#include "video_latency.h"  // For VideoLatencyTracker
+#include "video_recorder.h"
+#include "server_common.h" // For videoClientMutex, videoClientConnected, videoStreaming, videoSessionActive, shouldCloseWindow, videoQueueMutex, videoFrameQueue, videoCond, mainThreadCond
 
-inline void handleVideoClient(int sockfd) {
-    std::string client_info = getClientInfo(sockfd); // getClientInfo from server_utils.h
-    logInfo("Video streaming started from " + client_info);
+#define VIDEO_FEEDBACK_SEND_TIMEOUT_MS 100 // How long the rest of a report that went out in part may take
+
+// Pastes the patches of a received frame onto the reference picture, decoding them in parallel.
+// Returns false if the frame cannot be applied (e.g. a delta before the first keyframe).
+inline bool applyVideoFrame(const VideoFrameInfo& info, cv::Mat& reference) {
+    static ThreadPool decodePool;
+
+    if (info.type == VIDEO_FRAME_KEY) {
+        reference.create(info.height, info.width, CV_8UC3);
+    } else if (reference.empty() || reference.cols != info.width || reference.rows != info.height) {
+        return false;
+    }
     
-    // Set flags to indicate video client is active
+    // Patches never overlap, so each one can be decoded straight into its own region
+    std::atomic<bool> ok{true};
+    decodePool.parallelFor(info.patches.size(), [&](size_t i) {
+        const VideoPatch& patch = info.patches[i];
+        try {
+            cv::Mat jpeg(1, (int)patch.size, CV_8U, const_cast<uint8_t*>(patch.data));
+            cv::Mat tile = cv::imdecode(jpeg, cv::IMREAD_COLOR);
+            if (tile.empty() || tile.cols != patch.w || tile.rows != patch.h) {
+                ok = false;
+                return;
+            }
+            tile.copyTo(reference(cv::Rect(patch.x, patch.y, patch.w, patch.h)));
+        } catch (const cv::Exception&) {
+            ok = false;
+        }
+    });
+    return ok;
+}
+
+// Makes the calling task's stream the one shown. A new stream replaces whichever one is
+// showing: the old session's task is cancelled and waited for here, on the new session's
+// worker, never in an accept loop. Then wakes the display loop. False if cancelled meanwhile.
+inline bool beginVideoSession(const CancelToken& cancel) {
+    {
+        std::unique_lock<std::mutex> lock(videoClientMutex);
+        while (videoClientBusy) {
+            if (cancel.cancelled()) return false;
+            CancelToken previous = videoClientTask;
+            lock.unlock();
+            previous.cancel(); // Wakes its socket; its handler then calls endVideoSession()
+            lock.lock();
+            videoClientDone.wait_for(lock, std::chrono::milliseconds(100), [] { return !videoClientBusy; });
+        }
+        videoClientBusy = true;
+        videoClientTask = cancel;
+    }
     videoClientConnected = true;
     videoStreaming = true;
     videoSessionActive = true;
     shouldCloseWindow = false;
-
-    // Notify main thread to start video display
     mainThreadCond.notify_one();
+    return true;
+}
+
+// Marks the video session as finished so the display loop can clean up
+inline void endVideoSession() {
+    videoClientConnected = false;
+    videoStreaming = false;
+    shouldCloseWindow = true;
+    videoSessionActive = false;
+    videoCond.notify_one();
+    mainThreadCond.notify_one(); // Ensure main thread is woken up for cleanup
+    {
+        std::lock_guard<std::mutex> lock(videoClientMutex);
+        videoClientBusy = false;
+    }
+    videoClientDone.notify_all();
+}
 
-    while (running && videoClientConnected) {
-        uint32_t frame_size_net;
-        if (!recvAll(sockfd, reinterpret_cast<char*>(&frame_size_net), sizeof(frame_size_net))) {
+// Names the files of one session: <start time>_<client ip>-<port>
+inline std::string videoSessionTag(const std::string& clientInfo) {
+    char stamp[32];
+    std::time_t now = std::time(nullptr);
+    std::strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", std::localtime(&now));
+    std::string client = clientInfo;
+    std::replace(client.begin(), client.end(), ':', '-');
+    return std::string(stamp) + "_" + client;
+}
+
+// Builds the sinks for one video session from the server options.
+// With no sinks at all (headless and nothing else requested) frames are simply discarded.
+inline std::vector<std::unique_ptr<VideoSink>> createVideoSinks(const std::string& clientInfo,
+                                                                const std::shared_ptr<VideoLatencyTracker>& latency) {
+    std::vector<std::unique_ptr<VideoSink>> sinks;
+    if (!serverOptions.headless) sinks.push_back(std::make_unique<DisplayVideoSink>(latency));
+    if (serverOptions.videoMetrics) sinks.push_back(std::make_unique<MetricsVideoSink>(clientInfo));
+    if (!serverOptions.relayTarget.empty()) {
+        sinks.push_back(std::make_unique<RelayVideoSink>(serverOptions.relayTarget, clientInfo));
+    }
+    if (serverOptions.recordVideo) {
+        mkdir(serverOptions.recordDir.c_str(), 0755); // Fine if it already exists
+        auto recorder = std::make_unique<VideoRecorder>();
+        if (recorder->start(serverOptions.recordDir + "/video_" + videoSessionTag(clientInfo))) {
+            sinks.push_back(std::move(recorder));
+        } else {
+            logError("Video recording disabled for " + clientInfo);
+        }
+    }
+    if (sinks.empty()) logInfo("No video sinks configured, discarding frames from " + clientInfo);
+    return sinks;
+}
+
+// Checks received wire frames, keeps the reference picture up to date when a sink needs
+// pictures, passes every usable frame to the session's sinks and reports back to the sender.
+// Shared by the TCP and UDP video transports.
+class VideoReceiver {
+public:
+    explicit VideoReceiver(const std::string& clientInfo)
+        : clientInfo_(clientInfo), latency_(createLatencyTracker(clientInfo)),
+          sinks_(createVideoSinks(clientInfo, latency_)), statsStart_(std::chrono::steady_clock::now()) {
+        for (auto& sink : sinks_) decode_ = decode_ || sink->needsPictures();
+    }
+
+    // Takes the frame buffer, which the sinks may keep
+    void onFrame(std::vector<uint8_t>& data) {
+        int64_t receiveUs = videoClockUs();
+        stats_.framesReceived++;
+        stats_.bytesReceived += (uint32_t)data.size();
+        
+        EncodedVideoFrame frame = std::make_shared<const std::vector<uint8_t>>(std::move(data));
+        bool parsed = parseVideoFrame(frame->data(), frame->size(), info_);
+        if (parsed) latency_->onSequence(info_.seq);
+        // After a loss, deltas are useless to every sink until the next keyframe
+        bool usable = parsed && (info_.type == VIDEO_FRAME_KEY || !keyframeNeeded_);
+        if (usable && decode_) usable = applyVideoFrame(info_, reference_);
+        if (!usable) {
+            if (!keyframeNeeded_) {
+                logError("Undecodable video frame from " + clientInfo_ + ", waiting for next keyframe");
+            }
+            onFramesLost(1);
+            return;
+        }
+        keyframeNeeded_ = false;
+        // Before the sinks, so the display can never report a frame the tracker has not seen
+        latency_->onDecoded(info_, (uint32_t)frame->size(), receiveUs, videoClockUs());
+        
+        for (auto& sink : sinks_) {
+            sink->onEncoded(frame, info_);
+            if (decode_ && sink->needsPictures()) sink->onPicture(reference_, info_);
+        }
+    }
+
+    // The reference is unreliable after a lost or bad frame: drop everything until the next keyframe
+    void onFramesLost(uint32_t count) {
+        stats_.framesDropped += count;
+        reference_.release();
+        keyframeNeeded_ = true;
+    }
+
+    // Once per VIDEO_FEEDBACK_INTERVAL_MS, fills in the report (in network byte order) and returns true
+    bool takeFeedback(VideoFeedback& fb) {
+        auto now = std::chrono::steady_clock::now();
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - statsStart_).count();
+        if (elapsed < VIDEO_FEEDBACK_INTERVAL_MS) return false;
+        
+        for (auto& sink : sinks_) stats_.framesDropped += sink->takeDropped();
+        stats_.intervalMs = (uint32_t)elapsed;
+        stats_.flags = keyframeNeeded_ ? VIDEO_FEEDBACK_KEYFRAME : 0;
+        fb = stats_;
+        stats_ = VideoFeedback{0, 0, 0, 0, 0};
+        statsStart_ = now;
+        return true;
+    }
+
+    // Sends a VideoFeedback report once per VIDEO_FEEDBACK_INTERVAL_MS. Best effort: a report
+    // that finds the socket buffer full is skipped, so a slow reader never stalls frame
+    // reception. One that went out in part has to be finished, or the client would read every
+    // later report out of step; the rest gets VIDEO_FEEDBACK_SEND_TIMEOUT_MS. Returns false if
+    // the connection failed or the report could not be finished.
+    bool maybeSendFeedback(int sockfd) {
+        VideoFeedback fb;
+        if (!takeFeedback(fb)) return true;
+        WireBuffer<VideoFeedback> wire = encodeWire(fb); // From wire_schema.h
+        size_t sent = 0;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(VIDEO_FEEDBACK_SEND_TIMEOUT_MS);
+        while (sent < wire.size()) {
+            ssize_t n = send(sockfd, wire.data() + sent, wire.size() - sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (n > 0) {
+                sent += (size_t)n;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) return false;
+            if (sent == 0) return true; // No room: skip this report
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+            if (left <= 0) return false;
+            pollfd pfd = {sockfd, POLLOUT, 0};
+            poll(&pfd, 1, (int)left);
+        }
+        return true;
+    }
+
+private:
+    static std::shared_ptr<VideoLatencyTracker> createLatencyTracker(const std::string& clientInfo) {
+        std::string csvPath;
+        if (!serverOptions.latencyDir.empty()) {
+            mkdir(serverOptions.latencyDir.c_str(), 0755); // Fine if it already exists
+            csvPath = serverOptions.latencyDir + "/latency_" + videoSessionTag(clientInfo) + ".csv";
+        }
+        return std::make_shared<VideoLatencyTracker>(clientInfo, csvPath, !serverOptions.headless);
+    }
+
+    std::string clientInfo_;
+    std::shared_ptr<VideoLatencyTracker> latency_; // Shared with the display loop
+    std::vector<std::unique_ptr<VideoSink>> sinks_;
+    bool decode_ = false;
+    cv::Mat reference_; // Current picture, patched by every delta frame
+    VideoFrameInfo info_;
+    VideoFeedback stats_{0, 0, 0, 0, 0};
+    std::chrono::steady_clock::time_point statsStart_;
+    bool keyframeNeeded_ = true; // Nothing usable until the first keyframe
+};
+
+inline void handleVideoClient(int sockfd, const CancelToken& cancel) {
+    std::string client_info = getClientInfo(sockfd); // getClientInfo from server_utils.h
+    if (!beginVideoSession(cancel)) {
+        close(sockfd);
+        return;
+    }
+    logInfo("Video streaming started from " + client_info);
+
+    ShutdownOnCancel wake(cancel, sockfd); // Wakes recvAll() on shutdown, replacement or a stall (from server_utils.h)
+    VideoReceiver receiver(client_info);
+    CancelOnIdle idle(cancel, VIDEO_IDLE_TIMEOUT_MS, "No video from " + client_info); // Frees the video slot
+
+    while (!cancel.cancelled() && videoClientConnected) {
+        VideoStreamHeader header;
+        if (!recvWireFromClient(sockfd, header)) { // From server_utils.h
             break;
         }
         
-        uint32_t frame_size = ntohl(frame_size_net);
+        uint32_t frame_size = header.frameSize;
         if (frame_size == 0) {
             logInfo("End of video stream from " + client_info);
             break;
         }
         
         std::vector<uchar> buffer(frame_size);
-        if (!recvAll(sockfd, reinterpret_cast<char*>(buffer.data()), frame_size)) {
+        if (!recvAllFromClient(sockfd, buffer.data(), frame_size)) {
             break;
         }
         
-        cv::Mat frame = cv::imdecode(buffer, cv::IMREAD_COLOR);
-        if (!frame.empty()) {
-            {
-                std::lock_guard<std::mutex> lock(videoQueueMutex);
-                // Clear old frames to prevent queue buildup
-                while (videoFrameQueue.size() > 2) {
-                    videoFrameQueue.pop();
-                }
-                videoFrameQueue.push(frame);
-            }
-            videoCond.notify_one();
+        idle.touch();
+        receiver.onFrame(buffer);
+        if (!receiver.maybeSendFeedback(sockfd)) {
+            logError("Lost the feedback stream to " + client_info + ", closing the video connection.");
+            break;
         }
     }
-    
+
     // Clean shutdown
-    videoClientConnected = false;
-    videoStreaming = false;
-    shouldCloseWindow = true;
-    videoSessionActive = false;
-    videoCond.notify_one();
-    mainThreadCond.notify_one(); // Ensure main thread is woken up for cleanup
-    
+    endVideoSession();
+    wake.reset();
     close(sockfd);
     logInfo("Video streaming ended from " + client_info);
 }
@@ -0,0 +1,81 @@
+#ifndef VIDEO_JITTER_BUFFER_H
+#define VIDEO_JITTER_BUFFER_H
+
+#include <map>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+
+#include "video_fec.h" // For VideoFrameAssembly, VideoFragmentHeader
+
+#define VIDEO_JITTER_MS 60        // How long a frame may hold up later, complete frames
+#define VIDEO_JITTER_MAX_FRAMES 32 // Pending frames kept before skipping ahead regardless
+
+// Reassembles UDP fragments into frames and releases them strictly in sequence order.
+// A frame that is still incomplete once VIDEO_JITTER_MS has passed since a later frame
+// became ready is treated as unrecoverable and skipped.
+class VideoJitterBuffer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    void add(const VideoFragmentHeader& h, const uint8_t* payload) {
+        if (!started_) {
+            nextSeq_ = h.frameSeq;
+            started_ = true;
+        }
+        if (h.frameSeq < nextSeq_) return; // Too late: already rendered or skipped
+
+        auto it = pending_.find(h.frameSeq);
+        if (it == pending_.end()) it = pending_.emplace(h.frameSeq, VideoFrameAssembly(h)).first;
+        it->second.add(h, payload);
+    }
+
+    // Pops the next frame to render. Returns false if nothing is ready yet.
+    // Every frame skipped on the way is counted in skipped.
+    bool pop(std::vector<uint8_t>& out, uint32_t& skipped, uint32_t& recovered) {
+        skipped = 0;
+        recovered = 0;
+        while (!pending_.empty()) {
+            auto head = pending_.begin();
+            if (head->first == nextSeq_ && head->second.complete()) {
+                out = head->second.data();
+                recovered = head->second.recovered();
+                pending_.erase(head);
+                nextSeq_++;
+                blockedSince_ = Clock::time_point();
+                return true;
+            }
+
+            // The head is missing or incomplete: wait while nothing newer is ready
+            bool laterReady = false;
+            for (auto& entry : pending_) {
+                if (entry.first != nextSeq_ && entry.second.complete()) {
+                    laterReady = true;
+                    break;
+                }
+            }
+            if (!laterReady && pending_.size() < VIDEO_JITTER_MAX_FRAMES) return false;
+
+            auto now = Clock::now();
+            if (blockedSince_ == Clock::time_point()) blockedSince_ = now;
+            bool expired = now - blockedSince_ >= std::chrono::milliseconds(VIDEO_JITTER_MS);
+            if (!expired && pending_.size() < VIDEO_JITTER_MAX_FRAMES) return false;
+
+            // Give up on the head and move on to the next frame we have anything for
+            uint32_t from = nextSeq_;
+            if (head->first == nextSeq_) pending_.erase(head);
+            nextSeq_ = pending_.empty() ? from + 1 : pending_.begin()->first;
+            skipped += nextSeq_ - from;
+            blockedSince_ = Clock::time_point();
+        }
+        return false;
+    }
+
+private:
+    std::map<uint32_t, VideoFrameAssembly> pending_;
+    uint32_t nextSeq_ = 0;
+    bool started_ = false;
+    Clock::time_point blockedSince_;
+};
+
+#endif // VIDEO_JITTER_BUFFER_H
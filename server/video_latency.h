@@ -0,0 +1,208 @@
+#ifndef VIDEO_LATENCY_H
+#define VIDEO_LATENCY_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <cstdio> // For snprintf, fopen
+#include <cstdint>
+#include <algorithm> // For std::min
+
+#include "common_utils.h"
+#include "video_protocol.h" // For VideoFrameInfo, videoClockUs
+
+#define VIDEO_LATENCY_PENDING_MAX 64 // Frames awaiting display before they count as never shown
+
+// Latency histogram with roughly 12% wide log-scaled buckets: exact below 16 us,
+// then 8 buckets per power of two. Values are microseconds.
+class LatencyHistogram {
+public:
+    static const int BUCKETS = 16 + 60 * 8;
+
+    void record(int64_t us) {
+        if (us < 0) { // Sender and receiver clocks disagree
+            negative_++;
+            us = 0;
+        }
+        buckets_[bucketOf((uint64_t)us)]++;
+        count_++;
+        sumUs_ += us;
+        if (us > maxUs_) maxUs_ = us;
+    }
+
+    uint64_t count() const { return count_; }
+    uint64_t negative() const { return negative_; }
+    int64_t maxUs() const { return maxUs_; }
+    double meanUs() const { return count_ ? (double)sumUs_ / count_ : 0.0; }
+
+    // Midpoint of the bucket holding the given percentile (0-100)
+    int64_t percentileUs(double p) const {
+        if (count_ == 0) return 0;
+        uint64_t rank = (uint64_t)(p / 100.0 * (count_ - 1));
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS; i++) {
+            seen += buckets_[i];
+            if (seen > rank) return std::min(midpoint(i), maxUs_);
+        }
+        return maxUs_;
+    }
+
+private:
+    static int bucketOf(uint64_t us) {
+        if (us < 16) return (int)us;
+        int exp = 63 - __builtin_clzll(us); // >= 4
+        int sub = (int)((us >> (exp - 3)) & 7);
+        return 16 + (exp - 4) * 8 + sub;
+    }
+
+    static int64_t midpoint(int bucket) {
+        if (bucket < 16) return bucket;
+        int exp = (bucket - 16) / 8 + 4;
+        int sub = (bucket - 16) % 8;
+        return ((int64_t)(8 + sub) << (exp - 3)) + ((int64_t)1 << (exp - 4));
+    }
+
+    uint64_t buckets_[BUCKETS] = {};
+    uint64_t count_ = 0;
+    uint64_t negative_ = 0;
+    int64_t sumUs_ = 0;
+    int64_t maxUs_ = 0;
+};
+
+// Every timestamp of one frame, sender side from the frame header, receiver side added here
+struct VideoFrameTimes {
+    uint32_t seq = 0;
+    uint32_t bytes = 0;
+    int64_t captureUs = 0, encodeUs = 0, sendUs = 0;
+    int64_t receiveUs = 0, decodeUs = 0, displayUs = 0; // 0 if the stage never happened
+};
+
+// Per-session latency bookkeeping: one histogram per pipeline stage, sequence gap
+// counting and optional per-frame records for offline analysis. Frames are reported
+// by the receiving thread and, when shown, by the display loop, hence the mutex.
+class VideoLatencyTracker {
+public:
+    enum Stage { ENCODE, SEND_QUEUE, NETWORK, DECODE, DISPLAY, TOTAL, STAGES };
+
+    // csvPath empty: keep no per-frame records. waitForDisplay: a display will report shown frames.
+    VideoLatencyTracker(const std::string& clientInfo, const std::string& csvPath, bool waitForDisplay)
+        : clientInfo_(clientInfo), csvPath_(csvPath), waitForDisplay_(waitForDisplay) {}
+
+    ~VideoLatencyTracker() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& entry : pending_) finish(entry.second);
+        pending_.clear();
+        report();
+        writeCsv();
+    }
+
+    // Every parsed frame, usable or not: gaps in the sequence are frames lost before they got here
+    void onSequence(uint32_t seq) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (started_ && seq != expectedSeq_) {
+            if ((int32_t)(seq - expectedSeq_) > 0) {
+                gaps_ += seq - expectedSeq_;
+            } else {
+                late_++; // Duplicate or reordered; should not happen over TCP or the jitter buffer
+                return;
+            }
+        }
+        started_ = true;
+        expectedSeq_ = seq + 1;
+    }
+
+    // A frame that was decoded (or only parsed, when nothing needs pictures)
+    void onDecoded(const VideoFrameInfo& info, uint32_t bytes, int64_t receiveUs, int64_t decodeUs) {
+        VideoFrameTimes t;
+        t.seq = info.seq;
+        t.bytes = bytes;
+        t.captureUs = info.captureUs;
+        t.encodeUs = info.encodeUs;
+        t.sendUs = info.sendUs;
+        t.receiveUs = receiveUs;
+        t.decodeUs = decodeUs;
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!waitForDisplay_) {
+            finish(t);
+            return;
+        }
+        pending_[t.seq] = t;
+        // Frames the display skipped will never be reported
+        while (pending_.size() > VIDEO_LATENCY_PENDING_MAX) {
+            finish(pending_.begin()->second);
+            pending_.erase(pending_.begin());
+        }
+    }
+
+    void onDisplayed(uint32_t seq, int64_t displayUs) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = pending_.find(seq);
+        if (it == pending_.end()) return;
+        it->second.displayUs = displayUs;
+        finish(it->second);
+        pending_.erase(it);
+    }
+
+private:
+    void finish(const VideoFrameTimes& t) {
+        stages_[ENCODE].record(t.encodeUs - t.captureUs);
+        stages_[SEND_QUEUE].record(t.sendUs - t.encodeUs);
+        stages_[NETWORK].record(t.receiveUs - t.sendUs);
+        stages_[DECODE].record(t.decodeUs - t.receiveUs);
+        if (t.displayUs) stages_[DISPLAY].record(t.displayUs - t.decodeUs);
+        stages_[TOTAL].record((t.displayUs ? t.displayUs : t.decodeUs) - t.captureUs);
+        if (!csvPath_.empty()) records_.push_back(t);
+    }
+
+    void report() const {
+        static const char* names[STAGES] = {
+            "capture->encoded", "encoded->sent", "sent->received", "received->decoded",
+            "decoded->displayed", "capture->shown",
+        };
+        logInfo("Video latency for " + clientInfo_ + ": " + std::to_string(stages_[TOTAL].count()) +
+                " frames, " + std::to_string(gaps_) + " lost in sequence gaps, " + std::to_string(late_) + " out of order");
+        for (int i = 0; i < STAGES; i++) {
+            const LatencyHistogram& h = stages_[i];
+            if (h.count() == 0) continue;
+            char line[200];
+            snprintf(line, sizeof(line), "  %-19s p50 %7.1f  p95 %7.1f  p99 %7.1f  max %7.1f  mean %7.1f ms",
+                     names[i], h.percentileUs(50) / 1000.0, h.percentileUs(95) / 1000.0,
+                     h.percentileUs(99) / 1000.0, h.maxUs() / 1000.0, h.meanUs() / 1000.0);
+            logInfo(line + (h.negative() ? " (" + std::to_string(h.negative()) + " negative: clocks out of sync?)" : std::string()));
+        }
+    }
+
+    // Written once at the end so the live path never waits on the disk
+    void writeCsv() const {
+        if (csvPath_.empty()) return;
+        FILE* f = fopen(csvPath_.c_str(), "w");
+        if (!f) {
+            logError("Failed to write latency records to " + csvPath_);
+            return;
+        }
+        fprintf(f, "seq,bytes,capture_us,encode_us,send_us,receive_us,decode_us,display_us\n");
+        for (const VideoFrameTimes& t : records_) {
+            fprintf(f, "%u,%u,%lld,%lld,%lld,%lld,%lld,%lld\n", t.seq, t.bytes,
+                    (long long)t.captureUs, (long long)t.encodeUs, (long long)t.sendUs,
+                    (long long)t.receiveUs, (long long)t.decodeUs, (long long)t.displayUs);
+        }
+        fclose(f);
+        logInfo("Latency records written to " + csvPath_);
+    }
+
+    std::string clientInfo_;
+    std::string csvPath_;
+    bool waitForDisplay_;
+    std::mutex mutex_;
+    LatencyHistogram stages_[STAGES];
+    std::map<uint32_t, VideoFrameTimes> pending_; // Decoded, waiting for the display
+    std::vector<VideoFrameTimes> records_;
+    bool started_ = false;
+    uint32_t expectedSeq_ = 0;
+    uint64_t gaps_ = 0;
+    uint64_t late_ = 0;
+};
+
+#endif // VIDEO_LATENCY_H
@@ -0,0 +1,189 @@
+#ifndef VIDEO_RECORDER_H
+#define VIDEO_RECORDER_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cstring> // For strerror
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "common_utils.h"
+#include "bounded_queue.h"
+#include "video_sink.h"      // For VideoSink, EncodedVideoFrame
+#include "video_recording.h" // For VideoIndexHeader, VideoIndexEntry, videoSegmentPath
+#include "thread_roles.h"    // For ThreadRoleScope
+
+#define VIDEO_REC_QUEUE_DEPTH 256 // Frames buffered for the I/O thread (~8 s at 30 FPS)
+
+// Appends the encoded frames of one session to segmented .mzv/.idx files.
+// The live path only timestamps the frame and moves it into a queue; all file
+// I/O happens on a background thread. If the disk falls behind, frames are
+// dropped and recording resumes cleanly at the next keyframe.
+class VideoRecorder : public VideoSink {
+public:
+    VideoRecorder() = default;
+    VideoRecorder(const VideoRecorder&) = delete;
+    VideoRecorder& operator=(const VideoRecorder&) = delete;
+    ~VideoRecorder() override { stop(); }
+
+    bool start(const std::string& prefix) {
+        prefix_ = prefix;
+        start_ = std::chrono::steady_clock::now();
+        startUnixUs_ = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        if (!openSegment()) return false;
+        io_ = std::thread(&VideoRecorder::ioLoop, this);
+        logInfo("Recording video to " + prefix_ + "_*.mzv");
+        return true;
+    }
+
+    bool active() const { return io_.joinable(); }
+
+    // Live path: never blocks on disk
+    void onEncoded(const EncodedVideoFrame& frame, const VideoFrameInfo& info) override {
+        if (!active()) return;
+        Item item;
+        item.serial = nextSerial_++;
+        item.timestampUs = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start_).count();
+        item.keyframe = info.type == VIDEO_FRAME_KEY;
+        item.frame = frame;
+        queue_.push(std::move(item));
+    }
+
+    void stop() {
+        if (!active()) return;
+        queue_.close();
+        io_.join();
+        closeSegment();
+        logInfo("Recording finished: " + std::to_string(segment_ + 1) + " segment(s), " +
+                std::to_string(framesWritten_) + " frames, " + std::to_string(framesSkipped_) + " skipped");
+    }
+
+private:
+    struct Item {
+        uint64_t serial = 0;
+        int64_t timestampUs = 0;
+        bool keyframe = false;
+        EncodedVideoFrame frame;
+    };
+
+    void ioLoop() {
+        ThreadRoleScope role(ROLE_BULK);
+        Item item;
+        uint64_t expected = 0;
+        bool waitKeyframe = false;
+        while (queue_.pop(item)) {
+            // A gap means the queue overflowed: deltas are useless until the next keyframe
+            if (item.serial != expected) waitKeyframe = true;
+            expected = item.serial + 1;
+            if (waitKeyframe && !item.keyframe) {
+                framesSkipped_++;
+                continue;
+            }
+            waitKeyframe = false;
+
+            // Rotate on a keyframe so every segment can be decoded on its own
+            bool full = header_->count >= VIDEO_REC_INDEX_CAPACITY;
+            bool large = dataSize_ >= VIDEO_REC_SEGMENT_BYTES;
+            if (item.keyframe && (full || large) && header_->count > 0) {
+                closeSegment();
+                segment_++;
+                if (!openSegment()) return;
+            } else if (full) {
+                // Out of index slots: hold off until a keyframe lets us rotate
+                waitKeyframe = true;
+                framesSkipped_++;
+                continue;
+            }
+
+            if (!writeAll(dataFd_, item.frame->data(), item.frame->size())) {
+                logError("Recording write failed: " + std::string(strerror(errno)));
+                return;
+            }
+            VideoIndexEntry& e = entries_[header_->count];
+            e.timestampUs = item.timestampUs;
+            e.offset = dataSize_;
+            e.size = (uint32_t)item.frame->size();
+            e.flags = item.keyframe ? VIDEO_INDEX_KEYFRAME : 0;
+            header_->count++; // Publish the entry only once it is complete
+            dataSize_ += item.frame->size();
+            framesWritten_++;
+        }
+    }
+
+    bool openSegment() {
+        std::string dataPath = videoSegmentPath(prefix_, segment_, ".mzv");
+        std::string indexPath = videoSegmentPath(prefix_, segment_, ".idx");
+        dataFd_ = ::open(dataPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        indexFd_ = ::open(indexPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        indexSize_ = sizeof(VideoIndexHeader) + VIDEO_REC_INDEX_CAPACITY * sizeof(VideoIndexEntry);
+        void* map = MAP_FAILED;
+        if (dataFd_ >= 0 && indexFd_ >= 0 && ftruncate(indexFd_, indexSize_) == 0) {
+            map = mmap(nullptr, indexSize_, PROT_READ | PROT_WRITE, MAP_SHARED, indexFd_, 0);
+        }
+        if (map == MAP_FAILED) {
+            logError("Failed to open recording segment " + dataPath + ": " + std::string(strerror(errno)));
+            if (dataFd_ >= 0) ::close(dataFd_);
+            if (indexFd_ >= 0) ::close(indexFd_);
+            dataFd_ = indexFd_ = -1;
+            return false;
+        }
+        header_ = static_cast<VideoIndexHeader*>(map);
+        entries_ = reinterpret_cast<VideoIndexEntry*>(header_ + 1);
+        *header_ = VideoIndexHeader{VIDEO_REC_MAGIC, VIDEO_REC_VERSION, 0, startUnixUs_};
+        dataSize_ = 0;
+        return true;
+    }
+
+    // Trims the index to the entries actually used
+    void closeSegment() {
+        if (!header_) return;
+        size_t used = sizeof(VideoIndexHeader) + header_->count * sizeof(VideoIndexEntry);
+        munmap(header_, indexSize_);
+        header_ = nullptr;
+        entries_ = nullptr;
+        if (ftruncate(indexFd_, used) != 0) logError("Failed to trim recording index.");
+        ::close(indexFd_);
+        ::close(dataFd_);
+        indexFd_ = dataFd_ = -1;
+    }
+
+    static bool writeAll(int fd, const uint8_t* data, size_t len) {
+        while (len > 0) {
+            ssize_t n = ::write(fd, data, len);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            data += n;
+            len -= (size_t)n;
+        }
+        return true;
+    }
+
+    std::string prefix_;
+    std::chrono::steady_clock::time_point start_;
+    int64_t startUnixUs_ = 0;
+    uint64_t nextSerial_ = 0;
+    BoundedQueue<Item> queue_{VIDEO_REC_QUEUE_DEPTH};
+    std::thread io_;
+
+    // Owned by the I/O thread while it runs
+    int segment_ = 0;
+    int dataFd_ = -1;
+    int indexFd_ = -1;
+    size_t indexSize_ = 0;
+    uint64_t dataSize_ = 0;
+    VideoIndexHeader* header_ = nullptr;
+    VideoIndexEntry* entries_ = nullptr;
+    uint64_t framesWritten_ = 0;
+    uint64_t framesSkipped_ = 0;
+};
+
+#endif // VIDEO_RECORDER_H
@@ -0,0 +1,233 @@
+#ifndef VIDEO_SINK_H
+#define VIDEO_SINK_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstring> // For strerror
+#include <cstdio>  // For snprintf
+#include <cstdlib> // For atoi
+#include <cerrno>
+#include <unistd.h> // For close
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/time.h> // For timeval
+#include <opencv2/opencv.hpp>
+
+#include "common_utils.h"
+#include "bounded_queue.h"
+#include "video_protocol.h" // For VideoFrameInfo, VIDEO_FRAME_KEY
+#include "server_common.h"  // For TCP_PORT, MODE_VIDEO, DisplayFrame, videoFrameQueue, videoQueueMutex, videoCond
+#include "video_latency.h"  // For VideoLatencyTracker
+#include "thread_roles.h"   // For ThreadRoleScope
+
+#define VIDEO_METRICS_INTERVAL_MS 5000
+#define VIDEO_RELAY_QUEUE_DEPTH 8          // Frames buffered for a slow relay target
+#define VIDEO_RELAY_SEND_TIMEOUT_MS 2000   // Gives up on a relay target that stops reading
+
+// A received frame exactly as it came off the wire, shared by every sink that keeps it
+using EncodedVideoFrame = std::shared_ptr<const std::vector<uint8_t>>;
+
+// Destination for the frames of a video session. The receiver hands every usable frame
+// to each sink on its own thread, so sinks must not block; slow work belongs on a sink's
+// own thread. Pictures are only decoded if at least one sink asks for them.
+class VideoSink {
+public:
+    virtual ~VideoSink() = default;
+
+    virtual bool needsPictures() const { return false; }
+
+    // Called for every frame the sinks can use; info points into *frame
+    virtual void onEncoded(const EncodedVideoFrame&, const VideoFrameInfo&) {}
+
+    // The decoded picture, only valid during the call
+    virtual void onPicture(const cv::Mat&, const VideoFrameInfo&) {}
+
+    // Frames the sink had to drop since the last call, reported back to the sender
+    virtual uint32_t takeDropped() { return 0; }
+};
+
+// Hands pictures to the display loop on the main thread, which reports back when each is shown
+class DisplayVideoSink : public VideoSink {
+public:
+    explicit DisplayVideoSink(std::shared_ptr<VideoLatencyTracker> latency) : latency_(std::move(latency)) {}
+
+    bool needsPictures() const override { return true; }
+
+    void onPicture(const cv::Mat& picture, const VideoFrameInfo& info) override {
+        // The display owns its copy; the receiver keeps patching its own
+        DisplayFrame frame{picture.clone(), info.seq, latency_};
+        {
+            std::lock_guard<std::mutex> lock(videoQueueMutex);
+            // Clear old frames to prevent queue buildup
+            while (videoFrameQueue.size() > 2) {
+                videoFrameQueue.pop();
+                dropped_++;
+            }
+            videoFrameQueue.push(std::move(frame));
+        }
+        videoCond.notify_one();
+    }
+
+    uint32_t takeDropped() override {
+        uint32_t dropped = dropped_;
+        dropped_ = 0;
+        return dropped;
+    }
+
+private:
+    std::shared_ptr<VideoLatencyTracker> latency_;
+    uint32_t dropped_ = 0;
+};
+
+// Logs frame rate, bitrate and keyframe share without touching the pixels
+class MetricsVideoSink : public VideoSink {
+public:
+    explicit MetricsVideoSink(const std::string& clientInfo)
+        : clientInfo_(clientInfo), intervalStart_(std::chrono::steady_clock::now()) {}
+
+    ~MetricsVideoSink() override {
+        logInfo("Video metrics " + clientInfo_ + ": " + std::to_string(totalFrames_) + " frames, " +
+                std::to_string(totalBytes_ / 1024) + " KiB in total");
+    }
+
+    void onEncoded(const EncodedVideoFrame& frame, const VideoFrameInfo& info) override {
+        frames_++;
+        bytes_ += frame->size();
+        if (info.type == VIDEO_FRAME_KEY) keyframes_++;
+        width_ = info.width;
+        height_ = info.height;
+
+        auto now = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(now - intervalStart_).count();
+        if (seconds * 1000 < VIDEO_METRICS_INTERVAL_MS) return;
+
+        char line[160];
+        snprintf(line, sizeof(line), "%.1f fps, %.0f kbit/s, %u keyframes, %dx%d",
+                 frames_ / seconds, bytes_ * 8 / 1000.0 / seconds, keyframes_, width_, height_);
+        logInfo("Video metrics " + clientInfo_ + ": " + line);
+        totalFrames_ += frames_;
+        totalBytes_ += bytes_;
+        frames_ = keyframes_ = 0;
+        bytes_ = 0;
+        intervalStart_ = now;
+    }
+
+private:
+    std::string clientInfo_;
+    std::chrono::steady_clock::time_point intervalStart_;
+    uint32_t frames_ = 0;
+    uint32_t keyframes_ = 0;
+    uint64_t bytes_ = 0;
+    int width_ = 0;
+    int height_ = 0;
+    uint64_t totalFrames_ = 0;
+    uint64_t totalBytes_ = 0;
+};
+
+// Forwards the session, unchanged, to another server as a regular TCP video client.
+// Sending happens on a background thread; if the target falls behind, frames are
+// dropped and forwarding resumes at the next keyframe.
+class RelayVideoSink : public VideoSink {
+public:
+    // target is "IP" or "IP:PORT"
+    RelayVideoSink(const std::string& target, const std::string& clientInfo)
+        : target_(target), clientInfo_(clientInfo) {
+        sender_ = std::thread(&RelayVideoSink::sendLoop, this);
+    }
+
+    ~RelayVideoSink() override {
+        queue_.close();
+        sender_.join();
+    }
+
+    void onEncoded(const EncodedVideoFrame& frame, const VideoFrameInfo& info) override {
+        queue_.push(Item{nextSerial_++, info.type == VIDEO_FRAME_KEY, frame});
+    }
+
+private:
+    struct Item {
+        uint64_t serial = 0;
+        bool keyframe = false;
+        EncodedVideoFrame frame;
+    };
+
+    int connectTarget() {
+        std::string ip = target_;
+        int port = TCP_PORT;
+        size_t colon = target_.find(':');
+        if (colon != std::string::npos) {
+            ip = target_.substr(0, colon);
+            port = std::atoi(target_.c_str() + colon + 1);
+        }
+
+        int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+        if (sockfd < 0) return -1;
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        uint8_t mode = MODE_VIDEO;
+        if (inet_pton(AF_INET, ip.c_str(), &addr.sin_addr) <= 0 ||
+            connect(sockfd, (sockaddr*)&addr, sizeof(addr)) < 0 ||
+            !sendAll(sockfd, (char*)&mode, sizeof(mode))) {
+            close(sockfd);
+            return -1;
+        }
+
+        timeval timeout{VIDEO_RELAY_SEND_TIMEOUT_MS / 1000, (VIDEO_RELAY_SEND_TIMEOUT_MS % 1000) * 1000};
+        setsockopt(sockfd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        return sockfd;
+    }
+
+    void sendLoop() {
+        ThreadRoleScope role(ROLE_NETWORK);
+        int sockfd = connectTarget();
+        if (sockfd < 0) {
+            logError("Failed to relay video from " + clientInfo_ + " to " + target_ + ": " + std::string(strerror(errno)));
+        } else {
+            logInfo("Relaying video from " + clientInfo_ + " to " + target_);
+        }
+
+        Item item;
+        uint64_t expected = 0;
+        bool waitKeyframe = false;
+        uint64_t skipped = 0;
+        while (queue_.pop(item)) {
+            if (sockfd < 0) continue; // Keep draining so the live path never notices
+
+            // A gap means the queue overflowed: deltas are useless until the next keyframe
+            if (item.serial != expected) waitKeyframe = true;
+            expected = item.serial + 1;
+            if (waitKeyframe && !item.keyframe) {
+                skipped++;
+                continue;
+            }
+            waitKeyframe = false;
+
+            // Header and frame in one system call (wire_schema.h)
+            if (!sendWire(sockfd, VideoStreamHeader{(uint32_t)item.frame->size()}, item.frame->data(), item.frame->size())) {
+                logError("Relay target " + target_ + " stopped accepting video, relay disabled.");
+                close(sockfd);
+                sockfd = -1;
+            }
+        }
+
+        if (sockfd >= 0) {
+            sendWire(sockfd, VideoStreamHeader{0}); // End of stream
+            close(sockfd);
+        }
+        logInfo("Video relay to " + target_ + " finished (" + std::to_string(skipped) + " frames skipped)");
+    }
+
+    std::string target_;
+    std::string clientInfo_;
+    uint64_t nextSerial_ = 0;
+    BoundedQueue<Item> queue_{VIDEO_RELAY_QUEUE_DEPTH};
+    std::thread sender_;
+};
+
+#endif // VIDEO_SINK_H
@@ -0,0 +1,136 @@
+#ifndef VIDEO_UDP_HANDLER_H
+#define VIDEO_UDP_HANDLER_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstring> // For strerror
+#include <cerrno>
+#include <poll.h>
+#include <unistd.h> // For close
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "server_utils.h"
+#include "common_utils.h"
+#include "video_fec.h"          // For parseVideoFragmentHeader
+#include "video_jitter_buffer.h"
+#include "video_handler.h"      // For VideoReceiver, beginVideoSession, endVideoSession
+#include "server_common.h"      // For videoClientConnected
+
+// Video session whose frames arrive as UDP fragments (MODE_VIDEO_UDP).
+// The TCP connection stays open as the control channel: the server announces its
+// UDP port on it, sends feedback on it, and the client ends the session on it.
+inline void handleVideoUdpClient(int sockfd, const CancelToken& cancel) {
+    std::string client_info = getClientInfo(sockfd); // getClientInfo from server_utils.h
+
+    sockaddr_in peer{};
+    socklen_t peer_len = sizeof(peer);
+    getpeername(sockfd, (sockaddr*)&peer, &peer_len);
+
+    int udpfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (udpfd < 0) {
+        logError("Failed to create UDP video socket for " + client_info);
+        close(sockfd);
+        return;
+    }
+
+    // Room for a burst of keyframe fragments while the jitter buffer catches up
+    int rcvbuf = 4 * 1024 * 1024;
+    setsockopt(udpfd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = 0; // Ephemeral port, announced to the client below
+    socklen_t addr_len = sizeof(addr);
+    if (bind(udpfd, (sockaddr*)&addr, sizeof(addr)) < 0 ||
+        getsockname(udpfd, (sockaddr*)&addr, &addr_len) < 0) {
+        logError("Failed to bind UDP video socket: " + std::string(strerror(errno)));
+        close(udpfd);
+        close(sockfd);
+        return;
+    }
+
+    VideoUdpAnnounce announce{ntohs(addr.sin_port)};
+    if (!sendWire(sockfd, announce)) { // From wire_schema.h
+        logError("Failed to announce UDP video port to " + client_info);
+        close(udpfd);
+        close(sockfd);
+        return;
+    }
+    if (!beginVideoSession(cancel)) {
+        close(udpfd);
+        close(sockfd);
+        return;
+    }
+    logInfo("Video streaming (UDP port " + std::to_string(announce.port) + ") started from " + client_info);
+
+    VideoReceiver receiver(client_info);
+    CancelOnIdle idle(cancel, VIDEO_IDLE_TIMEOUT_MS, "No video from " + client_info); // From server_utils.h
+    VideoJitterBuffer jitter;
+    std::vector<uint8_t> datagram(VIDEO_FRAG_HEADER_SIZE + VIDEO_UDP_PAYLOAD);
+    std::vector<uint8_t> frame;
+    uint32_t totalSkipped = 0;
+    uint32_t totalRecovered = 0;
+
+    pollfd fds[2] = {{sockfd, POLLIN, 0}, {udpfd, POLLIN, 0}};
+    while (!cancel.cancelled() && videoClientConnected) {
+        // Short timeout so stalled frames are skipped even when no packets arrive (and cancellation is seen)
+        int ready = poll(fds, 2, 10);
+        if (ready < 0 && errno != EINTR) break;
+
+        // Control channel: end signal or disconnect
+        if (ready > 0 && (fds[0].revents & (POLLIN | POLLHUP | POLLERR))) {
+            VideoStreamHeader end_signal;
+            if (!recvWireFromClient(sockfd, end_signal) || end_signal.frameSize == 0) { // From server_utils.h
+                logInfo("End of video stream from " + client_info);
+                break;
+            }
+        }
+
+        // Drain every queued datagram before rendering
+        if (ready > 0 && (fds[1].revents & POLLIN)) {
+            while (true) {
+                sockaddr_in from{};
+                socklen_t from_len = sizeof(from);
+                ssize_t bytes = recvfrom(udpfd, datagram.data(), datagram.size(), MSG_DONTWAIT,
+                                         (sockaddr*)&from, &from_len);
+                if (bytes < 0) break;
+                if (from.sin_addr.s_addr != peer.sin_addr.s_addr) continue; // Only accept the session's client
+                captureDatagram(datagram.data(), (size_t)bytes);              // From session_capture.h
+
+                VideoFragmentHeader h;
+                if (!parseVideoFragmentHeader(datagram.data(), (size_t)bytes, h)) continue;
+                idle.touch();
+                jitter.add(h, datagram.data() + VIDEO_FRAG_HEADER_SIZE);
+            }
+        }
+
+        uint32_t skipped = 0;
+        uint32_t recovered = 0;
+        while (jitter.pop(frame, skipped, recovered)) {
+            if (skipped) receiver.onFramesLost(skipped);
+            totalSkipped += skipped;
+            totalRecovered += recovered;
+            receiver.onFrame(frame);
+        }
+        if (skipped) {
+            receiver.onFramesLost(skipped);
+            totalSkipped += skipped;
+        }
+        if (!receiver.maybeSendFeedback(sockfd)) {
+            logError("Lost the feedback stream to " + client_info + ", closing the video connection.");
+            break;
+        }
+    }
+
+    endVideoSession();
+
+    close(udpfd);
+    close(sockfd);
+    logInfo("Video streaming ended from " + client_info + " (fragments recovered by FEC: " +
+            std::to_string(totalRecovered) + ", frames skipped: " + std::to_string(totalSkipped) + ")");
+}
+
+#endif // VIDEO_UDP_HANDLER_H
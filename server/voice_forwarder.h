@@ -0,0 +1,116 @@
+#ifndef VOICE_FORWARDER_H
+#define VOICE_FORWARDER_H
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <utility> // For std::swap
+#include <arpa/inet.h>
+
+#include "common_utils.h"
+#include "udp_batch.h" // For UdpPacket, UdpSendBatch
+
+#define VOICE_MAX_LISTENERS 64        // Clients that get forwarded voice; further ones only talk
+#define VOICE_LISTENER_IDLE_MS 10000  // A listener that sent nothing for this long is dropped
+#define VOICE_FORWARD_BATCH 1024      // Datagrams per sendmmsg() (the kernel's UIO_MAXIOV)
+
+// A client that gets everyone else's voice. Every client that sends voice (or comfort
+// noise, which silent clients keep sending) is one.
+struct VoiceListener {
+    sockaddr_in addr;
+    int64_t lastPacketMs = 0;
+    std::vector<const UdpPacket*> queue; // Packets of the current receive batch still to send
+};
+
+// Forwards each speaker's packets, unchanged, to every other listener. Forwarded packets
+// are not copied: the per-listener queues point into the receive batch's arena, and
+// flush() sends them all before the next receive overwrites it. Listener storage is
+// allocated when a client joins, so forwarding itself never allocates.
+class VoiceForwarder {
+public:
+    VoiceForwarder() : sendBatch_(VOICE_FORWARD_BATCH) {
+        listeners_.reserve(VOICE_MAX_LISTENERS);
+        sendBatch_.enableGso(true);
+    }
+
+    // Refreshes (or registers) the sender and queues the packet for everybody else.
+    // packet must stay valid until flush().
+    void queue(const UdpPacket& packet, int64_t nowMs) {
+        VoiceListener* sender = find(packet.from);
+        if (!sender && listeners_.size() < VOICE_MAX_LISTENERS) {
+            listeners_.emplace_back();
+            sender = &listeners_.back();
+            sender->addr = packet.from;
+            sender->queue.reserve(UDP_BATCH_SIZE);
+            logInfo("Voice listener joined: " + describe(packet.from) + " (" +
+                    std::to_string(listeners_.size()) + " listening)");
+        }
+        if (sender) sender->lastPacketMs = nowMs;
+        for (VoiceListener& listener : listeners_) {
+            if (&listener != sender) listener.queue.push_back(&packet);
+        }
+    }
+
+    // Sends every queue, one listener after another so that GSO can merge each listener's
+    // packets, with one sendmmsg() per VOICE_FORWARD_BATCH datagrams
+    void flush(int sockfd) {
+        for (VoiceListener& listener : listeners_) {
+            for (const UdpPacket* packet : listener.queue) {
+                if (!sendBatch_.add(listener.addr, packet->data, packet->size)) {
+                    forwarded_ += sendBatch_.flush(sockfd);
+                    sendBatch_.add(listener.addr, packet->data, packet->size);
+                }
+            }
+            listener.queue.clear();
+        }
+        if (sendBatch_.pending()) forwarded_ += sendBatch_.flush(sockfd);
+    }
+
+    // STOP_AUDIO: the client left
+    void remove(const sockaddr_in& addr) {
+        VoiceListener* listener = find(addr);
+        if (listener) erase(listener, "left");
+    }
+
+    void expire(int64_t nowMs) {
+        for (size_t i = 0; i < listeners_.size();) {
+            if (nowMs - listeners_[i].lastPacketMs > VOICE_LISTENER_IDLE_MS) {
+                erase(&listeners_[i], "timed out");
+            } else {
+                i++;
+            }
+        }
+    }
+
+    uint64_t forwarded() const { return forwarded_; }
+
+private:
+    static std::string describe(const sockaddr_in& addr) {
+        char ip[INET_ADDRSTRLEN] = {0};
+        inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+        return std::string(ip) + ":" + std::to_string(ntohs(addr.sin_port));
+    }
+
+    // A linear scan over a few dozen listeners beats hashing here, and allocates nothing
+    VoiceListener* find(const sockaddr_in& addr) {
+        for (VoiceListener& listener : listeners_) {
+            if (listener.addr.sin_addr.s_addr == addr.sin_addr.s_addr && listener.addr.sin_port == addr.sin_port) {
+                return &listener;
+            }
+        }
+        return nullptr;
+    }
+
+    // Packets still queued for the listener are dropped with it
+    void erase(VoiceListener* listener, const char* why) {
+        logInfo("Voice listener " + std::string(why) + ": " + describe(listener->addr));
+        std::swap(*listener, listeners_.back());
+        listeners_.pop_back();
+    }
+
+    std::vector<VoiceListener> listeners_;
+    UdpSendBatch sendBatch_;
+    uint64_t forwarded_ = 0;
+};
+
+#endif // VOICE_FORWARDER_H
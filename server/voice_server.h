@@ -5,139 +5,187 @@
 #include <string>
 #include <arpa/inet.h>
 #include <unistd.h>
-#include <portaudio.h>
 #include <cstring>
+#include <cerrno>
+#include <thread>
+#include <functional> // For std::ref
+#include <algorithm> // For std::min
+#include <chrono>
+#include <memory>     // For std::unique_ptr
+#include <atomic>
 
 #include "common_utils.h"
-#include "server_common.h" // running, UDP_VOICE_PORT, BUFFER_SIZE
-
-inline void voiceUDPServer() {
-    logInfo("Voice UDP server starting...");
+#include "server_utils.h"  // For ShutdownOnCancel
+#include "server_common.h" // UDP_VOICE_PORT, BUFFER_SIZE
+#include "voice_protocol.h"      // For parseVoiceHeader, VOICE_SAMPLE_RATE
+#include "voice_codec.h"         // For voiceSupportedCodecs, clampVoiceBitrate
+#include "voice_red.h"           // For VOICE_RED_MAX_BLOCKS
+#include "voice_mixer.h"         // For VoiceMixer
+#include "voice_forwarder.h"     // For VoiceForwarder
+#include "audio_device.h"        // For createAudioDevice
+#include "udp_batch.h"           // For UdpReceiveBatch
+
+#define VOICE_RECV_BACKOFF_MAX_MS 1000 // Longest pause after repeated receive errors
+
+// Receive errors that retrying cannot fix: the socket itself is unusable
+inline bool voiceReceiveErrorFatal(int error) {
+    return error == EBADF || error == ENOTSOCK || error == EFAULT || error == EINVAL;
+}
 
-    if (Pa_Initialize() != paNoError) {
-        logError("Failed to init PortAudio.");
-        return;
+// Picks the codec and bitrate for a client's OFFER and sends the ANSWER back
+inline void answerVoiceOffer(int sockfd, const sockaddr_in& cliaddr, const VoicePacketHeader& header,
+                             const uint8_t* data, size_t len) {
+    uint8_t codecs = 0;
+    uint32_t bitrate = 0;
+    uint8_t redundancy = 0;
+    if (!parseVoiceNegotiation(data, len, codecs, bitrate, redundancy)) return;
+    redundancy = std::min<uint8_t>(redundancy, VOICE_RED_MAX_BLOCKS);
+
+    uint8_t common = codecs & voiceSupportedCodecs();
+    uint8_t codec = (common & VOICE_CODEC_BIT(VOICE_PAYLOAD_OPUS)) ? VOICE_PAYLOAD_OPUS : VOICE_PAYLOAD_PCM16;
+    if (codec == VOICE_PAYLOAD_OPUS) {
+        bitrate = clampVoiceBitrate(std::min(bitrate, serverOptions.voiceMaxBitrate));
+    } else {
+        bitrate = VOICE_SAMPLE_RATE * 16;
     }
 
-    // Select first available output device
-    PaDeviceIndex outputDevice = Pa_GetDefaultOutputDevice();
-    const PaDeviceInfo* deviceInfo = nullptr;
+    uint8_t answer[VOICE_NEGOTIATION_SIZE];
+    writeVoiceNegotiation(answer, VOICE_PAYLOAD_ANSWER, header.sourceId, codec, bitrate, redundancy);
+    sendto(sockfd, answer, sizeof(answer), 0, (const sockaddr*)&cliaddr, sizeof(cliaddr));
 
-    if (outputDevice == paNoDevice) {
-        logError("No default output device found!");
-        Pa_Terminate();
+    char client_ip[INET_ADDRSTRLEN] = {0};
+    inet_ntop(AF_INET, &cliaddr.sin_addr, client_ip, sizeof(client_ip));
+    logInfo("Voice codec for " + std::string(client_ip) + ":" + std::to_string(ntohs(cliaddr.sin_port)) + ": " +
+            voiceCodecName(codec) + " at " + std::to_string(bitrate / 1000) + " kbit/s, " +
+            std::to_string(redundancy) + " redundant frames per packet");
+}
+
+// mixer is null when the server has no speaker and only forwards
+inline void handleVoiceDatagram(int sockfd, const UdpPacket& packet, VoiceMixer* mixer,
+                                VoiceForwarder& forwarder, int64_t nowMs) {
+    // Stop signal: ends that client's sources only
+    if (packet.size == strlen("STOP_AUDIO") && memcmp(packet.data, "STOP_AUDIO", packet.size) == 0) {
+        if (mixer) mixer->stopAddress(packet.from);
+        forwarder.remove(packet.from);
         return;
     }
 
-    deviceInfo = Pa_GetDeviceInfo(outputDevice);
-    logInfo("Using audio output device: " + std::string(deviceInfo->name));
-
-    // Outer loop to allow multiple audio sessions
-    while (running) {
-        PaStream* stream = nullptr;
-        int sockfd = -1;
-        bool audioActive = false;
-        sockaddr_in cliaddr{};
-        socklen_t len = sizeof(cliaddr);
-        char client_ip[INET_ADDRSTRLEN] = {0};
-        int client_port = 0;
-
-        try {
-            // Setup output parameters explicitly
-            PaStreamParameters outputParams;
-            outputParams.device = outputDevice;
-            outputParams.channelCount = 1; // Mono
-            outputParams.sampleFormat = paInt16;
-            outputParams.suggestedLatency = deviceInfo->defaultLowOutputLatency;
-            outputParams.hostApiSpecificStreamInfo = nullptr;
-
-            if (Pa_OpenStream(&stream,
-                              nullptr, // no input
-                              &outputParams,
-                              44100,
-                              512,
-                              paNoFlag,
-                              nullptr,
-                              nullptr) != paNoError) {
-                logError("Failed to open PortAudio output stream.");
-                throw std::runtime_error("PortAudio open failed");
-            }
-
-            if (Pa_StartStream(stream) != paNoError) {
-                logError("Failed to start PortAudio stream.");
-                throw std::runtime_error("PortAudio start failed");
-            }
-
-            sockfd = socket(AF_INET, SOCK_DGRAM, 0);
-            if (sockfd < 0) {
-                logError("Failed to create UDP voice socket.");
-                throw std::runtime_error("Socket creation failed");
-            }
+    VoicePacketHeader header;
+    if (!parseVoiceHeader(packet.data, packet.size, header)) {
+        return; // Not a voice packet we understand
+    }
+    if (header.payloadType == VOICE_PAYLOAD_OFFER) {
+        answerVoiceOffer(sockfd, packet.from, header, packet.data, packet.size);
+        return;
+    }
+    if (!isVoiceMedia(header.payloadType)) return;
+    forwarder.queue(packet, nowMs);
+    if (mixer) mixer->onPacket(packet.from, header, packet.data + VOICE_HEADER_SIZE, packet.size - VOICE_HEADER_SIZE);
+}
 
-            sockaddr_in servaddr{};
-            servaddr.sin_family = AF_INET;
-            servaddr.sin_port = htons(UDP_VOICE_PORT);
-            servaddr.sin_addr.s_addr = INADDR_ANY;
+inline void voiceUDPServer(const CancelToken& cancel) {
+    ThreadRoleScope role(ROLE_NETWORK); // From thread_roles.h
+    logInfo("Voice UDP server starting...");
 
-            if (bind(sockfd, (sockaddr*)&servaddr, sizeof(servaddr)) < 0) {
-                logError("Failed to bind UDP voice socket.");
-                throw std::runtime_error("Socket bind failed");
-            }
+    // One socket and one output device for the server's lifetime; clients come and go as mixer
+    // sources and listeners. Without a speaker the server still forwards voice between clients.
+    std::unique_ptr<AudioDevice> output = createAudioDevice(serverOptions.audioOutput, AudioDevice::OUTPUT,
+                                                            VOICE_SAMPLE_RATE);
+    bool playLocally = output && output->open(serverOptions.audioLatencyMs) && output->start();
+    if (playLocally) {
+        logInfo("Voice output: " + output->describe());
+    } else {
+        logError("No audio output, voice is only forwarded to clients.");
+    }
 
-            char buffer[BUFFER_SIZE];
+    int sockfd = -1;
+    VoiceMixer mixer;
+    VoiceForwarder forwarder;
+    std::atomic<bool> receiving{true}; // Stops the mixer when the receive loop gives up
+    std::thread mixerThread;
+    std::unique_ptr<ShutdownOnCancel> wake;
+
+    try {
+        sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (sockfd < 0) {
+            logError("Failed to create UDP voice socket.");
+            throw std::runtime_error("Socket creation failed");
+        }
 
-            logInfo("Voice UDP server listening for clients...");
+        sockaddr_in servaddr{};
+        servaddr.sin_family = AF_INET;
+        servaddr.sin_port = htons(UDP_VOICE_PORT);
+        servaddr.sin_addr.s_addr = INADDR_ANY;
 
-            while (running) {
-                ssize_t bytes = recvfrom(sockfd, buffer, sizeof(buffer), 0, (sockaddr*)&cliaddr, &len);
-                if (bytes <= 0) {
-                    if (bytes == 0) {
-                        logInfo("UDP client disconnected gracefully.");
-                    } else {
-                        logError("Error receiving UDP data: " + std::string(strerror(errno)));
-                    }
-                    break;
-                }
+        if (bind(sockfd, (sockaddr*)&servaddr, sizeof(servaddr)) < 0) {
+            logError("Failed to bind UDP voice socket.");
+            throw std::runtime_error("Socket bind failed");
+        }
 
-                // Stop signal
-                if (bytes == strlen("STOP_AUDIO") && std::string(buffer, bytes) == "STOP_AUDIO") {
-                    if (audioActive) {
-                        logInfo("Audio streaming ended by client: " +
-                                std::string(client_ip) + ":" + std::to_string(client_port));
-                    } else {
-                        logInfo("Received STOP_AUDIO before session started.");
-                    }
+        wake.reset(new ShutdownOnCancel(cancel, sockfd)); // Wakes recvmmsg() on shutdown (from server_utils.h)
+        if (playLocally) {
+            // Paced by the sound card, so it keeps a thread of its own rather than an executor worker
+            mixerThread = std::thread([&mixer, &output, &receiving, cancel] {
+                ThreadRoleScope mixing(ROLE_MIX);
+                mixer.run(*output, [&cancel, &receiving] { return !cancel.cancelled() && receiving; });
+            });
+        }
+        UdpReceiveBatch batch(BUFFER_SIZE); // One syscall per burst of datagrams, arena allocated once
+
+        logInfo("Voice UDP server listening for clients...");
+
+        uint32_t errors = 0; // In a row; the pause after each doubles up to VOICE_RECV_BACKOFF_MAX_MS
+        while (!cancel.cancelled()) {
+            int received = batch.receive(sockfd);
+            if (received <= 0) {
+                if (cancel.cancelled()) break; // Woken by ShutdownOnCancel
+                if (received == 0 || errno == EINTR) continue;
+                int error = errno;
+                if (voiceReceiveErrorFatal(error)) {
+                    logError("Error receiving UDP data: " + std::string(strerror(error)) + ", stopping.");
                     break;
                 }
-
-                if (!audioActive) {
-                    inet_ntop(AF_INET, &cliaddr.sin_addr, client_ip, sizeof(client_ip));
-                    client_port = ntohs(cliaddr.sin_port);
-                    logInfo("Audio streaming started from " +
-                            std::string(client_ip) + ":" + std::to_string(client_port));
-                    audioActive = true;
+                // Transient (e.g. ENOMEM, or ICMP errors from forwarding): log the first of a run, then back off
+                if (errors++ == 0) logError("Error receiving UDP data: " + std::string(strerror(error)));
+                uint32_t pauseMs = std::min<uint32_t>(VOICE_RECV_BACKOFF_MAX_MS, 1u << std::min<uint32_t>(errors - 1, 10));
+                std::this_thread::sleep_for(std::chrono::milliseconds(pauseMs));
+                continue;
+            }
+            if (errors > 1) logInfo("Voice receive recovered after " + std::to_string(errors) + " errors.");
+            errors = 0;
+            int64_t nowMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+            for (size_t i = 0; i < batch.count(); i++) {
+                if (serverCapture.active()) {
+                    const UdpPacket& packet = batch.packet(i);
+                    serverCapture.voiceDatagram(packet.from, packet.data, packet.size); // From session_capture.h
                 }
-
-                Pa_WriteStream(stream, buffer, 512); // play received audio
+                handleVoiceDatagram(sockfd, batch.packet(i), playLocally ? &mixer : nullptr, forwarder, nowMs);
             }
+            forwarder.flush(sockfd); // Before the next receive reuses the arena
+            forwarder.expire(nowMs);
         }
-        catch (const std::exception& e) {
-            logError("Voice UDP server error: " + std::string(e.what()));
-        }
-        catch (...) {
-            logError("Unknown error in Voice UDP server.");
-        }
+    }
+    catch (const std::exception& e) {
+        logError("Voice UDP server error: " + std::string(e.what()));
+    }
+    catch (...) {
+        logError("Unknown error in Voice UDP server.");
+    }
 
-        // Cleanup
-        if (sockfd != -1) close(sockfd);
-        if (stream) {
-            Pa_StopStream(stream);
-            Pa_CloseStream(stream);
-        }
+    // Cleanup
+    receiving = false;
+    if (mixerThread.joinable()) mixerThread.join();
+    wake.reset();
+    if (sockfd != -1) close(sockfd);
+    if (output) output->close();
+    if (playLocally) {
+        logInfo("Voice output: " + std::to_string(output->underruns()) + " underruns, " +
+                std::to_string(output->overruns()) + " overruns");
     }
+    logInfo("Voice forwarding: " + std::to_string(forwarder.forwarded()) + " packets sent to listeners");
 
-    Pa_Terminate();
     logInfo("Voice UDP server stopped.");
 }
 
-#endif // VOICE_SERVER_H
\ No newline at end of file
+#endif // VOICE_SERVER_H
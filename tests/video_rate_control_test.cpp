@@ -0,0 +1,95 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <algorithm> // For std::sort, std::max
+
+#include "video_rate_control.h" // For VideoRateController
+
+// Convergence test for the video rate controller (client/video_rate_control.h), in real time
+// over an in-process throttled link: frames go into a queue that drains at the link rate, and
+// the controller sees that queue as its backlog, as it sees SIOCOUTQ or the session's video
+// backlog in the app. The link starts fast, then drops to a fraction of the rate the starting
+// settings need. Frame sizes follow a rough JPEG model (bits per pixel grow with quality).
+//
+// Passes if, over the last RATE_TEST_SETTLE_S of each phase, the queueing delay's 90th
+// percentile is under the target, the link is at least RATE_TEST_MIN_UTILISATION used (so the
+// controller neither overshoots nor gives up bandwidth to stay under it), and the controller
+// stepped down after the drop.
+
+#define RATE_TEST_FAST_BPS 1500000 // Bytes per second
+#define RATE_TEST_SLOW_BPS 400000
+#define RATE_TEST_PHASE_S 8.0
+#define RATE_TEST_SETTLE_S 2.0
+#define RATE_TEST_MIN_UTILISATION 0.7
+
+static size_t frameBytes(int height, int quality) {
+    double pixels = (double)height * height * 16 / 9;
+    double bitsPerPixel = 0.08 + quality * 0.012;
+    return (size_t)(pixels * bitsPerPixel / 8);
+}
+
+struct PhaseResult {
+    double medianMs = 0, p90Ms = 0, utilisation = 0;
+    int height = 0, quality = 0, fps = 0;
+};
+
+static PhaseResult runPhase(VideoRateController& rate, double linkBps, double& queue) {
+    using Clock = std::chrono::steady_clock;
+    auto start = Clock::now(), last = start;
+    std::vector<double> delays;
+    double settledBytes = 0, settledSeconds = 0;
+    while (true) {
+        auto now = Clock::now();
+        double elapsed = std::chrono::duration<double>(now - start).count();
+        if (elapsed >= RATE_TEST_PHASE_S) break;
+        queue = std::max(0.0, queue - linkBps * std::chrono::duration<double>(now - last).count());
+        last = now;
+
+        size_t bytes = frameBytes(rate.height(), rate.quality());
+        queue += bytes;
+        rate.onSent(bytes);
+        rate.update((size_t)queue);
+        if (elapsed >= RATE_TEST_PHASE_S - RATE_TEST_SETTLE_S) {
+            delays.push_back(queue / linkBps * 1000.0);
+            settledBytes += bytes;
+        }
+        std::this_thread::sleep_until(now + std::chrono::microseconds(1000000 / rate.fps()));
+    }
+    settledSeconds = RATE_TEST_SETTLE_S;
+
+    PhaseResult r;
+    std::sort(delays.begin(), delays.end());
+    if (!delays.empty()) {
+        r.medianMs = delays[delays.size() / 2];
+        r.p90Ms = delays[delays.size() * 9 / 10];
+    }
+    r.utilisation = std::min(1.0, settledBytes / settledSeconds / linkBps);
+    r.height = rate.height();
+    r.quality = rate.quality();
+    r.fps = rate.fps();
+    return r;
+}
+
+static bool report(const char* name, const PhaseResult& r) {
+    bool ok = r.p90Ms <= VIDEO_LATENCY_TARGET_MS && r.utilisation >= RATE_TEST_MIN_UTILISATION;
+    printf("%-5s link: queueing delay %.0f ms median, %.0f ms p90; link %.0f%% used; settled at %dp q%d %d fps  %s\n",
+           name, r.medianMs, r.p90Ms, r.utilisation * 100, r.height, r.quality, r.fps, ok ? "ok" : "FAIL");
+    return ok;
+}
+
+int main() {
+    VideoRateController rate;
+    double queue = 0; // Bytes on the simulated link, carried over between phases
+    PhaseResult fast = runPhase(rate, RATE_TEST_FAST_BPS, queue);
+    PhaseResult slow = runPhase(rate, RATE_TEST_SLOW_BPS, queue);
+
+    bool ok = report("fast", fast);
+    ok = report("slow", slow) && ok;
+    bool steppedDown = frameBytes(slow.height, slow.quality) * slow.fps < frameBytes(fast.height, fast.quality) * fast.fps;
+    if (!steppedDown) printf("FAIL: the controller did not lower its rate after the drop\n");
+    ok = ok && steppedDown;
+    printf(ok ? "PASS\n" : "FAIL\n");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
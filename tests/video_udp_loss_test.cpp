@@ -0,0 +1,228 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <random>
+#include <thread>
+#include <chrono>
+#include <algorithm> // For std::sort, std::min
+#include <unistd.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "common_utils.h"       // For sendAll, recvAll
+#include "video_fec.h"          // For fragmentVideoFrame, parseVideoFragmentHeader
+#include "video_jitter_buffer.h" // For VideoJitterBuffer
+
+// Loss test for the UDP video path (utils/video_fec.h, server/video_jitter_buffer.h) against
+// the TCP path it replaces, over loopback. A sender paces frames at LOSS_TEST_FPS.
+// - UDP: every frame is fragmented with parity and each datagram is dropped at random
+//   before sendto. The receiver runs the same poll/add/pop loop as video_udp_handler.h.
+// - TCP: the frames go over a real loopback TCP connection. Loopback never loses, so each
+//   segment that would have been lost stalls the byte stream instead, as the retransmission
+//   would: one round trip when enough segments follow it for fast retransmit, a retransmission
+//   timeout for the last segments of a frame. Everything behind the hole waits with it.
+// Latency is from a frame's capture time to the moment the receiver has it, and every
+// delivered frame is checked byte for byte.
+//
+// Passes if, at every loss rate, the UDP path's 99th percentile latency is below the TCP
+// path's, at least LOSS_TEST_MIN_DELIVERED of the frames are shown over UDP, and FEC rebuilt
+// some of the lost fragments.
+
+#define LOSS_TEST_FPS 30
+#define LOSS_TEST_FRAMES 120
+#define LOSS_TEST_FRAME_BYTES 24000 // A 640x360 JPEG at the default quality
+#define LOSS_TEST_TCP_MSS 1448
+#define LOSS_TEST_RTT_MS 40         // Simulated path round trip for fast retransmit
+#define LOSS_TEST_RTO_MS 200        // Linux's minimum retransmission timeout
+#define LOSS_TEST_MIN_DELIVERED 0.75
+
+using Clock = std::chrono::steady_clock;
+
+struct PathResult {
+    int delivered = 0, corrupt = 0;
+    uint32_t skipped = 0, recovered = 0;
+    double p50Ms = 0, p99Ms = 0;
+};
+
+static void fillFrame(std::vector<uint8_t>& frame, uint32_t seq) {
+    frame.resize(LOSS_TEST_FRAME_BYTES);
+    for (size_t i = 0; i < frame.size(); i++) frame[i] = (uint8_t)(seq * 131 + i * 7);
+    memcpy(frame.data(), &seq, sizeof(seq));
+}
+
+// The frame's sequence number, or -1 if it is not the frame that was sent
+static int64_t frameSeq(const std::vector<uint8_t>& frame) {
+    uint32_t seq = 0;
+    if (frame.size() < sizeof(seq)) return -1;
+    memcpy(&seq, frame.data(), sizeof(seq));
+    std::vector<uint8_t> expected;
+    fillFrame(expected, seq);
+    return frame == expected ? seq : -1;
+}
+
+static Clock::time_point captureTime(Clock::time_point start, uint32_t seq) {
+    return start + std::chrono::microseconds((int64_t)seq * 1000000 / LOSS_TEST_FPS);
+}
+
+static void finish(PathResult& r, std::vector<double>& latencies) {
+    std::sort(latencies.begin(), latencies.end());
+    if (latencies.empty()) return;
+    r.p50Ms = latencies[latencies.size() / 2];
+    r.p99Ms = latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)];
+}
+
+static PathResult runUdp(double loss) {
+    int rx = socket(AF_INET, SOCK_DGRAM, 0);
+    int tx = socket(AF_INET, SOCK_DGRAM, 0);
+    int rcvbuf = 4 * 1024 * 1024;
+    setsockopt(rx, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    bind(rx, (sockaddr*)&addr, sizeof(addr));
+    getsockname(rx, (sockaddr*)&addr, &addr_len);
+
+    Clock::time_point start = Clock::now();
+    std::thread sender([&] {
+        std::mt19937 rng(7);
+        std::bernoulli_distribution lost(loss);
+        std::vector<uint8_t> frame;
+        std::vector<std::vector<uint8_t>> datagrams;
+        for (uint32_t seq = 0; seq < LOSS_TEST_FRAMES; seq++) {
+            std::this_thread::sleep_until(captureTime(start, seq));
+            fillFrame(frame, seq);
+            fragmentVideoFrame(seq, frame.data(), frame.size(), datagrams);
+            for (auto& d : datagrams) {
+                if (lost(rng)) continue;
+                sendto(tx, d.data(), d.size(), 0, (sockaddr*)&addr, sizeof(addr));
+            }
+        }
+    });
+
+    PathResult r;
+    std::vector<double> latencies;
+    VideoJitterBuffer jitter;
+    std::vector<uint8_t> datagram(VIDEO_FRAG_HEADER_SIZE + VIDEO_UDP_PAYLOAD);
+    std::vector<uint8_t> frame;
+    Clock::time_point end = captureTime(start, LOSS_TEST_FRAMES) + std::chrono::milliseconds(LOSS_TEST_RTO_MS * 2);
+    pollfd pfd = {rx, POLLIN, 0};
+    int64_t last = -1;
+    while (Clock::now() < end && last < LOSS_TEST_FRAMES - 1) {
+        if (poll(&pfd, 1, 10) > 0) {
+            while (true) {
+                ssize_t bytes = recv(rx, datagram.data(), datagram.size(), MSG_DONTWAIT);
+                if (bytes < 0) break;
+                VideoFragmentHeader h;
+                if (!parseVideoFragmentHeader(datagram.data(), (size_t)bytes, h)) continue;
+                jitter.add(h, datagram.data() + VIDEO_FRAG_HEADER_SIZE);
+            }
+        }
+
+        uint32_t skipped = 0, recovered = 0;
+        while (jitter.pop(frame, skipped, recovered)) {
+            r.skipped += skipped;
+            r.recovered += recovered;
+            int64_t seq = frameSeq(frame);
+            if (seq <= last) {
+                r.corrupt++;
+                continue;
+            }
+            latencies.push_back(std::chrono::duration<double, std::milli>(Clock::now() - captureTime(start, seq)).count());
+            r.delivered++;
+            last = seq;
+        }
+        r.skipped += skipped;
+    }
+    sender.join();
+    close(tx);
+    close(rx);
+    finish(r, latencies);
+    return r;
+}
+
+static PathResult runTcp(double loss) {
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    bind(listener, (sockaddr*)&addr, sizeof(addr));
+    listen(listener, 1);
+    getsockname(listener, (sockaddr*)&addr, &addr_len);
+    int tx = socket(AF_INET, SOCK_STREAM, 0);
+    connect(tx, (sockaddr*)&addr, sizeof(addr));
+    int rx = accept(listener, nullptr, nullptr);
+    close(listener);
+    int one = 1;
+    setsockopt(tx, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    Clock::time_point start = Clock::now();
+    std::thread sender([&] {
+        std::mt19937 rng(7);
+        std::bernoulli_distribution lost(loss);
+        std::vector<uint8_t> frame;
+        for (uint32_t seq = 0; seq < LOSS_TEST_FRAMES; seq++) {
+            std::this_thread::sleep_until(captureTime(start, seq)); // Returns at once while behind
+            fillFrame(frame, seq);
+            uint32_t size = htonl((uint32_t)frame.size());
+            std::vector<uint8_t> wire((uint8_t*)&size, (uint8_t*)&size + sizeof(size));
+            wire.insert(wire.end(), frame.begin(), frame.end());
+            for (size_t off = 0; off < wire.size(); off += LOSS_TEST_TCP_MSS) {
+                size_t len = std::min((size_t)LOSS_TEST_TCP_MSS, wire.size() - off);
+                if (lost(rng)) {
+                    size_t behind = (wire.size() - off - len + LOSS_TEST_TCP_MSS - 1) / LOSS_TEST_TCP_MSS;
+                    int stallMs = behind >= 3 ? LOSS_TEST_RTT_MS : LOSS_TEST_RTO_MS;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(stallMs));
+                }
+                if (!sendAll(tx, (const char*)wire.data() + off, len)) return;
+            }
+        }
+    });
+
+    PathResult r;
+    std::vector<double> latencies;
+    std::vector<uint8_t> frame;
+    for (int i = 0; i < LOSS_TEST_FRAMES; i++) {
+        uint32_t size = 0;
+        if (!recvAll(rx, (char*)&size, sizeof(size))) break;
+        frame.resize(ntohl(size));
+        if (!recvAll(rx, (char*)frame.data(), frame.size())) break;
+        int64_t seq = frameSeq(frame);
+        if (seq != i) {
+            r.corrupt++;
+            continue;
+        }
+        latencies.push_back(std::chrono::duration<double, std::milli>(Clock::now() - captureTime(start, seq)).count());
+        r.delivered++;
+    }
+    sender.join();
+    close(tx);
+    close(rx);
+    finish(r, latencies);
+    return r;
+}
+
+int main() {
+    const double rates[] = {0.01, 0.02, 0.05};
+    bool ok = true;
+    for (double loss : rates) {
+        PathResult udp = runUdp(loss);
+        PathResult tcp = runTcp(loss);
+        double delivered = (double)udp.delivered / LOSS_TEST_FRAMES;
+        bool pass = udp.corrupt == 0 && tcp.corrupt == 0 && udp.p99Ms < tcp.p99Ms &&
+                    delivered >= LOSS_TEST_MIN_DELIVERED && udp.recovered > 0;
+        printf("%2.0f%% loss  udp: %3d/%d frames (%u skipped, %u fragments rebuilt), %5.1f ms p50, %5.1f ms p99\n"
+               "          tcp: %3d/%d frames, %5.1f ms p50, %5.1f ms p99  %s\n",
+               loss * 100, udp.delivered, LOSS_TEST_FRAMES, udp.skipped, udp.recovered, udp.p50Ms, udp.p99Ms,
+               tcp.delivered, LOSS_TEST_FRAMES, tcp.p50Ms, tcp.p99Ms, pass ? "ok" : "FAIL");
+        if (udp.corrupt || tcp.corrupt) printf("FAIL: %d corrupt frames over UDP, %d over TCP\n", udp.corrupt, tcp.corrupt);
+        ok = ok && pass;
+    }
+    printf(ok ? "PASS\n" : "FAIL\n");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
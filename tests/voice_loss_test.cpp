@@ -0,0 +1,225 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <algorithm> // For std::stable_sort
+
+#include "voice_protocol.h"      // For VoicePacketHeader, writeVoiceHeader, parseVoiceHeader
+#include "voice_codec.h"         // For VoiceEncoder, VoiceDecoder
+#include "voice_red.h"           // For VoiceRedSender, parseVoiceRed
+#include "voice_jitter_buffer.h" // For VoiceJitterBuffer
+
+// Loss test for the voice path: VoiceRedSender (utils/voice_red.h) on the sending side, the
+// mixer's parseVoiceRed / push / pushRedundant, and VoiceJitterBuffer playout into
+// VoiceDecoder with PCM and waveform-repetition concealment (utils/voice_concealment.h).
+// It runs on a simulated clock: a voiced, speech-like signal is sent every 20 ms, packets are
+// dropped at random or in bursts (the two-state model of --voice-loss), the rest arrive after
+// a fixed delay plus jitter, and the receiver pops one frame every 20 ms.
+// For each loss pattern and redundancy it counts the frames lost on the wire, the ones RED
+// copies rebuilt, and the gaps left for concealment; concealed audio is compared with the
+// audio that was sent.
+//
+// Passes if every frame played from its own packet arrives bit-exact and in order, one RED copy
+// rebuilds at least LOSS_TEST_MIN_RECOVERY_1 of the frames lost at 2% random loss and two
+// copies at least LOSS_TEST_MIN_RECOVERY_2 at 10%, two copies beat one on bursts, and
+// concealment is closer to the lost audio than silence by LOSS_TEST_MIN_PLC_SNR_DB.
+
+#define LOSS_TEST_FRAMES 3000            // 60 s of audio per run
+#define LOSS_TEST_DELAY_MS 30
+#define LOSS_TEST_JITTER_MS 10
+#define LOSS_TEST_BURST 3                // Mean burst length of the burst runs
+#define LOSS_TEST_MIN_RECOVERY_1 0.90
+#define LOSS_TEST_MIN_RECOVERY_2 0.95
+#define LOSS_TEST_MIN_PLC_SNR_DB 3.0
+
+using Clock = std::chrono::steady_clock;
+
+struct RunResult {
+    int sent = 0, dropped = 0, gaps = 0, corrupt = 0;
+    uint64_t recovered = 0;
+    double plcSnrDb = 0;
+
+    double recovery() const { return dropped ? (double)recovered / dropped : 1.0; }
+};
+
+// Voiced speech stand-in: a few harmonics of a gliding 100-200 Hz pitch, with a syllable-rate envelope
+static void speech(uint32_t frame, int16_t* out) {
+    for (size_t i = 0; i < VOICE_FRAME_SAMPLES; i++) {
+        double t = (frame * (double)VOICE_FRAME_SAMPLES + i) / VOICE_SAMPLE_RATE;
+        // Integral of f0(t) = 150 + 50 sin(2 pi 0.3 t)
+        double phase = 2 * M_PI * (150.0 * t - 50.0 / (2 * M_PI * 0.3) * cos(2 * M_PI * 0.3 * t));
+        double v = sin(phase) + 0.5 * sin(2 * phase) + 0.3 * sin(3 * phase) + 0.2 * sin(5 * phase);
+        double envelope = 0.6 + 0.4 * sin(2 * M_PI * 4.0 * t);
+        out[i] = (int16_t)(6000.0 * envelope * v);
+    }
+}
+
+// Two-state loss: `percent` of packets on average, in bursts of `burst` packets on average
+class LossModel {
+public:
+    LossModel(double percent, int burst) : burst_(burst) {
+        double p = percent / 100.0;
+        stayBad_ = 1.0 - 1.0 / burst;
+        enterBad_ = p * (1.0 - stayBad_) / (1.0 - p);
+        independent_ = p;
+    }
+
+    bool drop() {
+        if (burst_ <= 1) return chance_(rng_) < independent_;
+        bad_ = chance_(rng_) < (bad_ ? stayBad_ : enterBad_);
+        return bad_;
+    }
+
+private:
+    std::mt19937 rng_{42};
+    std::uniform_real_distribution<double> chance_{0.0, 1.0};
+    int burst_;
+    double independent_, enterBad_, stayBad_;
+    bool bad_ = false;
+};
+
+struct Arrival {
+    Clock::time_point at;
+    std::vector<uint8_t> packet;
+};
+
+static RunResult run(double percent, int burst, int redundancy) {
+    RunResult r;
+    Clock::time_point start = Clock::now();
+    auto frameTime = [&](uint32_t frame) { return start + std::chrono::milliseconds(frame * 20); };
+
+    // Sender, as in voice_mode.h: encode, wrap in RED with the copies kept so far, keep this one
+    VoiceEncoder encoder;
+    encoder.open(VOICE_PAYLOAD_PCM16, 0);
+    VoiceRedSender red(redundancy);
+    LossModel loss(percent, burst);
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<int> jitterUs(0, LOSS_TEST_JITTER_MS * 1000);
+    std::vector<Arrival> arrivals;
+    int16_t samples[VOICE_FRAME_SAMPLES];
+    uint8_t payload[VOICE_MAX_PAYLOAD], copy[VOICE_MAX_PAYLOAD], buffer[VOICE_MAX_PACKET];
+    VoicePacketHeader header{VOICE_VERSION, VOICE_PAYLOAD_PCM16, 0, 0, 1};
+    for (uint32_t frame = 0; frame < LOSS_TEST_FRAMES; frame++) {
+        speech(frame, samples);
+        int payloadBytes = encoder.encode(samples, payload);
+        size_t packetBytes = red.write(header, payload, payloadBytes, buffer);
+        uint8_t copyType = 0;
+        int copyBytes = encoder.encodeRedundant(samples, payload, payloadBytes, copy, copyType);
+        red.remember(header, copyType, copy, copyBytes);
+        r.sent++;
+        if (loss.drop()) {
+            r.dropped++;
+        } else {
+            auto at = frameTime(frame) + std::chrono::milliseconds(LOSS_TEST_DELAY_MS) + std::chrono::microseconds(jitterUs(rng));
+            arrivals.push_back(Arrival{at, std::vector<uint8_t>(buffer, buffer + packetBytes)});
+        }
+        header.seq++;
+        header.timestamp += VOICE_FRAME_SAMPLES;
+    }
+    std::stable_sort(arrivals.begin(), arrivals.end(), [](const Arrival& a, const Arrival& b) { return a.at < b.at; });
+
+    // Receiver, as in voice_mixer.h: push the primary and the copies, pop every 20 ms
+    VoiceJitterBuffer jitter(VOICE_SAMPLE_RATE, VOICE_FRAME_SAMPLES);
+    VoiceDecoder decoder;
+    decoder.open(VOICE_PAYLOAD_PCM16);
+    size_t next = 0;
+    int64_t expected = -1; // Frame the next pop plays or conceals
+    double signal = 0, error = 0;
+    VoiceFrame frame;
+    int16_t out[VOICE_FRAME_SAMPLES], original[VOICE_FRAME_SAMPLES];
+    for (uint32_t tick = 0; tick < LOSS_TEST_FRAMES + 50; tick++) {
+        Clock::time_point now = frameTime(tick) + std::chrono::milliseconds(7); // Playout runs at its own phase
+        for (; next < arrivals.size() && arrivals[next].at <= now; next++) {
+            const std::vector<uint8_t>& p = arrivals[next].packet;
+            VoicePacketHeader h;
+            if (!parseVoiceHeader(p.data(), p.size(), h)) continue;
+            VoiceRedBlock blocks[VOICE_RED_MAX_BLOCKS + 1];
+            size_t count = 1;
+            if (h.payloadType == VOICE_PAYLOAD_RED) {
+                count = parseVoiceRed(h, p.data() + VOICE_HEADER_SIZE, p.size() - VOICE_HEADER_SIZE, blocks);
+                if (count == 0) continue;
+            } else {
+                blocks[0] = VoiceRedBlock{h, p.data() + VOICE_HEADER_SIZE, p.size() - VOICE_HEADER_SIZE};
+            }
+            jitter.push(blocks[0].header, blocks[0].data, blocks[0].size, arrivals[next].at);
+            for (size_t i = 1; i < count; i++) jitter.pushRedundant(blocks[i].header, blocks[i].data, blocks[i].size);
+        }
+
+        VoiceJitterStats before = jitter.stats();
+        VoicePlayout playout = jitter.pop(frame, now);
+        VoiceJitterStats after = jitter.stats();
+        if (playout == VOICE_PLAY) {
+            decoder.decode(frame, out);
+            uint32_t seq = frame.seq; // Extended from 0, the first header's seq
+            if (expected >= 0 && (int64_t)seq != expected) r.corrupt++; // Out of order
+            expected = (int64_t)seq + 1;
+            speech(seq, original);
+            if (frame.payloadType == VOICE_PAYLOAD_PCM16 &&
+                (frame.payload.size() != sizeof(original) || memcmp(frame.payload.data(), original, sizeof(original)) != 0)) {
+                r.corrupt++;
+            }
+        } else if (playout == VOICE_CONCEAL && after.stretched == before.stretched) {
+            // A missing frame: conceal it, and score the concealment against what was lost.
+            // The underruns after the last frame are the end of the stream, not gaps.
+            decoder.conceal(nullptr, out);
+            if (expected < 0 || expected >= LOSS_TEST_FRAMES) continue;
+            r.gaps++;
+            speech((uint32_t)expected++, original);
+            for (size_t i = 0; i < VOICE_FRAME_SAMPLES; i++) {
+                signal += (double)original[i] * original[i];
+                error += ((double)out[i] - original[i]) * ((double)out[i] - original[i]);
+            }
+        }
+    }
+    r.recovered = jitter.stats().recovered;
+    r.plcSnrDb = error > 0 ? 10 * log10(signal / error) : 0;
+    return r;
+}
+
+int main() {
+    struct Case { const char* name; double percent; int burst; };
+    const Case cases[] = {{"random 2%", 2, 1}, {"random 5%", 5, 1}, {"random 10%", 10, 1},
+                          {"bursts 5%", 5, LOSS_TEST_BURST}, {"bursts 10%", 10, LOSS_TEST_BURST}};
+    RunResult results[5][VOICE_RED_MAX_BLOCKS + 1];
+    bool ok = true;
+    for (size_t c = 0; c < 5; c++) {
+        for (int redundancy = 0; redundancy <= VOICE_RED_MAX_BLOCKS; redundancy++) {
+            RunResult& r = results[c][redundancy];
+            r = run(cases[c].percent, cases[c].burst, redundancy);
+            printf("%-10s  %d copies: %3d of %d lost, %3.0f%% rebuilt by RED, %3d gaps concealed", cases[c].name,
+                   redundancy, r.dropped, r.sent, r.recovery() * 100, r.gaps);
+            if (redundancy == 0) printf(", concealment SNR %.1f dB", r.plcSnrDb);
+            printf("\n");
+            if (r.corrupt) {
+                printf("FAIL: %d frames played out of order or not as sent\n", r.corrupt);
+                ok = false;
+            }
+        }
+    }
+
+    double random2 = results[0][1].recovery(), random10 = results[2][2].recovery();
+    if (random2 < LOSS_TEST_MIN_RECOVERY_1) {
+        printf("FAIL: one copy rebuilt %.0f%% at 2%% loss\n", random2 * 100);
+        ok = false;
+    }
+    if (random10 < LOSS_TEST_MIN_RECOVERY_2) {
+        printf("FAIL: two copies rebuilt %.0f%% at 10%% loss\n", random10 * 100);
+        ok = false;
+    }
+    for (size_t c = 3; c < 5; c++) {
+        if (results[c][2].recovery() <= results[c][1].recovery()) {
+            printf("FAIL: two copies no better than one on %s\n", cases[c].name);
+            ok = false;
+        }
+    }
+    if (results[1][0].plcSnrDb < LOSS_TEST_MIN_PLC_SNR_DB) {
+        printf("FAIL: concealment SNR %.1f dB at 5%% loss\n", results[1][0].plcSnrDb);
+        ok = false;
+    }
+
+    printf(ok ? "PASS\n" : "FAIL\n");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
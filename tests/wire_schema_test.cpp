@@ -0,0 +1,216 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <random>
+#include <thread>
+#include <chrono>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "common_utils.h"     // For sendAll, recvAll
+#include "wire_schema.h"      // For encodeWire, decodeWire, sendWire
+#include "session_protocol.h" // For SessionFrameHeader, SessionWindowGrant, SessionFileOpen
+#include "video_protocol.h"   // For VideoFrameHeader, VideoPatchHeader, VideoFeedback, beginVideoFrame
+#include "video_fec.h"        // For VideoFragmentHeader
+
+// Test of the schema-generated wire encoders (utils/wire_schema.h) against byte-by-byte
+// reference encoders written the way the protocol headers were before the schemas.
+// 1. WIRE_TEST_CASES random values of every schema message: encodeWire must give exactly the
+//    reference bytes, and decodeWire of those bytes must give the fields back.
+// 2. Time to start a video frame: beginVideoFrame against the old push_back version.
+// 3. Small legacy video frames over a loopback socket pair: header and payload in one sendWire
+//    call against two sendAll calls.
+// Passes if (1) holds for every message, beginVideoFrame is at least WIRE_TEST_MIN_SPEEDUP times
+// as fast as the old version, and one call is at least WIRE_TEST_MIN_SEND_RATIO as fast as two
+// (sender and receiver compete for the CPU, so the ratio allows for noise).
+
+#define WIRE_TEST_CASES 100000
+#define WIRE_TEST_ROUNDS 2000000
+#define WIRE_TEST_FRAMES 200000
+#define WIRE_TEST_FRAME_BYTES 200
+#define WIRE_TEST_MIN_SPEEDUP 1.0
+#define WIRE_TEST_MIN_SEND_RATIO 0.9
+
+// Reference encoders: big-endian, one byte at a time
+static void put(std::vector<uint8_t>& out, uint64_t v, int bytes) {
+    for (int i = bytes - 1; i >= 0; i--) out.push_back((uint8_t)(v >> (8 * i)));
+}
+
+static std::vector<uint8_t> reference(const VideoFrameHeader& h) {
+    std::vector<uint8_t> out;
+    put(out, h.type, 1);
+    put(out, h.width, 2);
+    put(out, h.height, 2);
+    put(out, h.patchCount, 2);
+    put(out, h.seq, 4);
+    put(out, (uint64_t)h.captureUs, 8);
+    put(out, (uint64_t)h.encodeUs, 8);
+    put(out, (uint64_t)h.sendUs, 8);
+    return out;
+}
+
+static std::vector<uint8_t> reference(const VideoPatchHeader& h) {
+    std::vector<uint8_t> out;
+    put(out, h.x, 2);
+    put(out, h.y, 2);
+    put(out, h.w, 2);
+    put(out, h.h, 2);
+    put(out, h.size, 4);
+    return out;
+}
+
+static std::vector<uint8_t> reference(const VideoFragmentHeader& h) {
+    std::vector<uint8_t> out;
+    put(out, h.frameSeq, 4);
+    put(out, h.frameSize, 4);
+    put(out, h.index, 2);
+    put(out, h.count, 2);
+    put(out, h.flags, 1);
+    put(out, h.groupSize, 1);
+    put(out, h.payloadLen, 2);
+    return out;
+}
+
+static std::vector<uint8_t> reference(const SessionFrameHeader& h) {
+    std::vector<uint8_t> out;
+    put(out, h.channel, 1);
+    put(out, h.type, 1);
+    put(out, h.flags, 1);
+    put(out, 0, 1);
+    put(out, h.length, 4);
+    return out;
+}
+
+static std::vector<uint8_t> reference(const SessionWindowGrant& h) {
+    std::vector<uint8_t> out;
+    put(out, h.channel, 1);
+    put(out, h.credit, 4);
+    return out;
+}
+
+static std::vector<uint8_t> reference(const SessionFileOpen& h) {
+    std::vector<uint8_t> out;
+    put(out, h.size, 8);
+    return out;
+}
+
+static std::vector<uint8_t> reference(const VideoFeedback& h) {
+    std::vector<uint8_t> out;
+    put(out, h.framesReceived, 4);
+    put(out, h.bytesReceived, 4);
+    put(out, h.framesDropped, 4);
+    put(out, h.intervalMs, 4);
+    put(out, h.flags, 4);
+    return out;
+}
+
+// encodeWire against the reference, and decodeWire back (compared through the reference)
+template <typename T>
+static bool check(const char* name, const T& msg, uint32_t& failures) {
+    std::vector<uint8_t> expected = reference(msg);
+    WireBuffer<T> got = encodeWire(msg);
+    T decoded;
+    decodeWire(expected.data(), decoded);
+    bool ok = expected.size() == got.size() && memcmp(expected.data(), got.data(), got.size()) == 0 &&
+              reference(decoded) == expected;
+    if (!ok && failures++ == 0) printf("FAIL: %s differs from the reference encoding\n", name);
+    return ok;
+}
+
+// The old beginVideoFrame, before wire_schema.h
+static void legacyBeginVideoFrame(std::vector<uint8_t>& out, uint8_t type, uint16_t width, uint16_t height,
+                                  uint32_t seq, int64_t captureUs) {
+    out.clear();
+    out.push_back(type);
+    put(out, width, 2);
+    put(out, height, 2);
+    put(out, 0, 2);
+    put(out, seq, 4);
+    put(out, (uint64_t)captureUs, 8);
+    put(out, 0, 8);
+    put(out, 0, 8);
+}
+
+template <typename Begin>
+static double nsPerFrameStart(Begin begin) {
+    std::vector<uint8_t> out;
+    out.reserve(VIDEO_FRAME_HEADER_SIZE);
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < WIRE_TEST_ROUNDS; i++) {
+        begin(out, VIDEO_FRAME_DELTA, 1280, 720, i, (int64_t)i * 33333);
+        asm volatile("" : : "r"(out.data()) : "memory"); // Keep every frame
+    }
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / WIRE_TEST_ROUNDS;
+}
+
+// Microseconds per legacy video frame (VideoStreamHeader + payload) through a socket pair
+static double usPerFrameSent(bool oneCall) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) return 0;
+    std::thread reader([&] {
+        std::vector<char> frame(WIRE_TEST_FRAME_BYTES);
+        for (int i = 0; i < WIRE_TEST_FRAMES; i++) {
+            VideoStreamHeader h;
+            if (!recvWire(sv[1], h) || !recvAll(sv[1], frame.data(), h.frameSize)) break;
+        }
+    });
+    std::vector<uint8_t> payload(WIRE_TEST_FRAME_BYTES, 0x5a);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < WIRE_TEST_FRAMES; i++) {
+        VideoStreamHeader h{(uint32_t)payload.size()};
+        if (oneCall) {
+            sendWire(sv[0], h, payload.data(), payload.size());
+        } else {
+            WireBuffer<VideoStreamHeader> head = encodeWire(h);
+            sendAll(sv[0], (const char*)head.data(), head.size());
+            sendAll(sv[0], (const char*)payload.data(), payload.size());
+        }
+    }
+    reader.join();
+    double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / WIRE_TEST_FRAMES;
+    close(sv[0]);
+    close(sv[1]);
+    return us;
+}
+
+int main() {
+    std::mt19937_64 rng(1);
+    auto u8 = [&] { return (uint8_t)rng(); };
+    auto u16 = [&] { return (uint16_t)rng(); };
+    auto u32 = [&] { return (uint32_t)rng(); };
+    uint32_t failures = 0;
+    for (int i = 0; i < WIRE_TEST_CASES; i++) {
+        check("VideoFrameHeader", VideoFrameHeader{u8(), u16(), u16(), u16(), u32(), (int64_t)rng(), (int64_t)rng(), (int64_t)rng()}, failures);
+        check("VideoPatchHeader", VideoPatchHeader{u16(), u16(), u16(), u16(), u32()}, failures);
+        check("VideoFragmentHeader", VideoFragmentHeader{u32(), u32(), u16(), u16(), u8(), u8(), u16()}, failures);
+        check("SessionFrameHeader", SessionFrameHeader{u8(), u8(), u8(), u32()}, failures);
+        check("SessionWindowGrant", SessionWindowGrant{u8(), u32()}, failures);
+        check("SessionFileOpen", SessionFileOpen{rng()}, failures);
+        check("VideoFeedback", VideoFeedback{u32(), u32(), u32(), u32(), u32()}, failures);
+    }
+    printf("%d random cases of 7 messages: %u differ from the reference\n", WIRE_TEST_CASES, failures);
+    bool ok = failures == 0;
+
+    double schemaNs = nsPerFrameStart(beginVideoFrame);
+    double legacyNs = nsPerFrameStart(legacyBeginVideoFrame);
+    double speedup = legacyNs / schemaNs;
+    printf("beginVideoFrame: %.1f ns, old push_back version %.1f ns (%.1fx)\n", schemaNs, legacyNs, speedup);
+    if (speedup < WIRE_TEST_MIN_SPEEDUP) {
+        printf("FAIL: beginVideoFrame slower than the old version\n");
+        ok = false;
+    }
+
+    double twoCalls = usPerFrameSent(false);
+    double oneCall = usPerFrameSent(true);
+    double ratio = twoCalls / oneCall;
+    printf("%d-byte frames over a socket pair: %.2f us with sendWire, %.2f us with two sendAll calls (%.2fx)\n",
+           WIRE_TEST_FRAME_BYTES, oneCall, twoCalls, ratio);
+    if (ratio < WIRE_TEST_MIN_SEND_RATIO) {
+        printf("FAIL: one sendWire call slower than two sendAll calls\n");
+        ok = false;
+    }
+
+    printf(ok ? "PASS\n" : "FAIL\n");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,497 @@
+#ifndef AUDIO_DEVICE_H
+#define AUDIO_DEVICE_H
+
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <string>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstdio>    // For FILE, sscanf
+#include <cstring>   // For memcmp
+#include <cmath>     // For sin
+#include <algorithm> // For std::fill, std::max, std::min
+#ifndef MINI_ZOOM_NO_PORTAUDIO
+#include <portaudio.h>
+#endif
+
+#include "common_utils.h"
+#include "spsc_ring.h"   // For SpscRing
+#include "frame_clock.h" // For FrameClock
+#include "thread_roles.h" // For ThreadRoleScope, threadRoles
+
+// PortAudio is optional: build with -DMINI_ZOOM_NO_PORTAUDIO (and without -lportaudio) for
+// machines without a sound card; only the file, tone and null devices are left.
+#define AUDIO_RING_SAMPLES 8192   // Ring between the device and the network thread (~170 ms at 48 kHz)
+#define AUDIO_WAIT_MIN_US 1000    // Shortest sleep while waiting on the ring
+#define AUDIO_CLOCK_PERIOD_MS 10  // Tick of the devices that run on a timer instead of a sound card
+#define AUDIO_TONE_HZ 440
+#define AUDIO_TONE_LEVEL 8000     // Amplitude of the test tone, well above the VAD's noise floor
+#define AUDIO_CALLBACK_WAIT_MS 500 // How long start() waits for the first callback to learn its thread
+
+// Mono 16-bit audio device. Samples move between the device and the network thread through
+// a preallocated SpscRing: the device side (an audio callback or a timer thread) only copies,
+// so it never blocks or allocates, and the network thread sleeps instead of blocking on it.
+class AudioDevice {
+public:
+    enum Direction { INPUT, OUTPUT };
+
+    AudioDevice(Direction direction, int sampleRate)
+        : direction_(direction), sampleRate_(sampleRate), ring_(AUDIO_RING_SAMPLES) {}
+    virtual ~AudioDevice() = default;
+
+    // latencyMs 0: the backend's lowest recommended latency
+    virtual bool open(int latencyMs) = 0;
+    virtual bool start() = 0;
+    virtual void close() = 0;
+    virtual std::string describe() const = 0;
+
+    // OUTPUT: queue samples for the device. Samples that do not fit are dropped and counted.
+    void write(const int16_t* samples, size_t n) {
+        size_t written = ring_.write(samples, n);
+        if (written < n) overruns_++;
+        primed_.store(true, std::memory_order_release);
+    }
+
+    // INPUT: takes exactly n captured samples, sleeping until they are there. Returns false
+    // if keepGoing() turned false first, or the input ended (end of a file).
+    template <typename KeepGoing>
+    bool read(int16_t* samples, size_t n, KeepGoing keepGoing) {
+        while (ring_.size() < n) {
+            if (!keepGoing() || ended_.load(std::memory_order_acquire)) return false;
+            sleepForSamples(n - ring_.size());
+        }
+        return ring_.read(samples, n) == n;
+    }
+
+    // OUTPUT: sleeps until at most `samples` are still queued for the device
+    template <typename KeepGoing>
+    bool waitForRoom(size_t samples, KeepGoing keepGoing) {
+        while (ring_.size() > samples) {
+            if (!keepGoing()) return false;
+            sleepForSamples(ring_.size() - samples);
+        }
+        return true;
+    }
+
+    Direction direction() const { return direction_; }
+    uint64_t underruns() const { return underruns_; }
+    uint64_t overruns() const { return overruns_; }
+
+protected:
+    // Device side, INPUT: no room means the network thread fell behind, the newest samples are lost
+    void capture(const int16_t* samples, size_t n) {
+        if (ring_.write(samples, n) < n) overruns_++;
+    }
+
+    // Device side, OUTPUT: fills out from the ring, with silence if it ran dry
+    void play(int16_t* out, size_t n) {
+        size_t got = ring_.read(out, n);
+        if (got < n) {
+            std::fill(out + got, out + n, 0);
+            if (primed_.load(std::memory_order_acquire)) underruns_++;
+        }
+    }
+
+    // INPUT: no more samples will come
+    void finish() { ended_.store(true, std::memory_order_release); }
+
+    Direction direction_;
+    int sampleRate_;
+    std::atomic<uint64_t> underruns_{0};
+    std::atomic<uint64_t> overruns_{0};
+
+private:
+    void sleepForSamples(size_t samples) {
+        int64_t us = (int64_t)samples * 1000000 / sampleRate_;
+        std::this_thread::sleep_for(std::chrono::microseconds(std::max<int64_t>(us, AUDIO_WAIT_MIN_US)));
+    }
+
+    SpscRing<int16_t> ring_;
+    std::atomic<bool> primed_{false}; // Output: nothing counts as an underrun before the first write
+    std::atomic<bool> ended_{false};
+};
+
+#ifndef MINI_ZOOM_NO_PORTAUDIO
+// A sound card through PortAudio in callback mode. Each device holds its own reference on
+// the library (Pa_Initialize is reference counted).
+class PortAudioDevice : public AudioDevice {
+public:
+    // device paNoDevice: the host's default device for the direction
+    PortAudioDevice(Direction direction, int sampleRate, PaDeviceIndex device = paNoDevice)
+        : AudioDevice(direction, sampleRate), device_(device) {}
+
+    ~PortAudioDevice() override { close(); }
+
+    bool open(int latencyMs) override {
+        if (Pa_Initialize() != paNoError) {
+            logError("Failed to initialize PortAudio.");
+            return false;
+        }
+        initialized_ = true;
+        PaDeviceIndex device = device_ != paNoDevice ? device_
+                             : direction_ == INPUT ? Pa_GetDefaultInputDevice() : Pa_GetDefaultOutputDevice();
+        const PaDeviceInfo* info = device != paNoDevice ? Pa_GetDeviceInfo(device) : nullptr;
+        if (!info) {
+            logError("No audio " + std::string(direction_ == INPUT ? "input" : "output") + " device found.");
+            return false;
+        }
+        PaStreamParameters params;
+        params.device = device;
+        params.channelCount = 1; // Mono
+        params.sampleFormat = paInt16;
+        params.suggestedLatency = latencyMs > 0 ? latencyMs / 1000.0
+                                : direction_ == INPUT ? info->defaultLowInputLatency : info->defaultLowOutputLatency;
+        params.hostApiSpecificStreamInfo = nullptr;
+
+        PaError err = Pa_OpenStream(&stream_,
+                                    direction_ == INPUT ? &params : nullptr,
+                                    direction_ == OUTPUT ? &params : nullptr,
+                                    sampleRate_,
+                                    paFramesPerBufferUnspecified, // Let the host pick its best buffer size
+                                    paNoFlag,
+                                    &PortAudioDevice::callback,
+                                    this);
+        if (err != paNoError) {
+            logError("Failed to open PortAudio stream: " + std::string(Pa_GetErrorText(err)));
+            stream_ = nullptr;
+            return false;
+        }
+        name_ = info->name;
+        const PaStreamInfo* streamInfo = Pa_GetStreamInfo(stream_);
+        if (streamInfo) {
+            double latency = direction_ == INPUT ? streamInfo->inputLatency : streamInfo->outputLatency;
+            logInfo("Audio " + std::string(direction_ == INPUT ? "input" : "output") + " on " + info->name +
+                    ", device latency " + std::to_string((int)(latency * 1000 + 0.5)) + " ms");
+        }
+        return true;
+    }
+
+    bool start() override {
+        if (!stream_ || Pa_StartStream(stream_) != paNoError) return false;
+        adoptCallbackThread();
+        return true;
+    }
+
+    void close() override {
+        if (callbackAdopted_) {
+            threadRoles().release(callbackTid_); // While the callback thread still runs
+            callbackAdopted_ = false;
+        }
+        if (stream_) {
+            Pa_StopStream(stream_);
+            Pa_CloseStream(stream_);
+            stream_ = nullptr;
+            callbackSeen_.store(false, std::memory_order_relaxed); // A new stream may call from another thread
+        }
+        if (initialized_) {
+            Pa_Terminate();
+            initialized_ = false;
+        }
+    }
+
+    std::string describe() const override { return name_.empty() ? "PortAudio" : name_; }
+
+private:
+    // Runs on the audio thread: lock-free and allocation-free
+    static int callback(const void* input, void* output, unsigned long frames,
+                        const PaStreamCallbackTimeInfo*, PaStreamCallbackFlags flags, void* user) {
+        PortAudioDevice* self = static_cast<PortAudioDevice*>(user);
+        if (!self->callbackSeen_.load(std::memory_order_relaxed)) { // First call only: one gettid, no locks
+            self->callbackThread_ = pthread_self();
+            self->callbackTid_ = currentThreadId();
+            self->callbackSeen_.store(true, std::memory_order_release);
+        }
+        if (self->direction_ == INPUT) {
+            if (input) self->capture(static_cast<const int16_t*>(input), frames);
+            if (flags & paInputOverflow) self->overruns_++;
+        } else {
+            self->play(static_cast<int16_t*>(output), frames);
+            if (flags & paOutputUnderflow) self->underruns_++;
+        }
+        return paContinue;
+    }
+
+    // The audio role goes on the callback thread from here, not from the callback: taking it
+    // on may read /proc, lock and change the thread's scheduling, none of which a real-time
+    // callback may do. Waits for the first callback to say which thread it runs on.
+    void adoptCallbackThread() {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(AUDIO_CALLBACK_WAIT_MS);
+        while (!callbackSeen_.load(std::memory_order_acquire)) {
+            if (std::chrono::steady_clock::now() >= deadline) return; // Counted to no role
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (callbackAdopted_) return;
+        threadRoles().adopt(ROLE_AUDIO, callbackThread_, callbackTid_);
+        callbackAdopted_ = true;
+    }
+
+    PaDeviceIndex device_;
+    PaStream* stream_ = nullptr;
+    bool initialized_ = false;
+    std::string name_;
+    std::atomic<bool> callbackSeen_{false}; // Set by the first callback, with the two below
+    pthread_t callbackThread_{};
+    long callbackTid_ = 0;
+    bool callbackAdopted_ = false;
+};
+#endif
+
+// A device driven by a timer thread instead of a sound card: every AUDIO_CLOCK_PERIOD_MS it
+// takes one period of samples from produce() (input) or hands one to consume() (output), so
+// the rest of the voice path runs at the same real-time pace as with hardware.
+class ClockedAudioDevice : public AudioDevice {
+public:
+    ClockedAudioDevice(Direction direction, int sampleRate)
+        : AudioDevice(direction, sampleRate), chunk_((size_t)sampleRate * AUDIO_CLOCK_PERIOD_MS / 1000) {}
+
+    ~ClockedAudioDevice() override { stopClock(); }
+
+    bool open(int) override { return true; }
+
+    bool start() override {
+        if (thread_.joinable()) return true;
+        running_ = true;
+        thread_ = std::thread(&ClockedAudioDevice::tick, this);
+        return true;
+    }
+
+    void close() override { stopClock(); }
+
+protected:
+    // Timer thread: fills out with the next n input samples; false once there are no more
+    virtual bool produce(int16_t* out, size_t n) {
+        std::fill(out, out + n, 0);
+        return true;
+    }
+
+    // Timer thread: n samples just played
+    virtual void consume(const int16_t*, size_t) {}
+
+    // Derived destructors call this before their members go away
+    void stopClock() {
+        running_ = false;
+        if (thread_.joinable()) thread_.join();
+    }
+
+private:
+    void tick() {
+        ThreadRoleScope role(ROLE_AUDIO);
+        FrameClock clock(1000.0 / AUDIO_CLOCK_PERIOD_MS);
+        while (running_) {
+            clock.wait();
+            if (direction_ == INPUT) {
+                if (!produce(chunk_.data(), chunk_.size())) {
+                    finish();
+                    return;
+                }
+                capture(chunk_.data(), chunk_.size());
+            } else {
+                play(chunk_.data(), chunk_.size());
+                consume(chunk_.data(), chunk_.size());
+            }
+        }
+    }
+
+    std::vector<int16_t> chunk_;
+    std::atomic<bool> running_{false};
+    std::thread thread_;
+};
+
+// Silence in, nothing out, at real-time pace
+class NullAudioDevice : public ClockedAudioDevice {
+public:
+    using ClockedAudioDevice::ClockedAudioDevice;
+    std::string describe() const override { return "null device"; }
+};
+
+// Input only: one second of a sine tone, one second of silence, over and over, like talk
+// spurts and pauses, so silence suppression has something to do
+class ToneAudioDevice : public ClockedAudioDevice {
+public:
+    ToneAudioDevice(int sampleRate, int hz) : ClockedAudioDevice(INPUT, sampleRate), hz_(hz) {}
+    ~ToneAudioDevice() override { stopClock(); }
+
+    std::string describe() const override { return std::to_string(hz_) + " Hz tone"; }
+
+protected:
+    bool produce(int16_t* out, size_t n) override {
+        for (size_t i = 0; i < n; i++, position_++) {
+            bool on = (position_ / sampleRate_) % 2 == 0;
+            out[i] = on ? (int16_t)(AUDIO_TONE_LEVEL * std::sin(2.0 * M_PI * hz_ * position_ / sampleRate_)) : 0;
+        }
+        return true;
+    }
+
+private:
+    int hz_;
+    uint64_t position_ = 0;
+};
+
+// A WAV file: input plays it once (16-bit PCM at the device's sample rate, stereo is mixed
+// down) and then ends; output records everything played into it.
+class WavAudioDevice : public ClockedAudioDevice {
+public:
+    WavAudioDevice(Direction direction, int sampleRate, const std::string& path)
+        : ClockedAudioDevice(direction, sampleRate), path_(path) {}
+
+    ~WavAudioDevice() override { close(); }
+
+    bool open(int) override {
+        return direction_ == INPUT ? load() : create();
+    }
+
+    void close() override {
+        stopClock();
+        if (!file_) return;
+        // Now that the length is known, fill in the RIFF and data chunk sizes
+        uint32_t dataBytes = (uint32_t)(written_ * sizeof(int16_t));
+        writeU32At(4, 36 + dataBytes);
+        writeU32At(40, dataBytes);
+        fclose(file_);
+        file_ = nullptr;
+        logInfo("Wrote " + std::to_string(written_ / sampleRate_) + " s of audio to " + path_);
+    }
+
+    std::string describe() const override { return "WAV file " + path_; }
+
+protected:
+    bool produce(int16_t* out, size_t n) override {
+        if (position_ >= samples_.size()) return false;
+        size_t take = std::min(n, samples_.size() - position_);
+        std::copy(samples_.begin() + position_, samples_.begin() + position_ + take, out);
+        std::fill(out + take, out + n, 0);
+        position_ += take;
+        return true;
+    }
+
+    void consume(const int16_t* samples, size_t n) override {
+        if (file_) written_ += fwrite(samples, sizeof(int16_t), n, file_);
+    }
+
+private:
+    static uint32_t u32(const uint8_t* p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24); }
+    static uint16_t u16(const uint8_t* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+
+    // Reads the whole file up front, so the timer thread never touches the disk
+    bool load() {
+        FILE* f = fopen(path_.c_str(), "rb");
+        if (!f) {
+            logError("Could not open WAV file " + path_);
+            return false;
+        }
+        std::vector<uint8_t> bytes;
+        uint8_t buffer[65536];
+        size_t got;
+        while ((got = fread(buffer, 1, sizeof(buffer), f)) > 0) bytes.insert(bytes.end(), buffer, buffer + got);
+        fclose(f);
+
+        if (bytes.size() < 12 || memcmp(bytes.data(), "RIFF", 4) != 0 || memcmp(bytes.data() + 8, "WAVE", 4) != 0) {
+            logError(path_ + " is not a WAV file.");
+            return false;
+        }
+        int channels = 0;
+        int bits = 0;
+        uint32_t rate = 0;
+        for (size_t pos = 12; pos + 8 <= bytes.size();) {
+            uint32_t size = u32(&bytes[pos + 4]);
+            const uint8_t* body = &bytes[pos + 8];
+            size_t available = std::min<size_t>(size, bytes.size() - pos - 8);
+            if (memcmp(&bytes[pos], "fmt ", 4) == 0 && available >= 16) {
+                if (u16(body) != 1) break; // Not integer PCM
+                channels = u16(body + 2);
+                rate = u32(body + 4);
+                bits = u16(body + 14);
+            } else if (memcmp(&bytes[pos], "data", 4) == 0 && channels > 0) {
+                if (bits != 16 || (channels != 1 && channels != 2) || rate != (uint32_t)sampleRate_) break;
+                size_t frames = available / (2 * channels);
+                samples_.resize(frames);
+                for (size_t i = 0; i < frames; i++) {
+                    int32_t sum = 0;
+                    for (int c = 0; c < channels; c++) sum += (int16_t)u16(body + (i * channels + c) * 2);
+                    samples_[i] = (int16_t)(sum / channels);
+                }
+                logInfo("Audio input from " + path_ + ": " + std::to_string(frames / sampleRate_) + " s");
+                return true;
+            }
+            pos += 8 + size + (size & 1); // Chunks are padded to an even size
+        }
+        logError(path_ + " must be 16-bit PCM, mono or stereo, at " + std::to_string(sampleRate_) + " Hz.");
+        return false;
+    }
+
+    bool create() {
+        file_ = fopen(path_.c_str(), "wb");
+        if (!file_) {
+            logError("Could not create WAV file " + path_);
+            return false;
+        }
+        uint8_t header[44] = {'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'A', 'V', 'E',
+                              'f', 'm', 't', ' ', 16, 0, 0, 0, 1, 0, 1, 0, // PCM, mono
+                              0, 0, 0, 0, 0, 0, 0, 0, 2, 0, 16, 0,         // rate, byte rate, block align, bits
+                              'd', 'a', 't', 'a', 0, 0, 0, 0};
+        fwrite(header, 1, sizeof(header), file_);
+        writeU32At(24, (uint32_t)sampleRate_);
+        writeU32At(28, (uint32_t)sampleRate_ * 2);
+        return true;
+    }
+
+    void writeU32At(long offset, uint32_t value) {
+        uint8_t b[4] = {(uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24)};
+        long end = ftell(file_);
+        fseek(file_, offset, SEEK_SET);
+        fwrite(b, 1, 4, file_);
+        fseek(file_, end, SEEK_SET);
+    }
+
+    std::string path_;
+    std::vector<int16_t> samples_; // Input
+    size_t position_ = 0;
+    FILE* file_ = nullptr;         // Output
+    uint64_t written_ = 0;
+};
+
+// Default --audio-input / --audio-output spec
+#ifdef MINI_ZOOM_NO_PORTAUDIO
+#define AUDIO_DEFAULT_DEVICE "null"
+#else
+#define AUDIO_DEFAULT_DEVICE "portaudio"
+#endif
+
+// Parses an audio device spec: "portaudio[:INDEX]" (a sound card, the default one without
+// an index), "wav:PATH", "tone[:HZ]" (input only) or "null"; empty means AUDIO_DEFAULT_DEVICE.
+// Returns nullptr if invalid.
+inline std::unique_ptr<AudioDevice> createAudioDevice(const std::string& spec, AudioDevice::Direction direction,
+                                                      int sampleRate) {
+    if (spec.empty()) return createAudioDevice(AUDIO_DEFAULT_DEVICE, direction, sampleRate);
+    std::string kind = spec;
+    std::string arg;
+    size_t colon = spec.find(':');
+    if (colon != std::string::npos) {
+        kind = spec.substr(0, colon);
+        arg = spec.substr(colon + 1);
+    }
+
+#ifndef MINI_ZOOM_NO_PORTAUDIO
+    if (kind == "portaudio") {
+        int index = paNoDevice;
+        if (!arg.empty() && (sscanf(arg.c_str(), "%d", &index) != 1 || index < 0)) return nullptr;
+        return std::make_unique<PortAudioDevice>(direction, sampleRate, (PaDeviceIndex)index);
+    }
+#endif
+    if (kind == "null" && arg.empty()) {
+        return std::make_unique<NullAudioDevice>(direction, sampleRate);
+    }
+    if (kind == "wav" && !arg.empty()) {
+        return std::make_unique<WavAudioDevice>(direction, sampleRate, arg);
+    }
+    if (kind == "tone" && direction == AudioDevice::INPUT) {
+        int hz = AUDIO_TONE_HZ;
+        if (!arg.empty() && (sscanf(arg.c_str(), "%d", &hz) != 1 || hz <= 0 || hz >= sampleRate / 2)) return nullptr;
+        return std::make_unique<ToneAudioDevice>(sampleRate, hz);
+    }
+    return nullptr;
+}
+
+#endif // AUDIO_DEVICE_H
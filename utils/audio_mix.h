@@ -0,0 +1,75 @@
+#ifndef AUDIO_MIX_H
+#define AUDIO_MIX_H
+
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(__i386__)
+  #include <immintrin.h>
+  #define AUDIO_MIX_X86 1
+#elif defined(__ARM_NEON)
+  #include <arm_neon.h>
+  #define AUDIO_MIX_NEON 1
+#endif
+
+// Saturating 16-bit mixing kernels: acc[i] = clamp(acc[i] + src[i]), so loud overlapping
+// speakers clip instead of wrapping around into noise. Dispatch follows tile_diff.h:
+// AVX2 when the CPU has it, SSE2 otherwise on x86, NEON on ARM, scalar elsewhere.
+
+inline void mixAddScalar(int16_t* acc, const int16_t* src, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        int sum = (int)acc[i] + (int)src[i];
+        acc[i] = (int16_t)(sum > INT16_MAX ? INT16_MAX : sum < INT16_MIN ? INT16_MIN : sum);
+    }
+}
+
+#if defined(AUDIO_MIX_X86)
+__attribute__((target("avx2")))
+inline void mixAddAvx2(int16_t* acc, const int16_t* src, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc + i));
+        __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc + i), _mm256_adds_epi16(a, s));
+    }
+    mixAddScalar(acc + i, src + i, n - i);
+}
+
+inline void mixAddSse2(int16_t* acc, const int16_t* src, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(acc + i));
+        __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(acc + i), _mm_adds_epi16(a, s)); // paddsw
+    }
+    mixAddScalar(acc + i, src + i, n - i);
+}
+#endif
+
+#if defined(AUDIO_MIX_NEON)
+inline void mixAddNeon(int16_t* acc, const int16_t* src, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        vst1q_s16(acc + i, vqaddq_s16(vld1q_s16(acc + i), vld1q_s16(src + i)));
+    }
+    mixAddScalar(acc + i, src + i, n - i);
+}
+#endif
+
+// Picks the best kernel for this machine once
+inline void mixAdd(int16_t* acc, const int16_t* src, size_t n) {
+#if defined(AUDIO_MIX_X86)
+    static const bool hasAvx2 = __builtin_cpu_supports("avx2");
+    if (hasAvx2) {
+        mixAddAvx2(acc, src, n);
+    } else {
+        mixAddSse2(acc, src, n);
+    }
+#elif defined(AUDIO_MIX_NEON)
+    mixAddNeon(acc, src, n);
+#else
+    mixAddScalar(acc, src, n);
+#endif
+}
+
+#endif // AUDIO_MIX_H
@@ -0,0 +1,102 @@
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstddef>
+#include <chrono>
+
+// Thread-safe bounded queue used to connect pipeline stages.
+// When full, push() drops the oldest item so consumers always see the freshest data.
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : capacity_(capacity ? capacity : 1) {}
+
+    // Returns false if an older item had to be dropped to make room (or the queue is closed)
+    bool push(T item) {
+        bool dropped = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (closed_) return false;
+            while (items_.size() >= capacity_) {
+                items_.pop_front();
+                droppedCount_++;
+                dropped = true;
+            }
+            items_.push_back(std::move(item));
+        }
+        cond_.notify_one();
+        return !dropped;
+    }
+
+    // Blocks until there is room instead of dropping (back-pressure); returns false once closed
+    bool pushWait(T item) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            spaceCond_.wait(lock, [this] { return items_.size() < capacity_ || closed_; });
+            if (closed_) return false;
+            items_.push_back(std::move(item));
+        }
+        cond_.notify_one();
+        return true;
+    }
+
+    // Blocks until an item is available; returns false once closed and drained
+    bool pop(T& out) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [this] { return !items_.empty() || closed_; });
+            if (items_.empty()) return false;
+            out = std::move(items_.front());
+            items_.pop_front();
+        }
+        spaceCond_.notify_one();
+        return true;
+    }
+
+    // Like pop(), but also returns false after waiting `timeout` for nothing
+    template <typename Rep, typename Period>
+    bool popFor(T& out, std::chrono::duration<Rep, Period> timeout) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (!cond_.wait_for(lock, timeout, [this] { return !items_.empty() || closed_; }) || items_.empty()) {
+                return false;
+            }
+            out = std::move(items_.front());
+            items_.pop_front();
+        }
+        spaceCond_.notify_one();
+        return true;
+    }
+
+    // Wakes up all waiting consumers; further pushes are ignored
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+        }
+        cond_.notify_all();
+        spaceCond_.notify_all();
+    }
+
+    size_t dropped() const { return droppedCount_; }
+
+    bool closed() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return closed_;
+    }
+
+private:
+    std::deque<T> items_;
+    size_t capacity_;
+    bool closed_ = false;
+    std::atomic<size_t> droppedCount_{0};
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::condition_variable spaceCond_;
+};
+
+#endif // BOUNDED_QUEUE_H
@@ -9,6 +9,8 @@
 #include <unistd.h>  // For STDIN_FILENO
 
 #include "common_utils.h" // For logInfo, logError
+#include "client_common.h" // For ClientOptions
+#include "thread_roles.h" // For parseThreadRole
 
 // Non-blocking character read utility
 // This function handles setting and restoring non-blocking mode locally.
@@ -74,4 +76,85 @@ inline int getMenuChoice() {
     }
 }
 
+// Applies one "--name" or "--name=value" command-line option; returns false if unknown or invalid
+inline bool parseClientOption(const std::string& arg, ClientOptions& options) {
+    std::string name = arg;
+    std::string value;
+    size_t eq = arg.find('=');
+    if (eq != std::string::npos) {
+        name = arg.substr(0, eq);
+        value = arg.substr(eq + 1);
+    }
+    
+    try {
+        if (name == "--video-udp" && value.empty()) {
+            options.videoUdp = true;
+            return true;
+        }
+        if (name == "--video-loss" && !value.empty()) {
+            options.videoLossPercent = std::stoi(value);
+            return options.videoLossPercent >= 0 && options.videoLossPercent <= 100;
+        }
+        if (name == "--video-source" && !value.empty()) {
+            options.videoSource = value;
+            return true;
+        }
+        if (name == "--video-max-speed" && value.empty()) {
+            options.videoMaxSpeed = true;
+            return true;
+        }
+        if (name == "--voice-codec" && (value == "opus" || value == "pcm")) {
+            options.voiceCodec = value;
+            return true;
+        }
+        if (name == "--voice-bitrate" && !value.empty()) {
+            options.voiceBitrateKbps = std::stoi(value);
+            return options.voiceBitrateKbps > 0;
+        }
+        if (name == "--voice-vad" && (value == "on" || value == "off")) {
+            options.voiceVad = value == "on";
+            return true;
+        }
+        if (name == "--voice-red" && !value.empty()) {
+            options.voiceRedundancy = std::stoi(value);
+            return options.voiceRedundancy >= 0 && options.voiceRedundancy <= 2;
+        }
+        if (name == "--voice-loss" && !value.empty()) {
+            size_t colon = value.find(':');
+            options.voiceLossPercent = std::stoi(value.substr(0, colon));
+            options.voiceLossBurst = colon == std::string::npos ? 1 : std::stoi(value.substr(colon + 1));
+            return options.voiceLossPercent >= 0 && options.voiceLossPercent < 100 && options.voiceLossBurst >= 1;
+        }
+        if (name == "--audio-latency" && !value.empty()) {
+            options.audioLatencyMs = std::stoi(value);
+            return options.audioLatencyMs >= 0;
+        }
+        if (name == "--audio-input" && !value.empty()) {
+            options.audioInput = value;
+            return true;
+        }
+        if (name == "--audio-output" && !value.empty()) {
+            options.audioOutput = value;
+            return true;
+        }
+        if (name == "--transport" && !value.empty()) {
+            size_t colon = value.find(':');
+            options.transport = value.substr(0, colon);
+            if (colon != std::string::npos) options.transportPath = value.substr(colon + 1);
+            if (options.transport == "tcp") return colon == std::string::npos;
+            return (options.transport == "unix" || options.transport == "shm") && !options.transportPath.empty();
+        }
+        if (name == "--thread-role") {
+            ThreadRole role;
+            ThreadRolePolicy policy;
+            if (!parseThreadRole(value, role, policy)) return false;
+            options.threadRoles.push_back(value);
+            return true;
+        }
+    } catch (...) {
+        return false;
+    }
+    return false;
+}
+
 #endif // CLIENT_UTILS_H
\ No newline at end of file
@@ -1,11 +1,13 @@
 #include "common_utils.h"
 #include <cstring>
+#include <cerrno>
 #include <unistd.h>  // for read/write/close on POSIX
 
 bool sendAll(int sockfd, const char* data, size_t len) {
     size_t totalSent = 0;
     while (totalSent < len) {
         ssize_t sent = send(sockfd, data + totalSent, len - totalSent, 0);
+        if (sent < 0 && errno == EINTR) continue; // A signal, not a failed connection
         if (sent <= 0) return false;
         totalSent += sent;
     }
@@ -16,6 +18,7 @@ bool recvAll(int sockfd, char* buffer, size_t len) {
     size_t totalReceived = 0;
     while (totalReceived < len) {
         ssize_t received = recv(sockfd, buffer + totalReceived, len - totalReceived, 0);
+        if (received < 0 && errno == EINTR) continue;
         if (received <= 0) return false;
         totalReceived += received;
     }
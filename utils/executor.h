@@ -0,0 +1,345 @@
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <algorithm> // For std::max
+
+#include "common_utils.h"
+
+#define EXECUTOR_MAX_THREADS 256 // Workers, including those parked in blocking tasks; further tasks wait in the queues
+
+// Cooperative cancellation. A token is cancelled once, by whoever holds a copy; tasks poll
+// cancelled() between steps and register callbacks to interrupt what they block on (e.g.
+// shutting down their socket). Tokens made with child() are cancelled with their parent.
+class CancelToken {
+public:
+    CancelToken() : state_(std::make_shared<State>()) {}
+
+    bool cancelled() const { return state_->cancelled.load(std::memory_order_acquire); }
+
+    // Runs the registered callbacks, on this thread, the first time it is called
+    void cancel() const {
+        std::map<uint64_t, std::function<void()>> callbacks;
+        {
+            std::lock_guard<std::mutex> lock(state_->mutex);
+            if (state_->cancelled) return;
+            state_->cancelled = true;
+            callbacks.swap(state_->callbacks);
+            state_->canceller = std::this_thread::get_id();
+        }
+        for (auto& callback : callbacks) callback.second();
+        {
+            std::lock_guard<std::mutex> lock(state_->mutex);
+            state_->canceller = std::thread::id();
+        }
+        state_->done.notify_all();
+    }
+
+    // Calls fn on cancel(), or at once if already cancelled (then returns 0)
+    uint64_t onCancel(std::function<void()> fn) const {
+        std::unique_lock<std::mutex> lock(state_->mutex);
+        if (!state_->cancelled) {
+            uint64_t id = ++state_->nextId;
+            state_->callbacks.emplace(id, std::move(fn));
+            return id;
+        }
+        lock.unlock();
+        fn();
+        return 0;
+    }
+
+    // Once this returns, the callback is not running and never will
+    void removeCallback(uint64_t id) const {
+        std::unique_lock<std::mutex> lock(state_->mutex);
+        if (state_->callbacks.erase(id)) return;
+        state_->done.wait(lock, [this] {
+            return state_->canceller == std::thread::id() || state_->canceller == std::this_thread::get_id();
+        });
+    }
+
+    CancelToken child() const {
+        CancelToken c;
+        std::weak_ptr<State> weak = c.state_;
+        c.state_->parent = state_;
+        c.state_->parentId = onCancel([weak] {
+            if (std::shared_ptr<State> s = weak.lock()) CancelToken(s).cancel();
+        });
+        return c;
+    }
+
+private:
+    struct State {
+        std::atomic<bool> cancelled{false};
+        std::mutex mutex;
+        std::condition_variable done;
+        std::map<uint64_t, std::function<void()>> callbacks;
+        uint64_t nextId = 0;
+        std::thread::id canceller; // Thread running the callbacks, if any
+        std::shared_ptr<State> parent;
+        uint64_t parentId = 0;
+
+        ~State() {
+            if (!parent || !parentId) return;
+            std::lock_guard<std::mutex> lock(parent->mutex); // The callback only holds a weak pointer, so no need to wait
+            parent->callbacks.erase(parentId);
+        }
+    };
+
+    explicit CancelToken(std::shared_ptr<State> state) : state_(std::move(state)) {}
+
+    std::shared_ptr<State> state_;
+};
+
+// Runs fn when token is cancelled, until reset() or the end of its scope
+class CancelRegistration {
+public:
+    CancelRegistration(const CancelToken& token, std::function<void()> fn) : token_(token), id_(token.onCancel(std::move(fn))) {}
+    ~CancelRegistration() { reset(); }
+
+    // Once this returns, fn is not running and never will
+    void reset() {
+        if (id_) token_.removeCallback(id_);
+        id_ = 0;
+    }
+
+    CancelRegistration(const CancelRegistration&) = delete;
+    CancelRegistration& operator=(const CancelRegistration&) = delete;
+
+private:
+    CancelToken token_;
+    uint64_t id_;
+};
+
+enum TaskPriority { PRIORITY_HIGH, PRIORITY_NORMAL, PRIORITY_LOW, TASK_PRIORITIES };
+
+// Work-stealing executor. Each worker owns a deque per priority. It runs the most urgent task
+// there is: of the highest priority anyone has queued, its own newest task or else another
+// worker's oldest. Tasks spawned from a worker stay on its deque; others are dealt round-robin.
+// Blocking tasks (a connection handler blocks in recv for the connection's lifetime) are
+// compensated for: while one runs, a parked spare worker is woken or a new one started, so
+// `cores` workers are always free for other tasks, up to EXECUTOR_MAX_THREADS. When a
+// blocking task ends and more than `cores` workers are free, its worker parks as a spare, so
+// threads are reused rather than created per connection. Callers that take work from outside
+// (accept loops) check hasRoomForBlocking() and turn it away rather than queue it behind the cap.
+// Every task gets a child of the executor's CancelToken; cancel() cancels them all.
+class Executor {
+public:
+    using Task = std::function<void(const CancelToken&)>;
+
+    // Workers start with the first task, so they inherit the signal mask main() set up by then
+    explicit Executor(size_t cores = std::max(1u, std::thread::hardware_concurrency()),
+                      size_t maxThreads = EXECUTOR_MAX_THREADS)
+        : cores_(std::max<size_t>(1, cores)), maxThreads_(std::max(cores_, maxThreads)), workers_(new Worker[maxThreads_]) {}
+
+    ~Executor() { shutdown(); }
+
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
+    // Queues a short task. Returns its token, which cancels just this task.
+    CancelToken spawn(Task task, TaskPriority priority = PRIORITY_NORMAL) { return push(std::move(task), priority, false); }
+
+    // Queues a task that may block for long, e.g. on a socket
+    CancelToken spawnBlocking(Task task, TaskPriority priority = PRIORITY_NORMAL) { return push(std::move(task), priority, true); }
+
+    // False once the blocking tasks running and queued would leave fewer than `cores` workers
+    // for everything else at EXECUTOR_MAX_THREADS; a further blocking task would just wait
+    bool hasRoomForBlocking() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return blocked_ + queuedBlocking_ + cores_ < maxThreads_;
+    }
+
+    const CancelToken& token() const { return token_; }
+    bool cancelled() const { return token_.cancelled(); }
+    void cancel() { token_.cancel(); }
+
+    // Cancels every task, lets the queued ones run (they see their token cancelled) and joins
+    // the workers. Not to be called from a task. Tasks spawned afterwards run on the caller.
+    void shutdown() {
+        token_.cancel();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_) return;
+            stopping_ = true;
+        }
+        cond_.notify_all();
+        spareCond_.notify_all();
+        for (size_t i = 0; i < count_; i++) {
+            if (workers_[i].thread.joinable()) workers_[i].thread.join();
+        }
+        if (tasksRun_ > 0) logInfo("Executor: " + std::to_string(tasksRun_) + " tasks run, " + std::to_string(steals_) + " stolen, " +
+                std::to_string(count_) + " threads at most");
+    }
+
+    size_t threads() const { return count_; }
+    uint64_t tasksRun() const { return tasksRun_; }
+    uint64_t steals() const { return steals_; }
+
+private:
+    struct Job {
+        Task fn;
+        CancelToken token;
+        bool blocking = false;
+    };
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Job> queues[TASK_PRIORITIES];
+        std::thread thread;
+    };
+
+    struct Current {
+        Executor* owner = nullptr;
+        size_t index = 0;
+    };
+
+    static Current& current() {
+        thread_local Current c;
+        return c;
+    }
+
+    CancelToken push(Task task, TaskPriority priority, bool blocking) {
+        Job job{std::move(task), token_.child(), blocking};
+        CancelToken token = job.token;
+        std::unique_lock<std::mutex> lock(mutex_); // Spawns are rare next to the work they start
+        if (stopping_) { // No worker will take it: run it here, already cancelled, so it releases what it owns
+            lock.unlock();
+            job.fn(job.token);
+            return token;
+        }
+        while (count_ < cores_) startWorker();
+        size_t target = current().owner == this ? current().index : next_++ % count_;
+        {
+            // Counted under the queue's lock, so take() never sees the job before its count
+            std::lock_guard<std::mutex> queueLock(workers_[target].mutex);
+            workers_[target].queues[priority].push_back(std::move(job));
+            queuedAt_[priority]++;
+            queued_++;
+        }
+        if (blocking) queuedBlocking_++;
+        if (idle_ > 0) cond_.notify_one();
+        return token;
+    }
+
+    // Most urgent task anywhere: at each priority, own newest first, else another worker's oldest
+    bool take(size_t index, Job& job) {
+        if (queued_.load(std::memory_order_acquire) == 0) return false;
+        size_t count = count_.load(std::memory_order_acquire);
+        for (int p = 0; p < TASK_PRIORITIES; p++) {
+            if (queuedAt_[p].load(std::memory_order_acquire) == 0) continue;
+            for (size_t i = 0; i < count; i++) {
+                Worker& worker = workers_[(index + i) % count];
+                std::lock_guard<std::mutex> lock(worker.mutex);
+                std::deque<Job>& queue = worker.queues[p];
+                if (queue.empty()) continue;
+                if (i == 0) {
+                    job = std::move(queue.back());
+                    queue.pop_back();
+                } else {
+                    job = std::move(queue.front());
+                    queue.pop_front();
+                    steals_++;
+                }
+                queuedAt_[p]--;
+                queued_--;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // With mutex_ held
+    void startWorker() {
+        size_t index = count_;
+        workers_[index].thread = std::thread(&Executor::workerLoop, this, index);
+        count_.store(index + 1, std::memory_order_release);
+    }
+
+    // With mutex_ held: workers neither blocked nor parked
+    size_t freeWorkers() const { return count_ - blocked_ - parked_; }
+
+    void beginBlocking() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queuedBlocking_--;
+        blocked_++;
+        if (freeWorkers() >= cores_ || stopping_) return;
+        if (parked_ > 0) {
+            spareCond_.notify_one();
+        } else if (count_ < maxThreads_) {
+            startWorker();
+        } else if (!saturated_) {
+            saturated_ = true;
+            logError("Executor: all " + std::to_string(maxThreads_) + " threads busy, new tasks wait");
+        }
+    }
+
+    void endBlocking() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        blocked_--;
+        if (saturated_ && blocked_ + cores_ < maxThreads_) {
+            saturated_ = false;
+            logInfo("Executor: threads free again");
+        }
+        if (freeWorkers() <= cores_ || stopping_) return;
+        parked_++; // Surplus now: wait as a spare until a blocking task needs a stand-in
+        spareCond_.wait(lock, [this] { return stopping_ || freeWorkers() < cores_; });
+        parked_--;
+    }
+
+    void workerLoop(size_t index) {
+        current() = Current{this, index};
+        Job job;
+        while (true) {
+            if (!take(index, job)) {
+                std::unique_lock<std::mutex> lock(mutex_);
+                if (queued_ > 0) continue;
+                if (stopping_) break;
+                idle_++;
+                cond_.wait(lock, [this] { return queued_ > 0 || stopping_; });
+                idle_--;
+                continue;
+            }
+            if (job.blocking) beginBlocking();
+            try {
+                job.fn(job.token);
+            } catch (const std::exception& e) {
+                logError(std::string("Executor: task failed: ") + e.what());
+            }
+            tasksRun_++;
+            if (job.blocking) endBlocking();
+            job = Job(); // Drops the task's captures (sockets, buffers) now, not at the next task
+        }
+    }
+
+    const size_t cores_;
+    const size_t maxThreads_;
+    std::unique_ptr<Worker[]> workers_; // Fixed capacity, so thieves never see it move
+    std::atomic<size_t> count_{0};
+    size_t next_ = 0;
+    std::atomic<size_t> queued_{0};
+    std::atomic<size_t> queuedAt_[TASK_PRIORITIES] = {}; // Per priority, so take() skips empty levels
+    CancelToken token_;
+
+    std::mutex mutex_;
+    std::condition_variable cond_;      // Idle workers wait here for tasks
+    std::condition_variable spareCond_; // Parked spares wait here for a blocking task to start
+    size_t idle_ = 0;
+    size_t blocked_ = 0;
+    size_t queuedBlocking_ = 0; // Blocking tasks spawned but not started
+    size_t parked_ = 0;
+    bool stopping_ = false;
+    bool saturated_ = false;
+    std::atomic<uint64_t> tasksRun_{0};
+    std::atomic<uint64_t> steals_{0};
+};
+
+#endif // EXECUTOR_H
@@ -0,0 +1,41 @@
+#ifndef FRAME_CLOCK_H
+#define FRAME_CLOCK_H
+
+#include <chrono>
+#include <thread>
+
+// Paces a loop at a fixed rate using absolute deadlines, so the time spent
+// doing work in each iteration is not added on top of the period.
+class FrameClock {
+public:
+    explicit FrameClock(double fps)
+        : period_(std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+              std::chrono::duration<double>(1.0 / fps))),
+          next_(std::chrono::steady_clock::now()) {}
+
+    // Sleeps until the next tick. If we fell behind by more than a period,
+    // resync to now instead of bursting to catch up.
+    void wait() {
+        next_ += period_;
+        auto now = std::chrono::steady_clock::now();
+        if (next_ + period_ < now) {
+            next_ = now;
+            return;
+        }
+        std::this_thread::sleep_until(next_);
+    }
+
+    // Changes the rate starting from the next tick
+    void setRate(double fps) {
+        period_ = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(1.0 / fps));
+    }
+
+    std::chrono::steady_clock::duration period() const { return period_; }
+
+private:
+    std::chrono::steady_clock::duration period_;
+    std::chrono::steady_clock::time_point next_;
+};
+
+#endif // FRAME_CLOCK_H
@@ -2,18 +2,204 @@
 #define SERVER_UTILS_H
 
 #include <string>
+#include <functional>
 #include <arpa/inet.h> // For inet_ntop, ntohs
 #include <sys/socket.h> // For sockaddr_in, getpeername
+#include <netinet/tcp.h> // For TCP_KEEPIDLE
 
-// Utility: get client IP:port as string
+#include "common_utils.h"
+#include "server_common.h" // For ServerOptions, serverExecutor, serverTimers
+#include "frame_clock.h"
+#include "wire_schema.h" // For WireBuffer, decodeWire
+#include "thread_roles.h" // For ThreadRoleScope
+
+// Utility: get client IP:port (or the pid of a same-host client) as string
 inline std::string getClientInfo(int sockfd) {
-    sockaddr_in addr;
-    socklen_t addr_len = sizeof(addr);
-    getpeername(sockfd, (sockaddr*)&addr, &addr_len);
+    sockaddr_storage storage{};
+    socklen_t addr_len = sizeof(storage);
+    getpeername(sockfd, (sockaddr*)&storage, &addr_len);
+    if (storage.ss_family == AF_UNIX) { // Same-host client: name it by process
+#ifdef SO_PEERCRED
+        ucred cred{};
+        socklen_t cred_len = sizeof(cred);
+        if (getsockopt(sockfd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) == 0) return "local pid " + std::to_string(cred.pid);
+#endif
+        return "local client";
+    }
+    const sockaddr_in& addr = reinterpret_cast<const sockaddr_in&>(storage);
     char client_ip[INET_ADDRSTRLEN];
     inet_ntop(AF_INET, &addr.sin_addr, client_ip, sizeof(client_ip));
     int client_port = ntohs(addr.sin_port);
     return std::string(client_ip) + ":" + std::to_string(client_port);
 }
 
+// Applies one "--name" or "--name=value" command-line option; returns false if unknown or invalid
+inline bool parseServerOption(const std::string& arg, ServerOptions& options) {
+    std::string name = arg;
+    std::string value;
+    size_t eq = arg.find('=');
+    if (eq != std::string::npos) {
+        name = arg.substr(0, eq);
+        value = arg.substr(eq + 1);
+    }
+    
+    if (name == "--headless" && eq == std::string::npos) {
+        options.headless = true;
+        return true;
+    }
+    if (name == "--record") {
+        options.recordVideo = true;
+        if (eq != std::string::npos) options.recordDir = value;
+        return !options.recordDir.empty();
+    }
+    if (name == "--metrics" && eq == std::string::npos) {
+        options.videoMetrics = true;
+        return true;
+    }
+    if (name == "--latency-csv") {
+        options.latencyDir = eq == std::string::npos ? "latency" : value;
+        return !options.latencyDir.empty();
+    }
+    if (name == "--relay") {
+        options.relayTarget = value;
+        return !value.empty();
+    }
+    if (name == "--audio-latency" && !value.empty()) {
+        try {
+            options.audioLatencyMs = std::stoi(value);
+            return options.audioLatencyMs >= 0;
+        } catch (...) {
+            return false;
+        }
+    }
+    if (name == "--audio-output" && !value.empty()) {
+        options.audioOutput = value;
+        return true;
+    }
+    if (name == "--unix-socket" && !value.empty()) {
+        options.unixSocket = value == "off" ? "" : value;
+        return true;
+    }
+    if (name == "--capture" && !value.empty()) {
+        options.capturePath = value;
+        return true;
+    }
+    if (name == "--thread-role") {
+        ThreadRole role;
+        ThreadRolePolicy policy;
+        if (!parseThreadRole(value, role, policy)) return false; // From thread_roles.h
+        options.threadRoles.push_back(value);
+        return true;
+    }
+    if (name == "--voice-max-bitrate" && !value.empty()) {
+        try {
+            int kbps = std::stoi(value);
+            if (kbps <= 0) return false;
+            options.voiceMaxBitrate = (uint32_t)kbps * 1000;
+            return true;
+        } catch (...) {
+            return false;
+        }
+    }
+    return false;
+}
+
+// recv() on a client connection, recording what arrives when the server captures (session_capture.h)
+inline ssize_t recvFromClient(int sockfd, void* buffer, size_t len, int flags = 0) {
+    ssize_t bytes = recv(sockfd, buffer, len, flags);
+    if (bytes > 0) captureInbound(buffer, (size_t)bytes);
+    return bytes;
+}
+
+inline bool recvAllFromClient(int sockfd, void* buffer, size_t len) {
+    if (!recvAll(sockfd, static_cast<char*>(buffer), len)) return false;
+    captureInbound(buffer, len);
+    return true;
+}
+
+template <typename T>
+inline bool recvWireFromClient(int sockfd, T& msg) {
+    WireBuffer<T> in;
+    if (!recvAllFromClient(sockfd, in.data(), in.size())) return false;
+    decodeWire(in.data(), msg);
+    return true;
+}
+
+// Shuts the socket down when the task is cancelled, so a blocked recv() or accept() returns.
+// Must be reset before the socket is closed, so a reused descriptor is never shut down.
+class ShutdownOnCancel : public CancelRegistration {
+public:
+    ShutdownOnCancel(const CancelToken& cancel, int sockfd)
+        : CancelRegistration(cancel, [sockfd] { shutdown(sockfd, SHUT_RDWR); }) {}
+};
+
+// Cancels the task if it is still waiting when the deadline passes, e.g. for a handshake
+class CancelAfter {
+public:
+    CancelAfter(const CancelToken& cancel, uint32_t timeoutMs, const std::string& what)
+        : timer_(serverTimers.schedule(timeoutMs, [cancel, what] {
+              logError(what + ", closing the connection.");
+              cancel.cancel();
+          })) {}
+    ~CancelAfter() { disarm(); }
+
+    // False if the deadline already passed
+    bool disarm() {
+        bool pending = timer_ && serverTimers.cancel(timer_);
+        timer_ = 0;
+        return pending;
+    }
+
+    CancelAfter(const CancelAfter&) = delete;
+    CancelAfter& operator=(const CancelAfter&) = delete;
+
+private:
+    TimerWheel::TimerId timer_;
+};
+
+// Cancels the task once the connection saw no touch() for timeoutMs
+class CancelOnIdle : public IdleTimer {
+public:
+    CancelOnIdle(const CancelToken& cancel, uint32_t timeoutMs, const std::string& what)
+        : IdleTimer(serverTimers, timeoutMs, [cancel, what] {
+              if (cancel.cancelled()) return;
+              logError(what + ", closing the connection.");
+              cancel.cancel();
+          }) {}
+};
+
+// Lets the kernel probe a quiet TCP connection, so a peer that vanished (half-open) is noticed
+inline void enableKeepalive(int sockfd) {
+    int one = 1;
+    setsockopt(sockfd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+#ifdef TCP_KEEPIDLE
+    int idle = CHAT_KEEPALIVE_IDLE_S, interval = CHAT_KEEPALIVE_INTERVAL_S, probes = CHAT_KEEPALIVE_PROBES;
+    setsockopt(sockfd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+    setsockopt(sockfd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+    setsockopt(sockfd, IPPROTO_TCP, TCP_KEEPCNT, &probes, sizeof(probes));
+#endif
+}
+
+// Task advancing serverTimers: every connection timeout runs here, on one thread, instead of
+// each handler polling its own clock
+inline void timerService(const CancelToken& cancel) {
+    ThreadRoleScope role(ROLE_NETWORK);
+    FrameClock clock(1000.0 / serverTimers.tickMs()); // From frame_clock.h
+    while (!cancel.cancelled()) {
+        clock.wait();
+        serverTimers.advance();
+    }
+}
+
+// Stops the server: cancels every task on serverExecutor, which wakes the sockets they block on
+inline void requestShutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mainThreadMutex); // So the display loop cannot miss the wakeup
+        serverExecutor.cancel();
+    }
+    videoClientConnected = false;
+    mainThreadCond.notify_all();
+    videoCond.notify_all();
+}
+
 #endif // SERVER_UTILS_H
\ No newline at end of file
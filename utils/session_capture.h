@@ -0,0 +1,304 @@
+#ifndef SESSION_CAPTURE_H
+#define SESSION_CAPTURE_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <algorithm> // For std::stable_sort
+#include <unordered_map>
+#include <cstdio>
+#include <cstdint>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <netinet/in.h> // For sockaddr_in
+
+#include "common_utils.h" // For logInfo, logError
+#include "wire_schema.h"  // For WireSchema, encodeWire, decodeWire
+#include "transport.h"    // For Transport
+
+// Capture files of `server_app --capture=FILE`: everything clients sent, for replaying the
+// same load to a server again (session_replay). A CaptureFileHeader, then records of
+// a CaptureRecordHeader and its payload, all big-endian:
+//   CONNECT   a connection was accepted; payload: its mode byte (CAPTURE_MODE_VOICE for
+//             the datagrams of one voice address, MODE_SESSION for a shared-memory session)
+//   DATA      bytes read from the connection's stream, as read
+//   DATAGRAM  one datagram (UDP video of the connection, or voice)
+//   CLOSE     the server was done with the connection
+// Stream reads are coalesced per connection into records of up to CAPTURE_CHUNK_BYTES, or
+// CAPTURE_CHUNK_US worth of reads, stamped with the time of their first byte. Records of
+// different connections are therefore not in time order in the file; CaptureReader sorts them.
+
+#define CAPTURE_MAGIC 0x4D5A4350u // "MZCP"
+#define CAPTURE_VERSION 1
+#define CAPTURE_CHUNK_BYTES 65536       // Largest coalesced DATA record
+#define CAPTURE_CHUNK_US 1000           // Reads closer together than this share a record
+#define CAPTURE_FILE_BUFFER (1 << 20)   // stdio buffer; records reach the disk in large writes
+#define CAPTURE_MODE_VOICE 0x80         // Pseudo mode byte of a voice source address
+
+#define CAPTURE_CONNECT 1
+#define CAPTURE_DATA 2
+#define CAPTURE_DATAGRAM 3
+#define CAPTURE_CLOSE 4
+
+struct CaptureFileHeader {
+    uint32_t magic;
+    uint16_t version;
+    int64_t startUnixUs; // Wall clock time record times count from
+};
+
+template <>
+struct WireSchema<CaptureFileHeader> {
+    static constexpr auto fields = std::make_tuple(&CaptureFileHeader::magic, &CaptureFileHeader::version,
+                                                   WirePad<2>(), &CaptureFileHeader::startUnixUs);
+};
+static_assert(wireSize<CaptureFileHeader>() == 16, "Capture file header layout");
+
+struct CaptureRecordHeader {
+    uint8_t kind;        // CAPTURE_*
+    uint32_t connection; // Numbered from 1 in order of CONNECT
+    uint64_t timeUs;     // Since the capture started
+    uint32_t length;     // Payload bytes that follow
+};
+
+template <>
+struct WireSchema<CaptureRecordHeader> {
+    static constexpr auto fields = std::make_tuple(&CaptureRecordHeader::kind, &CaptureRecordHeader::connection,
+                                                   &CaptureRecordHeader::timeUs, &CaptureRecordHeader::length);
+};
+static_assert(wireSize<CaptureRecordHeader>() == 17, "Capture record header layout");
+
+// The capture file, shared by every connection. Inactive (and free) until open() succeeds.
+class CaptureWriter {
+public:
+    ~CaptureWriter() { close(); }
+
+    bool open(const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        file_ = fopen(path.c_str(), "wb");
+        if (!file_) return false;
+        setvbuf(file_, nullptr, _IOFBF, CAPTURE_FILE_BUFFER);
+        path_ = path;
+        start_ = std::chrono::steady_clock::now();
+        int64_t unixUs = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        WireBuffer<CaptureFileHeader> header = encodeWire(CaptureFileHeader{CAPTURE_MAGIC, CAPTURE_VERSION, unixUs});
+        bytes_ = fwrite(header.data(), 1, header.size(), file_);
+        active_ = true;
+        return bytes_ == header.size();
+    }
+
+    // Flushes the file; records arriving later are dropped
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!file_) return;
+        active_ = false;
+        bool ok = fclose(file_) == 0 && !failed_;
+        file_ = nullptr;
+        if (ok) {
+            logInfo("Capture: " + std::to_string(records_) + " records, " + std::to_string(bytes_) + " bytes in " + path_);
+        } else {
+            logError("Capture file " + path_ + " is incomplete (write failed)");
+        }
+    }
+
+    bool active() const { return active_.load(std::memory_order_relaxed); }
+
+    uint64_t nowUs() const {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_).count();
+    }
+
+    // Numbers a new connection and records its CONNECT
+    uint32_t connect(uint8_t mode) {
+        uint32_t connection = nextConnection_.fetch_add(1, std::memory_order_relaxed);
+        write(CAPTURE_CONNECT, connection, nowUs(), &mode, 1);
+        return connection;
+    }
+
+    void write(uint8_t kind, uint32_t connection, uint64_t timeUs, const void* data, size_t len) {
+        WireBuffer<CaptureRecordHeader> header = encodeWire(CaptureRecordHeader{kind, connection, timeUs, (uint32_t)len});
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!file_) return;
+        if (fwrite(header.data(), 1, header.size(), file_) != header.size() ||
+            (len && fwrite(data, 1, len, file_) != len)) {
+            failed_ = true;
+            return;
+        }
+        records_++;
+        bytes_ += header.size() + len;
+    }
+
+    // Voice datagrams have no connection: each source address gets one at its first datagram.
+    // Called from the voice server's thread only.
+    void voiceDatagram(const sockaddr_in& from, const void* data, size_t len) {
+        uint64_t key = ((uint64_t)from.sin_addr.s_addr << 16) | from.sin_port;
+        auto it = voiceSources_.find(key);
+        if (it == voiceSources_.end()) it = voiceSources_.emplace(key, connect(CAPTURE_MODE_VOICE)).first;
+        write(CAPTURE_DATAGRAM, it->second, nowUs(), data, len);
+    }
+
+private:
+    std::mutex mutex_;
+    FILE* file_ = nullptr;
+    std::string path_;
+    std::atomic<bool> active_{false};
+    bool failed_ = false;
+    std::chrono::steady_clock::time_point start_;
+    std::atomic<uint32_t> nextConnection_{1};
+    uint64_t records_ = 0;
+    uint64_t bytes_ = 0;
+    std::unordered_map<uint64_t, uint32_t> voiceSources_;
+};
+
+// One connection's part of the capture, alive while its handler runs. Also the thread's
+// current() stream, so handlers record what they read without being handed it.
+class CaptureStream {
+public:
+    CaptureStream(CaptureWriter& writer, uint8_t mode) : writer_(writer) {
+        if (!writer_.active()) return;
+        connection_ = writer_.connect(mode);
+        previous_ = slot();
+        slot() = this;
+    }
+
+    ~CaptureStream() {
+        if (!connection_) return;
+        flush();
+        writer_.write(CAPTURE_CLOSE, connection_, writer_.nowUs(), nullptr, 0);
+        slot() = previous_;
+    }
+
+    CaptureStream(const CaptureStream&) = delete;
+    CaptureStream& operator=(const CaptureStream&) = delete;
+
+    // Bytes read from the connection's stream
+    void data(const void* data, size_t len) {
+        uint64_t now = writer_.nowUs();
+        if (!chunk_.empty() && (now - chunkStartUs_ >= CAPTURE_CHUNK_US || chunk_.size() + len > CAPTURE_CHUNK_BYTES)) flush();
+        if (chunk_.empty()) chunkStartUs_ = now;
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        chunk_.insert(chunk_.end(), p, p + len);
+    }
+
+    void datagram(const void* data, size_t len) {
+        flush(); // Keeps the connection's records in the order they arrived
+        writer_.write(CAPTURE_DATAGRAM, connection_, writer_.nowUs(), data, len);
+    }
+
+    // The stream of the connection handled on this thread, or nullptr
+    static CaptureStream* current() { return slot(); }
+
+private:
+    void flush() {
+        if (chunk_.empty()) return;
+        writer_.write(CAPTURE_DATA, connection_, chunkStartUs_, chunk_.data(), chunk_.size());
+        chunk_.clear();
+    }
+
+    CaptureWriter& writer_;
+    uint32_t connection_ = 0; // 0: not capturing
+    CaptureStream* previous_ = nullptr;
+    std::vector<uint8_t> chunk_; // DATA not yet written
+    uint64_t chunkStartUs_ = 0;
+
+    static CaptureStream*& slot() {
+        thread_local CaptureStream* stream = nullptr;
+        return stream;
+    }
+};
+
+// Records bytes just read by the connection handled on this thread, if it is captured
+inline void captureInbound(const void* data, size_t len) {
+    if (CaptureStream* stream = CaptureStream::current()) stream->data(data, len);
+}
+
+inline void captureDatagram(const void* data, size_t len) {
+    if (CaptureStream* stream = CaptureStream::current()) stream->datagram(data, len);
+}
+
+// Records what a session reads, whatever it runs over
+class CaptureTransport : public Transport {
+public:
+    explicit CaptureTransport(std::unique_ptr<Transport> inner) : inner_(std::move(inner)) {}
+
+    bool sendAll(const void* data, size_t len) override { return inner_->sendAll(data, len); }
+    bool recvAll(void* data, size_t len) override {
+        if (!inner_->recvAll(data, len)) return false;
+        captureInbound(data, len);
+        return true;
+    }
+    void shutdown() override { inner_->shutdown(); }
+    int fd() const override { return inner_->fd(); }
+    std::string describe() const override { return inner_->describe(); }
+
+private:
+    std::unique_ptr<Transport> inner_;
+};
+
+struct CaptureEvent {
+    uint8_t kind;
+    uint32_t connection;
+    uint64_t timeUs;
+    uint64_t offset; // Of the payload in the file
+    uint32_t length;
+};
+
+// Index of a capture file, in time order; payloads are read on demand
+class CaptureReader {
+public:
+    CaptureReader() = default;
+    ~CaptureReader() {
+        if (fd_ >= 0) ::close(fd_);
+    }
+
+    CaptureReader(const CaptureReader&) = delete;
+    CaptureReader& operator=(const CaptureReader&) = delete;
+
+    bool open(const std::string& path) {
+        fd_ = ::open(path.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd_ < 0 || fstat(fd_, &st) < 0) return false;
+        uint64_t size = (uint64_t)st.st_size;
+
+        WireBuffer<CaptureFileHeader> headerBytes;
+        if (size < headerBytes.size() || pread(fd_, headerBytes.data(), headerBytes.size(), 0) != (ssize_t)headerBytes.size()) {
+            return false;
+        }
+        decodeWire(headerBytes.data(), header_);
+        if (header_.magic != CAPTURE_MAGIC || header_.version != CAPTURE_VERSION) return false;
+
+        uint64_t offset = headerBytes.size();
+        WireBuffer<CaptureRecordHeader> recordBytes;
+        while (pread(fd_, recordBytes.data(), recordBytes.size(), (off_t)offset) == (ssize_t)recordBytes.size()) {
+            CaptureRecordHeader r;
+            decodeWire(recordBytes.data(), r);
+            if (offset + recordBytes.size() + r.length > size) break; // Cut short by a server that did not stop cleanly
+            offset += recordBytes.size();
+            events_.push_back(CaptureEvent{r.kind, r.connection, r.timeUs, offset, r.length});
+            offset += r.length;
+        }
+        if (offset != size) logError("Capture file " + path + " ends in a partial record, ignoring it");
+        // Stable: a connection's records are written in order, and keep it on equal times
+        std::stable_sort(events_.begin(), events_.end(),
+                         [](const CaptureEvent& a, const CaptureEvent& b) { return a.timeUs < b.timeUs; });
+        return true;
+    }
+
+    const CaptureFileHeader& header() const { return header_; }
+    const std::vector<CaptureEvent>& events() const { return events_; }
+
+    bool payload(const CaptureEvent& e, std::vector<uint8_t>& out) const {
+        out.resize(e.length);
+        return e.length == 0 || pread(fd_, out.data(), e.length, (off_t)e.offset) == (ssize_t)e.length;
+    }
+
+private:
+    int fd_ = -1;
+    CaptureFileHeader header_{};
+    std::vector<CaptureEvent> events_;
+};
+
+#endif // SESSION_CAPTURE_H
@@ -0,0 +1,260 @@
+#ifndef SESSION_MUX_H
+#define SESSION_MUX_H
+
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <atomic>
+#include <cstdint>
+#include <cstring>   // For memcpy
+#include <algorithm> // For std::min, std::max
+#include <memory>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h> // For TCP_NODELAY, TCP_NOTSENT_LOWAT
+
+#include "common_utils.h"
+#include "session_protocol.h"
+#include "transport.h"
+#include "timer_wheel.h" // For IdleTimer
+#include "thread_roles.h" // For ThreadRoleScope
+
+#define SESSION_NOTSENT_LOWAT 16384 // Unsent bytes the kernel may hold; keeps bulk data from queueing ahead of chat
+#define SESSION_CLOSE_TIMEOUT_MS 1000 // How long close() lets queued frames drain
+
+// Both ends of a multiplexed session (session_protocol.h) over one connection (transport.h).
+// Senders queue messages per channel; a writer thread always sends the next frame of the
+// most urgent channel that has one, so a chat message waits for at most one bulk frame
+// (plus SESSION_NOTSENT_LOWAT in the kernel) instead of a whole upload. run() reads on the
+// caller's thread and hands each complete message to the handler.
+class SessionMux {
+public:
+    // Called on the reader thread for each message; may take the payload. Must not block:
+    // replies are sent with wait = false, and slow work (e.g. disk writes) goes to another
+    // thread with keepCredit().
+    using Handler = std::function<void(uint8_t channel, uint8_t type, std::vector<uint8_t>& payload)>;
+
+    explicit SessionMux(std::unique_ptr<Transport> transport) : transport_(std::move(transport)) {
+        for (int c = 0; c < SESSION_CHANNELS; c++) credit_[c] = SESSION_WINDOW_BYTES;
+        int sockfd = transport_->fd(); // The TCP options fail harmlessly on local transports
+        int one = 1;
+        setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // Chat frames are small
+#ifdef TCP_NOTSENT_LOWAT
+        int lowat = SESSION_NOTSENT_LOWAT;
+        setsockopt(sockfd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat, sizeof(lowat));
+#endif
+        writer_ = std::thread(&SessionMux::writeLoop, this);
+    }
+
+    ~SessionMux() { close(); }
+
+    SessionMux(const SessionMux&) = delete;
+    SessionMux& operator=(const SessionMux&) = delete;
+
+    int fd() const { return transport_->fd(); }
+    std::string describe() const { return transport_->describe(); }
+
+    // False once the connection failed or either side closed the session
+    bool open() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return !broken_ && !closing_;
+    }
+
+    // Queues a message, split into frames. With wait, blocks while the channel already has
+    // SESSION_QUEUE_BYTES queued (or no credit); without, gives up instead. Returns false if
+    // the message was not queued, or is longer than sessionMaxMessage(channel) allows.
+    bool send(uint8_t channel, uint8_t type, const void* data, size_t len, bool wait = true) {
+        if (len > sessionMaxMessage(channel)) {
+            dropped_++;
+            return false;
+        }
+        std::lock_guard<std::mutex> sendLock(channelMutex_[channel]); // Keeps a message's frames together
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        size_t offset = 0;
+        std::unique_lock<std::mutex> lock(mutex_);
+        do {
+            auto room = [&] { return queued_[channel] < SESSION_QUEUE_BYTES || broken_ || closing_; };
+            if (wait) {
+                cond_.wait(lock, room);
+            } else if (!room() && offset == 0) {
+                dropped_++;
+                return false;
+            }
+            if (broken_ || closing_) return false;
+            size_t n = std::min<size_t>(len - offset, SESSION_MAX_FRAME);
+            bool more = offset + n < len;
+            queues_[channel].push_back(frame(channel, type, more ? SESSION_FLAG_MORE : 0, p + offset, n));
+            queued_[channel] += n;
+            offset += n;
+            cond_.notify_all();
+        } while (offset < len);
+        return true;
+    }
+
+    // Reads until the peer leaves or the connection fails. Every frame received, control
+    // frames included, touches activity if given.
+    void run(const Handler& handler, IdleTimer* activity = nullptr) {
+        uint8_t header[SESSION_HEADER_SIZE];
+        std::vector<uint8_t> partial[SESSION_CHANNELS]; // Messages still being reassembled
+        while (transport_->recvAll(header, sizeof(header))) {
+            SessionFrameHeader h;
+            if (!parseSessionHeader(header, h) || partial[h.channel].size() + h.length > sessionMaxMessage(h.channel)) {
+                logError("Malformed session frame, closing the session.");
+                break;
+            }
+            std::vector<uint8_t>& message = partial[h.channel];
+            size_t start = message.size();
+            message.resize(start + h.length);
+            if (h.length && !transport_->recvAll(message.data() + start, h.length)) break;
+            received_++;
+            if (activity) activity->touch();
+
+            // The credit of every part goes back once the handler is done with the message,
+            // so the parts a peer has in flight and here together stay within the window
+            if (h.flags & SESSION_FLAG_MORE) continue;
+            if (h.channel == SESSION_CHANNEL_CONTROL && h.type == SESSION_CLOSE) break;
+            if (h.channel == SESSION_CHANNEL_CONTROL && h.type == SESSION_PING) {
+                send(SESSION_CHANNEL_CONTROL, SESSION_PONG, message.data(), message.size(), false);
+            } else if (h.channel == SESSION_CHANNEL_CONTROL && h.type == SESSION_PONG) {
+                // Only its arrival matters
+            } else if (h.channel == SESSION_CHANNEL_CONTROL && h.type == SESSION_WINDOW) {
+                SessionWindowGrant grant;
+                if (message.size() >= wireSize<SessionWindowGrant>()) decodeWire(message.data(), grant);
+                if (message.size() >= wireSize<SessionWindowGrant>() && grant.channel < SESSION_CHANNELS) {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    credit_[grant.channel] += grant.credit;
+                    cond_.notify_all();
+                }
+            } else {
+                size_t bytes = message.size(); // The handler may take the payload
+                creditKept_ = false;
+                handler(h.channel, h.type, message);
+                if (!creditKept_) consumed(h.channel, bytes);
+            }
+            message.clear();
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        broken_ = true;
+        cond_.notify_all();
+    }
+
+    // Lets queued frames drain briefly, tells the peer, then shuts the connection down so
+    // run() returns. The transport is closed by the destructor.
+    void close() {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (!closing_ && !broken_) {
+                queues_[SESSION_CHANNEL_CONTROL].push_back(frame(SESSION_CHANNEL_CONTROL, SESSION_CLOSE, 0, nullptr, 0));
+            }
+            closing_ = true;
+            cond_.notify_all();
+            cond_.wait_for(lock, std::chrono::milliseconds(SESSION_CLOSE_TIMEOUT_MS), [this] { return writerDone_; });
+        }
+        transport_->shutdown(); // Also unblocks a writer stuck on a full socket or ring
+        if (writer_.joinable()) writer_.join();
+    }
+
+    // Called from the handler: the message's credit is not returned when the handler returns,
+    // but by returnCredit() with the message's size once whoever the handler passed it to is
+    // done with it. The peer can then have at most a window of the channel's data waiting there.
+    void keepCredit() { creditKept_ = true; }
+
+    void returnCredit(uint8_t channel, size_t bytes) { consumed(channel, bytes); }
+
+    // Payload bytes of a channel still queued here or, on flow-controlled channels, sent but
+    // not yet handled by the peer: the channel's own share of what the connection holds. The
+    // quarter window a peer may have handled before it returns credit is not counted.
+    size_t backlog(uint8_t channel) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        int64_t unacknowledged = SESSION_WINDOW_BYTES - credit_[channel] - SESSION_WINDOW_BYTES / 4;
+        size_t inFlight = SESSION_CHANNEL_FLOW_CONTROLLED(channel) ? (size_t)std::max<int64_t>(0, unacknowledged) : 0;
+        return queued_[channel] + inFlight;
+    }
+
+    uint64_t framesSent() const { return sent_; }
+    uint64_t framesReceived() const { return received_; }
+    uint64_t messagesDropped() const { return dropped_; }
+
+private:
+    static std::vector<uint8_t> frame(uint8_t channel, uint8_t type, uint8_t flags, const uint8_t* data, size_t len) {
+        std::vector<uint8_t> f(SESSION_HEADER_SIZE + len);
+        writeSessionHeader(f.data(), SessionFrameHeader{channel, type, flags, (uint32_t)len});
+        if (len) memcpy(f.data() + SESSION_HEADER_SIZE, data, len);
+        return f;
+    }
+
+    // Returns credit for bytes the receiving side is done with, in batches of a quarter window
+    void consumed(uint8_t channel, size_t bytes) {
+        if (!SESSION_CHANNEL_FLOW_CONTROLLED(channel)) return;
+        std::lock_guard<std::mutex> lock(mutex_);
+        consumed_[channel] += bytes;
+        if (consumed_[channel] < SESSION_WINDOW_BYTES / 4) return;
+        WireBuffer<SessionWindowGrant> grant = encodeWire(SessionWindowGrant{channel, (uint32_t)consumed_[channel]});
+        consumed_[channel] = 0;
+        if (broken_) return;
+        queues_[SESSION_CHANNEL_CONTROL].push_back(frame(SESSION_CHANNEL_CONTROL, SESSION_WINDOW, 0, grant.data(), grant.size()));
+        cond_.notify_all();
+    }
+
+    // Most urgent channel whose next frame may go out now, or -1
+    int nextChannel() const {
+        for (int c = 0; c < SESSION_CHANNELS; c++) {
+            if (queues_[c].empty()) continue;
+            size_t payload = queues_[c].front().size() - SESSION_HEADER_SIZE;
+            if (!SESSION_CHANNEL_FLOW_CONTROLLED(c) || credit_[c] >= (int64_t)payload) return c;
+        }
+        return -1;
+    }
+
+    void writeLoop() {
+        ThreadRoleScope role(ROLE_NETWORK);
+        std::vector<uint8_t> f;
+        while (true) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            int c = -1;
+            cond_.wait(lock, [&] { c = nextChannel(); return c >= 0 || closing_ || broken_; });
+            if (c < 0 || broken_) break; // Closing, and nothing left that could be sent
+            f = std::move(queues_[c].front());
+            queues_[c].pop_front();
+            size_t payload = f.size() - SESSION_HEADER_SIZE;
+            queued_[c] -= payload;
+            if (SESSION_CHANNEL_FLOW_CONTROLLED(c)) credit_[c] -= payload;
+            cond_.notify_all(); // Room for waiting senders
+            lock.unlock();
+
+            if (!transport_->sendAll(f.data(), f.size())) { // One syscall per frame on sockets, none on a busy shared ring
+                std::lock_guard<std::mutex> relock(mutex_);
+                broken_ = true;
+                cond_.notify_all();
+                break;
+            }
+            sent_++;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        writerDone_ = true;
+        cond_.notify_all();
+    }
+
+    std::unique_ptr<Transport> transport_;
+    std::thread writer_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::mutex channelMutex_[SESSION_CHANNELS];
+    std::deque<std::vector<uint8_t>> queues_[SESSION_CHANNELS];
+    size_t queued_[SESSION_CHANNELS] = {};   // Payload bytes waiting in each queue
+    int64_t credit_[SESSION_CHANNELS];       // Payload bytes each channel may still send
+    size_t consumed_[SESSION_CHANNELS] = {}; // Receiving side: bytes not yet returned as credit
+    bool creditKept_ = false;                // Reader thread only: see keepCredit()
+    bool closing_ = false;
+    bool broken_ = false;
+    bool writerDone_ = false;
+    std::atomic<uint64_t> sent_{0};
+    std::atomic<uint64_t> received_{0};
+    std::atomic<uint64_t> dropped_{0};
+};
+
+#endif // SESSION_MUX_H
@@ -0,0 +1,113 @@
+#ifndef SESSION_PROTOCOL_H
+#define SESSION_PROTOCOL_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include "wire_schema.h" // For WireSchema, encodeWire, decodeWire
+
+// Wire definitions of the multiplexed client session (MODE_SESSION).
+// After the mode byte, both directions carry frames: an 8-byte header (big-endian)
+// uint8 channel, uint8 type, uint8 flags, uint8 reserved, uint32 payload length,
+// then the payload. Messages longer than SESSION_MAX_FRAME are split into several
+// frames with SESSION_FLAG_MORE set on all but the last, so frames of other channels
+// can go out in between. Lower channel numbers go first. A message may be at most
+// sessionMaxMessage(channel) long; the receiver closes a session that sends a longer one.
+// Bulk channels (SESSION_CHANNEL_FLOW_CONTROLLED) are flow controlled per channel: the
+// sender may have at most SESSION_WINDOW_BYTES of payload unacknowledged, and the
+// receiver returns credit with WINDOW frames once it has handled the data (a whole
+// message, so a message must fit in the window).
+//
+// Channels and their messages:
+// CONTROL  WINDOW: SessionWindowGrant: uint8 channel, uint32 bytes of credit returned for it.
+//          CLOSE: the peer is leaving the session.
+//          PING: the peer wants to know the session is alive; answered with PONG and the
+//          same payload. The server pings a silent session and drops it if nothing comes back.
+// CHAT     DATA: one chat message (UTF-8 text).
+// VIDEO    OPEN / CLOSE: a video stream starts or ends (client to server).
+//          DATA: client to server one encoded frame (video_protocol.h), server to
+//          client one VideoFeedback report.
+// FILE     OPEN: SessionFileOpen (uint64 file size), then the file name (client to server).
+//          DATA: the next part of the file, at most one frame. CLOSE: the upload is complete.
+//          Server to client: CLOSE with uint8 1 (saved) or 0 (failed).
+
+#define SESSION_HEADER_SIZE 8
+#define SESSION_MAX_FRAME 16384            // Largest frame payload; bounds how long a bulk frame holds up chat
+#define SESSION_WINDOW_BYTES (256 * 1024)  // Per-channel credit of flow-controlled channels
+#define SESSION_MAX_SMALL_MESSAGE (64 * 1024)  // Control and chat messages
+#define SESSION_MAX_VIDEO_MESSAGE (SESSION_WINDOW_BYTES * 3 / 4) // One encoded frame: fits while a quarter window of credit is held back
+#define SESSION_QUEUE_BYTES (64 * 1024)    // Payload queued per channel before send() waits
+
+#define SESSION_CHANNEL_CONTROL 0
+#define SESSION_CHANNEL_CHAT 1
+#define SESSION_CHANNEL_VIDEO 2
+#define SESSION_CHANNEL_FILE 3
+#define SESSION_CHANNELS 4
+#define SESSION_CHANNEL_FLOW_CONTROLLED(c) ((c) == SESSION_CHANNEL_VIDEO || (c) == SESSION_CHANNEL_FILE)
+
+// Longest message a channel carries, and so the most a receiver holds while reassembling
+// one. File data comes in single frames and is never reassembled.
+inline size_t sessionMaxMessage(uint8_t channel) {
+    switch (channel) {
+    case SESSION_CHANNEL_VIDEO: return SESSION_MAX_VIDEO_MESSAGE;
+    case SESSION_CHANNEL_FILE: return SESSION_MAX_FRAME;
+    default: return SESSION_MAX_SMALL_MESSAGE;
+    }
+}
+
+#define SESSION_DATA 0
+#define SESSION_OPEN 1
+#define SESSION_CLOSE 2
+#define SESSION_WINDOW 3
+#define SESSION_PING 4
+#define SESSION_PONG 5
+
+#define SESSION_FLAG_MORE 0x01
+
+struct SessionFrameHeader {
+    uint8_t channel;
+    uint8_t type;
+    uint8_t flags;
+    uint32_t length;
+};
+
+template <>
+struct WireSchema<SessionFrameHeader> {
+    static constexpr auto fields = std::make_tuple(&SessionFrameHeader::channel, &SessionFrameHeader::type,
+                                                   &SessionFrameHeader::flags, WirePad<1>(), &SessionFrameHeader::length);
+};
+static_assert(wireSize<SessionFrameHeader>() == SESSION_HEADER_SIZE, "Session header layout");
+
+// Payload of CONTROL WINDOW
+struct SessionWindowGrant {
+    uint8_t channel;
+    uint32_t credit;
+};
+
+template <>
+struct WireSchema<SessionWindowGrant> {
+    static constexpr auto fields = std::make_tuple(&SessionWindowGrant::channel, &SessionWindowGrant::credit);
+};
+static_assert(wireSize<SessionWindowGrant>() == 5, "Window grant layout");
+
+// Start of the payload of FILE OPEN; the file name follows
+struct SessionFileOpen {
+    uint64_t size;
+};
+
+template <>
+struct WireSchema<SessionFileOpen> {
+    static constexpr auto fields = std::make_tuple(&SessionFileOpen::size);
+};
+
+inline void writeSessionHeader(uint8_t* out, const SessionFrameHeader& h) {
+    encodeWire(h, out); // From wire_schema.h
+}
+
+// Returns false for a header no peer of this version sends
+inline bool parseSessionHeader(const uint8_t* data, SessionFrameHeader& h) {
+    decodeWire(data, h);
+    return h.channel < SESSION_CHANNELS && h.type <= SESSION_PONG && h.length <= SESSION_MAX_FRAME;
+}
+
+#endif // SESSION_PROTOCOL_H
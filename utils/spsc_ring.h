@@ -0,0 +1,60 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+#include <vector>
+#include <cstddef>
+#include <algorithm> // For std::min, std::copy
+
+// Wait-free single-producer single-consumer ring buffer. Storage is allocated once in the
+// constructor, and read()/write() only copy and publish an index, so either side can run
+// inside an audio callback. Capacity is rounded up to a power of two.
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        buffer_.resize(size);
+        mask_ = size - 1;
+    }
+
+    size_t capacity() const { return buffer_.size(); }
+
+    // Elements ready to read; exact on the consumer side, a lower bound elsewhere
+    size_t size() const {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+
+    // Producer side: copies as many of the n elements as fit, returns how many
+    size_t write(const T* data, size_t n) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t tail = tail_.load(std::memory_order_acquire);
+        n = std::min(n, buffer_.size() - (head - tail));
+        size_t first = std::min(n, buffer_.size() - (head & mask_));
+        std::copy(data, data + first, buffer_.data() + (head & mask_));
+        std::copy(data + first, data + n, buffer_.data());
+        head_.store(head + n, std::memory_order_release);
+        return n;
+    }
+
+    // Consumer side: copies up to n elements out, returns how many
+    size_t read(T* data, size_t n) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t head = head_.load(std::memory_order_acquire);
+        n = std::min(n, head - tail);
+        size_t first = std::min(n, buffer_.size() - (tail & mask_));
+        std::copy(buffer_.data() + (tail & mask_), buffer_.data() + (tail & mask_) + first, data);
+        std::copy(buffer_.data(), buffer_.data() + (n - first), data + first);
+        tail_.store(tail + n, std::memory_order_release);
+        return n;
+    }
+
+private:
+    std::vector<T> buffer_;
+    size_t mask_ = 0;
+    alignas(64) std::atomic<size_t> head_{0}; // Written by the producer only
+    alignas(64) std::atomic<size_t> tail_{0}; // Written by the consumer only
+};
+
+#endif // SPSC_RING_H
@@ -0,0 +1,109 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <algorithm> // For std::min, std::max
+
+#include "thread_roles.h" // For ThreadRole, ThreadRoleScope
+
+// Fixed-size worker pool for CPU-bound fan-out work such as encoding frame strips
+class ThreadPool {
+public:
+    explicit ThreadPool(ThreadRole role = ROLE_CODEC, size_t threads = std::max(1u, std::thread::hardware_concurrency())) {
+        for (size_t i = 0; i < threads; i++) {
+            workers_.emplace_back([this, role] {
+                ThreadRoleScope scope(role);
+                workerLoop();
+            });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cond_.notify_all();
+        for (std::thread& t : workers_) {
+            if (t.joinable()) t.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return workers_.size(); }
+
+    void submit(std::function<void()> task) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tasks_.push(std::move(task));
+        }
+        cond_.notify_one();
+    }
+
+    // Runs fn(i) for every i in [0, count) on the pool plus the calling thread,
+    // and returns once all of them have finished
+    void parallelFor(size_t count, const std::function<void(size_t)>& fn) {
+        if (count == 0) return;
+        if (count == 1) {
+            fn(0);
+            return;
+        }
+
+        struct State {
+            std::atomic<size_t> next{0};
+            size_t helpers = 0;
+            std::mutex mutex;
+            std::condition_variable done;
+        } state;
+
+        auto drain = [&state, &fn, count] {
+            for (size_t i = state.next++; i < count; i = state.next++) fn(i);
+        };
+
+        size_t helpers = std::min(count - 1, workers_.size());
+        state.helpers = helpers;
+        for (size_t h = 0; h < helpers; h++) {
+            submit([&state, &drain] {
+                drain();
+                std::lock_guard<std::mutex> lock(state.mutex);
+                if (--state.helpers == 0) state.done.notify_one();
+            });
+        }
+
+        drain();
+        // Helpers reference our stack, so wait for all of them and not just for the work
+        std::unique_lock<std::mutex> lock(state.mutex);
+        state.done.wait(lock, [&state] { return state.helpers == 0; });
+    }
+
+private:
+    void workerLoop() {
+        while (true) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                cond_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+                if (stopping_ && tasks_.empty()) return;
+                task = std::move(tasks_.front());
+                tasks_.pop();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::queue<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool stopping_ = false;
+};
+
+#endif // THREAD_POOL_H
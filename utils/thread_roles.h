@@ -0,0 +1,471 @@
+#ifndef THREAD_ROLES_H
+#define THREAD_ROLES_H
+
+#include <string>
+#include <vector>
+#include <set>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <algorithm> // For std::min, std::remove
+#include <ctime>     // For clock_gettime
+#include <cstdio>  // For snprintf
+#include <cstdlib> // For strtol
+#include <cerrno>
+#include <cstring> // For strerror
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h> // For setpriority
+#ifdef __linux__
+#include <sys/syscall.h> // For SYS_gettid
+#endif
+
+#include "common_utils.h" // For logInfo, logError
+
+#define THREAD_ROLE_MAX_CPUS 1024 // Highest CPU number a policy may name, plus one
+
+// What a thread does, for where and how it is scheduled. Each role can be given CPUs and a
+// scheduling policy (--thread-role=ROLE:SPEC), applied as a thread takes on the role:
+//   cpus=N, cpus=N-M or cpus=N+M+...   CPUs the role's threads may run on
+//   fifo=1..99                         SCHED_FIFO at this priority (needs CAP_SYS_NICE or an rtprio limit)
+//   nice=-20..19                       niceness under the normal scheduler
+// e.g. --thread-role=mix:cpus=3,fifo=60 --thread-role=bulk:nice=10
+// ThreadRoleScope applies its role for as long as it lives and gives the thread back its
+// previous settings afterwards, so tasks on shared executor workers can take a role too. The
+// registry sums the CPU time and run-queue wait (/proc schedstat) of each role's threads;
+// taking on a role only reads the thread's CPU clock, /proc is read when a thread starts,
+// ends, or the registry reports.
+
+enum ThreadRole {
+    ROLE_NETWORK, // Sockets: accept loops, connection readers and writers, voice receive, timers
+    ROLE_CODEC,   // Video and voice coding: decoding on the server, capture and encoding on the client
+    ROLE_MIX,     // Voice mixing, paced by the audio output
+    ROLE_AUDIO,   // Audio device threads (sound card callbacks, or the clock of WAV/null devices)
+    ROLE_BULK,    // File uploads and recordings, which may wait without hurting anyone
+    THREAD_ROLES
+};
+
+inline const char* threadRoleName(ThreadRole role) {
+    static const char* names[THREAD_ROLES] = {"network", "codec", "mix", "audio", "bulk"};
+    return names[role];
+}
+
+struct ThreadRolePolicy {
+    std::vector<int> cpus; // Empty: wherever the scheduler likes
+    int fifoPriority = 0;  // 0: normal scheduler
+    bool niceSet = false;
+    int nice = 0;
+
+    bool empty() const { return cpus.empty() && fifoPriority == 0 && !niceSet; }
+};
+
+// CPU time and run-queue wait of a thread, from /proc schedstat, in nanoseconds
+struct ThreadSchedSample {
+    uint64_t cpuNs = 0;
+    uint64_t waitNs = 0; // Runnable but waiting for a CPU
+    uint64_t slices = 0; // Times it got a CPU
+};
+
+inline ThreadSchedSample operator-(const ThreadSchedSample& a, const ThreadSchedSample& b) {
+    return ThreadSchedSample{a.cpuNs - b.cpuNs, a.waitNs - b.waitNs, a.slices - b.slices};
+}
+
+inline ThreadSchedSample& operator+=(ThreadSchedSample& a, const ThreadSchedSample& b) {
+    a.cpuNs += b.cpuNs;
+    a.waitNs += b.waitNs;
+    a.slices += b.slices;
+    return a;
+}
+
+// Reads a schedstat file of /proc; zeros where the kernel does not keep them
+inline ThreadSchedSample readSchedstat(const char* path) {
+    ThreadSchedSample s;
+#ifdef __linux__
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return s;
+    char text[96];
+    ssize_t n = read(fd, text, sizeof(text) - 1);
+    close(fd);
+    if (n <= 0) return s;
+    text[n] = '\0';
+    char* p = text;
+    s.cpuNs = strtoull(p, &p, 10);
+    s.waitNs = strtoull(p, &p, 10);
+    s.slices = strtoull(p, &p, 10);
+#else
+    (void)path;
+#endif
+    return s;
+}
+
+inline ThreadSchedSample sampleThisThread() {
+    return readSchedstat("/proc/thread-self/schedstat");
+}
+
+// Another thread of this process, by kernel thread id
+inline ThreadSchedSample sampleThread(long tid) {
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/task/%ld/schedstat", tid);
+    return readSchedstat(path);
+}
+
+// Kernel id of the calling thread; 0 where there is none
+inline long currentThreadId() {
+#ifdef __linux__
+    return syscall(SYS_gettid);
+#else
+    return 0;
+#endif
+}
+
+// Parses "ROLE:KEY=VALUE[,KEY=VALUE...]"; false if anything is unknown or out of range
+inline bool parseThreadRole(const std::string& spec, ThreadRole& role, ThreadRolePolicy& policy) {
+    size_t colon = spec.find(':');
+    if (colon == std::string::npos) return false;
+    std::string name = spec.substr(0, colon);
+    role = THREAD_ROLES;
+    for (int r = 0; r < THREAD_ROLES; r++) {
+        if (name == threadRoleName((ThreadRole)r)) role = (ThreadRole)r;
+    }
+    if (role == THREAD_ROLES) return false;
+
+    policy = ThreadRolePolicy();
+    size_t start = colon + 1;
+    while (start <= spec.size()) {
+        size_t end = spec.find(',', start);
+        if (end == std::string::npos) end = spec.size();
+        std::string item = spec.substr(start, end - start);
+        size_t eq = item.find('=');
+        if (eq == std::string::npos) return false;
+        std::string key = item.substr(0, eq);
+        const char* value = item.c_str() + eq + 1;
+        char* rest = nullptr;
+        if (key == "cpus") {
+            for (const char* p = value; *p;) {
+                long first = strtol(p, &rest, 10);
+                long last = first;
+                if (rest == p || first < 0 || first >= THREAD_ROLE_MAX_CPUS) return false;
+                if (*rest == '-') {
+                    p = rest + 1;
+                    last = strtol(p, &rest, 10);
+                    if (rest == p || last < first || last >= THREAD_ROLE_MAX_CPUS) return false;
+                }
+                for (long cpu = first; cpu <= last; cpu++) policy.cpus.push_back((int)cpu);
+                if (*rest == '+') rest++;
+                else if (*rest) return false;
+                p = rest;
+            }
+            if (policy.cpus.empty()) return false;
+        } else if (key == "fifo") {
+            policy.fifoPriority = (int)strtol(value, &rest, 10);
+            if (rest == value || *rest || policy.fifoPriority < 1 || policy.fifoPriority > 99) return false;
+        } else if (key == "nice") {
+            policy.nice = (int)strtol(value, &rest, 10);
+            policy.niceSet = true;
+            if (rest == value || *rest || policy.nice < -20 || policy.nice > 19) return false;
+        } else {
+            return false;
+        }
+        start = end + 1;
+    }
+    return true;
+}
+// Thread CPU time of the calling thread in nanoseconds: the clock schedstat's first field counts
+inline uint64_t threadCpuNs() {
+    timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) return 0;
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// One thread's accounting: the CPU time it spent in each role, kept by the thread itself
+// without locking as it switches roles. The registry samples the thread's schedstat when the
+// slot is registered, when it reports, and when the thread ends, and shares the run-queue
+// wait between the roles by their CPU time.
+struct ThreadRoleSlot {
+    explicit ThreadRoleSlot(long threadId) : tid(threadId) {
+        for (auto& ns : cpuNs) ns.store(0, std::memory_order_relaxed);
+    }
+
+    // Owner thread: what it used since the last switch goes to the role it had; cpuNow from
+    // its own CPU clock. Returns the role it had.
+    ThreadRole switchTo(ThreadRole next, uint64_t cpuNow) {
+        int previous = role.load(std::memory_order_relaxed);
+        if (previous != THREAD_ROLES) {
+            cpuNs[previous].fetch_add(cpuNow - roleStartNs.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+        roleStartNs.store(cpuNow, std::memory_order_relaxed);
+        role.store(next, std::memory_order_relaxed);
+        return (ThreadRole)previous;
+    }
+
+    // Any thread: the thread's use of each role up to now, a schedstat sample of it. A switch
+    // that happens while it reads may be counted to the wrong side of it.
+    void split(const ThreadSchedSample& now, ThreadSchedSample out[THREAD_ROLES]) const {
+        if (now.cpuNs < start.cpuNs) return; // The thread is gone, or /proc cannot be read
+        ThreadSchedSample used = now - start;
+        int current = role.load(std::memory_order_relaxed);
+        uint64_t since = roleStartNs.load(std::memory_order_relaxed);
+        for (int r = 0; r < THREAD_ROLES; r++) {
+            uint64_t cpu = cpuNs[r].load(std::memory_order_relaxed);
+            if (r == current && now.cpuNs > since) cpu += now.cpuNs - since;
+            double share = used.cpuNs ? std::min(1.0, (double)cpu / used.cpuNs) : 0.0;
+            out[r] += ThreadSchedSample{cpu, (uint64_t)(used.waitNs * share), (uint64_t)(used.slices * share)};
+        }
+    }
+
+    const long tid;
+    std::atomic<int> role{THREAD_ROLES};         // The role it has now; THREAD_ROLES: none
+    std::atomic<uint64_t> roleStartNs{0};        // Its CPU time when it took on role
+    std::atomic<uint64_t> cpuNs[THREAD_ROLES];   // CPU time in each role before that
+    ThreadSchedSample start;                     // schedstat at registration (set by the registry)
+};
+
+inline void setThreadRolePolicy(ThreadRole role, const ThreadRolePolicy& policy, pthread_t thread, long tid);
+
+// Policies and statistics of every role, one per process (threadRoles())
+class ThreadRoleRegistry {
+public:
+    ThreadRoleRegistry() : start_(std::chrono::steady_clock::now()) {
+        for (auto& entries : entries_) entries.store(0, std::memory_order_relaxed);
+        for (auto& set : policySet_) set.store(false, std::memory_order_relaxed);
+    }
+
+    // Applies one --thread-role option; false if it does not parse
+    bool configure(const std::string& spec) {
+        ThreadRole role;
+        ThreadRolePolicy policy;
+        if (!parseThreadRole(spec, role, policy)) return false;
+        std::lock_guard<std::mutex> lock(mutex_);
+        policies_[role] = policy;
+        policySet_[role].store(!policy.empty(), std::memory_order_release);
+        return true;
+    }
+
+    // Roles without a policy, the usual case, are answered without locking
+    bool hasPolicy(ThreadRole role) const { return policySet_[role].load(std::memory_order_acquire); }
+
+    ThreadRolePolicy policy(ThreadRole role) {
+        if (!hasPolicy(role)) return ThreadRolePolicy();
+        std::lock_guard<std::mutex> lock(mutex_);
+        return policies_[role];
+    }
+
+    // A thread or task took on the role
+    void entered(ThreadRole role) { entries_[role].fetch_add(1, std::memory_order_relaxed); }
+
+    // A thread's first role: its slot is counted from here until retire()
+    void add(ThreadRoleSlot* slot, const ThreadSchedSample& start) {
+        slot->start = start;
+        std::lock_guard<std::mutex> lock(mutex_);
+        live_.push_back(slot);
+    }
+
+    // The thread ends: its time goes to the totals; final is its last schedstat sample
+    void retire(ThreadRoleSlot* slot, const ThreadSchedSample& final) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        slot->split(final, totals_);
+        live_.erase(std::remove(live_.begin(), live_.end(), slot), live_.end());
+    }
+
+    // A thread the process did not start and cannot put a scope on, e.g. the sound card
+    // callback thread of PortAudio: called from another thread, it applies the role's policy
+    // to it and counts it to the role until release(tid).
+    void adopt(ThreadRole role, pthread_t thread, long tid) {
+        if (tid <= 0) return;
+        std::unique_ptr<ThreadRoleSlot> slot(new ThreadRoleSlot(tid));
+        ThreadSchedSample start = sampleThread(tid);
+        slot->switchTo(role, start.cpuNs);
+        entered(role);
+        if (hasPolicy(role)) setThreadRolePolicy(role, policy(role), thread, tid);
+        add(slot.get(), start);
+        std::lock_guard<std::mutex> lock(mutex_);
+        adopted_.push_back(std::move(slot));
+    }
+
+    // Call while the adopted thread still runs, so its last sample can be read
+    void release(long tid) {
+        std::unique_ptr<ThreadRoleSlot> slot;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto it = adopted_.begin(); it != adopted_.end(); ++it) {
+                if ((*it)->tid != tid) continue;
+                slot = std::move(*it);
+                adopted_.erase(it);
+                break;
+            }
+        }
+        if (slot) retire(slot.get(), sampleThread(tid));
+    }
+
+    // Logs a policy that could not be applied, once per role and kind of failure
+    void failed(ThreadRole role, const std::string& what, int error) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!warned_[role].insert(what).second) return;
+        }
+        logError(std::string("Thread role ") + threadRoleName(role) + ": cannot " + what + " (" + strerror(error) + ")");
+    }
+
+    // Includes threads still running, e.g. the workers of static pools; samples each of them
+    void totals(ThreadSchedSample out[THREAD_ROLES]) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (int r = 0; r < THREAD_ROLES; r++) out[r] = totals_[r];
+        for (ThreadRoleSlot* slot : live_) slot->split(sampleThread(slot->tid), out);
+    }
+
+    // One line per role that ran: threads and tasks that took it on, share of one CPU, and
+    // mean run-queue wait per time it got the CPU (how long it was kept waiting after waking
+    // up or being preempted).
+    void report() {
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+        ThreadSchedSample t[THREAD_ROLES];
+        totals(t);
+        for (int r = 0; r < THREAD_ROLES; r++) {
+            uint32_t entries = entries_[r].load(std::memory_order_relaxed);
+            if (entries == 0) continue;
+            char line[192];
+            snprintf(line, sizeof(line), "Thread role %s (%u threads/tasks): %.2f s CPU (%.1f%% of a core), run-queue wait %.1f us per switch-in (%llu)",
+                     threadRoleName((ThreadRole)r), entries, t[r].cpuNs / 1e9, seconds > 0 ? 100.0 * t[r].cpuNs / 1e9 / seconds : 0.0,
+                     t[r].slices ? t[r].waitNs / 1e3 / t[r].slices : 0.0, (unsigned long long)t[r].slices);
+            logInfo(line);
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    std::chrono::steady_clock::time_point start_;
+    std::vector<ThreadRoleSlot*> live_; // Threads with a role so far, still running
+    std::vector<std::unique_ptr<ThreadRoleSlot>> adopted_;
+    ThreadRolePolicy policies_[THREAD_ROLES];
+    std::atomic<bool> policySet_[THREAD_ROLES];
+    ThreadSchedSample totals_[THREAD_ROLES]; // Of threads that ended
+    std::atomic<uint32_t> entries_[THREAD_ROLES];
+    std::set<std::string> warned_[THREAD_ROLES];
+};
+
+// Never destroyed: threads of static pools leave their roles during static destruction
+inline ThreadRoleRegistry& threadRoles() {
+    static ThreadRoleRegistry* registry = new ThreadRoleRegistry();
+    return *registry;
+}
+
+// Sets a role's CPUs and scheduling on a thread, the calling one or another of the process
+inline void setThreadRolePolicy(ThreadRole role, const ThreadRolePolicy& policy, pthread_t thread, long tid) {
+#ifdef __linux__
+    if (!policy.cpus.empty()) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for (int cpu : policy.cpus) CPU_SET(cpu, &cpus);
+        int error = pthread_setaffinity_np(thread, sizeof(cpus), &cpus);
+        if (error) threadRoles().failed(role, "set CPU affinity", error);
+    }
+    if (policy.niceSet && setpriority(PRIO_PROCESS, tid, policy.nice) < 0) {
+        threadRoles().failed(role, "set nice " + std::to_string(policy.nice), errno);
+    }
+#else
+    (void)tid;
+    if (!policy.cpus.empty()) threadRoles().failed(role, "set CPU affinity", ENOTSUP);
+    if (policy.niceSet) threadRoles().failed(role, "set a per-thread nice", ENOTSUP);
+#endif
+    if (policy.fifoPriority > 0) {
+        sched_param param{};
+        param.sched_priority = policy.fifoPriority;
+        int error = pthread_setschedparam(thread, SCHED_FIFO, &param);
+        if (error) threadRoles().failed(role, "use SCHED_FIFO", error);
+    }
+}
+
+// The calling thread takes on a role until the end of the scope: its CPUs and scheduling
+// policy are set from the role's policy (if it has one) and restored afterwards, and its CPU
+// time is counted to the role. Scopes nest; an inner one pauses the outer one's accounting.
+// Without a policy a scope only reads the thread's CPU clock on the way in and out; the
+// thread's slot is registered the first time it takes on any role.
+class ThreadRoleScope {
+public:
+    explicit ThreadRoleScope(ThreadRole role) : role_(role), outer_(current()), slot_(threadSlot()) {
+        slot_.switchTo(role_, threadCpuNs());
+        current() = this;
+        threadRoles().entered(role_);
+        apply();
+    }
+
+    ~ThreadRoleScope() {
+        restore();
+        current() = outer_;
+        slot_.switchTo(outer_ ? outer_->role_ : THREAD_ROLES, threadCpuNs());
+    }
+
+    ThreadRoleScope(const ThreadRoleScope&) = delete;
+    ThreadRoleScope& operator=(const ThreadRoleScope&) = delete;
+
+    ThreadRole role() const { return role_; }
+
+    // Innermost scope of the calling thread, or nullptr
+    static ThreadRoleScope* active() { return current(); }
+
+private:
+    // Registered on the thread's first scope, retired when the thread ends
+    class ThreadSlot {
+    public:
+        ThreadSlot() : slot_(currentThreadId()) { threadRoles().add(&slot_, sampleThisThread()); }
+        ~ThreadSlot() { threadRoles().retire(&slot_, sampleThisThread()); }
+        ThreadRoleSlot& get() { return slot_; }
+
+    private:
+        ThreadRoleSlot slot_;
+    };
+
+    static ThreadRoleScope*& current() {
+        thread_local ThreadRoleScope* scope = nullptr;
+        return scope;
+    }
+
+    static ThreadRoleSlot& threadSlot() {
+        thread_local ThreadSlot slot;
+        return slot.get();
+    }
+
+    void apply() {
+        if (!threadRoles().hasPolicy(role_)) return;
+        ThreadRolePolicy policy = threadRoles().policy(role_);
+        applied_ = true;
+        pthread_t self = pthread_self();
+        pthread_getschedparam(self, &oldPolicy_, &oldParam_);
+#ifdef __linux__
+        errno = 0;
+        oldNice_ = getpriority(PRIO_PROCESS, slot_.tid);
+        cpusSaved_ = !policy.cpus.empty() && pthread_getaffinity_np(self, sizeof(oldCpus_), &oldCpus_) == 0;
+#endif
+        setThreadRolePolicy(role_, policy, self, slot_.tid);
+    }
+
+    void restore() {
+        if (!applied_) return;
+        pthread_t self = pthread_self();
+        pthread_setschedparam(self, oldPolicy_, &oldParam_);
+#ifdef __linux__
+        if (cpusSaved_) pthread_setaffinity_np(self, sizeof(oldCpus_), &oldCpus_);
+        // Raising the priority back needs the same privilege as lowering nice below 0 does
+        if (getpriority(PRIO_PROCESS, slot_.tid) != oldNice_ && setpriority(PRIO_PROCESS, slot_.tid, oldNice_) < 0) {
+            threadRoles().failed(role_, "restore nice " + std::to_string(oldNice_) + " after a task", errno);
+        }
+#endif
+    }
+
+    ThreadRole role_;
+    ThreadRoleScope* outer_;
+    ThreadRoleSlot& slot_;
+    bool applied_ = false;
+    int oldPolicy_ = SCHED_OTHER;
+    sched_param oldParam_{};
+#ifdef __linux__
+    int oldNice_ = 0;
+    bool cpusSaved_ = false;
+    cpu_set_t oldCpus_;
+#endif
+};
+
+#endif // THREAD_ROLES_H
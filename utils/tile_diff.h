@@ -0,0 +1,96 @@
+#ifndef TILE_DIFF_H
+#define TILE_DIFF_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib> // For std::abs
+
+#if defined(__x86_64__) || defined(__i386__)
+  #include <immintrin.h>
+  #define TILE_DIFF_X86 1
+#elif defined(__ARM_NEON)
+  #include <arm_neon.h>
+  #define TILE_DIFF_NEON 1
+#endif
+
+// Sum of absolute differences kernels used to detect changed video tiles.
+// x86 uses AVX2 when the CPU supports it (runtime dispatch, no build flags needed)
+// and SSE2 otherwise; ARM uses NEON; everything else falls back to scalar code.
+
+inline uint64_t sadRowScalar(const uint8_t* a, const uint8_t* b, size_t n) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < n; i++) sum += std::abs((int)a[i] - (int)b[i]);
+    return sum;
+}
+
+#if defined(TILE_DIFF_X86)
+__attribute__((target("avx2")))
+inline uint64_t sadRowAvx2(const uint8_t* a, const uint8_t* b, size_t n) {
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(va, vb));
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), acc);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sadRowScalar(a + i, b + i, n - i);
+}
+
+inline uint64_t sadRowSse2(const uint8_t* a, const uint8_t* b, size_t n) {
+    __m128i acc = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(va, vb));
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), acc);
+    return lanes[0] + lanes[1] + sadRowScalar(a + i, b + i, n - i);
+}
+#endif
+
+#if defined(TILE_DIFF_NEON)
+inline uint64_t sadRowNeon(const uint8_t* a, const uint8_t* b, size_t n) {
+    uint64_t sum = 0;
+    size_t i = 0;
+    while (i + 16 <= n) {
+        // 16-bit lanes gain at most 510 per step, so flush before they can overflow
+        uint16x8_t acc = vdupq_n_u16(0);
+        for (int steps = 0; steps < 128 && i + 16 <= n; steps++, i += 16) {
+            acc = vpadalq_u8(acc, vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i)));
+        }
+        sum += vaddlvq_u16(acc);
+    }
+    return sum + sadRowScalar(a + i, b + i, n - i);
+}
+#endif
+
+// Picks the best kernel for this machine once
+inline uint64_t sadRow(const uint8_t* a, const uint8_t* b, size_t n) {
+#if defined(TILE_DIFF_X86)
+    static const bool hasAvx2 = __builtin_cpu_supports("avx2");
+    return hasAvx2 ? sadRowAvx2(a, b, n) : sadRowSse2(a, b, n);
+#elif defined(TILE_DIFF_NEON)
+    return sadRowNeon(a, b, n);
+#else
+    return sadRowScalar(a, b, n);
+#endif
+}
+
+// Returns true if the mean absolute difference over a 2D block exceeds the threshold.
+// Stops early as soon as the threshold is crossed.
+inline bool blockChanged(const uint8_t* a, size_t strideA, const uint8_t* b, size_t strideB,
+                         size_t rowBytes, size_t rows, unsigned meanThreshold) {
+    uint64_t limit = (uint64_t)meanThreshold * rowBytes * rows;
+    uint64_t sum = 0;
+    for (size_t r = 0; r < rows; r++) {
+        sum += sadRow(a + r * strideA, b + r * strideB, rowBytes);
+        if (sum > limit) return true;
+    }
+    return false;
+}
+
+#endif // TILE_DIFF_H
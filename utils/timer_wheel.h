@@ -0,0 +1,282 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <vector>
+#include <unordered_set>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <algorithm> // For std::min, std::max
+
+#define TIMER_WHEEL_BITS 6                            // 64 slots per level
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS 4                          // 64^4 ticks: 19 days at 100 ms ticks
+
+inline uint64_t timerNowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Hierarchical timer wheel. Level 0 has a slot per tick; each higher level has a slot per
+// 64 ticks of the level below, and its slot is spread over the level below when the clock
+// reaches it. Timers live in a pool and are linked into their slot's list, so schedule,
+// cancel and reschedule are O(1) whatever the number of timers, and advance() costs one slot
+// per tick plus the timers that fire. Callbacks run on the thread calling advance(), outside
+// the lock; they must be short (cancelling a task, queueing a message).
+class TimerWheel {
+public:
+    using TimerId = uint64_t; // 0 is never a timer
+
+    explicit TimerWheel(uint32_t tickMs, uint64_t nowMs = timerNowMs())
+        : tickMs_(std::max<uint32_t>(1, tickMs)), startMs_(nowMs) {
+        for (auto& level : slots_) {
+            for (int32_t& head : level) head = -1;
+        }
+    }
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    uint32_t tickMs() const { return tickMs_; }
+
+    // Calls fn once, delayMs from now to within a tick (advance() only sees whole ticks)
+    TimerId schedule(uint32_t delayMs, std::function<void()> fn) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        int32_t index;
+        if (free_ >= 0) {
+            index = free_;
+            free_ = nodes_[index].next;
+        } else {
+            index = (int32_t)nodes_.size();
+            nodes_.emplace_back();
+        }
+        Node& node = nodes_[index];
+        node.fn = std::move(fn);
+        node.active = true;
+        node.expiry = expiryFor(delayMs);
+        link(index);
+        active_++;
+        return id(index);
+    }
+
+    // Moves a pending timer to delayMs from now; false if it already fired or was cancelled
+    bool reschedule(TimerId timer, uint32_t delayMs) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        int32_t index = find(timer);
+        if (index < 0) return false;
+        unlink(index);
+        nodes_[index].expiry = expiryFor(delayMs);
+        link(index);
+        return true;
+    }
+
+    // True if the timer was pending. Once this returns, its callback is not running (unless
+    // called from that callback) and never will.
+    bool cancel(TimerId timer) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        int32_t index = find(timer);
+        if (index >= 0) {
+            unlink(index);
+            release(index);
+            return true;
+        }
+        if (dueBatch_.erase(timer)) return true; // Due, but advance() has not got to it yet
+        done_.wait(lock, [&] { return running_ != timer || runner_ == std::this_thread::get_id(); });
+        return false;
+    }
+
+    // Runs every timer due by nowMs; returns how many fired
+    size_t advance(uint64_t nowMs = timerNowMs()) {
+        std::vector<std::pair<TimerId, std::function<void()>>> due;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            uint64_t target = nowMs > startMs_ ? (nowMs - startMs_) / tickMs_ : 0;
+            while (tick_ < target) {
+                tick_++;
+                // Spread the higher-level slots this tick reaches over the levels below, top down
+                for (int level = TIMER_WHEEL_LEVELS - 1; level > 0; level--) {
+                    if (tick_ & ((1ull << (TIMER_WHEEL_BITS * level)) - 1)) continue;
+                    int32_t& head = slots_[level][(tick_ >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1)];
+                    int32_t index = head;
+                    head = -1;
+                    while (index >= 0) {
+                        int32_t next = nodes_[index].next;
+                        link(index);
+                        index = next;
+                    }
+                }
+                int32_t& head = slots_[0][tick_ & (TIMER_WHEEL_SLOTS - 1)];
+                int32_t index = head;
+                head = -1;
+                while (index >= 0) {
+                    int32_t next = nodes_[index].next;
+                    due.emplace_back(id(index), std::move(nodes_[index].fn));
+                    dueBatch_.insert(due.back().first);
+                    release(index);
+                    index = next;
+                }
+            }
+            runner_ = std::this_thread::get_id();
+        }
+        size_t fired = 0;
+        for (auto& timer : due) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!dueBatch_.erase(timer.first)) continue; // Cancelled while waiting its turn
+                running_ = timer.first;
+            }
+            timer.second();
+            fired++;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                running_ = 0;
+            }
+            done_.notify_all();
+        }
+        return fired;
+    }
+
+    size_t pending() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return active_;
+    }
+
+private:
+    struct Node {
+        std::function<void()> fn;
+        uint64_t expiry = 0;     // Tick it fires on
+        int32_t prev = -1;
+        int32_t next = -1;       // Also links the free list
+        uint32_t generation = 0; // Bumped on release, so stale ids never match a reused node
+        int8_t level = 0;
+        uint8_t slot = 0;
+        bool active = false;
+    };
+
+    TimerId id(int32_t index) const { return ((TimerId)nodes_[index].generation << 32) | (uint32_t)(index + 1); }
+
+    // With mutex_ held: index of a pending timer, or -1
+    int32_t find(TimerId timer) const {
+        int64_t index = (int64_t)(timer & 0xFFFFFFFFu) - 1;
+        if (index < 0 || index >= (int64_t)nodes_.size()) return -1;
+        const Node& node = nodes_[index];
+        return node.active && node.generation == (uint32_t)(timer >> 32) ? (int32_t)index : -1;
+    }
+
+    uint64_t expiryFor(uint32_t delayMs) const {
+        uint64_t ticks = std::max<uint64_t>(1, (delayMs + tickMs_ - 1) / tickMs_);
+        uint64_t span = (1ull << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1;
+        return tick_ + std::min(ticks, span);
+    }
+
+    // Puts a node into the slot for its expiry, in the lowest level whose range covers it
+    void link(int32_t index) {
+        Node& node = nodes_[index];
+        uint64_t delta = node.expiry > tick_ ? node.expiry - tick_ : 0;
+        int level = 0;
+        while (level < TIMER_WHEEL_LEVELS - 1 && delta >= (1ull << (TIMER_WHEEL_BITS * (level + 1)))) level++;
+        node.level = (int8_t)level;
+        // Outside advance() expiry is always ahead of tick_; a timer cascading on its own tick
+        // lands in the level-0 slot advance() is about to fire
+        node.slot = (uint8_t)((node.expiry >> (TIMER_WHEEL_BITS * level)) & (TIMER_WHEEL_SLOTS - 1));
+        int32_t& head = slots_[level][node.slot];
+        node.prev = -1;
+        node.next = head;
+        if (head >= 0) nodes_[head].prev = index;
+        head = index;
+    }
+
+    void unlink(int32_t index) {
+        Node& node = nodes_[index];
+        if (node.prev >= 0) nodes_[node.prev].next = node.next;
+        else slots_[node.level][node.slot] = node.next;
+        if (node.next >= 0) nodes_[node.next].prev = node.prev;
+    }
+
+    // Back to the free list (already unlinked from its slot)
+    void release(int32_t index) {
+        Node& node = nodes_[index];
+        node.fn = nullptr;
+        node.active = false;
+        node.generation++;
+        node.next = free_;
+        free_ = index;
+        active_--;
+    }
+
+    const uint32_t tickMs_;
+    const uint64_t startMs_;
+    uint64_t tick_ = 0;
+    std::mutex mutex_;
+    std::condition_variable done_;
+    std::vector<Node> nodes_;
+    int32_t slots_[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    int32_t free_ = -1;
+    size_t active_ = 0;
+    std::unordered_set<TimerId> dueBatch_; // Taken out of the wheel by advance(), not run yet
+    TimerId running_ = 0;       // Timer whose callback advance() is running
+    std::thread::id runner_;    // Thread running advance()
+};
+
+// Calls onIdle once nothing was touch()ed for timeoutMs, and again every timeoutMs while it
+// stays idle. touch() is one relaxed atomic store, cheap enough for every packet: the timer
+// is not moved on each touch, but re-armed for the remaining time whenever it comes due early.
+class IdleTimer {
+public:
+    IdleTimer(TimerWheel& wheel, uint32_t timeoutMs, std::function<void()> onIdle)
+        : wheel_(wheel), timeoutMs_(timeoutMs), onIdle_(std::move(onIdle)), last_(timerNowMs()) {
+        arm(timeoutMs_);
+    }
+
+    // Once this returns, onIdle is not running and never will
+    ~IdleTimer() {
+        stopped_ = true;
+        TimerWheel::TimerId timer;
+        do {
+            timer = id_;
+            wheel_.cancel(timer); // Waits for a running callback, which may have re-armed
+        } while (timer != id_);
+    }
+
+    IdleTimer(const IdleTimer&) = delete;
+    IdleTimer& operator=(const IdleTimer&) = delete;
+
+    void touch() { last_.store(timerNowMs(), std::memory_order_relaxed); }
+
+    // Milliseconds since the last touch()
+    uint64_t idleMs() const {
+        uint64_t now = timerNowMs();
+        uint64_t last = last_.load(std::memory_order_relaxed);
+        return now > last ? now - last : 0;
+    }
+
+private:
+    void arm(uint64_t delayMs) {
+        id_ = wheel_.schedule((uint32_t)delayMs, [this] { due(); });
+    }
+
+    // On the wheel's thread
+    void due() {
+        if (stopped_) return;
+        uint64_t idle = idleMs();
+        if (idle + wheel_.tickMs() / 2 < timeoutMs_) {
+            arm(timeoutMs_ - idle);
+            return;
+        }
+        onIdle_();
+        arm(timeoutMs_);
+    }
+
+    TimerWheel& wheel_;
+    const uint64_t timeoutMs_;
+    std::function<void()> onIdle_;
+    std::atomic<uint64_t> last_;
+    std::atomic<TimerWheel::TimerId> id_{0};
+    std::atomic<bool> stopped_{false};
+};
+
+#endif // TIMER_WHEEL_H
@@ -0,0 +1,350 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <string>
+#include <memory>
+#include <new>     // For placement new
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <cstring>   // For memcpy, strerror
+#include <cerrno>
+#include <algorithm> // For std::min
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#ifdef __linux__
+  #include <fcntl.h>    // For F_ADD_SEALS
+  #include <sys/mman.h> // For memfd_create, mmap
+  #include <sys/stat.h>
+  #include <sys/eventfd.h>
+#endif
+
+#include "common_utils.h"
+
+#define SHM_RING_BYTES (64 * 1024)   // Shared ring per direction; small, so bulk frames queue ahead of chat no longer than on TCP
+#define SHM_SPIN_ITERATIONS 2000     // Polls of an empty or full ring before sleeping (multi-core hosts only)
+#define SHM_TRANSPORT_FDS 5          // Passed with MODE_SESSION_SHM: memfd, then data/space eventfds of both rings
+
+// The byte stream a SessionMux runs over. sendAll() is called from one thread and recvAll()
+// from one other thread at a time; shutdown() may be called from anywhere and makes both
+// return false, on this end and the peer's.
+class Transport {
+public:
+    virtual ~Transport() = default;
+    virtual bool sendAll(const void* data, size_t len) = 0;
+    virtual bool recvAll(void* data, size_t len) = 0;
+    virtual void shutdown() = 0;
+    virtual int fd() const = 0;                // The socket behind the transport (for shutdown and socket statistics)
+    virtual std::string describe() const = 0;
+};
+
+// TCP or Unix domain stream socket. Takes ownership of the socket.
+class SocketTransport : public Transport {
+public:
+    explicit SocketTransport(int sockfd) : sockfd_(sockfd) {
+        sockaddr_storage addr{};
+        socklen_t len = sizeof(addr);
+        unix_ = getsockname(sockfd_, (sockaddr*)&addr, &len) == 0 && addr.ss_family == AF_UNIX;
+    }
+    ~SocketTransport() override { ::close(sockfd_); }
+
+    bool sendAll(const void* data, size_t len) override { return ::sendAll(sockfd_, static_cast<const char*>(data), len); }
+    bool recvAll(void* data, size_t len) override { return ::recvAll(sockfd_, static_cast<char*>(data), len); }
+    void shutdown() override { ::shutdown(sockfd_, SHUT_RDWR); }
+    int fd() const override { return sockfd_; }
+    std::string describe() const override { return unix_ ? "Unix socket" : "TCP"; }
+
+private:
+    int sockfd_;
+    bool unix_ = false;
+};
+
+// Connects to a server's Unix domain socket; -1 on failure
+inline int connectUnixSocket(const std::string& path) {
+    sockaddr_un addr{};
+    if (path.size() >= sizeof(addr.sun_path)) {
+        logError("Unix socket path too long: " + path);
+        return -1;
+    }
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    int sockfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sockfd < 0) return -1;
+    if (connect(sockfd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        logError("Failed to connect to " + path + ": " + strerror(errno));
+        ::close(sockfd);
+        return -1;
+    }
+    return sockfd;
+}
+
+// Sends bytes together with descriptors (SCM_RIGHTS) over a Unix socket
+inline bool sendWithFds(int sockfd, const void* data, size_t len, const int* fds, int count) {
+    iovec iov{const_cast<void*>(data), len};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * SHM_TRANSPORT_FDS)] = {};
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * count);
+    return sendmsg(sockfd, &msg, MSG_NOSIGNAL) == (ssize_t)len;
+}
+
+// Receives up to len bytes and the descriptors sent with them (at most SHM_TRANSPORT_FDS;
+// count is set to how many arrived). Returns the bytes read, <= 0 on failure.
+inline ssize_t recvWithFds(int sockfd, void* data, size_t len, int* fds, int& count) {
+    iovec iov{data, len};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * SHM_TRANSPORT_FDS)];
+    msghdr msg{};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    count = 0;
+    ssize_t n = recvmsg(sockfd, &msg, 0);
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); n >= 0 && cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) continue;
+        int received = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        for (int i = 0; i < received; i++) {
+            int fd;
+            memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(fd));
+            if (count < SHM_TRANSPORT_FDS) fds[count++] = fd;
+            else ::close(fd);
+        }
+    }
+    return n;
+}
+
+#ifdef __linux__
+
+// Head of one direction's ring in the shared mapping. The counters only grow; the producer
+// writes head, the consumer tail. A side about to sleep sets its waiting flag, and the other
+// side only signals the eventfd when it is set, so a busy stream makes no syscalls at all.
+struct ShmRingHeader {
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+    alignas(64) std::atomic<uint32_t> readerWaiting;
+    std::atomic<uint32_t> writerWaiting;
+};
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared counters must be lock-free");
+
+#define SHM_RING_STRIDE (sizeof(ShmRingHeader) + SHM_RING_BYTES)
+#define SHM_MAPPING_BYTES (2 * SHM_RING_STRIDE)
+
+// Same-host transport: two byte rings in a memfd shared with the peer, plus eventfds to wake
+// a side sleeping on an empty or full ring. Data is copied into and out of the mapping by the
+// processes themselves, never by the kernel. The Unix socket the descriptors came over stays
+// open: it carries nothing more, but hangs up when either side leaves or shuts down.
+// Ring 0 runs from the side that created the memory to the other.
+class ShmTransport : public Transport {
+public:
+    // Takes ownership of the socket, the descriptors and the mapping
+    ShmTransport(int sockfd, const int (&fds)[SHM_TRANSPORT_FDS], uint8_t* mapping, bool creator)
+        : sockfd_(sockfd), mapping_(mapping),
+          spin_(std::thread::hardware_concurrency() > 1 ? SHM_SPIN_ITERATIONS : 0) {
+        memcpy(fds_, fds, sizeof(fds_));
+        int tx = creator ? 0 : 1;
+        tx_ = ring(tx);
+        rx_ = ring(1 - tx);
+        txData_ = tx_ + sizeof(ShmRingHeader);
+        rxData_ = rx_ + sizeof(ShmRingHeader);
+        txDataFd_ = fds_[1 + 2 * tx];
+        txSpaceFd_ = fds_[2 + 2 * tx];
+        rxDataFd_ = fds_[1 + 2 * (1 - tx)];
+        rxSpaceFd_ = fds_[2 + 2 * (1 - tx)];
+    }
+
+    ~ShmTransport() override {
+        munmap(mapping_, SHM_MAPPING_BYTES);
+        for (int fd : fds_) ::close(fd);
+        ::close(sockfd_);
+    }
+
+    bool sendAll(const void* data, size_t len) override {
+        ShmRingHeader& r = header(tx_);
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        while (len > 0) {
+            // The peer can write tail at any time: check one snapshot and size the copy from it
+            uint64_t head = r.head.load(std::memory_order_relaxed);
+            uint64_t used = head - r.tail.load(std::memory_order_acquire);
+            if (used > SHM_RING_BYTES) return false; // Corrupted by the peer
+            if (used == SHM_RING_BYTES) {
+                auto hasSpace = [&] { return head - r.tail.load(std::memory_order_acquire) != SHM_RING_BYTES; };
+                if (!waitFor(r.writerWaiting, txSpaceFd_, hasSpace)) return false;
+                continue;
+            }
+            size_t n = std::min<size_t>(len, SHM_RING_BYTES - used);
+            size_t offset = head % SHM_RING_BYTES;
+            size_t first = std::min<size_t>(n, SHM_RING_BYTES - offset);
+            memcpy(txData_ + offset, p, first);
+            memcpy(txData_, p + first, n - first);
+            r.head.store(head + n, std::memory_order_release);
+            wake(r.readerWaiting, txDataFd_);
+            p += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    bool recvAll(void* data, size_t len) override {
+        ShmRingHeader& r = header(rx_);
+        uint8_t* p = static_cast<uint8_t*>(data);
+        while (len > 0) {
+            // As in sendAll(), head comes from the peer: one snapshot, checked, sizes the copy
+            uint64_t tail = r.tail.load(std::memory_order_relaxed);
+            uint64_t ready = r.head.load(std::memory_order_acquire) - tail;
+            if (ready > SHM_RING_BYTES) return false;
+            if (ready == 0) {
+                auto hasData = [&] { return r.head.load(std::memory_order_acquire) != tail; };
+                if (!waitFor(r.readerWaiting, rxDataFd_, hasData)) return false;
+                continue;
+            }
+            size_t n = std::min<size_t>(len, ready);
+            size_t offset = tail % SHM_RING_BYTES;
+            size_t first = std::min<size_t>(n, SHM_RING_BYTES - offset);
+            memcpy(p, rxData_ + offset, first);
+            memcpy(p + first, rxData_, n - first);
+            r.tail.store(tail + n, std::memory_order_release);
+            wake(r.writerWaiting, rxSpaceFd_);
+            p += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    void shutdown() override { ::shutdown(sockfd_, SHUT_RDWR); } // Wakes sleepers on both ends
+    int fd() const override { return sockfd_; }
+    std::string describe() const override { return "shared memory"; }
+
+private:
+    uint8_t* ring(int index) const { return mapping_ + index * SHM_RING_STRIDE; }
+    static ShmRingHeader& header(uint8_t* ring) { return *reinterpret_cast<ShmRingHeader*>(ring); }
+
+    // Signals the other side if it went to sleep waiting for what was just published
+    static void wake(std::atomic<uint32_t>& waiting, int eventFd) {
+        std::atomic_thread_fence(std::memory_order_seq_cst); // Pairs with the fence in waitFor()
+        if (waiting.load(std::memory_order_relaxed)) {
+            uint64_t one = 1;
+            ssize_t ignored = write(eventFd, &one, sizeof(one));
+            (void)ignored;
+        }
+    }
+
+    // Spins briefly, then sleeps on the eventfd until ready() holds. False once the socket
+    // hung up (peer gone or shutdown()) with nothing left to do.
+    template <typename Ready>
+    bool waitFor(std::atomic<uint32_t>& waiting, int eventFd, Ready ready) {
+        for (int i = 0; i < spin_; i++) {
+            if (ready()) return true;
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+        }
+        while (true) {
+            waiting.store(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst); // The peer sees the flag or we see its update
+            if (ready()) {
+                waiting.store(0, std::memory_order_relaxed);
+                return true;
+            }
+            pollfd fds[2] = {{eventFd, POLLIN, 0}, {sockfd_, POLLIN, 0}};
+            int n = poll(fds, 2, -1);
+            waiting.store(0, std::memory_order_relaxed);
+            if (n < 0 && errno != EINTR) return false;
+            if (n > 0 && (fds[0].revents & POLLIN)) {
+                uint64_t count;
+                ssize_t ignored = read(eventFd, &count, sizeof(count));
+                (void)ignored;
+            }
+            if (ready()) return true; // Data published before a hang-up is still delivered
+            if (n > 0 && fds[1].revents) return false;
+        }
+    }
+
+    int sockfd_;
+    int fds_[SHM_TRANSPORT_FDS];
+    uint8_t* mapping_;
+    int spin_;
+    uint8_t* tx_ = nullptr;
+    uint8_t* rx_ = nullptr;
+    uint8_t* txData_ = nullptr;
+    uint8_t* rxData_ = nullptr;
+    int txDataFd_ = -1, txSpaceFd_ = -1, rxDataFd_ = -1, rxSpaceFd_ = -1;
+};
+
+// Client side: creates the shared rings and their eventfds, and sends them to the server
+// with the mode byte over sockfd (a connected Unix socket). Takes ownership of the socket;
+// nullptr on failure.
+inline std::unique_ptr<Transport> createShmTransport(int sockfd, uint8_t mode) {
+    int fds[SHM_TRANSPORT_FDS];
+    int created = 0;
+    auto fail = [&](const std::string& what) -> std::unique_ptr<Transport> {
+        logError("Shared-memory transport: " + what + ": " + strerror(errno));
+        for (int i = 0; i < created; i++) ::close(fds[i]);
+        ::close(sockfd);
+        return nullptr;
+    };
+    fds[0] = memfd_create("mini_zoom_session", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fds[0] < 0) return fail("memfd_create");
+    created = 1;
+    // Sealed at its size, so the server never maps past the end of a file the client shrank
+    if (ftruncate(fds[0], SHM_MAPPING_BYTES) < 0 ||
+        fcntl(fds[0], F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0) {
+        return fail("sizing the shared memory");
+    }
+    for (; created < SHM_TRANSPORT_FDS; created++) {
+        fds[created] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (fds[created] < 0) return fail("eventfd");
+    }
+    void* mapping = mmap(nullptr, SHM_MAPPING_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+    if (mapping == MAP_FAILED) return fail("mmap");
+    for (int i = 0; i < 2; i++) new (static_cast<uint8_t*>(mapping) + i * SHM_RING_STRIDE) ShmRingHeader{};
+    if (!sendWithFds(sockfd, &mode, sizeof(mode), fds, SHM_TRANSPORT_FDS)) {
+        munmap(mapping, SHM_MAPPING_BYTES);
+        return fail("sending the descriptors");
+    }
+    return std::unique_ptr<Transport>(new ShmTransport(sockfd, fds, static_cast<uint8_t*>(mapping), true));
+}
+
+// Server side: maps the rings a client passed over sockfd. Takes ownership of the socket and
+// the descriptors; nullptr (everything closed) if they are not what createShmTransport() sends.
+inline std::unique_ptr<Transport> attachShmTransport(int sockfd, const int (&fds)[SHM_TRANSPORT_FDS]) {
+    struct stat st{};
+    int seals = fcntl(fds[0], F_GET_SEALS);
+    void* mapping = MAP_FAILED;
+    if (fstat(fds[0], &st) == 0 && st.st_size == (off_t)SHM_MAPPING_BYTES && seals >= 0 && (seals & F_SEAL_SHRINK)) {
+        mapping = mmap(nullptr, SHM_MAPPING_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+    }
+    if (mapping == MAP_FAILED) {
+        logError("Client sent unusable shared memory.");
+        for (int fd : fds) ::close(fd);
+        ::close(sockfd);
+        return nullptr;
+    }
+    return std::unique_ptr<Transport>(new ShmTransport(sockfd, fds, static_cast<uint8_t*>(mapping), false));
+}
+
+#else
+
+inline std::unique_ptr<Transport> createShmTransport(int sockfd, uint8_t) {
+    logError("The shared-memory transport needs Linux (memfd and eventfd).");
+    ::close(sockfd);
+    return nullptr;
+}
+
+inline std::unique_ptr<Transport> attachShmTransport(int sockfd, const int (&fds)[SHM_TRANSPORT_FDS]) {
+    for (int fd : fds) ::close(fd);
+    ::close(sockfd);
+    return nullptr;
+}
+
+#endif // __linux__
+
+#endif // TRANSPORT_H
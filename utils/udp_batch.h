@@ -0,0 +1,243 @@
+#ifndef UDP_BATCH_H
+#define UDP_BATCH_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>   // For memset
+#include <cerrno>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h> // For iovec
+#include <netinet/in.h>
+#include <netinet/udp.h> // For UDP_SEGMENT
+
+#include "common_utils.h"
+
+#define UDP_BATCH_SIZE 32      // Datagrams moved per syscall
+#define UDP_GSO_MAX_SEGMENTS 64 // Kernel limit on segments per GSO send
+#define UDP_GSO_MAX_BYTES 65000 // Stay under the 64 KiB UDP payload limit per GSO send
+#define UDP_GSO_MAX_SEGMENT 1472 // Segments must fit the path MTU (Ethernet 1500 minus IPv4/UDP headers)
+
+#if defined(__linux__)
+  #define UDP_BATCH_MMSG 1
+#endif
+
+// One received datagram; data points into the batch's arena and stays valid until the next receive()
+struct UdpPacket {
+    const uint8_t* data;
+    size_t size;
+    sockaddr_in from;
+};
+
+// Receives up to UDP_BATCH_SIZE datagrams per recvmmsg() call into an arena allocated once,
+// so the receive loop does one syscall per burst and never allocates. Falls back to one
+// recvfrom() per call where recvmmsg() is not available.
+class UdpReceiveBatch {
+public:
+    explicit UdpReceiveBatch(size_t slotBytes, size_t batch = UDP_BATCH_SIZE)
+        : slotBytes_(slotBytes), arena_(slotBytes * batch), addrs_(batch), packets_(batch) {
+#if defined(UDP_BATCH_MMSG)
+        iovs_.resize(batch);
+        msgs_.resize(batch);
+        for (size_t i = 0; i < batch; i++) {
+            iovs_[i].iov_base = arena_.data() + i * slotBytes;
+            iovs_[i].iov_len = slotBytes;
+        }
+#endif
+    }
+
+    // Blocks until at least one datagram is there, then also takes whatever else is queued.
+    // Returns the number of packets, 0 if the socket was shut down, -1 on error (errno set).
+    int receive(int sockfd) {
+        count_ = 0;
+#if defined(UDP_BATCH_MMSG)
+        while (count_ == 0) {
+            for (size_t i = 0; i < msgs_.size(); i++) {
+                memset(&msgs_[i], 0, sizeof(msgs_[i]));
+                msgs_[i].msg_hdr.msg_iov = &iovs_[i];
+                msgs_[i].msg_hdr.msg_iovlen = 1;
+                msgs_[i].msg_hdr.msg_name = &addrs_[i];
+                msgs_[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            }
+            int n = recvmmsg(sockfd, msgs_.data(), (unsigned)msgs_.size(), MSG_WAITFORONE, nullptr);
+            if (n <= 0) return n;
+            for (int i = 0; i < n; i++) {
+                if (msgs_[i].msg_hdr.msg_flags & MSG_TRUNC) continue; // Larger than a slot: not ours
+                if (msgs_[i].msg_len == 0) continue;
+                packets_[count_++] = UdpPacket{arena_.data() + i * slotBytes_, msgs_[i].msg_len, addrs_[i]};
+            }
+        }
+        return (int)count_;
+#else
+        socklen_t len = sizeof(sockaddr_in);
+        ssize_t bytes = recvfrom(sockfd, arena_.data(), slotBytes_, 0, (sockaddr*)&addrs_[0], &len);
+        if (bytes <= 0) return (int)bytes;
+        packets_[count_++] = UdpPacket{arena_.data(), (size_t)bytes, addrs_[0]};
+        return 1;
+#endif
+    }
+
+    size_t count() const { return count_; }
+    const UdpPacket& packet(size_t i) const { return packets_[i]; }
+
+private:
+    size_t slotBytes_;
+    std::vector<uint8_t> arena_;
+    std::vector<sockaddr_in> addrs_;
+    std::vector<UdpPacket> packets_;
+    size_t count_ = 0;
+#if defined(UDP_BATCH_MMSG)
+    std::vector<iovec> iovs_;
+    std::vector<mmsghdr> msgs_;
+#endif
+};
+
+// Collects outgoing datagrams and sends them with as few syscalls as possible: one
+// sendmmsg() per flush and, with GSO enabled, one message per run of equal-sized datagrams
+// to the same destination (UDP_SEGMENT; the kernel splits them). Data is not copied:
+// every pointer passed to add() must stay valid until flush().
+class UdpSendBatch {
+public:
+    explicit UdpSendBatch(size_t capacity = UDP_BATCH_SIZE) : entries_(capacity) {
+#if defined(UDP_BATCH_MMSG)
+        iovs_.resize(capacity);
+        msgs_.resize(capacity);
+        controls_.resize(capacity);
+        runs_.resize(capacity);
+#endif
+    }
+
+    // Ask for UDP_SEGMENT offload; silently stays off where the kernel refuses it
+    void enableGso(bool enable) {
+#if defined(UDP_BATCH_MMSG) && defined(UDP_SEGMENT)
+        gso_ = enable;
+#else
+        (void)enable;
+#endif
+    }
+
+    bool full() const { return count_ == entries_.size(); }
+    size_t pending() const { return count_; }
+
+    // Returns false (and queues nothing) when full: flush first
+    bool add(const sockaddr_in& to, const uint8_t* data, size_t size) {
+        if (full()) return false;
+        entries_[count_++] = Entry{to, data, size};
+        return true;
+    }
+
+    // Sends everything queued. Returns the number of datagrams the kernel accepted.
+    size_t flush(int sockfd) {
+        size_t sent = 0;
+#if defined(UDP_BATCH_MMSG)
+        size_t first = 0;
+        while (first < count_) {
+            // Build messages from first on, coalescing runs for GSO
+            size_t msgCount = 0;
+            size_t next = first;
+            while (next < count_) {
+                size_t run = gso_ ? runLength(next) : 1;
+                buildMessage(msgCount++, next, run);
+                next += run;
+            }
+            int n = sendmmsg(sockfd, msgs_.data(), (unsigned)msgCount, 0);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (gso_ && (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT)) {
+                    logInfo("UDP GSO is not available here, sending datagrams one by one.");
+                    gso_ = false; // Retry the same datagrams without offload
+                    continue;
+                }
+                // Skip the datagram that failed (e.g. unreachable listener) and carry on
+                first += messageDatagrams(0);
+                continue;
+            }
+            for (int i = 0; i < n; i++) {
+                size_t datagrams = messageDatagrams(i);
+                sent += datagrams;
+                first += datagrams;
+            }
+        }
+#else
+        for (size_t i = 0; i < count_; i++) {
+            const Entry& e = entries_[i];
+            if (sendto(sockfd, e.data, e.size, 0, (const sockaddr*)&e.to, sizeof(e.to)) >= 0) sent++;
+        }
+#endif
+        count_ = 0;
+        return sent;
+    }
+
+private:
+    struct Entry {
+        sockaddr_in to;
+        const uint8_t* data;
+        size_t size;
+    };
+
+#if defined(UDP_BATCH_MMSG)
+    static bool sameDestination(const sockaddr_in& a, const sockaddr_in& b) {
+        return a.sin_addr.s_addr == b.sin_addr.s_addr && a.sin_port == b.sin_port;
+    }
+
+    // Datagrams from i on that can go out as one GSO message: same destination, same size
+    // (the kernel allows a shorter last one, but equal sizes keep it simple). Datagrams
+    // larger than a segment may be are sent on their own and left to IP fragmentation.
+    size_t runLength(size_t i) const {
+        size_t run = 1;
+        if (entries_[i].size > UDP_GSO_MAX_SEGMENT) return run;
+        while (i + run < count_ && run < UDP_GSO_MAX_SEGMENTS &&
+               (run + 1) * entries_[i].size <= UDP_GSO_MAX_BYTES &&
+               entries_[i + run].size == entries_[i].size &&
+               sameDestination(entries_[i + run].to, entries_[i].to)) {
+            run++;
+        }
+        return run;
+    }
+
+    void buildMessage(size_t m, size_t first, size_t run) {
+        for (size_t k = 0; k < run; k++) {
+            iovs_[first + k].iov_base = const_cast<uint8_t*>(entries_[first + k].data);
+            iovs_[first + k].iov_len = entries_[first + k].size;
+        }
+        msghdr& h = msgs_[m].msg_hdr;
+        memset(&msgs_[m], 0, sizeof(msgs_[m]));
+        h.msg_name = &entries_[first].to;
+        h.msg_namelen = sizeof(sockaddr_in);
+        h.msg_iov = &iovs_[first];
+        h.msg_iovlen = run;
+        runs_[m] = run;
+#if defined(UDP_SEGMENT)
+        if (run > 1) {
+            h.msg_control = controls_[m].buf;
+            h.msg_controllen = sizeof(controls_[m].buf);
+            cmsghdr* cm = CMSG_FIRSTHDR(&h);
+            cm->cmsg_level = SOL_UDP;
+            cm->cmsg_type = UDP_SEGMENT;
+            cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t segment = (uint16_t)entries_[first].size;
+            memcpy(CMSG_DATA(cm), &segment, sizeof(segment));
+        }
+#endif
+    }
+
+    size_t messageDatagrams(size_t m) const { return runs_[m]; }
+
+    union Control {
+        char buf[CMSG_SPACE(sizeof(uint16_t))];
+        cmsghdr align;
+    };
+
+    std::vector<iovec> iovs_;
+    std::vector<mmsghdr> msgs_;
+    std::vector<Control> controls_;
+    std::vector<size_t> runs_; // Datagrams carried by each message of the current sendmmsg()
+#endif
+
+    std::vector<Entry> entries_;
+    size_t count_ = 0;
+    bool gso_ = false;
+};
+
+#endif // UDP_BATCH_H
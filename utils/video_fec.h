@@ -0,0 +1,173 @@
+#ifndef VIDEO_FEC_H
+#define VIDEO_FEC_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring> // For memcpy
+#include <vector>
+#include <algorithm> // For std::min
+
+#include "wire_schema.h" // For WireSchema, encodeWire, decodeWire
+
+// UDP video transport: every frame is cut into MTU-sized data fragments, and each
+// group of VIDEO_FEC_GROUP data fragments is followed by one XOR parity fragment,
+// so any single loss inside a group can be rebuilt without a retransmission.
+//
+// Datagram: uint32 frame seq, uint32 frame size, uint16 index, uint16 data fragment count,
+// uint8 flags, uint8 group size, uint16 payload length, payload.
+// For parity fragments the index is the group number.
+
+#define VIDEO_UDP_PAYLOAD 1200 // Keeps datagrams under a 1280-byte path MTU
+#define VIDEO_FEC_GROUP 8
+#define VIDEO_FRAG_HEADER_SIZE 16
+#define VIDEO_FRAG_PARITY 0x1
+#define VIDEO_UDP_MAX_FRAME (8 * 1024 * 1024)
+
+struct VideoFragmentHeader {
+    uint32_t frameSeq;
+    uint32_t frameSize;
+    uint16_t index;
+    uint16_t count;
+    uint8_t flags;
+    uint8_t groupSize;
+    uint16_t payloadLen;
+};
+
+template <>
+struct WireSchema<VideoFragmentHeader> {
+    static constexpr auto fields = std::make_tuple(&VideoFragmentHeader::frameSeq, &VideoFragmentHeader::frameSize,
+                                                   &VideoFragmentHeader::index, &VideoFragmentHeader::count,
+                                                   &VideoFragmentHeader::flags, &VideoFragmentHeader::groupSize,
+                                                   &VideoFragmentHeader::payloadLen);
+};
+static_assert(wireSize<VideoFragmentHeader>() == VIDEO_FRAG_HEADER_SIZE, "Video fragment header layout");
+
+inline void putVideoFragmentHeader(std::vector<uint8_t>& out, const VideoFragmentHeader& h) {
+    size_t pos = out.size();
+    out.resize(pos + VIDEO_FRAG_HEADER_SIZE);
+    encodeWire(h, out.data() + pos);
+}
+
+inline bool parseVideoFragmentHeader(const uint8_t* data, size_t len, VideoFragmentHeader& h) {
+    if (len < VIDEO_FRAG_HEADER_SIZE) return false;
+    decodeWire(data, h);
+    if (h.payloadLen != len - VIDEO_FRAG_HEADER_SIZE || h.payloadLen > VIDEO_UDP_PAYLOAD) return false;
+    if (h.count == 0 || h.groupSize == 0) return false;
+    if (h.frameSize > VIDEO_UDP_MAX_FRAME) return false;
+    if ((size_t)h.count * VIDEO_UDP_PAYLOAD < h.frameSize) return false;
+    if ((size_t)(h.count - 1) * VIDEO_UDP_PAYLOAD > h.frameSize) return false;
+    if (h.flags & VIDEO_FRAG_PARITY) return h.index < (h.count + h.groupSize - 1) / h.groupSize;
+    return h.index < h.count;
+}
+
+// Size of data fragment i of a frame
+inline size_t videoFragmentLength(uint32_t frameSize, uint16_t index) {
+    size_t start = (size_t)index * VIDEO_UDP_PAYLOAD;
+    return std::min((size_t)VIDEO_UDP_PAYLOAD, frameSize - start);
+}
+
+// Splits one wire frame into datagrams (data fragments with interleaved parity)
+inline void fragmentVideoFrame(uint32_t seq, const uint8_t* data, size_t size,
+                               std::vector<std::vector<uint8_t>>& datagrams) {
+    datagrams.clear();
+    uint16_t count = (uint16_t)((size + VIDEO_UDP_PAYLOAD - 1) / VIDEO_UDP_PAYLOAD);
+    if (count == 0) count = 1;
+
+    std::vector<uint8_t> parity;
+    for (uint16_t i = 0; i < count; i++) {
+        size_t len = size ? videoFragmentLength((uint32_t)size, i) : 0;
+        const uint8_t* payload = data + (size_t)i * VIDEO_UDP_PAYLOAD;
+
+        std::vector<uint8_t> dgram;
+        dgram.reserve(VIDEO_FRAG_HEADER_SIZE + len);
+        putVideoFragmentHeader(dgram, {seq, (uint32_t)size, i, count, 0, VIDEO_FEC_GROUP, (uint16_t)len});
+        dgram.insert(dgram.end(), payload, payload + len);
+        datagrams.push_back(std::move(dgram));
+
+        // Parity = XOR of the group's payloads, zero-padded to the longest one
+        if (i % VIDEO_FEC_GROUP == 0) parity.assign(len, 0);
+        for (size_t b = 0; b < len; b++) parity[b] ^= payload[b];
+
+        bool groupEnd = (i % VIDEO_FEC_GROUP == VIDEO_FEC_GROUP - 1) || i == count - 1;
+        if (groupEnd) {
+            std::vector<uint8_t> pgram;
+            pgram.reserve(VIDEO_FRAG_HEADER_SIZE + parity.size());
+            putVideoFragmentHeader(pgram, {seq, (uint32_t)size, (uint16_t)(i / VIDEO_FEC_GROUP), count,
+                                           VIDEO_FRAG_PARITY, VIDEO_FEC_GROUP, (uint16_t)parity.size()});
+            pgram.insert(pgram.end(), parity.begin(), parity.end());
+            datagrams.push_back(std::move(pgram));
+        }
+    }
+}
+
+// Collects the fragments of one frame and rebuilds single losses per group from parity
+class VideoFrameAssembly {
+public:
+    explicit VideoFrameAssembly(const VideoFragmentHeader& h)
+        : frameSize_(h.frameSize), count_(h.count), groupSize_(h.groupSize),
+          data_(h.frameSize), have_(h.count, false),
+          parity_((h.count + h.groupSize - 1) / h.groupSize) {}
+
+    bool complete() const { return received_ == count_; }
+    uint32_t recovered() const { return recovered_; }
+    const std::vector<uint8_t>& data() const { return data_; }
+
+    void add(const VideoFragmentHeader& h, const uint8_t* payload) {
+        if (h.frameSize != frameSize_ || h.count != count_ || h.groupSize != groupSize_) return;
+
+        uint16_t group;
+        if (h.flags & VIDEO_FRAG_PARITY) {
+            group = h.index;
+            if (!parity_[group].empty()) return;
+            parity_[group].assign(payload, payload + h.payloadLen);
+        } else {
+            if (have_[h.index] || h.payloadLen != videoFragmentLength(frameSize_, h.index)) return;
+            memcpy(data_.data() + (size_t)h.index * VIDEO_UDP_PAYLOAD, payload, h.payloadLen);
+            have_[h.index] = true;
+            received_++;
+            group = h.index / groupSize_;
+        }
+        tryRecover(group);
+    }
+
+private:
+    void tryRecover(uint16_t group) {
+        const std::vector<uint8_t>& parity = parity_[group];
+        if (parity.empty()) return;
+
+        uint16_t first = group * groupSize_;
+        uint16_t last = std::min<uint16_t>(count_, first + groupSize_);
+        int missing = -1;
+        for (uint16_t i = first; i < last; i++) {
+            if (have_[i]) continue;
+            if (missing >= 0) return; // Two or more losses: XOR cannot help
+            missing = i;
+        }
+        if (missing < 0) return;
+
+        size_t len = videoFragmentLength(frameSize_, (uint16_t)missing);
+        if (parity.size() < len) return;
+        uint8_t* out = data_.data() + (size_t)missing * VIDEO_UDP_PAYLOAD;
+        memcpy(out, parity.data(), len);
+        for (uint16_t i = first; i < last; i++) {
+            if (i == missing) continue;
+            const uint8_t* src = data_.data() + (size_t)i * VIDEO_UDP_PAYLOAD;
+            size_t n = std::min(len, videoFragmentLength(frameSize_, i));
+            for (size_t b = 0; b < n; b++) out[b] ^= src[b];
+        }
+        have_[missing] = true;
+        received_++;
+        recovered_++;
+    }
+
+    uint32_t frameSize_;
+    uint16_t count_;
+    uint8_t groupSize_;
+    std::vector<uint8_t> data_;
+    std::vector<bool> have_;
+    std::vector<std::vector<uint8_t>> parity_;
+    uint16_t received_ = 0;
+    uint32_t recovered_ = 0;
+};
+
+#endif // VIDEO_FEC_H
@@ -0,0 +1,214 @@
+#ifndef VIDEO_PROTOCOL_H
+#define VIDEO_PROTOCOL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <chrono>
+
+#include "wire_schema.h" // For WireSchema, encodeWire, decodeWire
+
+// Wire definitions shared by the video client and server.
+// Client -> server: VideoStreamHeader (uint32 frame size) + frame bytes (size 0 ends the stream).
+// With MODE_VIDEO_UDP the frames travel as UDP fragments instead (see video_fec.h)
+// and the TCP connection only carries VideoUdpAnnounce and the end signal.
+// Server -> client: periodic VideoFeedback reports on the TCP connection.
+//
+// Frame bytes: VideoFrameHeader (uint8 type, uint16 width, uint16 height, uint16 patch count,
+// uint32 sequence number, int64 capture / encode-done / send timestamps), then per patch
+// VideoPatchHeader (uint16 x, y, w, h, uint32 JPEG length) and the JPEG bytes.
+// Timestamps are wall-clock microseconds (videoClockUs), so latencies across
+// machines are only meaningful when their clocks are synchronised (e.g. NTP).
+// A keyframe covers the whole picture; a delta frame only carries the changed
+// regions, which the receiver pastes onto its reference frame.
+
+#define VIDEO_FRAME_KEY   1
+#define VIDEO_FRAME_DELTA 2
+
+#define VIDEO_FRAME_HEADER_SIZE 35
+#define VIDEO_PATCH_HEADER_SIZE 12
+
+// Byte offsets of the header fields after width and height
+#define VIDEO_FRAME_COUNT_OFFSET   5
+#define VIDEO_FRAME_SEQ_OFFSET     7
+#define VIDEO_FRAME_CAPTURE_OFFSET 11
+#define VIDEO_FRAME_ENCODE_OFFSET 19
+#define VIDEO_FRAME_SEND_OFFSET   27
+
+// Legacy TCP stream (MODE_VIDEO): precedes every frame
+struct VideoStreamHeader {
+    uint32_t frameSize; // 0 ends the stream
+};
+
+template <>
+struct WireSchema<VideoStreamHeader> {
+    static constexpr auto fields = std::make_tuple(&VideoStreamHeader::frameSize);
+};
+
+// MODE_VIDEO_UDP: the server's answer to the mode byte
+struct VideoUdpAnnounce {
+    uint16_t port; // UDP port the frames go to
+};
+
+template <>
+struct WireSchema<VideoUdpAnnounce> {
+    static constexpr auto fields = std::make_tuple(&VideoUdpAnnounce::port);
+};
+
+struct VideoFrameHeader {
+    uint8_t type;
+    uint16_t width, height;
+    uint16_t patchCount;
+    uint32_t seq;
+    int64_t captureUs, encodeUs, sendUs;
+};
+
+template <>
+struct WireSchema<VideoFrameHeader> {
+    static constexpr auto fields = std::make_tuple(&VideoFrameHeader::type, &VideoFrameHeader::width, &VideoFrameHeader::height,
+                                                   &VideoFrameHeader::patchCount, &VideoFrameHeader::seq, &VideoFrameHeader::captureUs,
+                                                   &VideoFrameHeader::encodeUs, &VideoFrameHeader::sendUs);
+};
+static_assert(wireSize<VideoFrameHeader>() == VIDEO_FRAME_HEADER_SIZE, "Video frame header layout");
+static_assert(wireOffset<&VideoFrameHeader::patchCount>() == VIDEO_FRAME_COUNT_OFFSET &&
+              wireOffset<&VideoFrameHeader::seq>() == VIDEO_FRAME_SEQ_OFFSET &&
+              wireOffset<&VideoFrameHeader::captureUs>() == VIDEO_FRAME_CAPTURE_OFFSET &&
+              wireOffset<&VideoFrameHeader::encodeUs>() == VIDEO_FRAME_ENCODE_OFFSET &&
+              wireOffset<&VideoFrameHeader::sendUs>() == VIDEO_FRAME_SEND_OFFSET, "Video frame header offsets");
+
+struct VideoPatchHeader {
+    uint16_t x, y, w, h;
+    uint32_t size; // JPEG bytes following
+};
+
+template <>
+struct WireSchema<VideoPatchHeader> {
+    static constexpr auto fields = std::make_tuple(&VideoPatchHeader::x, &VideoPatchHeader::y, &VideoPatchHeader::w,
+                                                   &VideoPatchHeader::h, &VideoPatchHeader::size);
+};
+static_assert(wireSize<VideoPatchHeader>() == VIDEO_PATCH_HEADER_SIZE, "Video patch header layout");
+
+struct VideoPatch {
+    uint16_t x, y, w, h;
+    const uint8_t* data; // Points into the received frame buffer
+    uint32_t size;
+};
+
+struct VideoFrameInfo {
+    uint8_t type;
+    uint16_t width, height;
+    uint32_t seq;
+    int64_t captureUs, encodeUs, sendUs;
+    std::vector<VideoPatch> patches;
+};
+
+// Clock used for all frame timestamps
+inline int64_t videoClockUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+inline uint64_t getU64(const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) v = (v << 8) | p[i];
+    return v;
+}
+
+// Overwrites a big-endian 64-bit field of an already built frame
+inline void setU64At(uint8_t* p, uint64_t v) {
+    for (int i = 7; i >= 0; i--) {
+        p[i] = (uint8_t)v;
+        v >>= 8;
+    }
+}
+
+// Starts a frame; the patch count and the encode and send timestamps are filled in later
+inline void beginVideoFrame(std::vector<uint8_t>& out, uint8_t type, uint16_t width, uint16_t height,
+                            uint32_t seq, int64_t captureUs) {
+    out.resize(VIDEO_FRAME_HEADER_SIZE);
+    encodeWire(VideoFrameHeader{type, width, height, 0, seq, captureUs, 0, 0}, out.data()); // From wire_schema.h
+}
+
+inline void setVideoPatchCount(std::vector<uint8_t>& out, uint16_t count) {
+    out[VIDEO_FRAME_COUNT_OFFSET] = (uint8_t)(count >> 8);
+    out[VIDEO_FRAME_COUNT_OFFSET + 1] = (uint8_t)count;
+}
+
+inline void setVideoEncodeTime(std::vector<uint8_t>& out, int64_t us) {
+    setU64At(out.data() + VIDEO_FRAME_ENCODE_OFFSET, (uint64_t)us);
+}
+
+// Stamped by the network stage right before the frame goes out
+inline void setVideoSendTime(std::vector<uint8_t>& out, int64_t us) {
+    setU64At(out.data() + VIDEO_FRAME_SEND_OFFSET, (uint64_t)us);
+}
+
+// Moves all sender timestamps of a frame by the same amount, keeping the stage durations
+inline void shiftVideoFrameTimes(std::vector<uint8_t>& frame, int64_t deltaUs) {
+    if (frame.size() < VIDEO_FRAME_HEADER_SIZE) return;
+    for (size_t offset = VIDEO_FRAME_CAPTURE_OFFSET; offset <= VIDEO_FRAME_SEND_OFFSET; offset += 8) {
+        uint8_t* p = frame.data() + offset;
+        setU64At(p, getU64(p) + (uint64_t)deltaUs);
+    }
+}
+
+inline void appendVideoPatch(std::vector<uint8_t>& out, uint16_t x, uint16_t y, uint16_t w, uint16_t h,
+                             const std::vector<uint8_t>& jpeg) {
+    size_t pos = out.size();
+    out.resize(pos + VIDEO_PATCH_HEADER_SIZE);
+    encodeWire(VideoPatchHeader{x, y, w, h, (uint32_t)jpeg.size()}, out.data() + pos);
+    out.insert(out.end(), jpeg.begin(), jpeg.end());
+}
+
+// Validates the layout and bounds of a received frame; patches point into data
+inline bool parseVideoFrame(const uint8_t* data, size_t len, VideoFrameInfo& out) {
+    if (len < VIDEO_FRAME_HEADER_SIZE) return false;
+    VideoFrameHeader h;
+    decodeWire(data, h);
+    out.type = h.type;
+    out.width = h.width;
+    out.height = h.height;
+    out.seq = h.seq;
+    out.captureUs = h.captureUs;
+    out.encodeUs = h.encodeUs;
+    out.sendUs = h.sendUs;
+    if (out.type != VIDEO_FRAME_KEY && out.type != VIDEO_FRAME_DELTA) return false;
+
+    out.patches.clear();
+    size_t pos = VIDEO_FRAME_HEADER_SIZE;
+    for (uint16_t i = 0; i < h.patchCount; i++) {
+        if (len - pos < VIDEO_PATCH_HEADER_SIZE) return false;
+        VideoPatchHeader ph;
+        decodeWire(data + pos, ph);
+        pos += VIDEO_PATCH_HEADER_SIZE;
+        if (ph.size > len - pos) return false;
+        if (ph.w == 0 || ph.h == 0 || (uint32_t)ph.x + ph.w > out.width || (uint32_t)ph.y + ph.h > out.height) return false;
+        out.patches.push_back(VideoPatch{ph.x, ph.y, ph.w, ph.h, data + pos, ph.size});
+        pos += ph.size;
+    }
+    return pos == len;
+}
+
+#define VIDEO_FEEDBACK_INTERVAL_MS 250
+
+// VideoFeedback flags
+#define VIDEO_FEEDBACK_KEYFRAME 0x1 // Receiver lost its reference and needs a keyframe
+
+// Receiver feedback, server to client once per VIDEO_FEEDBACK_INTERVAL_MS
+struct VideoFeedback {
+    uint32_t framesReceived; // Frames received during the interval
+    uint32_t bytesReceived;  // Payload bytes received during the interval
+    uint32_t framesDropped;  // Frames dropped or lost before display during the interval
+    uint32_t intervalMs;     // Length of the interval
+    uint32_t flags;          // VIDEO_FEEDBACK_* bits
+};
+
+template <>
+struct WireSchema<VideoFeedback> {
+    static constexpr auto fields = std::make_tuple(&VideoFeedback::framesReceived, &VideoFeedback::bytesReceived,
+                                                   &VideoFeedback::framesDropped, &VideoFeedback::intervalMs,
+                                                   &VideoFeedback::flags);
+};
+static_assert(wireSize<VideoFeedback>() == 20, "VideoFeedback layout");
+
+#endif // VIDEO_PROTOCOL_H
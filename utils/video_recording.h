@@ -0,0 +1,109 @@
+#ifndef VIDEO_RECORDING_H
+#define VIDEO_RECORDING_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdio>    // For snprintf
+#include <algorithm> // For std::upper_bound
+#include <utility>   // For std::swap
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// On-disk layout of recorded video sessions.
+// A session is a series of segments <prefix>_0000.mzv/.idx, <prefix>_0001.mzv/.idx, ...
+// The .mzv file holds the wire frames exactly as received (no re-encoding), back to back.
+// The .idx file is a VideoIndexHeader followed by one VideoIndexEntry per frame; it is
+// written through a memory mapping, so it uses host byte order and is meant to be read
+// back on the same kind of machine. Every segment starts with a keyframe.
+
+#define VIDEO_REC_MAGIC 0x4D5A5649u // "MZVI"
+#define VIDEO_REC_VERSION 2 // 2: frames carry the sequence/timestamp header
+#define VIDEO_REC_INDEX_CAPACITY 65536                   // Entries per segment (~36 min at 30 FPS)
+#define VIDEO_REC_SEGMENT_BYTES (512ull * 1024 * 1024)   // Data size after which a segment rotates
+
+#define VIDEO_INDEX_KEYFRAME 0x1
+
+struct VideoIndexHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t count;       // Number of valid entries
+    int64_t startUnixUs;  // Wall clock time of the session start
+};
+
+struct VideoIndexEntry {
+    int64_t timestampUs; // Since the session start
+    uint64_t offset;     // Into the segment's .mzv file
+    uint32_t size;
+    uint32_t flags;      // VIDEO_INDEX_* bits
+};
+
+inline std::string videoSegmentPath(const std::string& prefix, int segment, const char* ext) {
+    char suffix[16];
+    snprintf(suffix, sizeof(suffix), "_%04d", segment);
+    return prefix + suffix + ext;
+}
+
+// Read-only view of one segment index
+class VideoIndexReader {
+public:
+    VideoIndexReader() = default;
+    VideoIndexReader(const VideoIndexReader&) = delete;
+    VideoIndexReader& operator=(const VideoIndexReader&) = delete;
+    VideoIndexReader(VideoIndexReader&& other) noexcept { *this = std::move(other); }
+    VideoIndexReader& operator=(VideoIndexReader&& other) noexcept {
+        std::swap(map_, other.map_);
+        std::swap(mapSize_, other.mapSize_);
+        std::swap(header_, other.header_);
+        std::swap(entries_, other.entries_);
+        return *this;
+    }
+    ~VideoIndexReader() {
+        if (map_) munmap(map_, mapSize_);
+    }
+
+    bool open(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        bool ok = fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(VideoIndexHeader);
+        if (ok) {
+            mapSize_ = (size_t)st.st_size;
+            map_ = mmap(nullptr, mapSize_, PROT_READ, MAP_SHARED, fd, 0);
+            ok = map_ != MAP_FAILED;
+            if (!ok) map_ = nullptr;
+        }
+        ::close(fd);
+        if (!ok) return false;
+
+        header_ = static_cast<const VideoIndexHeader*>(map_);
+        entries_ = reinterpret_cast<const VideoIndexEntry*>(header_ + 1);
+        size_t fits = (mapSize_ - sizeof(VideoIndexHeader)) / sizeof(VideoIndexEntry);
+        return header_->magic == VIDEO_REC_MAGIC && header_->version == VIDEO_REC_VERSION && header_->count <= fits;
+    }
+
+    size_t count() const { return header_ ? (size_t)header_->count : 0; }
+    const VideoIndexEntry& entry(size_t i) const { return entries_[i]; }
+    int64_t startUnixUs() const { return header_->startUnixUs; }
+
+    // Index of the keyframe at or before the given timestamp, in O(log n) plus the
+    // walk back to the keyframe. Returns 0 for timestamps before the first frame.
+    size_t seek(int64_t timestampUs) const {
+        const VideoIndexEntry* end = entries_ + count();
+        const VideoIndexEntry* it = std::upper_bound(entries_, end, timestampUs,
+            [](int64_t ts, const VideoIndexEntry& e) { return ts < e.timestampUs; });
+        size_t i = it == entries_ ? 0 : (size_t)(it - entries_) - 1;
+        while (i > 0 && !(entries_[i].flags & VIDEO_INDEX_KEYFRAME)) i--;
+        return i;
+    }
+
+private:
+    void* map_ = nullptr;
+    size_t mapSize_ = 0;
+    const VideoIndexHeader* header_ = nullptr;
+    const VideoIndexEntry* entries_ = nullptr;
+};
+
+#endif // VIDEO_RECORDING_H
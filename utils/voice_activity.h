@@ -0,0 +1,159 @@
+#ifndef VOICE_ACTIVITY_H
+#define VOICE_ACTIVITY_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath> // For log10, pow
+
+#if defined(__x86_64__) || defined(__i386__)
+  #include <immintrin.h>
+  #define VOICE_ACTIVITY_X86 1
+#elif defined(__ARM_NEON)
+  #include <arm_neon.h>
+  #define VOICE_ACTIVITY_NEON 1
+#endif
+
+#define VAD_SPEECH_MARGIN_DB 10.0  // Energy above the noise floor that counts as speech
+#define VAD_UNVOICED_MARGIN_DB 5.0 // Quieter frames still count if they cross zero often (s, f, sh)
+#define VAD_UNVOICED_ZCR 0.25      // Zero crossings per sample typical of unvoiced consonants
+#define VAD_MIN_SPEECH_DB -55.0    // Never speech below this level (dBov)
+#define VAD_HANGOVER_FRAMES 15     // Frames still sent after speech ends, so word endings survive
+#define VAD_FLOOR_START_DB -60.0
+#define VAD_FLOOR_RISE 0.02        // Floor tracking speed when the background gets louder
+#define VAD_FLOOR_RISE_SPEECH 0.005 // Slower during speech, so steady noise is not taken for talking forever
+
+// Energy and zero-crossing measurement of one frame
+struct VoiceFrameFeatures {
+    uint64_t energy = 0;     // Sum of squared samples
+    uint32_t crossings = 0;  // Sign changes between neighbouring samples
+};
+
+inline VoiceFrameFeatures voiceFeaturesScalar(const int16_t* x, size_t n, size_t start = 0) {
+    VoiceFrameFeatures f;
+    for (size_t i = start; i < n; i++) {
+        f.energy += (uint64_t)((int32_t)x[i] * x[i]);
+        if (i > 0 && ((x[i] < 0) != (x[i - 1] < 0))) f.crossings++;
+    }
+    return f;
+}
+
+#if defined(VOICE_ACTIVITY_X86)
+inline VoiceFrameFeatures voiceFeaturesSse2(const int16_t* x, size_t n) {
+    VoiceFrameFeatures f;
+    if (n < 9) return voiceFeaturesScalar(x, n);
+    __m128i energy = _mm_setzero_si128();
+    __m128i zero = _mm_setzero_si128();
+    uint32_t crossings = 0;
+    size_t i = 1;
+    for (; i + 8 <= n; i += 8) {
+        __m128i cur = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i));
+        __m128i prev = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i - 1));
+        // pmaddwd: pairs of squares; at most 2^31 each, so widen as unsigned before adding
+        __m128i sq = _mm_madd_epi16(cur, cur);
+        energy = _mm_add_epi64(energy, _mm_unpacklo_epi32(sq, zero));
+        energy = _mm_add_epi64(energy, _mm_unpackhi_epi32(sq, zero));
+        __m128i signChange = _mm_xor_si128(_mm_cmplt_epi16(cur, zero), _mm_cmplt_epi16(prev, zero));
+        crossings += __builtin_popcount(_mm_movemask_epi8(signChange)) / 2;
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), energy);
+    VoiceFrameFeatures rest = voiceFeaturesScalar(x, n, i);
+    f.energy = lanes[0] + lanes[1] + rest.energy + (uint64_t)((int32_t)x[0] * x[0]);
+    f.crossings = crossings + rest.crossings;
+    return f;
+}
+#endif
+
+#if defined(VOICE_ACTIVITY_NEON)
+inline VoiceFrameFeatures voiceFeaturesNeon(const int16_t* x, size_t n) {
+    VoiceFrameFeatures f;
+    if (n < 9) return voiceFeaturesScalar(x, n);
+    uint64x2_t energy = vdupq_n_u64(0);
+    uint32_t crossings = 0;
+    size_t i = 1;
+    for (; i + 8 <= n; i += 8) {
+        int16x8_t cur = vld1q_s16(x + i);
+        int16x8_t prev = vld1q_s16(x + i - 1);
+        int32x4_t lo = vmull_s16(vget_low_s16(cur), vget_low_s16(cur));
+        int32x4_t hi = vmull_s16(vget_high_s16(cur), vget_high_s16(cur));
+        energy = vpadalq_u32(energy, vreinterpretq_u32_s32(lo));
+        energy = vpadalq_u32(energy, vreinterpretq_u32_s32(hi));
+        uint16x8_t signChange = veorq_u16(vcltzq_s16(cur), vcltzq_s16(prev));
+        crossings += vaddvq_u16(vshrq_n_u16(signChange, 15));
+    }
+    VoiceFrameFeatures rest = voiceFeaturesScalar(x, n, i);
+    f.energy = vaddvq_u64(energy) + rest.energy + (uint64_t)((int32_t)x[0] * x[0]);
+    f.crossings = crossings + rest.crossings;
+    return f;
+}
+#endif
+
+inline VoiceFrameFeatures voiceFeatures(const int16_t* x, size_t n) {
+#if defined(VOICE_ACTIVITY_X86)
+    return voiceFeaturesSse2(x, n);
+#elif defined(VOICE_ACTIVITY_NEON)
+    return voiceFeaturesNeon(x, n);
+#else
+    return voiceFeaturesScalar(x, n);
+#endif
+}
+
+// Speech/silence decision per frame. The noise floor follows the background: it drops at
+// once to quieter frames and rises slowly otherwise (slower still during speech), so a fan
+// or hum soon stops counting as talking. A hangover keeps short pauses and trailing consonants.
+class VoiceActivityDetector {
+public:
+    // Returns true if the frame should be sent
+    bool process(const int16_t* samples, size_t n) {
+        VoiceFrameFeatures f = voiceFeatures(samples, n);
+        double meanSquare = n ? (double)f.energy / n : 0.0;
+        levelDb_ = meanSquare > 0 ? 10.0 * std::log10(meanSquare / (32768.0 * 32768.0)) : -96.0;
+        double zcr = n > 1 ? (double)f.crossings / (n - 1) : 0.0;
+
+        bool speech = levelDb_ > VAD_MIN_SPEECH_DB &&
+                      (levelDb_ > floorDb_ + VAD_SPEECH_MARGIN_DB ||
+                       (levelDb_ > floorDb_ + VAD_UNVOICED_MARGIN_DB && zcr > VAD_UNVOICED_ZCR));
+        if (levelDb_ < floorDb_) {
+            floorDb_ = levelDb_;
+        } else {
+            floorDb_ += (levelDb_ - floorDb_) * (speech ? VAD_FLOOR_RISE_SPEECH : VAD_FLOOR_RISE);
+        }
+
+        if (speech) {
+            hangover_ = VAD_HANGOVER_FRAMES;
+            return true;
+        }
+        if (hangover_ > 0) {
+            hangover_--;
+            return true;
+        }
+        return false;
+    }
+
+    // Background level for comfort noise, in -dBov as carried by CN packets (0-127)
+    uint8_t noiseLevel() const {
+        double level = -floorDb_;
+        return (uint8_t)(level < 0 ? 0 : level > 127 ? 127 : level + 0.5);
+    }
+
+    double levelDb() const { return levelDb_; }
+
+private:
+    double floorDb_ = VAD_FLOOR_START_DB;
+    double levelDb_ = -96.0;
+    int hangover_ = 0;
+};
+
+// White noise at a CN level (-dBov), standing in for a silent speaker's background.
+// state carries the generator between calls.
+inline void generateComfortNoise(uint8_t level, uint32_t& state, int16_t* out, size_t n) {
+    // Uniform noise in [-a, a] has an RMS of a / sqrt(3)
+    double amplitude = 32768.0 * std::pow(10.0, -level / 20.0) * 1.7320508;
+    int32_t scale = (int32_t)(amplitude < 32767.0 ? amplitude : 32767.0);
+    for (size_t i = 0; i < n; i++) {
+        state = state * 1664525u + 1013904223u; // LCG: plenty for noise, no allocation or locking
+        out[i] = (int16_t)(((int64_t)(int32_t)state * scale) >> 31);
+    }
+}
+
+#endif // VOICE_ACTIVITY_H
@@ -0,0 +1,233 @@
+#ifndef VOICE_CODEC_H
+#define VOICE_CODEC_H
+
+#include <vector>
+#include <string>
+#include <cstring>   // For memcpy
+#include <cstdint>
+#include <algorithm> // For std::min, std::max
+#ifdef MINI_ZOOM_OPUS
+#include <opus/opus.h>
+#endif
+
+#include "common_utils.h"
+#include "voice_protocol.h"      // For VOICE_PAYLOAD_*, VOICE_FRAME_SAMPLES
+#include "voice_jitter_buffer.h" // For VoiceFrame
+#include "voice_concealment.h"   // For VoiceConcealer
+
+// Opus is optional: build with -DMINI_ZOOM_OPUS and link -lopus to enable it.
+#define VOICE_OPUS_DEFAULT_BITRATE 24000 // Wideband speech, well above the FEC threshold
+#define VOICE_OPUS_MIN_BITRATE 6000
+#define VOICE_OPUS_MAX_BITRATE 128000
+#define VOICE_OPUS_LOSS_PERCENT 10       // Loss the encoder budgets in-band FEC for
+#define VOICE_MAX_PAYLOAD (VOICE_FRAME_SAMPLES * 2) // Largest payload (PCM) in bytes
+#define VOICE_PCMU_DECIMATION 6                     // 48 kHz down to 8 kHz for redundant copies
+#define VOICE_PCMU_SAMPLES (VOICE_FRAME_SAMPLES / VOICE_PCMU_DECIMATION)
+
+#define VOICE_CODEC_BIT(payloadType) (1u << (payloadType))
+
+// Payload types this build can encode and decode, as an OFFER bitmask
+inline uint8_t voiceSupportedCodecs() {
+#ifdef MINI_ZOOM_OPUS
+    return VOICE_CODEC_BIT(VOICE_PAYLOAD_PCM16) | VOICE_CODEC_BIT(VOICE_PAYLOAD_OPUS);
+#else
+    return VOICE_CODEC_BIT(VOICE_PAYLOAD_PCM16);
+#endif
+}
+
+inline std::string voiceCodecName(uint8_t payloadType) {
+    return payloadType == VOICE_PAYLOAD_OPUS ? "Opus" : "PCM";
+}
+
+inline uint32_t clampVoiceBitrate(uint32_t bitrate) {
+    return std::min<uint32_t>(std::max<uint32_t>(bitrate, VOICE_OPUS_MIN_BITRATE), VOICE_OPUS_MAX_BITRATE);
+}
+
+// G.711 mu-law: 14-bit range in 8 bits, logarithmic like hearing
+inline uint8_t linearToMulaw(int16_t sample) {
+    const int bias = 0x84;
+    int sign = sample < 0 ? 0x80 : 0;
+    int magnitude = std::min(sample < 0 ? -(int)sample : (int)sample, 32635) + bias;
+    int exponent = 7;
+    for (int mask = 0x4000; exponent > 0 && !(magnitude & mask); mask >>= 1) exponent--;
+    int mantissa = (magnitude >> (exponent + 3)) & 0x0F;
+    return (uint8_t)~(sign | (exponent << 4) | mantissa);
+}
+
+inline int16_t mulawToLinear(uint8_t code) {
+    code = ~code;
+    int magnitude = ((((code & 0x0F) << 3) + 0x84) << ((code >> 4) & 0x07)) - 0x84;
+    return (int16_t)((code & 0x80) ? -magnitude : magnitude);
+}
+
+// Low-quality copy of a PCM frame for RED: 8 kHz mu-law, a twelfth of the size. Each
+// sample averages six input samples, a crude low-pass that keeps speech intelligible.
+inline size_t encodePcmuFrame(const int16_t* pcm, uint8_t* out) {
+    for (size_t i = 0; i < VOICE_PCMU_SAMPLES; i++) {
+        int32_t sum = 0;
+        for (size_t k = 0; k < VOICE_PCMU_DECIMATION; k++) sum += pcm[i * VOICE_PCMU_DECIMATION + k];
+        out[i] = linearToMulaw((int16_t)(sum / VOICE_PCMU_DECIMATION));
+    }
+    return VOICE_PCMU_SAMPLES;
+}
+
+// Back to 48 kHz by linear interpolation
+inline void decodePcmuFrame(const uint8_t* in, size_t len, int16_t* out) {
+    size_t n = std::min<size_t>(len, VOICE_PCMU_SAMPLES);
+    for (size_t i = 0; i < VOICE_PCMU_SAMPLES; i++) {
+        int32_t a = i < n ? mulawToLinear(in[i]) : 0;
+        int32_t b = i + 1 < n ? mulawToLinear(in[i + 1]) : a;
+        for (size_t k = 0; k < VOICE_PCMU_DECIMATION; k++) {
+            out[i * VOICE_PCMU_DECIMATION + k] = (int16_t)(a + (b - a) * (int32_t)k / VOICE_PCMU_DECIMATION);
+        }
+    }
+}
+
+// Turns one VOICE_FRAME_SAMPLES frame of microphone samples into a packet payload
+class VoiceEncoder {
+public:
+    ~VoiceEncoder() {
+#ifdef MINI_ZOOM_OPUS
+        if (opus_) opus_encoder_destroy(opus_);
+#endif
+    }
+
+    bool open(uint8_t payloadType, uint32_t bitrate) {
+        payloadType_ = payloadType;
+        if (payloadType == VOICE_PAYLOAD_PCM16) return true;
+#ifdef MINI_ZOOM_OPUS
+        if (payloadType == VOICE_PAYLOAD_OPUS) {
+            int err = OPUS_OK;
+            opus_ = opus_encoder_create(VOICE_SAMPLE_RATE, 1, OPUS_APPLICATION_VOIP, &err);
+            if (err != OPUS_OK) {
+                logError("Failed to create Opus encoder: " + std::string(opus_strerror(err)));
+                opus_ = nullptr;
+                return false;
+            }
+            opus_encoder_ctl(opus_, OPUS_SET_BITRATE((opus_int32)bitrate));
+            opus_encoder_ctl(opus_, OPUS_SET_SIGNAL(OPUS_SIGNAL_VOICE));
+            // In-band FEC: each packet also carries a coarse copy of the previous frame
+            opus_encoder_ctl(opus_, OPUS_SET_INBANDFEC(1));
+            opus_encoder_ctl(opus_, OPUS_SET_PACKET_LOSS_PERC(VOICE_OPUS_LOSS_PERCENT));
+            return true;
+        }
+#endif
+        (void)bitrate;
+        logError("Voice codec " + std::to_string(payloadType) + " is not supported by this build.");
+        return false;
+    }
+
+    uint8_t payloadType() const { return payloadType_; }
+
+    // Returns the payload size in bytes (at most VOICE_MAX_PAYLOAD), or -1 on error
+    int encode(const int16_t* pcm, uint8_t* out) {
+#ifdef MINI_ZOOM_OPUS
+        if (opus_) {
+            opus_int32 bytes = opus_encode(opus_, pcm, VOICE_FRAME_SAMPLES, out, VOICE_MAX_PAYLOAD);
+            return bytes < 0 ? -1 : (int)bytes;
+        }
+#endif
+        memcpy(out, pcm, VOICE_FRAME_SAMPLES * sizeof(int16_t));
+        return VOICE_FRAME_SAMPLES * sizeof(int16_t);
+    }
+
+    // Copy of the frame just encoded, for the RED packets that follow: the Opus frame itself
+    // (already small), or an 8 kHz mu-law version of PCM. Returns its size and sets its type.
+    int encodeRedundant(const int16_t* pcm, const uint8_t* payload, int payloadBytes, uint8_t* out,
+                        uint8_t& payloadType) {
+        if (payloadType_ == VOICE_PAYLOAD_PCM16) {
+            payloadType = VOICE_PAYLOAD_PCMU;
+            return (int)encodePcmuFrame(pcm, out);
+        }
+        payloadType = payloadType_;
+        memcpy(out, payload, payloadBytes);
+        return payloadBytes;
+    }
+
+private:
+    uint8_t payloadType_ = VOICE_PAYLOAD_PCM16;
+#ifdef MINI_ZOOM_OPUS
+    OpusEncoder* opus_ = nullptr;
+#endif
+};
+
+// Turns jitter buffer output back into VOICE_FRAME_SAMPLES samples, covering missing frames
+// with Opus FEC or packet loss concealment, or for PCM by waveform repetition.
+class VoiceDecoder {
+public:
+    ~VoiceDecoder() {
+#ifdef MINI_ZOOM_OPUS
+        if (opus_) opus_decoder_destroy(opus_);
+#endif
+    }
+
+    bool open(uint8_t payloadType) {
+        payloadType_ = payloadType;
+        if (payloadType == VOICE_PAYLOAD_PCM16) return true;
+#ifdef MINI_ZOOM_OPUS
+        if (payloadType == VOICE_PAYLOAD_OPUS) {
+            int err = OPUS_OK;
+            opus_ = opus_decoder_create(VOICE_SAMPLE_RATE, 1, &err);
+            if (err != OPUS_OK) {
+                logError("Failed to create Opus decoder: " + std::string(opus_strerror(err)));
+                opus_ = nullptr;
+                return false;
+            }
+            return true;
+        }
+#endif
+        return false;
+    }
+
+    uint8_t payloadType() const { return payloadType_; }
+    uint64_t fecRecovered() const { return fecRecovered_; }
+
+    void decode(const VoiceFrame& frame, int16_t* out) {
+        if (frame.payloadType == VOICE_PAYLOAD_PCMU) { // Redundant copy standing in for a lost PCM frame
+            decodePcmuFrame(frame.payload.data(), frame.payload.size(), out);
+            plc_.good(out, VOICE_FRAME_SAMPLES);
+            return;
+        }
+#ifdef MINI_ZOOM_OPUS
+        if (opus_) {
+            int samples = opus_decode(opus_, frame.payload.data(), (opus_int32)frame.payload.size(),
+                                      out, VOICE_FRAME_SAMPLES, 0);
+            if (samples < 0) std::fill(out, out + VOICE_FRAME_SAMPLES, 0);
+            return;
+        }
+#endif
+        size_t samples = std::min<size_t>(frame.payload.size() / sizeof(int16_t), VOICE_FRAME_SAMPLES);
+        memcpy(out, frame.payload.data(), samples * sizeof(int16_t));
+        std::fill(out + samples, out + VOICE_FRAME_SAMPLES, 0);
+        plc_.good(out, VOICE_FRAME_SAMPLES);
+    }
+
+    // next: the packet after the missing one, if it is already buffered
+    void conceal(const VoiceFrame* next, int16_t* out) {
+#ifdef MINI_ZOOM_OPUS
+        if (opus_) {
+            int samples = -1;
+            if (next) {
+                samples = opus_decode(opus_, next->payload.data(), (opus_int32)next->payload.size(),
+                                      out, VOICE_FRAME_SAMPLES, 1);
+                if (samples > 0) fecRecovered_++;
+            }
+            if (samples < 0) samples = opus_decode(opus_, nullptr, 0, out, VOICE_FRAME_SAMPLES, 0);
+            if (samples < 0) std::fill(out, out + VOICE_FRAME_SAMPLES, 0);
+            return;
+        }
+#endif
+        (void)next;
+        plc_.conceal(out, VOICE_FRAME_SAMPLES);
+    }
+
+private:
+    uint8_t payloadType_ = VOICE_PAYLOAD_PCM16;
+    VoiceConcealer plc_; // PCM only; Opus conceals by itself
+    uint64_t fecRecovered_ = 0;
+#ifdef MINI_ZOOM_OPUS
+    OpusDecoder* opus_ = nullptr;
+#endif
+};
+
+#endif // VOICE_CODEC_H
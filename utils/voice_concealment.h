@@ -0,0 +1,136 @@
+#ifndef VOICE_CONCEALMENT_H
+#define VOICE_CONCEALMENT_H
+
+#include <cstdint>
+#include <cstddef>
+#include <algorithm> // For std::copy, std::min, std::max
+
+#define VOICE_PLC_HISTORY 1920       // Samples of played audio kept for the pitch search (40 ms at 48 kHz)
+#define VOICE_PLC_MIN_PITCH 120      // Shortest pitch period searched (400 Hz)
+#define VOICE_PLC_MAX_PITCH 768      // Longest pitch period searched (62.5 Hz)
+#define VOICE_PLC_DECIMATION 4       // The coarse pitch search runs at 12 kHz
+#define VOICE_PLC_HOLD_SAMPLES 480   // Concealment plays at full level for 10 ms...
+#define VOICE_PLC_FADE_SAMPLES 2880  // ...then fades out, silent after 60 ms
+#define VOICE_PLC_RESUME_SAMPLES 240 // Cross-fade from concealment back into real audio (5 ms)
+
+// Packet loss concealment by waveform repetition. A missing frame is rebuilt from the last
+// pitch period played before it, repeated with each copy cross-faded into the next so the
+// seams do not click. Long gaps fade out to silence, and the first real frame after a gap
+// is cross-faded in from the concealment.
+class VoiceConcealer {
+public:
+    // A decoded frame about to be played
+    void good(int16_t* frame, size_t n) {
+        if (concealing_) {
+            size_t m = std::min<size_t>(n, VOICE_PLC_RESUME_SAMPLES);
+            for (size_t i = 0; i < m; i++) {
+                float w = (i + 0.5f) / m;
+                frame[i] = saturate(continuation_[i] * (1.0f - w) + frame[i] * w);
+            }
+            concealing_ = false;
+        }
+        remember(frame, n);
+    }
+
+    // Fills a frame for a missing packet
+    void conceal(int16_t* out, size_t n) {
+        if (!concealing_) start();
+        for (size_t i = 0; i < n; i++) out[i] = saturate(synthesize(pos_ + i));
+        pos_ += n;
+        for (size_t i = 0; i < VOICE_PLC_RESUME_SAMPLES; i++) continuation_[i] = synthesize(pos_ + i);
+        remember(out, n);
+    }
+
+    size_t pitch() const { return period_; }
+
+private:
+    static int16_t saturate(float v) {
+        return (int16_t)std::max(-32768.0f, std::min(32767.0f, v));
+    }
+
+    void remember(const int16_t* samples, size_t n) {
+        n = std::min<size_t>(n, VOICE_PLC_HISTORY);
+        std::copy(history_ + n, history_ + VOICE_PLC_HISTORY, history_);
+        std::copy(samples, samples + n, history_ + VOICE_PLC_HISTORY - n);
+    }
+
+    // Takes the last pitch period (plus the overlap before it) as the template to repeat
+    void start() {
+        period_ = estimatePitch();
+        overlap_ = period_ / 4;
+        std::copy(history_ + VOICE_PLC_HISTORY - period_ - overlap_, history_ + VOICE_PLC_HISTORY, template_);
+        pos_ = 0;
+        concealing_ = true;
+    }
+
+    // Sample t of the concealment. Copy k of the template starts overlap_ samples before
+    // t = k * period_ and fades in over them while copy k - 1 fades out, so neighbouring
+    // copies always sum to full weight. Copy 0 starts right where the played audio ended.
+    float synthesize(size_t t) const {
+        if (t >= VOICE_PLC_FADE_SAMPLES) return 0.0f;
+        size_t r = t % period_;
+        size_t j = r + overlap_; // Position in the copy that covers t from the start
+        float v;
+        if (j < period_) {
+            v = template_[j];
+        } else {
+            float w = (float)(period_ + overlap_ - j) / overlap_; // Fading out
+            v = template_[j] * w + template_[j - period_] * (1.0f - w);
+        }
+        float gain = t < VOICE_PLC_HOLD_SAMPLES ? 1.0f
+                   : (float)(VOICE_PLC_FADE_SAMPLES - t) / (VOICE_PLC_FADE_SAMPLES - VOICE_PLC_HOLD_SAMPLES);
+        return v * gain;
+    }
+
+    // Lag with the best normalised autocorrelation at the end of the history: searched at
+    // 12 kHz, then refined at the full rate around the winner
+    size_t estimatePitch() const {
+        const size_t D = VOICE_PLC_DECIMATION;
+        const size_t N = VOICE_PLC_HISTORY / D;
+        float x[VOICE_PLC_HISTORY / VOICE_PLC_DECIMATION];
+        for (size_t i = 0; i < N; i++) {
+            int32_t sum = 0;
+            for (size_t k = 0; k < D; k++) sum += history_[i * D + k];
+            x[i] = (float)sum / D;
+        }
+        size_t coarse = bestLag(x, N, VOICE_PLC_MAX_PITCH / D, VOICE_PLC_MIN_PITCH / D, VOICE_PLC_MAX_PITCH / D);
+
+        float full[VOICE_PLC_HISTORY];
+        for (size_t i = 0; i < VOICE_PLC_HISTORY; i++) full[i] = history_[i];
+        size_t lo = std::max<size_t>(coarse * D - D, VOICE_PLC_MIN_PITCH);
+        size_t hi = std::min<size_t>(coarse * D + D, VOICE_PLC_MAX_PITCH);
+        return bestLag(full, VOICE_PLC_HISTORY, VOICE_PLC_MAX_PITCH, lo, hi);
+    }
+
+    // Compares the last `window` samples of x with the same span `lag` samples earlier
+    static size_t bestLag(const float* x, size_t n, size_t window, size_t minLag, size_t maxLag) {
+        const float* end = x + n - window;
+        size_t best = maxLag;
+        float bestScore = -1e30f;
+        for (size_t lag = minLag; lag <= maxLag; lag++) {
+            const float* past = end - lag;
+            float corr = 0.0f;
+            float energy = 1.0f;
+            for (size_t i = 0; i < window; i++) {
+                corr += end[i] * past[i];
+                energy += past[i] * past[i];
+            }
+            float score = corr * (corr < 0 ? -corr : corr) / energy; // Sign-preserving corr^2 / energy
+            if (score > bestScore) {
+                bestScore = score;
+                best = lag;
+            }
+        }
+        return best;
+    }
+
+    int16_t history_[VOICE_PLC_HISTORY] = {};
+    float template_[VOICE_PLC_MAX_PITCH + VOICE_PLC_MAX_PITCH / 4] = {};
+    float continuation_[VOICE_PLC_RESUME_SAMPLES] = {};
+    size_t period_ = VOICE_PLC_MIN_PITCH;
+    size_t overlap_ = VOICE_PLC_MIN_PITCH / 4;
+    size_t pos_ = 0;
+    bool concealing_ = false;
+};
+
+#endif // VOICE_CONCEALMENT_H
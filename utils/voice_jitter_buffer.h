@@ -0,0 +1,275 @@
+#ifndef VOICE_JITTER_BUFFER_H
+#define VOICE_JITTER_BUFFER_H
+
+#include <map>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <algorithm> // For std::nth_element, std::min_element, std::max
+
+#include "voice_protocol.h" // For VoicePacketHeader
+
+#define VOICE_UNDERRUN_TARGET 0.02   // Fraction of packets allowed to arrive too late for playout
+#define VOICE_JITTER_WINDOW 500      // Packets of delay history used to size the buffer (10 s of 20 ms frames)
+#define VOICE_JITTER_MAX_MS 300      // Upper bound on the playout delay
+#define VOICE_JITTER_SHRINK_AFTER 25 // Pops spent above target before a frame is dropped
+#define VOICE_JITTER_RESET_AFTER 20  // Consecutive empty pops before rebuffering (end of a talkspurt)
+
+// One received packet, payload still encoded
+struct VoiceFrame {
+    uint32_t seq = 0;       // Extended (never wraps) sequence number
+    uint32_t timestamp = 0;
+    uint8_t payloadType = 0;
+    std::vector<uint8_t> payload;
+};
+
+enum VoicePlayout {
+    VOICE_PLAY,    // out holds the next frame
+    VOICE_CONCEAL, // The next frame is missing or late: the caller must synthesise one
+    VOICE_SILENCE, // Not playing (nothing received yet, or rebuffering after a pause)
+};
+
+struct VoiceJitterStats {
+    uint64_t packets = 0;    // Accepted into the buffer
+    uint64_t played = 0;
+    uint64_t lost = 0;       // Skipped because later packets were already there
+    uint64_t recovered = 0;  // Missing packets filled in from redundant copies (RED)
+    uint64_t underruns = 0;  // Buffer ran dry while playing
+    uint64_t late = 0;       // Arrived after their playout slot
+    uint64_t duplicates = 0;
+    uint64_t dropped = 0;    // Discarded to bring the delay back down to target
+    uint64_t stretched = 0;  // Synthetic frames inserted to raise the delay to target
+    int targetFrames = 0;
+    int bufferedFrames = 0;
+    double jitterMs = 0;     // Interarrival jitter, smoothed as in RFC 3550
+};
+
+// Adaptive jitter buffer for one voice source. Packets are reordered by sequence number
+// and played on a schedule set by the fastest recent packet plus a target delay. The
+// target follows the measured jitter, so that only VOICE_UNDERRUN_TARGET of packets
+// arrive after their slot; playout stretches (conceals) or drops frames to follow it.
+// push() and pop() may be called from different threads.
+class VoiceJitterBuffer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    VoiceJitterBuffer(int sampleRate, int frameSamples, double underrunTarget = VOICE_UNDERRUN_TARGET)
+        : sampleRate_(sampleRate), frameUs_((int64_t)frameSamples * 1000000 / sampleRate),
+          underrunTarget_(underrunTarget) {}
+
+    void push(const VoicePacketHeader& h, const uint8_t* payload, size_t len, Clock::time_point arrival = Clock::now()) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint32_t seq = extendSeq(h.seq);
+        int64_t mediaUs = observeDelay(h.timestamp, arrival);
+
+        if (started_ && (int32_t)(seq - nextSeq_) < 0) {
+            stats_.late++;
+            return;
+        }
+        if (frames_.count(seq)) {
+            stats_.duplicates++;
+            return;
+        }
+        Entry& e = frames_[seq];
+        e.mediaUs = mediaUs;
+        e.frame.seq = seq;
+        e.frame.timestamp = h.timestamp;
+        e.frame.payloadType = h.payloadType;
+        e.frame.payload.assign(payload, payload + len);
+        stats_.packets++;
+    }
+
+    // A copy from a RED packet, pushed after the packet that carried it. It only fills a
+    // slot whose original is missing and still to be played. Copies come late by design,
+    // so they neither count as late nor feed the jitter estimate; instead the delay is
+    // kept long enough for the oldest copies to arrive in time.
+    void pushRedundant(const VoicePacketHeader& h, const uint8_t* payload, size_t len) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!tsStarted_) return;
+        uint32_t seq = extendSeq(h.seq);
+        int distance = (int)(highestSeq_ - seq);
+        if (distance > redundancyFrames_ && distance * frameUs_ <= (int64_t)VOICE_JITTER_MAX_MS * 1000) {
+            redundancyFrames_ = distance;
+            targetFrames_ = std::max(targetFrames_, redundancyFrames_ + 1);
+        }
+        if ((started_ && (int32_t)(seq - nextSeq_) < 0) || frames_.count(seq)) return;
+        Entry& e = frames_[seq];
+        e.mediaUs = (mediaTs_ + (int32_t)(h.timestamp - lastTs_)) * 1000000 / sampleRate_;
+        e.frame.seq = seq;
+        e.frame.timestamp = h.timestamp;
+        e.frame.payloadType = h.payloadType;
+        e.frame.payload.assign(payload, payload + len);
+        stats_.recovered++;
+    }
+
+    // Called once per playout period. Frame n is due once the time since the fastest
+    // packet's arrival covers its media time plus the target delay.
+    VoicePlayout pop(VoiceFrame& out, Clock::time_point now = Clock::now()) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        skippedMissing_ = false;
+        if (delays_.empty()) return VOICE_SILENCE;
+        int64_t nowUs = std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
+        int64_t dueMediaUs = nowUs - fastestUs_ - (int64_t)targetFrames_ * frameUs_;
+
+        if (!playing_) {
+            if (frames_.empty() || frames_.begin()->second.mediaUs > dueMediaUs) return VOICE_SILENCE;
+            playing_ = true;
+            started_ = true;
+            nextSeq_ = frames_.begin()->first;
+            nextMediaUs_ = frames_.begin()->second.mediaUs;
+            emptyPops_ = 0;
+            behindPops_ = 0;
+        }
+
+        // Ahead of schedule (the target grew): stretch with a synthetic frame
+        if (nextMediaUs_ - dueMediaUs > frameUs_) {
+            stats_.stretched++;
+            return VOICE_CONCEAL;
+        }
+        // Behind schedule for a while (the target shrank): drop a frame to cut the delay
+        behindPops_ = dueMediaUs - nextMediaUs_ > frameUs_ ? behindPops_ + 1 : 0;
+        if (behindPops_ >= VOICE_JITTER_SHRINK_AFTER && frames_.count(nextSeq_)) {
+            frames_.erase(nextSeq_);
+            advance();
+            stats_.dropped++;
+            behindPops_ = 0;
+        }
+
+        auto it = frames_.find(nextSeq_);
+        if (it != frames_.end()) {
+            out = std::move(it->second.frame);
+            frames_.erase(it);
+            advance();
+            emptyPops_ = 0;
+            stats_.played++;
+            // Comfort noise: the sender stopped for silence, so the gap that follows is no
+            // underrun. The next packet starts a new talkspurt on the same schedule.
+            if (out.payloadType == VOICE_PAYLOAD_CN) playing_ = false;
+            return VOICE_PLAY;
+        }
+
+        // Missing when due: anything arriving for it later counts as late
+        advance();
+        skippedMissing_ = true;
+        if (!frames_.empty()) {
+            stats_.lost++;
+            return VOICE_CONCEAL;
+        }
+        stats_.underruns++;
+        if (++emptyPops_ >= VOICE_JITTER_RESET_AFTER) {
+            playing_ = false; // The talker paused; rebuffer before the next talkspurt
+            return VOICE_SILENCE;
+        }
+        return VOICE_CONCEAL;
+    }
+
+    // Packet after the one pop() just reported missing, for decoders with in-band FEC
+    bool peekNext(VoiceFrame& out) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!skippedMissing_) return false; // A stretch, not a loss: nothing to recover
+        auto it = frames_.find(nextSeq_);
+        if (it == frames_.end()) return false;
+        out = it->second.frame;
+        return true;
+    }
+
+    VoiceJitterStats stats() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        VoiceJitterStats s = stats_;
+        s.targetFrames = targetFrames_;
+        s.bufferedFrames = bufferedFrames();
+        s.jitterMs = interarrivalUs_ / 1000.0;
+        return s;
+    }
+
+    int frameMs() const { return (int)(frameUs_ / 1000); }
+
+private:
+    // Maps a 16-bit wire sequence number to the 32-bit one nearest the newest seen
+    uint32_t extendSeq(uint16_t seq) {
+        if (!seqStarted_) {
+            seqStarted_ = true;
+            highestSeq_ = seq;
+            return highestSeq_;
+        }
+        uint32_t ext = highestSeq_ + (int16_t)(seq - (uint16_t)highestSeq_);
+        if ((int32_t)(ext - highestSeq_) > 0) highestSeq_ = ext;
+        return ext;
+    }
+
+    // Arrival time minus media time of each packet; its spread over the window is the jitter.
+    // Returns the packet's media time in microseconds.
+    int64_t observeDelay(uint32_t timestamp, Clock::time_point arrival) {
+        int64_t arrivalUs = std::chrono::duration_cast<std::chrono::microseconds>(arrival.time_since_epoch()).count();
+        if (!tsStarted_) {
+            tsStarted_ = true;
+            lastTs_ = timestamp;
+        }
+        mediaTs_ += (int32_t)(timestamp - lastTs_); // Extended timestamp, survives 32-bit wrap
+        lastTs_ = timestamp;
+        int64_t mediaUs = mediaTs_ * 1000000 / sampleRate_;
+
+        if (!delays_.empty()) {
+            int64_t d = arrivalUs - mediaUs - delays_.back();
+            interarrivalUs_ += ((d < 0 ? -d : d) - interarrivalUs_) / 16.0;
+        }
+        delays_.push_back(arrivalUs - mediaUs);
+        if (delays_.size() > VOICE_JITTER_WINDOW) delays_.pop_front();
+
+        // Delay beyond the fastest packet that covers all but underrunTarget of packets
+        scratch_.assign(delays_.begin(), delays_.end());
+        fastestUs_ = *std::min_element(scratch_.begin(), scratch_.end());
+        size_t k = (size_t)((1.0 - underrunTarget_) * (scratch_.size() - 1));
+        std::nth_element(scratch_.begin(), scratch_.begin() + k, scratch_.end());
+        int64_t jitterUs = std::min<int64_t>(scratch_[k] - fastestUs_, (int64_t)VOICE_JITTER_MAX_MS * 1000);
+
+        // One extra frame because playout pulls whole frames at its own phase
+        targetFrames_ = std::max((int)((jitterUs + frameUs_ - 1) / frameUs_) + 1, redundancyFrames_ + 1);
+        return mediaUs;
+    }
+
+    void advance() {
+        nextSeq_++;
+        nextMediaUs_ += frameUs_;
+    }
+
+    int bufferedFrames() const {
+        return frames_.empty() || !playing_ ? 0 : (int)(frames_.rbegin()->first - nextSeq_ + 1);
+    }
+
+    int sampleRate_;
+    int64_t frameUs_;
+    double underrunTarget_;
+    std::mutex mutex_;
+
+    struct Entry {
+        VoiceFrame frame;
+        int64_t mediaUs; // Position in the stream, from the extended timestamp
+    };
+    std::map<uint32_t, Entry> frames_;
+    bool playing_ = false;
+    bool started_ = false; // Something was played: older packets are late from now on
+    uint32_t nextSeq_ = 0;
+    int64_t nextMediaUs_ = 0;
+    int emptyPops_ = 0;
+    int behindPops_ = 0;
+    bool skippedMissing_ = false; // The last pop() passed over a missing frame
+    int targetFrames_ = 1;
+    int redundancyFrames_ = 0; // Furthest back a RED copy reached
+    int64_t fastestUs_ = 0; // Smallest arrival-minus-media delay in the window
+
+    bool seqStarted_ = false;
+    uint32_t highestSeq_ = 0;
+    bool tsStarted_ = false;
+    uint32_t lastTs_ = 0;
+    int64_t mediaTs_ = 0;
+    std::deque<int64_t> delays_;
+    double interarrivalUs_ = 0;
+    std::vector<int64_t> scratch_;
+
+    VoiceJitterStats stats_;
+};
+
+#endif // VOICE_JITTER_BUFFER_H
@@ -0,0 +1,229 @@
+#ifndef VOICE_MIXER_H
+#define VOICE_MIXER_H
+
+#include <map>
+#include <tuple>
+#include <memory>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdio>    // For snprintf
+#include <algorithm> // For std::fill
+#include <arpa/inet.h>
+
+#include "common_utils.h"
+#include "voice_protocol.h"      // For VoicePacketHeader, VOICE_FRAME_SAMPLES
+#include "voice_jitter_buffer.h" // For VoiceJitterBuffer
+#include "voice_codec.h"         // For VoiceDecoder
+#include "audio_mix.h"           // For mixAdd
+#include "audio_device.h"        // For AudioDevice
+#include "voice_activity.h"      // For generateComfortNoise
+#include "voice_red.h"           // For parseVoiceRed
+
+#define VOICE_MAX_SOURCES 64     // Speakers mixed at once; packets from further sources are ignored
+#define VOICE_SOURCE_IDLE_MS 10000 // A source that sent nothing for this long is removed
+
+// One speaker: a client address plus the source ID it picked for its session
+struct VoiceSource {
+    explicit VoiceSource(const std::string& info)
+        : clientInfo(info), jitter(VOICE_SAMPLE_RATE, VOICE_FRAME_SAMPLES) {
+        lastPacketMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    std::string clientInfo;
+    VoiceJitterBuffer jitter;
+    VoiceDecoder decoder;  // Opened by the receive thread, then only used by the mixer
+    std::atomic<uint8_t> mediaType{0}; // Codec of the source, set once the decoder is open; 0 until then
+    bool silent = false;   // Mixer only: the last frame was comfort noise, nothing to decode
+    uint8_t noiseLevel = 127;
+    std::atomic<bool> stopped{false};
+    std::atomic<int64_t> lastPacketMs{0};
+    uint64_t decodedFrames = 0;
+    uint64_t decodeUs = 0;
+};
+
+// Mixes every active source into one output stream. The receive thread feeds packets in;
+// the mixer thread pulls one frame per source per period, decodes it and adds it to the
+// mix with saturating SIMD adds. It is paced by the output ring: a new frame is mixed
+// once no more than one frame is still queued for the device. The server mixes what
+// clients send; a client mixes what the server forwards from the other participants.
+class VoiceMixer {
+public:
+    using SourceKey = std::tuple<uint32_t, uint16_t, uint32_t>; // IPv4 address, port, source ID
+
+    void onPacket(const sockaddr_in& from, const VoicePacketHeader& header, const uint8_t* payload, size_t len) {
+        // A RED packet is a frame plus copies of the ones before it
+        VoiceRedBlock frames[VOICE_RED_MAX_BLOCKS + 1];
+        size_t count = 1;
+        if (header.payloadType == VOICE_PAYLOAD_RED) {
+            count = parseVoiceRed(header, payload, len, frames);
+            if (count == 0) return;
+        } else {
+            frames[0] = VoiceRedBlock{header, payload, len};
+        }
+        const VoicePacketHeader& primary = frames[0].header;
+
+        SourceKey key(from.sin_addr.s_addr, from.sin_port, header.sourceId);
+        std::shared_ptr<VoiceSource> source;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = sources_.find(key);
+            if (it != sources_.end()) {
+                source = it->second;
+            } else {
+                if (sources_.size() >= VOICE_MAX_SOURCES) return;
+                if (primary.payloadType != VOICE_PAYLOAD_CN &&
+                    !(VOICE_CODEC_BIT(primary.payloadType) & voiceSupportedCodecs())) return;
+                source = std::make_shared<VoiceSource>(describe(from, header.sourceId));
+                sources_[key] = source;
+                logInfo("Audio streaming started from " + source->clientInfo + ", " +
+                        std::to_string(sources_.size()) + " active");
+            }
+        }
+        if (source->stopped) return;
+        // A client that starts out silent sends comfort noise first; the codec comes with its first audio
+        if (primary.payloadType != VOICE_PAYLOAD_CN) {
+            if (source->mediaType == 0) {
+                if (!(VOICE_CODEC_BIT(primary.payloadType) & voiceSupportedCodecs()) ||
+                    !source->decoder.open(primary.payloadType)) return;
+                source->mediaType = primary.payloadType;
+                logInfo("Voice codec for " + source->clientInfo + ": " + voiceCodecName(primary.payloadType));
+            } else if (primary.payloadType != source->mediaType) {
+                return;
+            }
+        }
+        source->lastPacketMs = nowMs();
+        source->jitter.push(primary, frames[0].data, frames[0].size);
+        for (size_t i = 1; i < count; i++) {
+            source->jitter.pushRedundant(frames[i].header, frames[i].data, frames[i].size);
+        }
+    }
+
+    // STOP_AUDIO carries no source ID, so it ends every source at that address and port
+    void stopAddress(const sockaddr_in& from) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        bool found = false;
+        for (auto& entry : sources_) {
+            if (std::get<0>(entry.first) == from.sin_addr.s_addr && std::get<1>(entry.first) == from.sin_port) {
+                entry.second->stopped = true;
+                found = true;
+            }
+        }
+        if (!found) logInfo("Received STOP_AUDIO from " + describe(from) + " with no active session.");
+    }
+
+    // Runs until keepGoing() turns false; removes finished sources between periods
+    template <typename KeepGoing>
+    void run(AudioDevice& output, KeepGoing keepGoing) {
+        std::vector<int16_t> mix(VOICE_FRAME_SAMPLES);
+        std::vector<int16_t> decoded(VOICE_FRAME_SAMPLES);
+        std::vector<std::shared_ptr<VoiceSource>> active;
+        VoiceFrame frame;
+        VoiceFrame next;
+        uint32_t noiseState = 1;
+        while (output.waitForRoom(VOICE_FRAME_SAMPLES, keepGoing)) {
+            collectSources(active);
+            std::fill(mix.begin(), mix.end(), 0);
+            int mixed = 0;
+            int quietestNoise = 128; // Loudest comfort noise level among silent sources (-dBov)
+            for (const auto& source : active) {
+                VoicePlayout playout = source->jitter.pop(frame);
+                if (playout == VOICE_PLAY && frame.payloadType == VOICE_PAYLOAD_CN) {
+                    source->silent = true;
+                    if (!frame.payload.empty()) source->noiseLevel = frame.payload[0];
+                } else if (playout == VOICE_PLAY) {
+                    source->silent = false;
+                }
+                // Silent speakers cost nothing here: no decoding and no mixing
+                if (source->silent || playout == VOICE_SILENCE || source->mediaType == 0) {
+                    if (source->silent) quietestNoise = std::min<int>(quietestNoise, source->noiseLevel);
+                    continue;
+                }
+                auto start = std::chrono::steady_clock::now();
+                if (playout == VOICE_PLAY) {
+                    source->decoder.decode(frame, decoded.data());
+                } else {
+                    bool haveNext = source->jitter.peekNext(next) && next.payloadType == source->decoder.payloadType();
+                    source->decoder.conceal(haveNext ? &next : nullptr, decoded.data());
+                }
+                source->decodedFrames++;
+                source->decodeUs += std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - start).count();
+                mixAdd(mix.data(), decoded.data(), VOICE_FRAME_SAMPLES);
+                mixed++;
+            }
+            // With nobody talking, one frame of background noise stands in for all silent speakers
+            if (mixed == 0 && quietestNoise < 128) {
+                generateComfortNoise((uint8_t)quietestNoise, noiseState, mix.data(), VOICE_FRAME_SAMPLES);
+            }
+            output.write(mix.data(), VOICE_FRAME_SAMPLES);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& entry : sources_) logStats(*entry.second);
+        sources_.clear();
+    }
+
+private:
+    static int64_t nowMs() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static std::string describe(const sockaddr_in& addr) {
+        char ip[INET_ADDRSTRLEN] = {0};
+        inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+        return std::string(ip) + ":" + std::to_string(ntohs(addr.sin_port));
+    }
+
+    // Forwarded speakers all arrive from the server's address, so the source ID tells them apart
+    static std::string describe(const sockaddr_in& addr, uint32_t sourceId) {
+        char id[16];
+        snprintf(id, sizeof(id), "%08x", sourceId);
+        return describe(addr) + " (source " + id + ")";
+    }
+
+    // Snapshot of the sources to mix this period, dropping stopped and idle ones
+    void collectSources(std::vector<std::shared_ptr<VoiceSource>>& active) {
+        active.clear();
+        int64_t now = nowMs();
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = sources_.begin(); it != sources_.end();) {
+            VoiceSource& source = *it->second;
+            bool idle = now - source.lastPacketMs > VOICE_SOURCE_IDLE_MS;
+            if (source.stopped || idle) {
+                logInfo("Audio streaming " + std::string(idle ? "timed out" : "ended by client") + ": " + source.clientInfo);
+                logStats(source);
+                it = sources_.erase(it);
+            } else {
+                active.push_back(it->second);
+                ++it;
+            }
+        }
+    }
+
+    static void logStats(VoiceSource& source) {
+        VoiceJitterStats s = source.jitter.stats();
+        char line[320];
+        snprintf(line, sizeof(line),
+                 "Voice jitter buffer: %llu played, %llu lost, %llu recovered from redundancy, %llu late, %llu underruns, "
+                 "%llu dropped, %llu stretched, target %d ms, jitter %.2f ms",
+                 (unsigned long long)s.played, (unsigned long long)s.lost, (unsigned long long)s.recovered,
+                 (unsigned long long)s.late, (unsigned long long)s.underruns, (unsigned long long)s.dropped, (unsigned long long)s.stretched,
+                 s.targetFrames * source.jitter.frameMs(), s.jitterMs);
+        logInfo(line);
+        snprintf(line, sizeof(line), "Voice decoding (%s): %.1f us per frame, %llu frames recovered by FEC",
+                 voiceCodecName(source.decoder.payloadType()).c_str(),
+                 source.decodedFrames ? (double)source.decodeUs / source.decodedFrames : 0.0,
+                 (unsigned long long)source.decoder.fecRecovered());
+        logInfo(line);
+    }
+
+    std::mutex mutex_;
+    std::map<SourceKey, std::shared_ptr<VoiceSource>> sources_;
+};
+
+#endif // VOICE_MIXER_H
@@ -0,0 +1,96 @@
+#ifndef VOICE_PROTOCOL_H
+#define VOICE_PROTOCOL_H
+
+#include <cstdint>
+#include <cstddef>
+
+// Wire definitions shared by the voice client and server.
+// Every datagram to UDP_VOICE_PORT is a 12-byte RTP-like header (big-endian) followed by the payload:
+// uint8 version, uint8 payload type, uint16 sequence number, uint32 timestamp
+// (in samples, so it also tells the receiver how much audio a packet covers),
+// uint32 source ID (random per session, tells speakers behind one address apart).
+// The plain text datagram "STOP_AUDIO" ends a session.
+// Before streaming, the client may send an OFFER (payload: uint8 bitmask of payload types
+// it can send, uint32 bitrate it wants in bit/s, uint8 redundant frames it wants per packet);
+// the server replies with an ANSWER (payload: uint8 payload type to use, uint32 bitrate,
+// uint8 redundant frames granted). Without an answer the client sends PCM without redundancy.
+// With redundancy, packets are RED packets carrying copies of the previous ones (voice_red.h).
+// During silence the client sends nothing but occasional comfort noise (CN) packets; the
+// sequence number counts packets sent, the timestamp keeps counting samples.
+
+#define VOICE_SAMPLE_RATE 48000
+#define VOICE_FRAME_SAMPLES 960 // Samples per packet (20 ms, an Opus frame size)
+
+#define VOICE_VERSION 2
+#define VOICE_HEADER_SIZE 12
+#define VOICE_PAYLOAD_PCM16 1   // Mono signed 16-bit samples in host byte order
+#define VOICE_PAYLOAD_OPUS 2    // One 20 ms Opus frame
+#define VOICE_PAYLOAD_CN 3      // Comfort noise: the sender is silent; payload: uint8 noise level in -dBov
+#define VOICE_PAYLOAD_RED 4     // Redundant audio: a frame plus copies of the packets before it
+#define VOICE_PAYLOAD_PCMU 5    // G.711 mu-law at 8 kHz; only inside RED, as a cheap copy of a PCM frame
+#define VOICE_PAYLOAD_OFFER 100
+#define VOICE_PAYLOAD_ANSWER 101
+#define VOICE_NEGOTIATION_SIZE (VOICE_HEADER_SIZE + 6)
+
+struct VoicePacketHeader {
+    uint8_t version;
+    uint8_t payloadType;
+    uint16_t seq;
+    uint32_t timestamp;
+    uint32_t sourceId;
+};
+
+inline void writeVoiceHeader(uint8_t* out, const VoicePacketHeader& h) {
+    out[0] = h.version;
+    out[1] = h.payloadType;
+    out[2] = (uint8_t)(h.seq >> 8);
+    out[3] = (uint8_t)h.seq;
+    for (int i = 0; i < 4; i++) {
+        out[4 + i] = (uint8_t)(h.timestamp >> (24 - 8 * i));
+        out[8 + i] = (uint8_t)(h.sourceId >> (24 - 8 * i));
+    }
+}
+
+// Returns false for anything that is not a voice packet of this version (e.g. "STOP_AUDIO")
+inline bool parseVoiceHeader(const uint8_t* data, size_t len, VoicePacketHeader& h) {
+    if (len < VOICE_HEADER_SIZE || data[0] != VOICE_VERSION) return false;
+    h.version = data[0];
+    h.payloadType = data[1];
+    h.seq = (uint16_t)((data[2] << 8) | data[3]);
+    h.timestamp = 0;
+    h.sourceId = 0;
+    for (int i = 0; i < 4; i++) {
+        h.timestamp = (h.timestamp << 8) | data[4 + i];
+        h.sourceId = (h.sourceId << 8) | data[8 + i];
+    }
+    return true;
+}
+
+// Audio packets, as opposed to negotiation; the server forwards these
+inline bool isVoiceMedia(uint8_t payloadType) {
+    return payloadType == VOICE_PAYLOAD_PCM16 || payloadType == VOICE_PAYLOAD_OPUS ||
+           payloadType == VOICE_PAYLOAD_CN || payloadType == VOICE_PAYLOAD_RED;
+}
+
+// Builds an OFFER or ANSWER datagram into out (VOICE_NEGOTIATION_SIZE bytes)
+inline void writeVoiceNegotiation(uint8_t* out, uint8_t type, uint32_t sourceId, uint8_t codec, uint32_t bitrate,
+                                  uint8_t redundancy) {
+    VoicePacketHeader h{VOICE_VERSION, type, 0, 0, sourceId};
+    writeVoiceHeader(out, h);
+    out[VOICE_HEADER_SIZE] = codec;
+    for (int i = 0; i < 4; i++) out[VOICE_HEADER_SIZE + 1 + i] = (uint8_t)(bitrate >> (24 - 8 * i));
+    out[VOICE_HEADER_SIZE + 5] = redundancy;
+}
+
+// Payload of an OFFER or ANSWER whose header was already parsed
+inline bool parseVoiceNegotiation(const uint8_t* data, size_t len, uint8_t& codec, uint32_t& bitrate,
+                                  uint8_t& redundancy) {
+    if (len < VOICE_NEGOTIATION_SIZE) return false;
+    codec = data[VOICE_HEADER_SIZE];
+    bitrate = 0;
+    for (int i = 0; i < 4; i++) bitrate = (bitrate << 8) | data[VOICE_HEADER_SIZE + 1 + i];
+    redundancy = data[VOICE_HEADER_SIZE + 5];
+    return true;
+}
+
+#endif // VOICE_PROTOCOL_H
@@ -0,0 +1,143 @@
+#ifndef VOICE_RED_H
+#define VOICE_RED_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>   // For memcpy
+#include <algorithm> // For std::min
+
+#include "voice_protocol.h" // For VoicePacketHeader, VOICE_PAYLOAD_RED
+#include "voice_codec.h"    // For VOICE_MAX_PAYLOAD
+
+// Redundant audio (after RFC 2198). A RED packet's header carries the sequence number and
+// timestamp of its primary frame; the payload is:
+// uint8 number of redundant blocks N, then per block (oldest first) uint8 payload type,
+// uint8 sequence distance back, uint16 timestamp distance back (samples), uint16 length;
+// then uint8 payload type of the primary frame, the N blocks' data and the primary data.
+// The receiver rebuilds each block's header from the distances, so a copy that arrives
+// after its original was lost fills the hole; copies of packets that arrived are ignored.
+
+#define VOICE_RED_MAX_BLOCKS 2    // Redundant copies per packet; two also cover bursts of two losses
+#define VOICE_RED_MAX_BLOCK 480   // Largest copy carried (a 20 ms Opus frame at 192 kbit/s)
+#define VOICE_RED_BLOCK_HEADER 6
+#define VOICE_MAX_PACKET (VOICE_HEADER_SIZE + 2 + VOICE_RED_MAX_BLOCKS * (VOICE_RED_BLOCK_HEADER + VOICE_RED_MAX_BLOCK) + \
+                          VOICE_MAX_PAYLOAD)
+
+// One frame of a RED packet; data points into the packet
+struct VoiceRedBlock {
+    VoicePacketHeader header;
+    const uint8_t* data;
+    size_t size;
+};
+
+// Splits a RED payload into its frames: blocks[0] is the primary, then the copies.
+// Returns the number of frames, or 0 if the payload is malformed.
+inline size_t parseVoiceRed(const VoicePacketHeader& h, const uint8_t* payload, size_t len,
+                            VoiceRedBlock (&blocks)[VOICE_RED_MAX_BLOCKS + 1]) {
+    if (len < 2 || payload[0] > VOICE_RED_MAX_BLOCKS) return 0;
+    size_t count = payload[0];
+    size_t pos = 1 + count * VOICE_RED_BLOCK_HEADER; // Primary payload type
+    if (len < pos + 1) return 0;
+    size_t dataPos = pos + 1;
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t* b = payload + 1 + i * VOICE_RED_BLOCK_HEADER;
+        VoiceRedBlock& block = blocks[1 + i];
+        block.header = h;
+        block.header.payloadType = b[0];
+        block.header.seq = (uint16_t)(h.seq - b[1]);
+        block.header.timestamp = h.timestamp - (uint32_t)((b[2] << 8) | b[3]);
+        block.size = (size_t)((b[4] << 8) | b[5]);
+        block.data = payload + dataPos;
+        dataPos += block.size;
+        if (b[0] == VOICE_PAYLOAD_RED || b[1] == 0 || dataPos > len) return 0;
+    }
+    blocks[0] = VoiceRedBlock{h, payload + dataPos, len - dataPos};
+    blocks[0].header.payloadType = payload[pos];
+    if (payload[pos] == VOICE_PAYLOAD_RED) return 0;
+    return count + 1;
+}
+
+// Sender side: remembers copies of the last few packets and wraps each new frame in a RED
+// packet together with the ones that can still help the receiver
+class VoiceRedSender {
+public:
+    explicit VoiceRedSender(int redundancy) : redundancy_(std::min(redundancy, VOICE_RED_MAX_BLOCKS)) {}
+
+    int redundancy() const { return redundancy_; }
+
+    // Writes the whole packet for one frame into out (at most VOICE_MAX_PACKET bytes) and
+    // returns its size. Without recent copies to carry, it is a plain packet.
+    size_t write(const VoicePacketHeader& h, const uint8_t* payload, size_t len, uint8_t* out) const {
+        // Only copies of the packets right before, and of frames from the last few 20 ms:
+        // after a pause, the comfort noise packet from long ago is not worth repeating
+        const Copy* copies[VOICE_RED_MAX_BLOCKS];
+        size_t count = 0;
+        for (int i = 0; i < redundancy_; i++) {
+            const Copy& c = history_[(next_ + i) % redundancy_]; // Oldest first
+            if (c.valid && (uint16_t)(h.seq - c.seq) <= redundancy_ &&
+                h.timestamp - c.timestamp <= (uint32_t)redundancy_ * VOICE_FRAME_SAMPLES) {
+                copies[count++] = &c;
+            }
+        }
+        if (count == 0) {
+            writeVoiceHeader(out, h);
+            memcpy(out + VOICE_HEADER_SIZE, payload, len);
+            return VOICE_HEADER_SIZE + len;
+        }
+
+        VoicePacketHeader red = h;
+        red.payloadType = VOICE_PAYLOAD_RED;
+        writeVoiceHeader(out, red);
+        uint8_t* p = out + VOICE_HEADER_SIZE;
+        *p++ = (uint8_t)count;
+        for (size_t i = 0; i < count; i++) {
+            const Copy& c = *copies[i];
+            uint16_t tsBack = (uint16_t)(h.timestamp - c.timestamp);
+            p[0] = c.payloadType;
+            p[1] = (uint8_t)(h.seq - c.seq);
+            p[2] = (uint8_t)(tsBack >> 8);
+            p[3] = (uint8_t)tsBack;
+            p[4] = (uint8_t)(c.size >> 8);
+            p[5] = (uint8_t)c.size;
+            p += VOICE_RED_BLOCK_HEADER;
+        }
+        *p++ = h.payloadType;
+        for (size_t i = 0; i < count; i++) {
+            memcpy(p, copies[i]->data, copies[i]->size);
+            p += copies[i]->size;
+        }
+        memcpy(p, payload, len);
+        return (size_t)(p + len - out);
+    }
+
+    // Keeps the copy of a frame just sent (possibly cheaper than the original, see
+    // VoiceEncoder::encodeRedundant) for the packets that follow
+    void remember(const VoicePacketHeader& h, uint8_t payloadType, const uint8_t* copy, size_t len) {
+        if (redundancy_ == 0) return;
+        Copy& c = history_[next_];
+        next_ = (next_ + 1) % redundancy_;
+        c.valid = len <= VOICE_RED_MAX_BLOCK; // Too big to carry: the receiver will conceal instead
+        if (!c.valid) return;
+        c.payloadType = payloadType;
+        c.seq = h.seq;
+        c.timestamp = h.timestamp;
+        c.size = (uint16_t)len;
+        memcpy(c.data, copy, len);
+    }
+
+private:
+    struct Copy {
+        bool valid = false;
+        uint8_t payloadType = 0;
+        uint16_t seq = 0;
+        uint32_t timestamp = 0;
+        uint16_t size = 0;
+        uint8_t data[VOICE_RED_MAX_BLOCK];
+    };
+
+    int redundancy_;
+    int next_ = 0; // Slot of the oldest copy, overwritten next
+    Copy history_[VOICE_RED_MAX_BLOCKS];
+};
+
+#endif // VOICE_RED_H
@@ -0,0 +1,201 @@
+#ifndef WIRE_SCHEMA_H
+#define WIRE_SCHEMA_H
+
+#include <array>
+#include <tuple>
+#include <cstdint>
+#include <cstddef>
+#include <cerrno>
+#include <type_traits>
+#include <sys/socket.h> // For sendmsg, MSG_NOSIGNAL
+#include <sys/uio.h>    // For iovec
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // macOS: SO_NOSIGPIPE instead
+#endif
+
+#include "common_utils.h" // For recvAll
+
+// Fixed-layout wire messages described once, at compile time. A message is a plain struct of
+// integers; its WireSchema specialisation lists the members in wire order, with WirePad<N>
+// for reserved bytes:
+//
+//   template <> struct WireSchema<VideoStreamHeader> {
+//       static constexpr auto fields = std::make_tuple(&VideoStreamHeader::frameSize);
+//   };
+//
+// From that, wireSize<T>() and wireOffset<&T::member>() are constants (so protocol headers
+// static_assert their documented layout), and encodeWire / decodeWire write and read every
+// field big-endian at its fixed offset, with no allocation. sendWire sends a header and its
+// payload in one system call.
+
+template <size_t N>
+struct WirePad {}; // N zero bytes, ignored when read
+
+template <typename T>
+struct WireSchema; // Specialised next to each message
+
+namespace wire_detail {
+
+template <typename F>
+struct Field; // Size and coding of one schema entry
+
+template <typename T, typename M>
+struct Field<M T::*> {
+    static_assert(std::is_integral<M>::value || std::is_enum<M>::value, "Wire fields must be integers");
+    static constexpr size_t size = sizeof(M);
+
+    static void encode(M T::*member, const T& msg, uint8_t* out) {
+        Unsigned v = (Unsigned)(msg.*member);
+        for (size_t i = size; i-- > 0; v = (Unsigned)(v >> 8)) out[i] = (uint8_t)v;
+    }
+
+    static void decode(M T::*member, T& msg, const uint8_t* in) {
+        Unsigned v = 0;
+        for (size_t i = 0; i < size; i++) v = (Unsigned)((v << 8) | in[i]); // Promoted to int first, so 8-bit fields shift safely
+        msg.*member = (M)v;
+    }
+
+private:
+    using Integer = typename std::conditional<std::is_enum<M>::value, std::underlying_type<M>, std::common_type<M>>::type::type;
+    using Unsigned = typename std::make_unsigned<Integer>::type;
+};
+
+template <size_t N>
+struct Field<WirePad<N>> {
+    static constexpr size_t size = N;
+
+    template <typename T>
+    static void encode(WirePad<N>, const T&, uint8_t* out) {
+        for (size_t i = 0; i < N; i++) out[i] = 0;
+    }
+
+    template <typename T>
+    static void decode(WirePad<N>, T&, const uint8_t*) {}
+};
+
+template <typename P>
+struct Owner;
+
+template <typename T, typename M>
+struct Owner<M T::*> {
+    using type = T;
+};
+
+template <typename Tuple, size_t... I>
+constexpr size_t sizeOf(std::index_sequence<I...>) {
+    return (size_t(0) + ... + Field<std::tuple_element_t<I, Tuple>>::size);
+}
+
+// Offset of the entry equal to member, or SIZE_MAX
+template <auto Member, typename Tuple, size_t I = 0>
+constexpr size_t offsetOf(const Tuple& fields, size_t offset = 0) {
+    if constexpr (I == std::tuple_size<Tuple>::value) {
+        return SIZE_MAX;
+    } else {
+        using F = std::tuple_element_t<I, Tuple>;
+        if constexpr (std::is_same<F, decltype(Member)>::value) {
+            if (std::get<I>(fields) == Member) return offset;
+        }
+        return offsetOf<Member, Tuple, I + 1>(fields, offset + Field<F>::size);
+    }
+}
+
+template <typename T, typename Tuple, size_t... I>
+void encode(const Tuple& fields, const T& msg, uint8_t* out, std::index_sequence<I...>) {
+    size_t offset = 0;
+    ((Field<std::tuple_element_t<I, Tuple>>::encode(std::get<I>(fields), msg, out + offset),
+      offset += Field<std::tuple_element_t<I, Tuple>>::size), ...);
+}
+
+template <typename T, typename Tuple, size_t... I>
+void decode(const Tuple& fields, T& msg, const uint8_t* in, std::index_sequence<I...>) {
+    size_t offset = 0;
+    ((Field<std::tuple_element_t<I, Tuple>>::decode(std::get<I>(fields), msg, in + offset),
+      offset += Field<std::tuple_element_t<I, Tuple>>::size), ...);
+}
+
+template <typename T>
+using Fields = typename std::remove_const<decltype(WireSchema<T>::fields)>::type;
+
+template <typename T>
+using Indices = std::make_index_sequence<std::tuple_size<Fields<T>>::value>;
+
+} // namespace wire_detail
+
+// Bytes a T takes on the wire
+template <typename T>
+constexpr size_t wireSize() {
+    return wire_detail::sizeOf<wire_detail::Fields<T>>(wire_detail::Indices<T>());
+}
+
+// Where a member starts in its message on the wire
+template <auto Member>
+constexpr size_t wireOffset() {
+    using T = typename wire_detail::Owner<decltype(Member)>::type;
+    return wire_detail::offsetOf<Member, wire_detail::Fields<T>>(WireSchema<T>::fields);
+}
+
+template <typename T>
+using WireBuffer = std::array<uint8_t, wireSize<T>()>;
+
+// Writes wireSize<T>() bytes
+template <typename T>
+inline void encodeWire(const T& msg, uint8_t* out) {
+    wire_detail::encode(WireSchema<T>::fields, msg, out, wire_detail::Indices<T>());
+}
+
+template <typename T>
+inline WireBuffer<T> encodeWire(const T& msg) {
+    WireBuffer<T> out;
+    encodeWire(msg, out.data());
+    return out;
+}
+
+// Reads wireSize<T>() bytes
+template <typename T>
+inline void decodeWire(const uint8_t* in, T& msg) {
+    wire_detail::decode(WireSchema<T>::fields, msg, in, wire_detail::Indices<T>());
+}
+
+// Sends head then body with as few sendmsg calls as the socket allows (one, unless it is full)
+inline bool sendAllParts(int sockfd, const void* head, size_t headLen, const void* body, size_t bodyLen) {
+    iovec parts[2] = {{const_cast<void*>(head), headLen}, {const_cast<void*>(body), bodyLen}};
+    iovec* next = parts;
+    int count = bodyLen ? 2 : 1;
+    while (count > 0) {
+        msghdr msg{};
+        msg.msg_iov = next;
+        msg.msg_iovlen = count;
+        ssize_t sent = sendmsg(sockfd, &msg, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue; // Interrupted before anything went out
+        if (sent <= 0) return false;
+        while (count > 0 && (size_t)sent >= next->iov_len) {
+            sent -= next->iov_len;
+            next++;
+            count--;
+        }
+        if (count > 0) {
+            next->iov_base = static_cast<uint8_t*>(next->iov_base) + sent;
+            next->iov_len -= sent;
+        }
+    }
+    return true;
+}
+
+// A message and the payload following it, in one system call
+template <typename T>
+inline bool sendWire(int sockfd, const T& msg, const void* payload = nullptr, size_t len = 0) {
+    WireBuffer<T> head = encodeWire(msg);
+    return sendAllParts(sockfd, head.data(), head.size(), payload, len);
+}
+
+template <typename T>
+inline bool recvWire(int sockfd, T& msg) {
+    WireBuffer<T> in;
+    if (!recvAll(sockfd, reinterpret_cast<char*>(in.data()), in.size())) return false;
+    decodeWire(in.data(), msg);
+    return true;
+}
+
+#endif // WIRE_SCHEMA_H